@@ -0,0 +1,797 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <filesystem>
+#include <sstream>
+#include <algorithm>
+#include <3dgl/AssetPack.h>
+#include <3dgl/Bitmap.h>
+#include <3dgl/Texture.h>
+#include "MappedFile.h"
+
+// assimp include files
+#include "assimp/scene.h"
+#include "assimp/cimport.h"
+#include "assimp/postprocess.h"
+
+using namespace _3dgl;
+
+namespace
+{
+	// Baked model layout. All offsets are relative to the beginning of the entry;
+	// all arrays are 16-byte aligned so that they can be used directly as AssImp arrays.
+	const uint32_t c_modelMagic = 0x314c444d;		// "MDL1"
+	const uint32_t c_textureMagic = 0x31584554;		// "TEX1"
+
+	struct STR { uint64_t offset; uint32_t length; uint32_t reserved; };
+
+	struct MODEL
+	{
+		uint32_t magic;
+		uint32_t nNodes, nMeshes, nMaterials;
+		uint64_t nodes, meshes, materials;			// offsets of the NODE, MESH and MATERIAL tables
+	};
+
+	struct NODE
+	{
+		STR name;
+		int32_t parent;								// index of the parent node, -1 for the root; parents precede their children
+		uint32_t nMeshes;
+		uint64_t meshes;							// uint32_t[nMeshes]
+		float transformation[16];					// aiMatrix4x4
+	};
+
+	struct MESH
+	{
+		STR name;
+		uint32_t materialIndex, primitiveTypes;
+		uint32_t nVertices, nFaces, nIndices, nUVComponents;
+		uint64_t vertices, normals, tangents, bitangents;	// aiVector3D[nVertices], 0 if not present
+		uint64_t colors;							// aiColor4D[nVertices], 0 if not present
+		uint64_t texCoords;							// aiVector3D[nVertices], 0 if not present
+		uint64_t faceSizes;							// uint32_t[nFaces]
+		uint64_t indices;							// uint32_t[nIndices]
+	};
+
+	struct MATERIAL
+	{
+		uint32_t nProperties, reserved;
+		uint64_t properties;						// PROPERTY[nProperties]
+	};
+
+	struct PROPERTY
+	{
+		STR key;
+		uint32_t semantic, index, type, dataLength;
+		uint64_t data;
+	};
+
+	struct TEXTURE
+	{
+		uint32_t magic;
+		uint32_t width, height, levels;
+		uint64_t levelOffsets[32];
+		uint64_t levelSizes[32];
+	};
+
+	// Growable binary buffer. Items are referred to by offsets, as the buffer may be reallocated.
+	class CBlob
+	{
+		std::vector<char> m_data;
+
+	public:
+		uint64_t reserve(size_t size, size_t align = 16)
+		{
+			size_t offset = (m_data.size() + align - 1) / align * align;
+			m_data.resize(offset + size, 0);
+			return offset;
+		}
+		uint64_t put(const void* p, size_t size)
+		{
+			if (p == NULL || size == 0) return 0;
+			uint64_t offset = reserve(size);
+			memcpy(&m_data[offset], p, size);
+			return offset;
+		}
+		STR put(std::string str)
+		{
+			return { put(str.c_str(), str.size() + 1), (uint32_t)str.size(), 0 };
+		}
+		template<class T> T* at(uint64_t offset, size_t i = 0)	{ return (T*)&m_data[offset] + i; }
+		std::vector<char>& data()								{ return m_data; }
+	};
+
+	// collects the nodes in pre-order, so that the parents precede their children
+	void collectNodes(const aiNode* pNode, int parent, std::vector<std::pair<const aiNode*, int>>& nodes)
+	{
+		int index = (int)nodes.size();
+		nodes.push_back({ pNode, parent });
+		for (unsigned i = 0; i < pNode->mNumChildren; i++)
+			collectNodes(pNode->mChildren[i], index, nodes);
+	}
+
+	// frees a node created by C3dglAssetPack::loadScene
+	void releaseNode(aiNode* pNode)
+	{
+		for (unsigned i = 0; i < pNode->mNumChildren; i++)
+			releaseNode(pNode->mChildren[i]);
+		delete[] pNode->mChildren;
+		delete[] pNode->mMeshes;
+		pNode->mChildren = NULL;
+		pNode->mMeshes = NULL;
+		pNode->mNumChildren = pNode->mNumMeshes = 0;
+		delete pNode;
+	}
+
+	// removes comments, trailing spaces and empty lines
+	std::string preprocessShader(const std::string& source)
+	{
+		std::string out, line;
+		auto flush = [&out, &line]()
+		{
+			line.erase(line.find_last_not_of(" \t") + 1);
+			if (!line.empty())
+				out += line + "\n";
+			line.clear();
+		};
+
+		bool bComment = false;	// inside a /* */ comment
+		for (size_t i = 0; i < source.size(); i++)
+		{
+			char c = source[i];
+			char next = i + 1 < source.size() ? source[i + 1] : 0;
+			if (bComment)
+			{
+				if (c == '*' && next == '/') { bComment = false; i++; }
+				else if (c == '\n') flush();
+			}
+			else if (c == '/' && next == '*') { bComment = true; i++; }
+			else if (c == '/' && next == '/')
+				while (i + 1 < source.size() && source[i + 1] != '\n') i++;
+			else if (c == '\n')
+				flush();
+			else if (c != '\r')
+				line += c;
+		}
+		flush();
+		return out;
+	}
+
+	// true if count items of itemSize bytes at offset lie within the entry of the given size
+	bool inRange(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t size)
+	{
+		return offset <= size && count <= (size - offset) / itemSize;
+	}
+
+	// Checks all tables, arrays and strings of a baked model against the size of its entry, before any of them is used.
+	// The parents must precede their children, and only the root (the first node) has no parent.
+	bool isValidModel(const char* pData, uint64_t size)
+	{
+		const MODEL* pModel = (const MODEL*)pData;
+		if (pModel->magic != c_modelMagic
+			|| !inRange(pModel->meshes, pModel->nMeshes, sizeof(MESH), size)
+			|| !inRange(pModel->materials, pModel->nMaterials, sizeof(MATERIAL), size)
+			|| !inRange(pModel->nodes, pModel->nNodes, sizeof(NODE), size))
+			return false;
+		auto isValidStr = [size](const STR& s) { return inRange(s.offset, s.length, 1, size); };
+		auto isValidArray = [size](uint64_t offset, uint64_t count, uint64_t itemSize) { return offset == 0 || inRange(offset, count, itemSize, size); };	// 0 = not present
+
+		const MESH* pMeshes = (const MESH*)(pData + pModel->meshes);
+		for (uint32_t i = 0; i < pModel->nMeshes; i++)
+		{
+			const MESH& mesh = pMeshes[i];
+			if (!isValidStr(mesh.name) || mesh.materialIndex >= pModel->nMaterials
+				|| !inRange(mesh.vertices, mesh.nVertices, sizeof(aiVector3D), size)
+				|| !isValidArray(mesh.normals, mesh.nVertices, sizeof(aiVector3D))
+				|| !isValidArray(mesh.tangents, mesh.nVertices, sizeof(aiVector3D))
+				|| !isValidArray(mesh.bitangents, mesh.nVertices, sizeof(aiVector3D))
+				|| !isValidArray(mesh.colors, mesh.nVertices, sizeof(aiColor4D))
+				|| !isValidArray(mesh.texCoords, mesh.nVertices, sizeof(aiVector3D))
+				|| !inRange(mesh.faceSizes, mesh.nFaces, sizeof(uint32_t), size)
+				|| !inRange(mesh.indices, mesh.nIndices, sizeof(uint32_t), size))
+				return false;
+			const uint32_t* pFaceSizes = (const uint32_t*)(pData + mesh.faceSizes);
+			uint64_t nIndices = 0;
+			for (uint32_t j = 0; j < mesh.nFaces; j++)
+				nIndices += pFaceSizes[j];
+			if (nIndices > mesh.nIndices)
+				return false;
+		}
+
+		const MATERIAL* pMaterials = (const MATERIAL*)(pData + pModel->materials);
+		for (uint32_t i = 0; i < pModel->nMaterials; i++)
+		{
+			if (!inRange(pMaterials[i].properties, pMaterials[i].nProperties, sizeof(PROPERTY), size))
+				return false;
+			const PROPERTY* pProperties = (const PROPERTY*)(pData + pMaterials[i].properties);
+			for (uint32_t j = 0; j < pMaterials[i].nProperties; j++)
+				if (!isValidStr(pProperties[j].key) || !inRange(pProperties[j].data, pProperties[j].dataLength, 1, size))
+					return false;
+		}
+
+		const NODE* pNodes = (const NODE*)(pData + pModel->nodes);
+		for (uint32_t i = 0; i < pModel->nNodes; i++)
+		{
+			const NODE& node = pNodes[i];
+			if (!isValidStr(node.name) || (i == 0 ? node.parent != -1 : node.parent < 0 || (uint32_t)node.parent >= i)
+				|| !inRange(node.meshes, node.nMeshes, sizeof(uint32_t), size))
+				return false;
+			const uint32_t* pMeshIds = (const uint32_t*)(pData + node.meshes);
+			for (uint32_t j = 0; j < node.nMeshes; j++)
+				if (pMeshIds[j] >= pModel->nMeshes)
+					return false;
+		}
+		return true;
+	}
+
+	// list of mounted packs
+	std::vector<C3dglAssetPack*>& mountedPacks()
+	{
+		static std::vector<C3dglAssetPack*> packs;
+		return packs;
+	}
+
+	// last write time and size of a file; false if it does not exist
+	bool sourceStamp(const std::filesystem::path& path, int64_t& time, uint64_t& size)
+	{
+		std::error_code ec;
+		auto t = std::filesystem::last_write_time(path, ec);
+		if (ec) return false;
+		size = (uint64_t)std::filesystem::file_size(path, ec);
+		if (ec) return false;
+		time = (int64_t)t.time_since_epoch().count();
+		return true;
+	}
+}
+
+/*********************************************************************************
+** class C3dglAssetPack
+*/
+
+C3dglAssetPack::C3dglAssetPack() : C3dglObject()
+{
+	m_pFile = NULL;
+}
+
+bool C3dglAssetPack::open(std::string filename)
+{
+	close();
+	m_filename = filename;
+
+	m_pFile = new C3dglMappedFile;
+	if (!m_pFile->open(filename.c_str()))
+	{
+		close();
+		return log(M3DGL_ERROR_CANNOT_OPEN_FILE, filename);
+	}
+
+	// validate the header and the index
+	const char* pData = m_pFile->data();
+	size_t size = m_pFile->size();
+	const ASSETPACK_HEADER* pHeader = (const ASSETPACK_HEADER*)pData;
+	if (size >= sizeof(ASSETPACK_HEADER) && memcmp(pHeader->magic, "3DGLPAK", 8) == 0 && pHeader->version != c_version)
+	{
+		close();
+		return log(M3DGL_ERROR_PACK_FORMAT, std::format("version {} (expected {}) - bake the pack again", pHeader->version, (uint32_t)c_version));
+	}
+	if (size < sizeof(ASSETPACK_HEADER) || memcmp(pHeader->magic, "3DGLPAK", 8) != 0
+		|| pHeader->indexOffset + (uint64_t)pHeader->nEntries * sizeof(ASSETPACK_ENTRY) > size || pHeader->namesOffset > size)
+	{
+		close();
+		return log(M3DGL_ERROR_PACK_FORMAT, "wrong header");
+	}
+
+	const ASSETPACK_ENTRY* pEntries = (const ASSETPACK_ENTRY*)(pData + pHeader->indexOffset);
+	for (uint32_t i = 0; i < pHeader->nEntries; i++)
+	{
+		const ASSETPACK_ENTRY& entry = pEntries[i];
+		if (entry.offset + entry.size > size || pHeader->namesOffset + entry.nameOffset + entry.nameLength > size)
+		{
+			close();
+			return log(M3DGL_ERROR_PACK_FORMAT, std::format("entry #{} out of range", i));
+		}
+		m_index[std::string(pData + pHeader->namesOffset + entry.nameOffset, entry.nameLength)] = &entry;
+	}
+
+	return log(M3DGL_SUCCESS_LOADED, filename);
+}
+
+void C3dglAssetPack::close()
+{
+	unmount(this);
+	m_index.clear();
+	if (m_pFile)
+		delete m_pFile;
+	m_pFile = NULL;
+}
+
+void C3dglAssetPack::mount(C3dglAssetPack* pPack)
+{
+	if (pPack && std::find(mountedPacks().begin(), mountedPacks().end(), pPack) == mountedPacks().end())
+		mountedPacks().push_back(pPack);
+}
+
+void C3dglAssetPack::unmount(C3dglAssetPack* pPack)
+{
+	mountedPacks().erase(std::remove(mountedPacks().begin(), mountedPacks().end(), pPack), mountedPacks().end());
+}
+
+C3dglAssetPack* C3dglAssetPack::findMounted(std::string filename, ASSET_TYPE type)
+{
+	for (C3dglAssetPack* pPack : mountedPacks())
+		if (pPack->hasAsset(filename, type))
+		{
+			if (!pPack->isStale(filename))
+				return pPack;
+			pPack->log(M3DGL_WARNING_STALE_ASSET, filename);
+		}
+	return NULL;
+}
+
+std::string C3dglAssetPack::getEntryName(std::string filename)
+{
+	std::replace(filename.begin(), filename.end(), '\\', '/');
+	std::string name = std::filesystem::path(filename).lexically_normal().generic_string();
+	std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)tolower(c); });
+	return name;
+}
+
+const ASSETPACK_ENTRY* C3dglAssetPack::findEntry(std::string filename) const
+{
+	auto it = m_index.find(getEntryName(filename));
+	return it == m_index.end() ? NULL : it->second;
+}
+
+bool C3dglAssetPack::hasAsset(std::string filename, ASSET_TYPE type) const
+{
+	const ASSETPACK_ENTRY* pEntry = findEntry(filename);
+	return pEntry && pEntry->type == type;
+}
+
+bool C3dglAssetPack::isStale(std::string filename) const
+{
+	const ASSETPACK_ENTRY* pEntry = findEntry(filename);
+	int64_t time;
+	uint64_t size;
+	if (!pEntry || !sourceStamp(filename, time, size))
+		return false;	// nothing to compare with: the pack is all there is
+	return time != pEntry->sourceTime || size != pEntry->sourceSize;
+}
+
+const void* C3dglAssetPack::getData(std::string filename, size_t& size) const
+{
+	const ASSETPACK_ENTRY* pEntry = findEntry(filename);
+	size = pEntry ? (size_t)pEntry->size : 0;
+	return pEntry ? m_pFile->data() + pEntry->offset : NULL;
+}
+
+std::string_view C3dglAssetPack::getShader(std::string filename) const
+{
+	const ASSETPACK_ENTRY* pEntry = findEntry(filename);
+	if (!pEntry || pEntry->type != ASSET_SHADER) return std::string_view();
+	return std::string_view(m_pFile->data() + pEntry->offset, (size_t)pEntry->size);
+}
+
+bool C3dglAssetPack::getTexture(std::string filename, ASSETPACK_TEXTURE& texture) const
+{
+	const ASSETPACK_ENTRY* pEntry = findEntry(filename);
+	if (!pEntry || pEntry->type != ASSET_TEXTURE || pEntry->size < sizeof(TEXTURE)) return false;
+
+	const char* pData = m_pFile->data() + pEntry->offset;
+	const TEXTURE* pTex = (const TEXTURE*)pData;
+	if (pTex->magic != c_textureMagic || pTex->levels > 32)
+		return log(M3DGL_ERROR_PACK_FORMAT, filename);
+	for (unsigned i = 0; i < pTex->levels; i++)
+		if (!inRange(pTex->levelOffsets[i], pTex->levelSizes[i], 1, pEntry->size))
+			return log(M3DGL_ERROR_PACK_FORMAT, filename);
+
+	texture.width = pTex->width;
+	texture.height = pTex->height;
+	texture.levels = pTex->levels;
+	for (unsigned i = 0; i < pTex->levels; i++)
+	{
+		texture.pLevels[i] = pData + pTex->levelOffsets[i];
+		texture.levelSizes[i] = (size_t)pTex->levelSizes[i];
+	}
+	return true;
+}
+
+const aiScene* C3dglAssetPack::loadScene(std::string filename, unsigned flags) const
+{
+	if (flags == 0)
+		flags = aiProcessPreset_TargetRealtime_MaxQuality;
+
+	const ASSETPACK_ENTRY* pEntry = findEntry(filename);
+	if (!pEntry || pEntry->type != ASSET_MODEL || pEntry->param != flags || pEntry->size < sizeof(MODEL)) return NULL;
+
+	char* pData = const_cast<char*>(m_pFile->data() + pEntry->offset);	// AssImp arrays are not const, but they will never be written
+	const MODEL* pModel = (const MODEL*)pData;
+	if (!isValidModel(pData, pEntry->size))
+	{
+		log(M3DGL_ERROR_PACK_FORMAT, filename);
+		return NULL;
+	}
+	auto str = [pData](const STR& s) { aiString str; str.Set(std::string(pData + s.offset, s.length)); return str; };
+	auto view = [pData]<class T>(T*& p, uint64_t offset) { p = offset ? (T*)(pData + offset) : NULL; };
+
+	aiScene* pScene = new aiScene;
+
+	// meshes - vertex and index arrays are the views of the mapped file
+	const MESH* pMeshes = (const MESH*)(pData + pModel->meshes);
+	pScene->mNumMeshes = pModel->nMeshes;
+	pScene->mMeshes = new aiMesh * [pModel->nMeshes];
+	for (unsigned i = 0; i < pModel->nMeshes; i++)
+	{
+		const MESH& mesh = pMeshes[i];
+		aiMesh* pMesh = pScene->mMeshes[i] = new aiMesh;
+		pMesh->mName = str(mesh.name);
+		pMesh->mMaterialIndex = mesh.materialIndex;
+		pMesh->mPrimitiveTypes = mesh.primitiveTypes;
+		pMesh->mNumVertices = mesh.nVertices;
+		pMesh->mNumUVComponents[0] = mesh.nUVComponents;
+		view(pMesh->mVertices, mesh.vertices);
+		view(pMesh->mNormals, mesh.normals);
+		view(pMesh->mTangents, mesh.tangents);
+		view(pMesh->mBitangents, mesh.bitangents);
+		view(pMesh->mColors[0], mesh.colors);
+		view(pMesh->mTextureCoords[0], mesh.texCoords);
+
+		const uint32_t* pFaceSizes = (const uint32_t*)(pData + mesh.faceSizes);
+		unsigned* pIndices = (unsigned*)(pData + mesh.indices);
+		pMesh->mNumFaces = mesh.nFaces;
+		pMesh->mFaces = new aiFace[mesh.nFaces];
+		for (unsigned j = 0; j < mesh.nFaces; j++)
+		{
+			pMesh->mFaces[j].mNumIndices = pFaceSizes[j];
+			pMesh->mFaces[j].mIndices = pIndices;
+			pIndices += pFaceSizes[j];
+		}
+	}
+
+	// materials - properties are copied
+	const MATERIAL* pMaterials = (const MATERIAL*)(pData + pModel->materials);
+	pScene->mNumMaterials = pModel->nMaterials;
+	pScene->mMaterials = new aiMaterial * [pModel->nMaterials];
+	for (unsigned i = 0; i < pModel->nMaterials; i++)
+	{
+		aiMaterial* pMaterial = pScene->mMaterials[i] = new aiMaterial;
+		const PROPERTY* pProperties = (const PROPERTY*)(pData + pMaterials[i].properties);
+		for (unsigned j = 0; j < pMaterials[i].nProperties; j++)
+		{
+			const PROPERTY& prop = pProperties[j];
+			pMaterial->AddBinaryProperty(pData + prop.data, prop.dataLength, std::string(pData + prop.key.offset, prop.key.length).c_str(),
+				prop.semantic, prop.index, (aiPropertyTypeInfo)prop.type);
+		}
+	}
+
+	// nodes
+	const NODE* pNodes = (const NODE*)(pData + pModel->nodes);
+	std::vector<aiNode*> nodes(pModel->nNodes);
+	std::vector<unsigned> nChildren(pModel->nNodes, 0);
+	for (unsigned i = 0; i < pModel->nNodes; i++)
+		if (pNodes[i].parent >= 0)
+			nChildren[pNodes[i].parent]++;
+	for (unsigned i = 0; i < pModel->nNodes; i++)
+	{
+		const NODE& node = pNodes[i];
+		aiNode* pNode = nodes[i] = new aiNode;
+		pNode->mName = str(node.name);
+		memcpy(&pNode->mTransformation, node.transformation, sizeof(node.transformation));
+		pNode->mNumMeshes = node.nMeshes;
+		pNode->mMeshes = node.nMeshes ? new unsigned[node.nMeshes] : NULL;
+		if (node.nMeshes)
+			memcpy(pNode->mMeshes, pData + node.meshes, node.nMeshes * sizeof(unsigned));
+		pNode->mChildren = nChildren[i] ? new aiNode * [nChildren[i]] : NULL;
+		if (node.parent >= 0)
+		{
+			aiNode* pParent = nodes[node.parent];
+			pNode->mParent = pParent;
+			pParent->mChildren[pParent->mNumChildren++] = pNode;
+		}
+	}
+	pScene->mRootNode = nodes.empty() ? new aiNode : nodes[0];
+
+	log(M3DGL_SUCCESS_LOADED_FROM_PACK, filename);
+	return pScene;
+}
+
+void C3dglAssetPack::release(const aiScene* pConstScene)
+{
+	if (!pConstScene) return;
+
+	// Everything allocated in this module is also freed here rather than in the AssImp DLL,
+	// which may use a different heap. The views of the mapped file are detached before deletion.
+	aiScene* pScene = const_cast<aiScene*>(pConstScene);
+	for (unsigned i = 0; i < pScene->mNumMeshes; i++)
+	{
+		aiMesh* pMesh = pScene->mMeshes[i];
+		pMesh->mVertices = pMesh->mNormals = pMesh->mTangents = pMesh->mBitangents = pMesh->mTextureCoords[0] = NULL;
+		pMesh->mColors[0] = NULL;
+		for (unsigned j = 0; j < pMesh->mNumFaces; j++)
+			pMesh->mFaces[j].mIndices = NULL;
+		delete pMesh;
+	}
+	for (unsigned i = 0; i < pScene->mNumMaterials; i++)
+		delete pScene->mMaterials[i];
+	delete[] pScene->mMeshes;
+	delete[] pScene->mMaterials;
+	pScene->mMeshes = NULL;
+	pScene->mMaterials = NULL;
+	pScene->mNumMeshes = pScene->mNumMaterials = 0;
+	if (pScene->mRootNode)
+		releaseNode(pScene->mRootNode);
+	pScene->mRootNode = NULL;
+	delete pScene;
+}
+
+/*********************************************************************************
+** class C3dglAssetPackWriter
+*/
+
+bool C3dglAssetPackWriter::bakeManifest(std::string manifest)
+{
+	std::ifstream file(manifest);
+	if (!file)
+		return log(M3DGL_ERROR_CANNOT_OPEN_FILE, manifest);
+
+	std::string basePath = std::filesystem::path(manifest).parent_path().string();
+	bool bResult = true;
+	std::string line;
+	for (unsigned nLine = 1; std::getline(file, line); nLine++)
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream stream(line);
+		std::string type, filename;
+		if (!(stream >> type))
+			continue;	// empty line
+		if (!(stream >> filename))
+		{
+			log(M3DGL_WARNING_MANIFEST_SYNTAX, nLine, "file name expected");
+			continue;
+		}
+
+		if (type == "model")
+		{
+			unsigned flags = 0;
+			stream >> std::hex >> flags;
+			bResult &= bakeModel(filename, flags, basePath);
+		}
+		else if (type == "texture")
+			bResult &= bakeTexture(filename, basePath);
+		else if (type == "shader")
+			bResult &= bakeShader(filename, basePath);
+		else if (type == "raw")
+			bResult &= bakeRaw(filename, basePath);
+		else
+			log(M3DGL_WARNING_MANIFEST_SYNTAX, nLine, "unknown asset type " + type);
+	}
+	return bResult;
+}
+
+bool C3dglAssetPackWriter::bakeModel(std::string filename, unsigned flags, std::string basePath)
+{
+	if (flags == 0)
+		flags = aiProcessPreset_TargetRealtime_MaxQuality;
+
+	std::string path = (std::filesystem::path(basePath) / filename).string();
+	const aiScene* pScene = aiImportFile(path.c_str(), flags);
+	if (!pScene)
+	{
+		log(M3DGL_WARNING_CANNOT_BAKE, filename, aiGetErrorString());
+		return false;
+	}
+
+	// features not supported by the pack format
+	std::string unsupported;
+	if (pScene->mNumAnimations) unsupported = "animations";
+	if (pScene->mNumTextures) unsupported = "embedded textures";
+	for (unsigned i = 0; i < pScene->mNumMeshes; i++)
+		if (pScene->mMeshes[i]->mNumBones) unsupported = "bones";
+	if (!unsupported.empty())
+	{
+		aiReleaseImport(pScene);
+		log(M3DGL_WARNING_CANNOT_BAKE, filename, unsupported + " are not supported");
+		return false;
+	}
+
+	CBlob blob;
+	blob.reserve(sizeof(MODEL));
+
+	// nodes
+	std::vector<std::pair<const aiNode*, int>> nodes;
+	collectNodes(pScene->mRootNode, -1, nodes);
+	uint64_t offNodes = blob.reserve(nodes.size() * sizeof(NODE));
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const aiNode* pNode = nodes[i].first;
+		STR name = blob.put(pNode->mName.C_Str());
+		uint64_t meshes = blob.put(pNode->mMeshes, pNode->mNumMeshes * sizeof(unsigned));
+		NODE* p = blob.at<NODE>(offNodes, i);
+		p->name = name;
+		p->parent = nodes[i].second;
+		p->nMeshes = pNode->mNumMeshes;
+		p->meshes = meshes;
+		memcpy(p->transformation, &pNode->mTransformation, sizeof(p->transformation));
+	}
+
+	// meshes
+	uint64_t offMeshes = blob.reserve(pScene->mNumMeshes * sizeof(MESH));
+	for (unsigned i = 0; i < pScene->mNumMeshes; i++)
+	{
+		const aiMesh* pMesh = pScene->mMeshes[i];
+		size_t nVertices = pMesh->mNumVertices;
+		std::vector<uint32_t> faceSizes, indices;
+		for (unsigned j = 0; j < pMesh->mNumFaces; j++)
+		{
+			faceSizes.push_back(pMesh->mFaces[j].mNumIndices);
+			indices.insert(indices.end(), pMesh->mFaces[j].mIndices, pMesh->mFaces[j].mIndices + pMesh->mFaces[j].mNumIndices);
+		}
+
+		MESH mesh = {};
+		mesh.name = blob.put(pMesh->mName.C_Str());
+		mesh.materialIndex = pMesh->mMaterialIndex;
+		mesh.primitiveTypes = pMesh->mPrimitiveTypes;
+		mesh.nVertices = (uint32_t)nVertices;
+		mesh.nFaces = (uint32_t)faceSizes.size();
+		mesh.nIndices = (uint32_t)indices.size();
+		mesh.nUVComponents = pMesh->mNumUVComponents[0];
+		mesh.vertices = blob.put(pMesh->mVertices, nVertices * sizeof(aiVector3D));
+		mesh.normals = blob.put(pMesh->mNormals, nVertices * sizeof(aiVector3D));
+		mesh.tangents = blob.put(pMesh->mTangents, nVertices * sizeof(aiVector3D));
+		mesh.bitangents = blob.put(pMesh->mBitangents, nVertices * sizeof(aiVector3D));
+		mesh.colors = blob.put(pMesh->mColors[0], nVertices * sizeof(aiColor4D));
+		mesh.texCoords = blob.put(pMesh->mTextureCoords[0], nVertices * sizeof(aiVector3D));
+		mesh.faceSizes = faceSizes.empty() ? 0 : blob.put(faceSizes.data(), faceSizes.size() * sizeof(uint32_t));
+		mesh.indices = indices.empty() ? 0 : blob.put(indices.data(), indices.size() * sizeof(uint32_t));
+		*blob.at<MESH>(offMeshes, i) = mesh;
+	}
+
+	// materials
+	uint64_t offMaterials = blob.reserve(pScene->mNumMaterials * sizeof(MATERIAL));
+	for (unsigned i = 0; i < pScene->mNumMaterials; i++)
+	{
+		const aiMaterial* pMaterial = pScene->mMaterials[i];
+		uint64_t offProperties = blob.reserve(pMaterial->mNumProperties * sizeof(PROPERTY));
+		for (unsigned j = 0; j < pMaterial->mNumProperties; j++)
+		{
+			const aiMaterialProperty* pProp = pMaterial->mProperties[j];
+			STR key = blob.put(pProp->mKey.C_Str());
+			uint64_t data = blob.put(pProp->mData, pProp->mDataLength);
+			*blob.at<PROPERTY>(offProperties, j) = { key, pProp->mSemantic, pProp->mIndex, (uint32_t)pProp->mType, pProp->mDataLength, data };
+		}
+		*blob.at<MATERIAL>(offMaterials, i) = { pMaterial->mNumProperties, 0, offProperties };
+	}
+
+	*blob.at<MODEL>(0) = { c_modelMagic, (uint32_t)nodes.size(), pScene->mNumMeshes, pScene->mNumMaterials, offNodes, offMeshes, offMaterials };
+	aiReleaseImport(pScene);
+
+	log(M3DGL_SUCCESS_BAKED, filename, blob.data().size());
+	std::string name = C3dglAssetPack::getEntryName(filename);
+	std::erase_if(m_items, [&name](const ITEM& item) { return item.name == name; });
+	ITEM item = { name, ASSET_MODEL, flags, std::move(blob.data()), 0, 0 };
+	sourceStamp(path, item.sourceTime, item.sourceSize);
+	m_items.push_back(std::move(item));
+	return true;
+}
+
+bool C3dglAssetPackWriter::bakeTexture(std::string filename, std::string basePath)
+{
+	std::string path = (std::filesystem::path(basePath) / filename).string();
+	C3dglBitmap bm;
+	if (!bm.load(path, GL_RGBA) || !bm.getBits())
+	{
+		log(M3DGL_WARNING_CANNOT_BAKE, filename, "cannot load the image");
+		return false;
+	}
+
+	// full mip chain - the same as generated at run time for the loose file
+	unsigned w = (unsigned)bm.getWidth(), h = (unsigned)abs(bm.getHeight());
+	std::vector<std::vector<unsigned char>> levels;
+	C3dglTexture::generateMipChain(w, h, bm.getBits(), levels);
+
+	CBlob blob;
+	blob.reserve(sizeof(TEXTURE));
+	TEXTURE tex = { c_textureMagic, w, h, 0, { }, { } };
+	for (auto& level : levels)
+	{
+		tex.levelOffsets[tex.levels] = blob.put(level.data(), level.size());
+		tex.levelSizes[tex.levels] = level.size();
+		tex.levels++;
+	}
+	*blob.at<TEXTURE>(0) = tex;
+
+	log(M3DGL_SUCCESS_BAKED, filename, blob.data().size());
+	std::string name = C3dglAssetPack::getEntryName(filename);
+	std::erase_if(m_items, [&name](const ITEM& item) { return item.name == name; });
+	ITEM item = { name, ASSET_TEXTURE, 0, std::move(blob.data()), 0, 0 };
+	sourceStamp(path, item.sourceTime, item.sourceSize);
+	m_items.push_back(std::move(item));
+	return true;
+}
+
+bool C3dglAssetPackWriter::bakeShader(std::string filename, std::string basePath)
+{
+	std::filesystem::path path = std::filesystem::path(basePath) / filename;
+	std::ifstream file(path);
+	if (!file)
+	{
+		log(M3DGL_WARNING_CANNOT_BAKE, filename, "cannot open the file");
+		return false;
+	}
+	std::string source(std::istreambuf_iterator<char>(file), (std::istreambuf_iterator<char>()));
+	source = preprocessShader(source);
+
+	log(M3DGL_SUCCESS_BAKED, filename, source.size());
+	std::string name = C3dglAssetPack::getEntryName(filename);
+	std::erase_if(m_items, [&name](const ITEM& item) { return item.name == name; });
+	ITEM item = { name, ASSET_SHADER, 0, std::vector<char>(source.begin(), source.end()), 0, 0 };
+	sourceStamp(path, item.sourceTime, item.sourceSize);
+	m_items.push_back(std::move(item));
+	return true;
+}
+
+bool C3dglAssetPackWriter::bakeRaw(std::string filename, std::string basePath)
+{
+	std::filesystem::path path = std::filesystem::path(basePath) / filename;
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		log(M3DGL_WARNING_CANNOT_BAKE, filename, "cannot open the file");
+		return false;
+	}
+	std::vector<char> data(std::istreambuf_iterator<char>(file), (std::istreambuf_iterator<char>()));
+
+	log(M3DGL_SUCCESS_BAKED, filename, data.size());
+	std::string name = C3dglAssetPack::getEntryName(filename);
+	std::erase_if(m_items, [&name](const ITEM& item) { return item.name == name; });
+	ITEM item = { name, ASSET_RAW, 0, std::move(data), 0, 0 };
+	sourceStamp(path, item.sourceTime, item.sourceSize);
+	m_items.push_back(std::move(item));
+	return true;
+}
+
+bool C3dglAssetPackWriter::save(std::string filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+		return log(M3DGL_ERROR_CANNOT_WRITE_FILE, filename);
+
+	const uint64_t align = C3dglAssetPack::c_alignment;
+	auto pad = [&file, align]()
+	{
+		uint64_t pos = (uint64_t)file.tellp();
+		std::vector<char> zeros((size_t)((align - pos % align) % align), 0);
+		file.write(zeros.data(), zeros.size());
+		return (uint64_t)file.tellp();
+	};
+
+	// header placeholder, then entries
+	ASSETPACK_HEADER header = { "3DGLPAK", C3dglAssetPack::c_version, (uint32_t)m_items.size(), 0, 0 };
+	file.write((const char*)&header, sizeof(header));
+
+	std::vector<ASSETPACK_ENTRY> entries;
+	std::string names;
+	for (const ITEM& item : m_items)
+	{
+		uint64_t offset = pad();
+		file.write(item.data.data(), item.data.size());
+		entries.push_back({ offset, item.data.size(), (uint32_t)item.type, item.param, (uint32_t)names.size(), (uint32_t)item.name.size(),
+			item.sourceTime, item.sourceSize });
+		names += item.name;
+	}
+
+	// index
+	header.indexOffset = pad();
+	file.write((const char*)entries.data(), entries.size() * sizeof(ASSETPACK_ENTRY));
+	header.namesOffset = (uint64_t)file.tellp();
+	file.write(names.data(), names.size());
+
+	file.seekp(0);
+	file.write((const char*)&header, sizeof(header));
+	if (!file)
+		return log(M3DGL_ERROR_CANNOT_WRITE_FILE, filename);
+	return log(M3DGL_SUCCESS_SAVED, filename);
+}
@@ -5,7 +5,13 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 *********************************************************************************/
 #include "pch.h"
 #include <iostream>
+#include <mutex>
+#include <chrono>
+#include <cfloat>
 #include <3dgl/Bitmap.h>
+#include <3dgl/AssetPack.h>
+#include "MappedFile.h"
+#include "ImageDecoder.h"
 
 // DevIL include file
 #undef _UNICODE
@@ -16,9 +22,26 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 
 using namespace _3dgl;
 
+namespace
+{
+	// DevIL keeps the bound image in a global state: all calls must be serialised
+	std::mutex& ilMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	void ilInitOnce()
+	{
+		static std::once_flag flag;
+		std::call_once(flag, []() { ilInit(); });
+	}
+}
+
 C3dglBitmap::C3dglBitmap() 
 { 
 	m_idImage = 0; 
+	m_pFile = NULL;
 	m_width = m_height = 0; 
 	m_pBits = NULL; 
 }
@@ -26,46 +49,56 @@ C3dglBitmap::C3dglBitmap()
 C3dglBitmap::C3dglBitmap(std::string fname, unsigned format)
 {
 	m_idImage = 0;
+	m_pFile = NULL;
 	m_width = m_height = 0;
 	m_pBits = NULL;
 	load(fname, format);
 }
 
-static bool bIlInitialised = false;
-
 bool C3dglBitmap::load(std::string fname, unsigned format)
 {
-	// initialise IL
-	if (!bIlInitialised)
-		ilInit(); 
-	bIlInitialised = true;
-
 	// destroy previous image
 	destroy();
-	
-	// generate IL image id
-	ilGenImages(1, &m_idImage); 
 
-	// bind IL image and load
-	ilBindImage(m_idImage);
-	ilEnable(IL_ORIGIN_SET);
-	ilOriginFunc(IL_ORIGIN_LOWER_LEFT); 
-	if (ilLoadImage((ILstring)fname.c_str()))
+	// baked texture from a mounted asset pack - the mip level 0 is used in place
+	ASSETPACK_TEXTURE texture;
+	C3dglAssetPack* pPack = C3dglAssetPack::findMounted(fname, ASSET_TEXTURE);
+	if (pPack && format == IL_RGBA && pPack->getTexture(fname, texture))
 	{
-		ilConvertImage(format, IL_UNSIGNED_BYTE); 
-		log(M3DGL_SUCCESS_LOADED, fname);
-
-		m_width = ilGetInteger(IL_IMAGE_WIDTH);
-		m_height = ilGetInteger(IL_IMAGE_HEIGHT);
-		m_pBits = ilGetData();
-
-		return true;
+		m_width = texture.width;
+		m_height = texture.height;
+		m_pBits = const_cast<void*>(texture.pLevels[0]);
+		return log(M3DGL_SUCCESS_LOADED_FROM_PACK, fname);
 	}
-	else 
+
+	// native decoder - the file is mapped and, if already in the requested format, its pixels are used in place
+	C3dglMappedFile* pFile = new C3dglMappedFile(fname.c_str());
+	if (!pFile->isOpen())
 	{
+		delete pFile;
 		log(M3DGL_WARNING_CANNOT_LOAD, fname);
 		return false;
 	}
+	DECODED_IMAGE image;
+	if (decodeImage(pFile->data(), pFile->size(), format, image))
+	{
+		m_width = image.width;
+		m_height = image.height;
+		m_pBits = (void*)image.pBits;
+		if (image.buffer.empty())
+			m_pFile = pFile;
+		else
+		{
+			m_buffer.swap(image.buffer);
+			delete pFile;
+		}
+		return log(M3DGL_SUCCESS_LOADED, fname);
+	}
+
+	// other formats
+	bool bResult = loadDevIL(fname, format, pFile->data(), pFile->size());
+	delete pFile;
+	return bResult ? log(M3DGL_SUCCESS_LOADED, fname) : log(M3DGL_WARNING_CANNOT_LOAD, fname);
 }
 
 bool C3dglBitmap::load(const aiTexture* pTexture, unsigned format)
@@ -74,6 +107,9 @@ bool C3dglBitmap::load(const aiTexture* pTexture, unsigned format)
 	size_t i = shortName.find_last_of("/\\");
 	if (i != std::string::npos) shortName = shortName.substr(i + 1);
 
+	// destroy previous image
+	destroy();
+
 	if (pTexture->mWidth && pTexture->mHeight && pTexture->pcData)
 	{
 		m_width = pTexture->mWidth;
@@ -83,48 +119,28 @@ bool C3dglBitmap::load(const aiTexture* pTexture, unsigned format)
 	}
 	else if (pTexture->mWidth && pTexture->mHeight == 0 && pTexture->pcData)
 	{
-		ILenum formatHint;
-		if (pTexture->CheckFormat("jpg"))
-			formatHint = IL_JPG;
-		else 
-			if (pTexture->CheckFormat("png"))
-			formatHint = IL_PNG;
-		else
+		// compressed image - the embedded data outlives the bitmap only as long as the scene, so it is always copied
+		DECODED_IMAGE image;
+		if (decodeImage(pTexture->pcData, pTexture->mWidth, format, image))
 		{
-			log(M3DGL_WARNING_EMBED_FILE_UNKNOWN_FORMAT, pTexture->achFormatHint, shortName);
-			return false;
+			m_width = image.width;
+			m_height = image.height;
+			if (image.buffer.empty())
+				m_buffer.assign(image.pBits, image.pBits + (size_t)image.width * image.height * getPixelSize(format));
+			else
+				m_buffer.swap(image.buffer);
+			m_pBits = m_buffer.data();
+			return log(M3DGL_SUCCESS_LOADED_FROM_EMBED_FILE, shortName);
 		}
 
-		// initialise IL
-		if (!bIlInitialised)
-			ilInit();
-		bIlInitialised = true;
-
-		// destroy previous image
-		destroy();
-
-		// generate IL image id
-		ilGenImages(1, &m_idImage);
-
-		// bind IL image and load
-		ilBindImage(m_idImage);
-		ilEnable(IL_ORIGIN_SET);
-		ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
-		if (ilLoadL(formatHint, pTexture->pcData, pTexture->mWidth))
-		{
-			ilConvertImage(format, IL_UNSIGNED_BYTE);
-
-			m_width = ilGetInteger(IL_IMAGE_WIDTH);
-			m_height = ilGetInteger(IL_IMAGE_HEIGHT);
-			m_pBits = ilGetData();
-
+		// other formats
+		if (loadDevIL(shortName, format, pTexture->pcData, pTexture->mWidth))
 			return log(M3DGL_SUCCESS_LOADED_FROM_EMBED_FILE, shortName);
-		}
-		else
-		{
+		if (pTexture->CheckFormat("jpg") || pTexture->CheckFormat("png") || pTexture->CheckFormat("bmp") || pTexture->CheckFormat("tga"))
 			log(M3DGL_WARNING_CANNOT_LOAD_FROM_EMBED_FILE, shortName);
-			return false;
-		}
+		else
+			log(M3DGL_WARNING_EMBED_FILE_UNKNOWN_FORMAT, pTexture->achFormatHint, shortName);
+		return false;
 	}
 	else
 	{
@@ -133,11 +149,115 @@ bool C3dglBitmap::load(const aiTexture* pTexture, unsigned format)
 	}
 }
 
+bool C3dglBitmap::loadDevIL(std::string fname, unsigned format, const void* pData, size_t size)
+{
+	std::lock_guard<std::mutex> lock(ilMutex());
+	ilInitOnce();
+
+	// generate IL image id
+	ilGenImages(1, &m_idImage);
+
+	// bind IL image and load
+	ilBindImage(m_idImage);
+	ilEnable(IL_ORIGIN_SET);
+	ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+	if (!ilLoadL(ilTypeFromExt((ILstring)fname.c_str()), pData, (ILuint)size))
+	{
+		ilDeleteImages(1, &m_idImage);
+		m_idImage = 0;
+		return false;
+	}
+
+	// conversion is only needed if the image is in another format
+	if (ilGetInteger(IL_IMAGE_FORMAT) != format || ilGetInteger(IL_IMAGE_TYPE) != IL_UNSIGNED_BYTE)
+		ilConvertImage(format, IL_UNSIGNED_BYTE);
+
+	m_width = ilGetInteger(IL_IMAGE_WIDTH);
+	m_height = ilGetInteger(IL_IMAGE_HEIGHT);
+	m_pBits = ilGetData();
+	return true;
+}
+
 void C3dglBitmap::destroy()
 {
 	if (m_idImage)
+	{
+		std::lock_guard<std::mutex> lock(ilMutex());
 		ilDeleteImages(1, &m_idImage);
+	}
 	m_idImage = 0;
+	if (m_pFile)
+		delete m_pFile;
+	m_pFile = NULL;
+	std::vector<unsigned char>().swap(m_buffer);
 	m_width = m_height = 0;
 	m_pBits = NULL;
 }
+
+size_t C3dglBitmap::loadParallel(size_t count, C3dglBitmap* pBitmaps, const std::string* pFilenames, unsigned format, unsigned nThreads)
+{
+	std::atomic<size_t> nLoaded = 0;
+	parallelFor(count, [&](size_t i)
+		{
+			if (pBitmaps[i].load(pFilenames[i], format))
+				nLoaded++;
+		}, nThreads);
+	return nLoaded;
+}
+
+double C3dglBitmap::benchmark(const std::vector<std::string>& filenames, unsigned nRuns)
+{
+	nRuns = std::max(nRuns, 1u);
+
+	// files are mapped up front, so that only the decoding is measured
+	std::vector<C3dglMappedFile> files(filenames.size());
+	double MB = 0;
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		files[i].open(filenames[i].c_str());
+		MB += files[i].size() / (1024.0 * 1024.0);
+	}
+
+	// each file is decoded once per hardware thread, to give all the cores some work
+	unsigned nThreads = std::max(1u, std::thread::hardware_concurrency());
+	size_t nTasks = files.size() * nThreads;
+	MB *= nThreads;
+
+	// returns the best time of nRuns, in seconds
+	auto measure = [nRuns](auto fn)
+	{
+		double best = DBL_MAX;
+		for (unsigned i = 0; i < nRuns; i++)
+		{
+			auto t0 = std::chrono::high_resolution_clock::now();
+			fn();
+			best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count());
+		}
+		return best;
+	};
+
+	auto decodeNative = [&](size_t i)
+	{
+		DECODED_IMAGE image;
+		const C3dglMappedFile& file = files[i % files.size()];
+		decodeImage(file.data(), file.size(), IL_RGBA, image);
+	};
+	double tNative = measure([&]() { parallelFor(nTasks, decodeNative); });
+	double tSingle = measure([&]() { parallelFor(nTasks, decodeNative, 1); });
+	double tDevIL = measure([&]()
+		{
+			for (size_t i = 0; i < nTasks; i++)
+			{
+				C3dglBitmap bm;
+				const C3dglMappedFile& file = files[i % files.size()];
+				bm.loadDevIL(filenames[i % files.size()], IL_RGBA, file.data(), file.size());
+			}
+		});
+
+	C3dglLogger::log("** Benchmark of the image decoder: {} images, {:.2f} MB", nTasks, MB);
+	C3dglLogger::log("Native ({} threads): {:.1f} ms, {:.1f} MB/s, {:.0f} images/s", nThreads, tNative * 1000, MB / tNative, nTasks / tNative);
+	C3dglLogger::log("Native (1 thread): {:.1f} ms, {:.1f} MB/s, {:.0f} images/s", tSingle * 1000, MB / tSingle, nTasks / tSingle);
+	C3dglLogger::log("DevIL: {:.1f} ms, {:.1f} MB/s, {:.0f} images/s, speed-up: x{:.1f}", tDevIL * 1000, MB / tDevIL, nTasks / tDevIL, tDevIL / tNative);
+
+	return MB / tNative;
+}
@@ -0,0 +1,540 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cfloat>
+#include <3dgl/BlockCompress.h>
+#include "MappedFile.h"
+
+using namespace _3dgl;
+
+namespace
+{
+	// 4x4 block of pixels, row by row, channels in the 0..255 range
+	typedef glm::vec4 BLOCK[16];
+
+	// Least significant bit first bit stream, as used by all BCn formats
+	struct BITSTREAM
+	{
+		unsigned char* p;
+		unsigned pos = 0;
+
+		BITSTREAM(unsigned char* p) : p(p)	{ }
+		void put(unsigned value, unsigned nBits)
+		{
+			for (unsigned i = 0; i < nBits; i++, pos++)
+				if ((value >> i) & 1)
+					p[pos >> 3] |= 1 << (pos & 7);
+		}
+		unsigned get(unsigned nBits)
+		{
+			unsigned value = 0;
+			for (unsigned i = 0; i < nBits; i++, pos++)
+				value |= ((p[pos >> 3] >> (pos & 7)) & 1) << i;
+			return value;
+		}
+	};
+
+	// Fits a line through the pixels: the endpoints are the extremes along the principal axis.
+	// Only the first nChannels channels are considered.
+	void fitLine(const BLOCK block, int nChannels, glm::vec4& e0, glm::vec4& e1)
+	{
+		glm::vec4 mask = nChannels == 4 ? glm::vec4(1) : glm::vec4(1, 1, 1, 0);
+		glm::vec4 mean(0);
+		for (int i = 0; i < 16; i++)
+			mean += block[i] * mask;
+		mean /= 16.f;
+
+		glm::mat4 cov(0);
+		for (int i = 0; i < 16; i++)
+		{
+			glm::vec4 d = block[i] * mask - mean;
+			cov += glm::outerProduct(d, d);
+		}
+
+		// power iteration, starting from the column of the largest variance
+		int k = 0;
+		for (int i = 1; i < nChannels; i++)
+			if (cov[i][i] > cov[k][k]) k = i;
+		glm::vec4 axis = cov[k];
+		for (int iter = 0; iter < 8 && glm::length(axis) > 1e-6f; iter++)
+			axis = glm::normalize(cov * axis);
+		if (glm::length(axis) <= 1e-6f)
+		{
+			e0 = e1 = mean;		// flat block
+			return;
+		}
+
+		float tMin = FLT_MAX, tMax = -FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = glm::dot(block[i] * mask - mean, axis);
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+		e0 = glm::clamp(mean + axis * tMax, 0.0f, 255.0f);
+		e1 = glm::clamp(mean + axis * tMin, 0.0f, 255.0f);
+	}
+
+	// Least squares endpoints for the given interpolation weights of the pixels; false if the system is singular
+	bool refineLine(const BLOCK block, const float weights[16], glm::vec4& e0, glm::vec4& e1)
+	{
+		float a = 0, b = 0, c = 0;
+		glm::vec4 x(0), y(0);
+		for (int i = 0; i < 16; i++)
+		{
+			float t = weights[i];
+			a += (1 - t) * (1 - t);
+			b += t * (1 - t);
+			c += t * t;
+			x += (1 - t) * block[i];
+			y += t * block[i];
+		}
+		float det = a * c - b * b;
+		if (std::abs(det) < 1e-6f)
+			return false;
+		e0 = glm::clamp((c * x - b * y) / det, 0.0f, 255.0f);
+		e1 = glm::clamp((a * y - b * x) / det, 0.0f, 255.0f);
+		return true;
+	}
+
+	float distance2(glm::vec4 a, glm::vec4 b, int nChannels)
+	{
+		glm::vec4 d = a - b;
+		if (nChannels == 3) d.w = 0;
+		return glm::dot(d, d);
+	}
+
+	/*********************************************************************************
+	** BC1 - colour block (also used in BC3)
+	*/
+
+	unsigned to565(glm::vec4 c)
+	{
+		return ((unsigned)(c.r * 31 / 255 + 0.5f) << 11) | ((unsigned)(c.g * 63 / 255 + 0.5f) << 5) | (unsigned)(c.b * 31 / 255 + 0.5f);
+	}
+
+	glm::vec4 from565(unsigned c)
+	{
+		unsigned r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		return glm::vec4((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255);
+	}
+
+	void encodeBC1(const BLOCK block, unsigned char* pDest)
+	{
+		glm::vec4 e0, e1;
+		fitLine(block, 3, e0, e1);
+
+		float bestError = FLT_MAX;
+		for (int iter = 0; iter < 3; iter++)
+		{
+			unsigned c0 = to565(e0), c1 = to565(e1);
+			if (c0 < c1) std::swap(c0, c1);		// four colour mode requires c0 > c1
+
+			glm::vec4 palette[4] = { from565(c0), from565(c1) };
+			palette[2] = glm::floor((2.f * palette[0] + palette[1]) / 3.f + 0.5f);
+			palette[3] = glm::floor((palette[0] + 2.f * palette[1]) / 3.f + 0.5f);
+			int nColors = c0 == c1 ? 1 : 4;
+
+			unsigned indices = 0;
+			float weights[16], error = 0;
+			const float c_weights[4] = { 0, 1, 1.f / 3, 2.f / 3 };
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				float bestDist = FLT_MAX;
+				for (int j = 0; j < nColors; j++)
+				{
+					float dist = distance2(block[i], palette[j], 3);
+					if (dist < bestDist) { bestDist = dist; best = j; }
+				}
+				indices |= best << (2 * i);
+				weights[i] = c_weights[best];
+				error += bestDist;
+			}
+
+			if (error < bestError)
+			{
+				bestError = error;
+				pDest[0] = c0 & 0xff; pDest[1] = c0 >> 8;
+				pDest[2] = c1 & 0xff; pDest[3] = c1 >> 8;
+				memcpy(pDest + 4, &indices, 4);
+			}
+
+			// refined endpoints for the next iteration; palette[0] and [1] may have been swapped - so are the weights
+			if (nColors == 1 || !refineLine(block, weights, e0, e1))
+				break;
+		}
+	}
+
+	/*********************************************************************************
+	** BC4 - single channel block (used in BC3 for alpha and twice in BC5)
+	*/
+
+	void encodeBC4(const float values[16], unsigned char* pDest)
+	{
+		float vMin = 255, vMax = 0, vMinInner = 255, vMaxInner = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			vMin = std::min(vMin, values[i]);
+			vMax = std::max(vMax, values[i]);
+			if (values[i] > 0 && values[i] < 255)
+			{
+				vMinInner = std::min(vMinInner, values[i]);
+				vMaxInner = std::max(vMaxInner, values[i]);
+			}
+		}
+
+		// two candidates: eight interpolated values (a0 > a1), or six values plus exact 0 and 255 (a0 <= a1)
+		unsigned char best[8] = { 0 };
+		float bestError = FLT_MAX;
+		for (int mode = 0; mode < 2; mode++)
+		{
+			unsigned a0, a1;
+			float palette[8];
+			if (mode == 0)
+			{
+				a0 = (unsigned)(vMax + 0.5f);		// for a flat block a0 == a1, which is decoded as the other mode - but index 0 is still a0
+				a1 = (unsigned)(vMin + 0.5f);
+				palette[0] = (float)a0; palette[1] = (float)a1;
+				for (int i = 1; i < 7; i++)
+					palette[i + 1] = (float)(((7 - i) * a0 + i * a1 + 3) / 7);
+			}
+			else
+			{
+				if (vMinInner > vMaxInner) vMinInner = vMaxInner = 0;
+				a0 = (unsigned)(vMinInner + 0.5f);
+				a1 = (unsigned)(vMaxInner + 0.5f);
+				palette[0] = (float)a0; palette[1] = (float)a1;
+				for (int i = 1; i < 5; i++)
+					palette[i + 1] = (float)(((5 - i) * a0 + i * a1 + 2) / 5);
+				palette[6] = 0; palette[7] = 255;
+			}
+
+			unsigned char block[8] = { (unsigned char)a0, (unsigned char)a1 };
+			BITSTREAM bits(block + 2);
+			float error = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				int bestIndex = 0;
+				for (int j = 1; j < 8; j++)
+					if (std::abs(values[i] - palette[j]) < std::abs(values[i] - palette[bestIndex]))
+						bestIndex = j;
+				bits.put(bestIndex, 3);
+				error += (values[i] - palette[bestIndex]) * (values[i] - palette[bestIndex]);
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(best, block, 8);
+			}
+		}
+		memcpy(pDest, best, 8);
+	}
+
+	void encodeBC4(const BLOCK block, int channel, unsigned char* pDest)
+	{
+		float values[16];
+		for (int i = 0; i < 16; i++)
+			values[i] = block[i][channel];
+		encodeBC4(values, pDest);
+	}
+
+	/*********************************************************************************
+	** BC7 - mode 6 only: one subset, RGBA endpoints 7.7.7.7 with a unique p-bit each, 4-bit indices
+	*/
+
+	const unsigned c_bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// quantizes the endpoint to 7 bits per channel plus a p-bit shared by all channels
+	void quantizeBC7(glm::vec4 e, unsigned q[4], unsigned& pbit)
+	{
+		float bestError = FLT_MAX;
+		for (unsigned p = 0; p < 2; p++)
+		{
+			unsigned qp[4];
+			float error = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				qp[c] = (unsigned)std::clamp((int)((e[c] - p) / 2 + 0.5f), 0, 127);
+				float d = (float)(qp[c] * 2 + p) - e[c];
+				error += d * d;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				pbit = p;
+				std::copy(qp, qp + 4, q);
+			}
+		}
+	}
+
+	void writeBC7Mode6(const unsigned q[2][4], const unsigned pbits[2], const unsigned indices[16], unsigned char* pDest)
+	{
+		memset(pDest, 0, 16);
+		BITSTREAM bits(pDest);
+		bits.put(1 << 6, 7);		// mode 6
+		for (int c = 0; c < 4; c++)
+		{
+			bits.put(q[0][c], 7);
+			bits.put(q[1][c], 7);
+		}
+		bits.put(pbits[0], 1);
+		bits.put(pbits[1], 1);
+		bits.put(indices[0], 3);	// the anchor index has an implicit most significant bit of 0
+		for (int i = 1; i < 16; i++)
+			bits.put(indices[i], 4);
+	}
+
+	bool readBC7Mode6(const unsigned char* pSrc, unsigned q[2][4], unsigned pbits[2], unsigned indices[16])
+	{
+		if ((pSrc[0] & 0x7f) != 0x40)
+			return false;			// not mode 6
+		BITSTREAM bits(const_cast<unsigned char*>(pSrc));
+		bits.get(7);
+		for (int c = 0; c < 4; c++)
+		{
+			q[0][c] = bits.get(7);
+			q[1][c] = bits.get(7);
+		}
+		pbits[0] = bits.get(1);
+		pbits[1] = bits.get(1);
+		indices[0] = bits.get(3);
+		for (int i = 1; i < 16; i++)
+			indices[i] = bits.get(4);
+		return true;
+	}
+
+	// the anchor (first) index must be less than 8: swaps the endpoints and inverts the indices otherwise
+	void fixBC7Anchor(unsigned q[2][4], unsigned pbits[2], unsigned indices[16])
+	{
+		if (indices[0] < 8)
+			return;
+		std::swap(q[0], q[1]);
+		std::swap(pbits[0], pbits[1]);
+		for (int i = 0; i < 16; i++)
+			indices[i] = 15 - indices[i];
+	}
+
+	void encodeBC7(const BLOCK block, unsigned char* pDest)
+	{
+		glm::vec4 e0, e1;
+		fitLine(block, 4, e0, e1);
+
+		float bestError = FLT_MAX;
+		for (int iter = 0; iter < 3; iter++)
+		{
+			unsigned q[2][4], pbits[2];
+			quantizeBC7(e0, q[0], pbits[0]);
+			quantizeBC7(e1, q[1], pbits[1]);
+
+			glm::vec4 E0, E1;
+			for (int c = 0; c < 4; c++)
+			{
+				E0[c] = (float)(q[0][c] * 2 + pbits[0]);
+				E1[c] = (float)(q[1][c] * 2 + pbits[1]);
+			}
+			glm::vec4 palette[16];
+			for (int j = 0; j < 16; j++)
+				palette[j] = glm::floor(((64.f - c_bc7Weights[j]) * E0 + (float)c_bc7Weights[j] * E1 + 32.f) / 64.f);
+
+			unsigned indices[16];
+			float weights[16], error = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				unsigned best = 0;
+				float bestDist = FLT_MAX;
+				for (unsigned j = 0; j < 16; j++)
+				{
+					float dist = distance2(block[i], palette[j], 4);
+					if (dist < bestDist) { bestDist = dist; best = j; }
+				}
+				indices[i] = best;
+				weights[i] = c_bc7Weights[best] / 64.f;
+				error += bestDist;
+			}
+
+			if (error < bestError)
+			{
+				bestError = error;
+				fixBC7Anchor(q, pbits, indices);
+				writeBC7Mode6(q, pbits, indices, pDest);
+			}
+
+			if (!refineLine(block, weights, e0, e1))
+				break;
+		}
+	}
+
+	/*********************************************************************************
+	** Flipping - the rows of each block are reversed; only the first nRows rows are valid
+	*/
+
+	void flipBC1(unsigned char* p, unsigned nRows)
+	{
+		std::reverse(p + 4, p + 4 + nRows);
+	}
+
+	void flipBC4(unsigned char* p, unsigned nRows)
+	{
+		uint64_t bits = 0, flipped;
+		memcpy(&bits, p + 2, 6);
+		flipped = bits;
+		for (unsigned r = 0; r < nRows; r++)
+		{
+			uint64_t row = (bits >> (12 * (nRows - 1 - r))) & 0xfff;
+			flipped = (flipped & ~(0xfffull << (12 * r))) | (row << (12 * r));
+		}
+		memcpy(p + 2, &flipped, 6);
+	}
+
+	bool flipBC7(unsigned char* p, unsigned nRows)
+	{
+		unsigned q[2][4], pbits[2], indices[16];
+		if (!readBC7Mode6(p, q, pbits, indices))
+			return false;
+		unsigned flipped[16];
+		std::copy(indices, indices + 16, flipped);
+		for (unsigned r = 0; r < nRows; r++)
+			std::copy(indices + 4 * (nRows - 1 - r), indices + 4 * (nRows - r), flipped + 4 * r);
+		fixBC7Anchor(q, pbits, flipped);
+		writeBC7Mode6(q, pbits, flipped, p);
+		return true;
+	}
+}
+
+size_t _3dgl::getBlockSize(BC_FORMAT format)
+{
+	return format == BC1 ? 8 : 16;
+}
+
+size_t _3dgl::getCompressedSize(BC_FORMAT format, unsigned width, unsigned height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+GLenum _3dgl::getGLFormat(BC_FORMAT format)
+{
+	switch (format)
+	{
+	case BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BC5: return GL_COMPRESSED_RG_RGTC2;
+	case BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return 0;
+	}
+}
+
+void _3dgl::compressBlocks(BC_FORMAT format, unsigned width, unsigned height, const void* pRGBA, void* pDest, unsigned nThreads)
+{
+	unsigned nBlocksX = (width + 3) / 4, nBlocksY = (height + 3) / 4;
+	size_t blockSize = getBlockSize(format);
+	const unsigned char* pSrc = (const unsigned char*)pRGBA;
+
+	// each row of blocks is a separate task
+	parallelFor(nBlocksY, [&](size_t by)
+		{
+			for (unsigned bx = 0; bx < nBlocksX; bx++)
+			{
+				BLOCK block;
+				for (unsigned i = 0; i < 16; i++)
+				{
+					unsigned x = std::min(bx * 4 + i % 4, width - 1), y = std::min((unsigned)by * 4 + i / 4, height - 1);
+					const unsigned char* p = pSrc + ((size_t)y * width + x) * 4;
+					block[i] = glm::vec4(p[0], p[1], p[2], p[3]);
+				}
+
+				unsigned char* pBlock = (unsigned char*)pDest + (by * nBlocksX + bx) * blockSize;
+				switch (format)
+				{
+				case BC1: encodeBC1(block, pBlock); break;
+				case BC3: encodeBC4(block, 3, pBlock); encodeBC1(block, pBlock + 8); break;
+				case BC5: encodeBC4(block, 0, pBlock); encodeBC4(block, 1, pBlock + 8); break;
+				case BC7: encodeBC7(block, pBlock); break;
+				}
+			}
+		}, nThreads);
+}
+
+namespace
+{
+	enum FLIP_KIND { FLIP_NONE, FLIP_BC1, FLIP_BC3, FLIP_BC4, FLIP_BC5, FLIP_BC7 };
+
+	FLIP_KIND getFlipKind(GLenum glFormat)
+	{
+		switch (glFormat)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:	return FLIP_BC1;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:	return FLIP_BC3;
+		case GL_COMPRESSED_RED_RGTC1:					return FLIP_BC4;
+		case GL_COMPRESSED_RG_RGTC2:					return FLIP_BC5;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:		return FLIP_BC7;
+		default:										return FLIP_NONE;
+		}
+	}
+}
+
+bool _3dgl::canFlipBlocks(GLenum glFormat, unsigned width, unsigned height, const void* pSrc)
+{
+	FLIP_KIND kind = getFlipKind(glFormat);
+	if (kind == FLIP_NONE)
+		return false;
+
+	// the rows of a partial bottom block would have to move across the block boundaries
+	if (height > 4 && height % 4 != 0)
+		return false;
+
+	// BC7 blocks other than mode 6 are not supported
+	if (kind == FLIP_BC7)
+	{
+		size_t nBlocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+		for (size_t i = 0; i < nBlocks; i++)
+			if ((((const unsigned char*)pSrc)[i * 16] & 0x7f) != 0x40)
+				return false;
+	}
+	return true;
+}
+
+bool _3dgl::flipBlocks(GLenum glFormat, unsigned width, unsigned height, const void* pSrc, void* pDest)
+{
+	FLIP_KIND kind = getFlipKind(glFormat);
+	size_t blockSize = (kind == FLIP_BC1 || kind == FLIP_BC4) ? 8 : 16;
+	unsigned nBlocksX = (width + 3) / 4, nBlocksY = (height + 3) / 4;
+	unsigned nRows = std::min(height, 4u);		// images lower than a block use only some of its rows
+	size_t rowSize = nBlocksX * blockSize;
+
+	// if the image cannot be flipped, it is left unflipped rather than scrambled
+	if (!canFlipBlocks(glFormat, width, height, pSrc))
+	{
+		if (kind != FLIP_NONE)
+			memcpy(pDest, pSrc, nBlocksY * rowSize);
+		return false;
+	}
+
+	for (unsigned by = 0; by < nBlocksY; by++)
+	{
+		unsigned char* pRow = (unsigned char*)pDest + (nBlocksY - 1 - by) * rowSize;
+		memcpy(pRow, (const unsigned char*)pSrc + by * rowSize, rowSize);
+		for (unsigned char* p = pRow; p < pRow + rowSize; p += blockSize)
+			switch (kind)
+			{
+			case FLIP_BC1: flipBC1(p, nRows); break;
+			case FLIP_BC3: flipBC4(p, nRows); flipBC1(p + 8, nRows); break;
+			case FLIP_BC4: flipBC4(p, nRows); break;
+			case FLIP_BC5: flipBC4(p, nRows); flipBC4(p + 8, nRows); break;
+			case FLIP_BC7: flipBC7(p, nRows); break;
+			default: break;
+			}
+	}
+	return true;
+}
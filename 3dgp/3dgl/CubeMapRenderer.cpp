@@ -0,0 +1,568 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/CubeMapRenderer.h>
+#include <3dgl/Shader.h>
+#include <3dgl/Texture.h>
+#include <3dgl/MemoryTracker.h>
+
+// GLM include files
+#include "../glm/gtc/matrix_transform.hpp"
+
+// standard libraries
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+using namespace _3dgl;
+
+namespace
+{
+	// directions and up vectors of the faces, as expected by OpenGL cube map sampling
+	const glm::vec3 c_faces[6][2] =
+	{
+		{ {  1,  0,  0 }, { 0, -1,  0 } },		// positive x
+		{ { -1,  0,  0 }, { 0, -1,  0 } },		// negative x
+		{ {  0,  1,  0 }, { 0,  0,  1 } },		// positive y
+		{ {  0, -1,  0 }, { 0,  0, -1 } },		// negative y
+		{ {  0,  0,  1 }, { 0, -1,  0 } },		// positive z
+		{ {  0,  0, -1 }, { 0, -1,  0 } },		// negative z
+	};
+
+	// Side planes of the face frustums, all through the centre; each separates two neighbouring faces.
+	// The face frustums are built of them: +n means dot(n, v) >= 0 inside, -n means dot(n, v) <= 0 inside
+	const glm::vec3 c_planes[6] = { { 1, 1, 0 }, { 1, -1, 0 }, { 1, 0, 1 }, { 1, 0, -1 }, { 0, 1, 1 }, { 0, 1, -1 } };
+	const int c_facePlanes[6][4] =		// 1-based indices of c_planes, negative for -n
+	{
+		{  1,  2,  3,  4 },		// positive x
+		{ -2, -1, -4, -3 },		// negative x
+		{  1, -2,  5,  6 },		// positive y
+		{  2, -1, -6, -5 },		// negative y
+		{  3, -4,  5, -6 },		// positive z
+		{  4, -3,  6, -5 },		// negative z
+	};
+
+	// Cube map file header; the levels follow, in order, each with all six faces
+	struct CUBEFILE_HEADER
+	{
+		char magic[8];				// "3DGLCUB"
+		uint32_t version;
+		uint32_t size, levels;
+	};
+	const uint32_t c_cubeFileVersion = 1;
+
+	double getTime()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+C3dglCubeMapRenderer::C3dglCubeMapRenderer() : C3dglObject()
+{
+	m_idFBO = m_idCubeMap = m_idDepth = m_idReference = 0;
+	m_size = m_levels = 0;
+	m_near = 0.02f;
+	m_far = 1000.0f;
+	m_bChangeDriven = false;
+	m_facesPerFrame = 6;
+	m_timeBudget = 0;
+	m_radius = 0;
+	m_position = glm::vec3(0);
+	std::fill_n(m_dirty, 6, true);
+	std::fill_n(m_age, 6, 0);
+	std::fill_n(m_idQueries, 6, 0);
+	std::fill_n(m_pending, 6, false);
+	m_faceCost = 0;
+	m_nFaces = 0;
+	m_nWindowFaces = 0;
+	m_windowStart = getTime();
+	m_facesPerSecond = 0;
+	m_error = -1;
+	m_nBinned = 0;
+	std::fill_n(m_nVisible, 6, 0);
+	m_nTested = m_nCulled = 0;
+}
+
+bool C3dglCubeMapRenderer::create(unsigned size, bool bMipmaps, float nearPlane, float farPlane)
+{
+	destroy();
+	m_size = size;
+	m_levels = bMipmaps ? C3dglTexture::getLevelCount(size, size) : 1;
+	m_near = nearPlane;
+	m_far = farPlane;
+	if (m_radius == 0)
+		m_radius = farPlane;
+	invalidate();
+
+	// preserve the currently bound texture and framebuffer
+	GLuint prevTex, prevFBO;
+	glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, (GLint*)&prevTex);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*)&prevFBO);
+
+	// immutable storage where available - the faces are never reallocated
+	bool bStorage = GLEW_ARB_texture_storage;
+	glGenTextures(1, &m_idCubeMap);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+	if (bStorage)
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, m_levels, GL_RGBA8, size, size);
+	else
+		for (unsigned face = 0; face < 6; face++)
+			for (unsigned level = 0; level < m_levels; level++)
+			{
+				GLsizei w = std::max(1u, size >> level);
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA8, w, w, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, m_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &m_idDepth);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_idDepth);
+	if (bStorage)
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_DEPTH_COMPONENT24, size, size);
+	else
+		for (unsigned face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, prevTex);
+
+	glGenFramebuffers(1, &m_idFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, m_idCubeMap, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X, m_idDepth, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		log(M3DGL_ERROR_FRAMEBUFFER, status);
+		destroy();
+		return false;
+	}
+
+	C3dglMemoryTracker::getInstance().add(MEM_CUBE_MAP, m_idCubeMap, C3dglMemoryTracker::getTextureSize(GL_RGBA8, size, size, m_levels, 6), GL_RGBA8, getName());
+	C3dglMemoryTracker::getInstance().add(MEM_CUBE_MAP, m_idDepth, C3dglMemoryTracker::getTextureSize(GL_DEPTH_COMPONENT24, size, size, 1, 6), GL_DEPTH_COMPONENT24, getName());
+
+	glGenQueries(6, m_idQueries);
+	return true;
+}
+
+void C3dglCubeMapRenderer::destroy()
+{
+	if (m_idFBO)
+		glDeleteFramebuffers(1, &m_idFBO);
+	for (GLuint* pId : { &m_idCubeMap, &m_idDepth, &m_idReference })
+		if (*pId)
+		{
+			C3dglMemoryTracker::getInstance().remove(MEM_CUBE_MAP, *pId);
+			glDeleteTextures(1, pId);
+		}
+	if (m_idQueries[0])
+		glDeleteQueries(6, m_idQueries);
+	m_idFBO = m_idCubeMap = m_idDepth = m_idReference = 0;
+	m_size = m_levels = 0;
+	std::fill_n(m_idQueries, 6, 0);
+	std::fill_n(m_pending, 6, false);
+}
+
+void C3dglCubeMapRenderer::begin(GLint& prevFBO, GLint viewport[4]) const
+{
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO);
+	glViewport(0, 0, m_size, m_size);
+}
+
+void C3dglCubeMapRenderer::end(GLint prevFBO, const GLint viewport[4]) const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void C3dglCubeMapRenderer::generateMipmap() const
+{
+	// blurred versions of the environment, for rough reflections
+	if (m_levels > 1)
+	{
+		GLuint prevTex;
+		glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, (GLint*)&prevTex);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, prevTex);
+	}
+}
+
+void C3dglCubeMapRenderer::invalidate()
+{
+	std::fill_n(m_dirty, 6, true);
+}
+
+void C3dglCubeMapRenderer::invalidate(glm::vec3 center, float radius)
+{
+	glm::vec3 v = center - m_position;
+	if (glm::length(v) - radius > m_radius)
+		return;
+
+	// the face sees the sphere unless it is entirely behind one of the four side planes of its frustum
+	for (unsigned face = 0; face < 6; face++)
+	{
+		glm::vec3 dir = c_faces[face][0], up = c_faces[face][1], side = glm::cross(dir, up);
+		bool bVisible = true;
+		for (glm::vec3 s : { up, -up, side, -side })
+			if (glm::dot(v, dir - s) < -radius * 1.41421356f)
+				bVisible = false;
+		if (bVisible)
+			m_dirty[face] = true;
+	}
+}
+
+void C3dglCubeMapRenderer::collectQueries()
+{
+	for (unsigned face = 0; face < 6; face++)
+		if (m_pending[face])
+		{
+			GLint bAvailable = 0;
+			glGetQueryObjectiv(m_idQueries[face], GL_QUERY_RESULT_AVAILABLE, &bAvailable);
+			if (!bAvailable)
+				continue;
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(m_idQueries[face], GL_QUERY_RESULT, &ns);
+			m_pending[face] = false;
+			float ms = ns / 1000000.0f;
+			m_faceCost = m_faceCost == 0 ? ms : 0.9f * m_faceCost + 0.1f * ms;
+		}
+}
+
+void C3dglCubeMapRenderer::beginFrame(glm::vec3 position)
+{
+	if (position != m_position)
+	{
+		m_position = position;
+		invalidate();
+	}
+	if (!m_bChangeDriven)
+		invalidate();
+	for (unsigned face = 0; face < 6; face++)
+		m_age[face]++;
+}
+
+void C3dglCubeMapRenderer::countFaces(unsigned n)
+{
+	m_nFaces += n;
+	m_nWindowFaces += n;
+	double t = getTime();
+	if (t - m_windowStart >= 1.0)
+	{
+		m_facesPerSecond = (float)(m_nWindowFaces / (t - m_windowStart));
+		m_nWindowFaces = 0;
+		m_windowStart = t;
+	}
+}
+
+unsigned C3dglCubeMapRenderer::render(glm::vec3 position, std::function<void(unsigned face, glm::mat4 matrixView, glm::mat4 matrixProjection)> render)
+{
+	if (!m_idFBO)
+		return 0;
+
+	collectQueries();
+	beginFrame(position);
+
+	// the stale faces, stalest first; as many as the limits allow
+	std::vector<unsigned> faces;
+	for (unsigned face = 0; face < 6; face++)
+		if (m_dirty[face])
+			faces.push_back(face);
+	std::stable_sort(faces.begin(), faces.end(), [this](unsigned a, unsigned b) { return m_age[a] > m_age[b]; });
+	size_t n = std::min<size_t>(faces.size(), m_facesPerFrame);
+	if (m_timeBudget > 0 && m_faceCost > 0)
+		n = std::min<size_t>(n, std::max(1, (int)(m_timeBudget / m_faceCost)));
+	faces.resize(n);
+
+	if (faces.empty())
+	{
+		countFaces(0);
+		return 0;
+	}
+
+	GLint prevFBO, viewport[4];
+	begin(prevFBO, viewport);
+	glm::mat4 translation = glm::translate(glm::mat4(1), -position);
+	for (unsigned face : faces)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_idCubeMap, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_idDepth, 0);
+
+		// a face still waiting for the previous result is not timed
+		bool bTimed = !m_pending[face];
+		if (bTimed)
+			glBeginQuery(GL_TIME_ELAPSED, m_idQueries[face]);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		render(face, getFaceRotation(face) * translation, getProjection());
+		if (bTimed)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			m_pending[face] = true;
+		}
+
+		m_dirty[face] = false;
+		m_age[face] = 0;
+	}
+	end(prevFBO, viewport);
+	generateMipmap();
+
+	countFaces((unsigned)faces.size());
+	return (unsigned)faces.size();
+}
+
+bool C3dglCubeMapRenderer::renderLayered(glm::vec3 position, C3dglProgram* pProgram, std::function<void(glm::mat4 matrixView, glm::mat4 matrixProjection)> render)
+{
+	if (!m_idFBO || !pProgram || pProgram->getUniformLocation("matrixCubeFaces") == -1)
+		return false;
+
+	beginFrame(position);
+	if (std::none_of(m_dirty, m_dirty + 6, [](bool b) { return b; }))
+	{
+		countFaces(0);
+		return true;
+	}
+
+	glm::mat4 faces[6];
+	for (unsigned face = 0; face < 6; face++)
+		faces[face] = getProjection() * getFaceRotation(face);
+	pProgram->sendUniform("matrixCubeFaces", faces, 6);
+	pProgram->sendUniform("cubeFaces", 6);
+
+	// the whole cube map attached: gl_Layer selects the face
+	GLint prevFBO, viewport[4];
+	begin(prevFBO, viewport);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_idCubeMap, 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_idDepth, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	render(glm::translate(glm::mat4(1), -position), glm::mat4(1));
+	end(prevFBO, viewport);
+	generateMipmap();
+
+	pProgram->sendUniform("cubeFaces", 0);
+	std::fill_n(m_dirty, 6, false);
+	std::fill_n(m_age, 6, 0);
+	countFaces(6);
+	return true;
+}
+
+glm::mat4 C3dglCubeMapRenderer::getFaceRotation(unsigned face)
+{
+	return glm::lookAt(glm::vec3(0), c_faces[face][0], c_faces[face][1]);
+}
+
+glm::mat4 C3dglCubeMapRenderer::getProjection() const
+{
+	return glm::perspective(glm::radians(90.0f), 1.0f, m_near, m_far);
+}
+
+void C3dglCubeMapRenderer::bind(GLenum texUnit) const
+{
+	glActiveTexture(texUnit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+}
+
+unsigned C3dglCubeMapRenderer::getFaceMask(glm::vec3 position, const glm::vec3 aabb[2]) const
+{
+	glm::vec3 lo = aabb[0] - position, hi = aabb[1] - position;
+
+	// extent of the box across each of the side planes - shared by the neighbouring faces
+	float minDot[6], maxDot[6];
+	for (unsigned i = 0; i < 6; i++)
+	{
+		glm::vec3 a = c_planes[i] * lo, b = c_planes[i] * hi;
+		glm::vec3 mn = glm::min(a, b), mx = glm::max(a, b);
+		minDot[i] = mn.x + mn.y + mn.z;
+		maxDot[i] = mx.x + mx.y + mx.z;
+	}
+
+	unsigned mask = 0;
+	for (unsigned face = 0; face < 6; face++)
+	{
+		bool bVisible = true;
+		for (int plane : c_facePlanes[face])
+			if (plane > 0 ? maxDot[plane - 1] < 0 : minDot[-plane - 1] > 0)
+				bVisible = false;
+
+		// the far plane
+		unsigned axis = face / 2;
+		float nearest = (face & 1) ? -hi[axis] : lo[axis];
+		if (nearest > m_far)
+			bVisible = false;
+
+		if (bVisible)
+			mask |= 1 << face;
+	}
+	return mask;
+}
+
+void C3dglCubeMapRenderer::bin(glm::vec3 position, const std::vector<std::pair<glm::vec3, glm::vec3>>& aabbs, std::vector<unsigned> faces[6])
+{
+	for (unsigned face = 0; face < 6; face++)
+		faces[face].clear();
+	for (unsigned i = 0; i < aabbs.size(); i++)
+	{
+		glm::vec3 aabb[2] = { aabbs[i].first, aabbs[i].second };
+		unsigned mask = getFaceMask(position, aabb);
+		for (unsigned face = 0; face < 6; face++)
+			if (mask & (1 << face))
+				faces[face].push_back(i);
+	}
+
+	m_nBinned = (unsigned)aabbs.size();
+	for (unsigned face = 0; face < 6; face++)
+	{
+		m_nVisible[face] = (unsigned)faces[face].size();
+		m_nCulled += m_nBinned - m_nVisible[face];
+	}
+	m_nTested += 6 * m_nBinned;
+}
+
+float C3dglCubeMapRenderer::measureError(std::function<void(unsigned face, glm::mat4 matrixView, glm::mat4 matrixProjection)> render)
+{
+	if (!m_idFBO)
+		return -1;
+
+	GLuint prevTex;
+	glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, (GLint*)&prevTex);
+	if (!m_idReference)
+	{
+		glGenTextures(1, &m_idReference);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, m_idReference);
+		for (unsigned face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, m_size, m_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+		C3dglMemoryTracker::getInstance().add(MEM_CUBE_MAP, m_idReference, C3dglMemoryTracker::getTextureSize(GL_RGBA8, m_size, m_size, 1, 6), GL_RGBA8, getName());
+	}
+
+	// fresh render of all faces, from where the cube map was last updated
+	GLint prevFBO, viewport[4];
+	begin(prevFBO, viewport);
+	glm::mat4 translation = glm::translate(glm::mat4(1), -m_position);
+	for (unsigned face = 0; face < 6; face++)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_idReference, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_idDepth, 0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		render(face, getFaceRotation(face) * translation, getProjection());
+	}
+	end(prevFBO, viewport);
+
+	// RMS difference of the RGB channels
+	std::vector<GLubyte> current((size_t)m_size * m_size * 4), reference(current.size());
+	double sum = 0;
+	for (unsigned face = 0; face < 6; face++)
+	{
+		glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+		glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, GL_UNSIGNED_BYTE, current.data());
+		glBindTexture(GL_TEXTURE_CUBE_MAP, m_idReference);
+		glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, GL_UNSIGNED_BYTE, reference.data());
+		for (size_t i = 0; i < current.size(); i++)
+			if (i % 4 != 3)
+			{
+				double d = (current[i] - reference[i]) / 255.0;
+				sum += d * d;
+			}
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, prevTex);
+
+	m_error = (float)sqrt(sum / ((double)m_size * m_size * 3 * 6));
+	return m_error;
+}
+
+bool C3dglCubeMapRenderer::save(std::string filename) const
+{
+	if (!m_idCubeMap)
+		return false;
+
+	std::error_code ec;
+	std::filesystem::path path(filename);
+	if (path.has_parent_path())
+		std::filesystem::create_directories(path.parent_path(), ec);
+	std::ofstream file(filename, std::ios::binary);
+	CUBEFILE_HEADER header = { "3DGLCUB", c_cubeFileVersion, m_size, m_levels };
+	file.write((char*)&header, sizeof(header));
+
+	GLuint prevTex;
+	glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, (GLint*)&prevTex);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+	std::vector<GLubyte> data;
+	for (unsigned level = 0; level < m_levels; level++)
+		for (unsigned face = 0; face < 6; face++)
+		{
+			unsigned w = std::max(1u, m_size >> level);
+			data.resize((size_t)w * w * 4);
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+			file.write((char*)data.data(), data.size());
+		}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, prevTex);
+
+	if (!file)
+		return log(M3DGL_WARNING_CANNOT_CACHE, filename);
+	return true;
+}
+
+bool C3dglCubeMapRenderer::load(std::string filename)
+{
+	CUBEFILE_HEADER header;
+	std::ifstream file(filename, std::ios::binary);
+	if (!m_idCubeMap || !file || !file.read((char*)&header, sizeof(header))
+		|| strcmp(header.magic, "3DGLCUB") != 0 || header.version != c_cubeFileVersion
+		|| header.size != m_size || header.levels != m_levels)
+		return false;		// missing or does not match
+
+	// read all before uploading anything - a truncated file leaves the cube map intact
+	std::vector<std::vector<GLubyte>> data(m_levels * 6);
+	for (unsigned level = 0; level < m_levels; level++)
+		for (unsigned face = 0; face < 6; face++)
+		{
+			unsigned w = std::max(1u, m_size >> level);
+			data[level * 6 + face].resize((size_t)w * w * 4);
+			if (!file.read((char*)data[level * 6 + face].data(), data[level * 6 + face].size()))
+				return false;
+		}
+
+	GLuint prevTex;
+	glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, (GLint*)&prevTex);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+	for (unsigned level = 0; level < m_levels; level++)
+		for (unsigned face = 0; face < 6; face++)
+		{
+			unsigned w = std::max(1u, m_size >> level);
+			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, w, w, GL_RGBA, GL_UNSIGNED_BYTE, data[level * 6 + face].data());
+		}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, prevTex);
+
+	std::fill_n(m_dirty, 6, false);
+	std::fill_n(m_age, 6, 0);
+	return log(M3DGL_SUCCESS_LOADED_FROM_CACHE, filename);
+}
+
+unsigned C3dglCubeMapRenderer::getMaxAge() const
+{
+	return *std::max_element(m_age, m_age + 6);
+}
+
+void C3dglCubeMapRenderer::stats() const
+{
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Size: {}x{}, {} levels, Policy: {}, {} faces per frame, Time budget: {}", m_size, m_size, m_levels,
+		m_bChangeDriven ? std::format("change driven within {}", m_radius) : std::string("continuous"), m_facesPerFrame,
+		m_timeBudget > 0 ? std::format("{:.2f} ms", m_timeBudget) : std::string("none"));
+	C3dglLogger::log("Faces updated: {}, {:.1f} per second, {:.3f} ms per face; the stalest face is {} frames old", m_nFaces, m_facesPerSecond, m_faceCost, getMaxAge());
+	if (m_error >= 0)
+		C3dglLogger::log("Visual error (RMS): {:.4f}", m_error);
+	if (m_nTested)
+		C3dglLogger::log("Culling: {} objects binned, seen by the faces: +X {}, -X {}, +Y {}, -Y {}, +Z {}, -Z {}; {:.1f}% of object-face pairs culled in total",
+			m_nBinned, m_nVisible[0], m_nVisible[1], m_nVisible[2], m_nVisible[3], m_nVisible[4], m_nVisible[5], 100.0 * m_nCulled / m_nTested);
+}
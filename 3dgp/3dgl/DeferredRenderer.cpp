@@ -0,0 +1,334 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/DeferredRenderer.h>
+#include <3dgl/Shader.h>
+#include <3dgl/MemoryTracker.h>
+
+// standard libraries
+#include <algorithm>
+
+using namespace _3dgl;
+
+namespace
+{
+	// Icosahedron, scaled so that it encloses the unit sphere (its inscribed radius is 0.7947 of the circumscribed one)
+	const float c_phi = 1.618034f, c_scale = 1.0f / (0.794654f * 1.902113f);
+	const float c_volume[12][3] =
+	{
+		{ -c_scale,  c_phi * c_scale, 0 }, { c_scale,  c_phi * c_scale, 0 }, { -c_scale, -c_phi * c_scale, 0 }, { c_scale, -c_phi * c_scale, 0 },
+		{ 0, -c_scale,  c_phi * c_scale }, { 0, c_scale,  c_phi * c_scale }, { 0, -c_scale, -c_phi * c_scale }, { 0, c_scale, -c_phi * c_scale },
+		{ c_phi * c_scale, 0, -c_scale }, { c_phi * c_scale, 0, c_scale }, { -c_phi * c_scale, 0, -c_scale }, { -c_phi * c_scale, 0, c_scale },
+	};
+	const GLubyte c_volumeIndices[60] =		// counter-clockwise, seen from outside
+	{
+		0, 11, 5,	0, 5, 1,	0, 1, 7,	0, 7, 10,	0, 10, 11,
+		1, 5, 9,	5, 11, 4,	11, 10, 2,	10, 7, 6,	7, 1, 8,
+		3, 9, 4,	3, 4, 2,	3, 2, 6,	3, 6, 8,	3, 8, 9,
+		4, 9, 5,	2, 4, 11,	6, 2, 10,	8, 6, 7,	9, 8, 1,
+	};
+
+	// Light volume instance: view space position and radius, colour
+	struct INSTANCE
+	{
+		glm::vec4 position;
+		glm::vec4 color;
+	};
+}
+
+C3dglDeferredRenderer::C3dglDeferredRenderer() : C3dglObject()
+{
+	m_idFBO = m_idAlbedo = m_idNormal = m_idDepth = m_idLight = 0;
+	m_width = m_height = 0;
+	m_idVAO = m_idVolume = m_idVolumeIndices = m_idInstances = m_idEmptyVAO = 0;
+	m_instanceSize = 0;
+	m_prevFBO = 0;
+	std::fill_n(m_viewport, 4, 0);
+	std::fill_n(m_idQueries, 2, 0);
+	std::fill_n(m_pending, 2, false);
+	std::fill_n(m_time, 2, 0.0f);
+	m_nLights = 0;
+}
+
+bool C3dglDeferredRenderer::create(unsigned width, unsigned height)
+{
+	destroy();
+	m_width = std::max(1u, width);
+	m_height = std::max(1u, height);
+
+	// preserve the currently bound texture, buffers and framebuffer
+	GLuint prevTex, prevFBO, prevVAO, prevBuffer;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*)&prevTex);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*)&prevFBO);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, (GLint*)&prevBuffer);
+
+	auto createTexture = [&](GLenum internalFormat, GLenum format, GLenum type)
+	{
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, m_width, m_height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		C3dglMemoryTracker::getInstance().add(MEM_TEXTURE, id, C3dglMemoryTracker::getTextureSize(internalFormat, m_width, m_height), internalFormat, getName());
+		return id;
+	};
+	m_idAlbedo = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+	m_idNormal = createTexture(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV);
+	m_idDepth = createTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+	m_idLight = createTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+
+	glGenFramebuffers(1, &m_idFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_idAlbedo, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_idNormal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_idLight, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_idDepth, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		log(M3DGL_ERROR_FRAMEBUFFER, status);
+		destroy();
+		return false;
+	}
+
+	// light volume geometry; the instance attributes are set up in resolve - their locations depend on the program
+	glGenVertexArrays(1, &m_idVAO);
+	glGenVertexArrays(1, &m_idEmptyVAO);
+	glBindVertexArray(m_idVAO);
+	glGenBuffers(1, &m_idVolume);
+	glBindBuffer(GL_ARRAY_BUFFER, m_idVolume);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(c_volume), c_volume, GL_STATIC_DRAW);
+	glGenBuffers(1, &m_idVolumeIndices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idVolumeIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(c_volumeIndices), c_volumeIndices, GL_STATIC_DRAW);
+	glGenBuffers(1, &m_idInstances);
+	glBindVertexArray(prevVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, prevBuffer);
+	C3dglMemoryTracker::getInstance().add(MEM_VERTEX_BUFFER, m_idVolume, sizeof(c_volume), GL_FLOAT, getName());
+	C3dglMemoryTracker::getInstance().add(MEM_INDEX_BUFFER, m_idVolumeIndices, sizeof(c_volumeIndices), GL_UNSIGNED_BYTE, getName());
+
+	glGenQueries(2, m_idQueries);
+	return true;
+}
+
+void C3dglDeferredRenderer::destroy()
+{
+	if (m_idFBO)
+		glDeleteFramebuffers(1, &m_idFBO);
+	for (GLuint* pId : { &m_idAlbedo, &m_idNormal, &m_idDepth, &m_idLight })
+		if (*pId)
+		{
+			C3dglMemoryTracker::getInstance().remove(MEM_TEXTURE, *pId);
+			glDeleteTextures(1, pId);
+		}
+	if (m_idVAO)
+	{
+		C3dglMemoryTracker::getInstance().remove(MEM_VERTEX_BUFFER, m_idVolume);
+		C3dglMemoryTracker::getInstance().remove(MEM_INDEX_BUFFER, m_idVolumeIndices);
+		C3dglMemoryTracker::getInstance().remove(MEM_VERTEX_BUFFER, m_idInstances);
+		GLuint buffers[] = { m_idVolume, m_idVolumeIndices, m_idInstances };
+		glDeleteBuffers(3, buffers);
+		glDeleteVertexArrays(1, &m_idVAO);
+		glDeleteVertexArrays(1, &m_idEmptyVAO);
+	}
+	if (m_idQueries[0])
+		glDeleteQueries(2, m_idQueries);
+	m_idFBO = m_idAlbedo = m_idNormal = m_idDepth = m_idLight = 0;
+	m_idVAO = m_idVolume = m_idVolumeIndices = m_idInstances = m_idEmptyVAO = 0;
+	m_instanceSize = 0;
+	m_width = m_height = 0;
+	std::fill_n(m_idQueries, 2, 0);
+	std::fill_n(m_pending, 2, false);
+}
+
+void C3dglDeferredRenderer::collectQueries()
+{
+	for (unsigned i = 0; i < 2; i++)
+		if (m_pending[i])
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(m_idQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(m_idQueries[i], GL_QUERY_RESULT, &ns);
+				m_time[i] = ns / 1000000.0f;
+				m_pending[i] = false;
+			}
+		}
+}
+
+void C3dglDeferredRenderer::beginGeometry()
+{
+	if (!m_idFBO)
+		return;
+	collectQueries();
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_prevFBO);
+	glGetIntegerv(GL_VIEWPORT, m_viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO);
+	GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+	glViewport(0, 0, m_width, m_height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	if (!m_pending[0])
+		glBeginQuery(GL_TIME_ELAPSED, m_idQueries[0]);
+}
+
+void C3dglDeferredRenderer::endGeometry()
+{
+	if (!m_idFBO)
+		return;
+	if (!m_pending[0])
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_pending[0] = true;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, m_prevFBO);
+	glViewport(m_viewport[0], m_viewport[1], m_viewport[2], m_viewport[3]);
+}
+
+void C3dglDeferredRenderer::bind(GLenum texUnit) const
+{
+	GLuint textures[] = { m_idAlbedo, m_idNormal, m_idDepth };
+	for (unsigned i = 0; i < 3; i++)
+	{
+		glActiveTexture(texUnit + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+}
+
+void C3dglDeferredRenderer::resolve(C3dglProgram* pProgram, glm::mat4 matrixView, glm::mat4 matrixProjection, const std::vector<POINT_LIGHT>& lights, GLenum texUnit)
+{
+	if (!pProgram || !m_idFBO)
+		return;
+
+	// preserve the state changed below
+	GLint prevVAO, prevBuffer, prevTexUnit, prevDepthFunc, prevCullFace;
+	GLboolean prevDepthMask;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prevVAO);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevBuffer);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &prevTexUnit);
+	glGetIntegerv(GL_DEPTH_FUNC, &prevDepthFunc);
+	glGetIntegerv(GL_CULL_FACE_MODE, &prevCullFace);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &prevDepthMask);
+	GLboolean bDepthTest = glIsEnabled(GL_DEPTH_TEST), bBlend = glIsEnabled(GL_BLEND), bCullFace = glIsEnabled(GL_CULL_FACE);
+
+	// the light accumulation shares the depth buffer of the G-buffer, for the depth test of the light volumes
+	glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO);
+	glDrawBuffer(GL_COLOR_ATTACHMENT2);
+	glViewport(0, 0, m_width, m_height);
+	glClear(GL_COLOR_BUFFER_BIT);
+	if (!m_pending[1])
+		glBeginQuery(GL_TIME_ELAPSED, m_idQueries[1]);
+
+	bind(texUnit);
+	pProgram->sendUniform("gbufferAlbedo", (int)(texUnit - GL_TEXTURE0));
+	pProgram->sendUniform("gbufferNormal", (int)(texUnit + 1 - GL_TEXTURE0));
+	pProgram->sendUniform("gbufferDepth", (int)(texUnit + 2 - GL_TEXTURE0));
+	pProgram->sendUniform("matrixView", matrixView);
+	pProgram->sendUniform("matrixProjection", matrixProjection);
+	pProgram->sendUniform("matrixInvProjection", glm::inverse(matrixProjection));
+
+	// full-screen pass: a single triangle, generated by the vertex shader
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDepthMask(GL_FALSE);
+	pProgram->sendUniform("lightVolume", 0);
+	glBindVertexArray(m_idEmptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// light volumes: back faces, where the scene is in front of them, added
+	m_nLights = (unsigned)lights.size();
+	if (!lights.empty())
+	{
+		std::vector<INSTANCE> instances;
+		for (const POINT_LIGHT& light : lights)
+			instances.push_back({ glm::vec4(glm::vec3(matrixView * glm::vec4(light.position, 1)), light.radius), glm::vec4(light.color, 1) });
+		size_t size = instances.size() * sizeof(INSTANCE);
+
+		glBindVertexArray(m_idVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, m_idInstances);
+		glBufferData(GL_ARRAY_BUFFER, size, instances.data(), GL_STREAM_DRAW);
+		if (size != m_instanceSize)
+		{
+			m_instanceSize = size;
+			C3dglMemoryTracker::getInstance().add(MEM_VERTEX_BUFFER, m_idInstances, size, GL_FLOAT, getName());
+		}
+		GLint attrPosition = pProgram->getAttribLocation("aLightPosition"), attrColor = pProgram->getAttribLocation("aLightColor");
+		if (attrPosition != -1)
+		{
+			glEnableVertexAttribArray(attrPosition);
+			glVertexAttribPointer(attrPosition, 4, GL_FLOAT, GL_FALSE, sizeof(INSTANCE), (void*)offsetof(INSTANCE, position));
+			glVertexAttribDivisor(attrPosition, 1);
+		}
+		if (attrColor != -1)
+		{
+			glEnableVertexAttribArray(attrColor);
+			glVertexAttribPointer(attrColor, 3, GL_FLOAT, GL_FALSE, sizeof(INSTANCE), (void*)offsetof(INSTANCE, color));
+			glVertexAttribDivisor(attrColor, 1);
+		}
+		GLint attrVertex = pProgram->getAttribLocation(ATTR_VERTEX);
+		if (attrVertex != -1)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_idVolume);
+			glEnableVertexAttribArray(attrVertex);
+			glVertexAttribPointer(attrVertex, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		}
+
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_GEQUAL);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		pProgram->sendUniform("lightVolume", 1);
+		glDrawElementsInstanced(GL_TRIANGLES, 60, GL_UNSIGNED_BYTE, 0, (GLsizei)lights.size());
+		pProgram->sendUniform("lightVolume", 0);
+	}
+
+	if (!m_pending[1])
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_pending[1] = true;
+	}
+
+	// restore the state
+	glBindVertexArray(prevVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, prevBuffer);
+	glActiveTexture(prevTexUnit);
+	glDepthFunc(prevDepthFunc);
+	glCullFace(prevCullFace);
+	glDepthMask(prevDepthMask);
+	if (bDepthTest) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
+	if (bBlend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
+	if (bCullFace) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
+
+	// the lit image and the depth, to the framebuffer bound at beginGeometry
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_idFBO);
+	glReadBuffer(GL_COLOR_ATTACHMENT2);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_prevFBO);
+	glBlitFramebuffer(0, 0, m_width, m_height, m_viewport[0], m_viewport[1], m_viewport[0] + m_viewport[2], m_viewport[1] + m_viewport[3],
+		GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_prevFBO);
+	glViewport(m_viewport[0], m_viewport[1], m_viewport[2], m_viewport[3]);
+}
+
+void C3dglDeferredRenderer::stats() const
+{
+	size_t bytes = 0;
+	for (GLuint id : { m_idAlbedo, m_idNormal, m_idDepth })
+		bytes += C3dglMemoryTracker::getInstance().getSize(MEM_TEXTURE, id);
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("G-buffer: {}x{}, {} bytes per pixel ({:.1f} MB, plus {:.1f} MB of light accumulation)", m_width, m_height, getBytesPerPixel(),
+		bytes / 1048576.0, C3dglMemoryTracker::getInstance().getSize(MEM_TEXTURE, m_idLight) / 1048576.0);
+	C3dglLogger::log("Light volumes: {}; Geometry pass: {:.2f} ms, Lighting pass: {:.2f} ms", m_nLights, m_time[0], m_time[1]);
+}
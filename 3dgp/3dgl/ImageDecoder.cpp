@@ -0,0 +1,487 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include "ImageDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <wincodec.h>
+
+// DevIL include file - for the format constants only
+#undef _UNICODE
+#include <IL/il.h>
+
+using namespace _3dgl;
+
+namespace
+{
+	// Pixel layout: pixel size and offsets of the channels (-1 if the channel is absent)
+	struct LAYOUT
+	{
+		unsigned format, size;
+		int r, g, b, a;
+	};
+
+	const LAYOUT c_layouts[] =
+	{
+		{ IL_RGBA, 4, 0, 1, 2, 3 },
+		{ IL_BGRA, 4, 2, 1, 0, 3 },
+		{ IL_RGB, 3, 0, 1, 2, -1 },
+		{ IL_BGR, 3, 2, 1, 0, -1 },
+		{ IL_LUMINANCE, 1, 0, 0, 0, -1 },
+		{ IL_LUMINANCE_ALPHA, 2, 0, 0, 0, 1 },
+		{ IL_ALPHA, 1, -1, -1, -1, 0 },
+	};
+	const LAYOUT& c_layoutBGRA = c_layouts[1];
+	const LAYOUT& c_layoutBGR = c_layouts[3];
+	const LAYOUT& c_layoutGrey = c_layouts[4];
+	const LAYOUT c_layoutBGRX = { 0, 4, 2, 1, 0, -1 };		// 32-bit BMP without alpha
+
+	const LAYOUT* findLayout(unsigned format)
+	{
+		for (const LAYOUT& layout : c_layouts)
+			if (layout.format == format)
+				return &layout;
+		return NULL;
+	}
+
+	inline unsigned rd16(const unsigned char* p)	{ return p[0] | (p[1] << 8); }
+	inline unsigned rd32(const unsigned char* p)	{ return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24); }
+
+	void convertRow(const unsigned char* pSrc, const LAYOUT& src, unsigned char* pDest, const LAYOUT& dest, unsigned width)
+	{
+		if (&src == &dest)
+		{
+			memcpy(pDest, pSrc, (size_t)width * src.size);
+			return;
+		}
+		bool bLuma = dest.r >= 0 && dest.r == dest.g && src.r != src.g;	// colour to luminance
+		for (unsigned x = 0; x < width; x++, pSrc += src.size, pDest += dest.size)
+		{
+			if (bLuma)
+				pDest[dest.r] = (unsigned char)((54 * pSrc[src.r] + 183 * pSrc[src.g] + 19 * pSrc[src.b] + 128) >> 8);
+			else if (dest.r >= 0)
+			{
+				pDest[dest.r] = src.r >= 0 ? pSrc[src.r] : 255;
+				pDest[dest.g] = src.g >= 0 ? pSrc[src.g] : 255;
+				pDest[dest.b] = src.b >= 0 ? pSrc[src.b] : 255;
+			}
+			if (dest.a >= 0)
+				pDest[dest.a] = src.a >= 0 ? pSrc[src.a] : 255;
+		}
+	}
+
+	// Converts rows stored at pRows; if the source is already in the destination layout, bottom-up and packed, it is used in place
+	void convertImage(const unsigned char* pRows, size_t stride, bool bTopDown, const LAYOUT& src, const LAYOUT& dest, DECODED_IMAGE& image)
+	{
+		if (&src == &dest && !bTopDown && stride == (size_t)image.width * dest.size)
+		{
+			image.pBits = pRows;
+			return;
+		}
+		size_t destStride = (size_t)image.width * dest.size;
+		image.buffer.resize(destStride * image.height);
+		for (unsigned y = 0; y < image.height; y++)
+			convertRow(pRows + (bTopDown ? image.height - 1 - y : y) * stride, src, &image.buffer[y * destStride], dest, image.width);
+		image.pBits = image.buffer.data();
+	}
+
+	// If the image has been passed through from a temporary buffer, the buffer is taken over
+	void keepBuffer(std::vector<unsigned char>& tmp, DECODED_IMAGE& image)
+	{
+		if (image.pBits == tmp.data())
+		{
+			image.buffer.swap(tmp);
+			image.pBits = image.buffer.data();
+		}
+	}
+
+	// Expands palette indices (1, 4 or 8 bits); palette holds 256 BGRA entries
+	void expandPalette(const unsigned char* pRows, size_t stride, bool bTopDown, unsigned bpp, const unsigned char* pPaletteBGRA, const LAYOUT& dest, DECODED_IMAGE& image)
+	{
+		unsigned char palette[256 * 4];
+		convertRow(pPaletteBGRA, c_layoutBGRA, palette, dest, 256);
+
+		size_t destStride = (size_t)image.width * dest.size;
+		image.buffer.resize(destStride * image.height);
+		unsigned mask = (1 << bpp) - 1;
+		for (unsigned y = 0; y < image.height; y++)
+		{
+			const unsigned char* pSrc = pRows + (bTopDown ? image.height - 1 - y : y) * stride;
+			unsigned char* pDest = &image.buffer[y * destStride];
+			for (unsigned x = 0; x < image.width; x++, pDest += dest.size)
+			{
+				unsigned bit = x * bpp;
+				unsigned index = (pSrc[bit >> 3] >> (8 - bpp - (bit & 7))) & mask;
+				memcpy(pDest, palette + index * dest.size, dest.size);
+			}
+		}
+		image.pBits = image.buffer.data();
+	}
+
+	// Expands pixels defined by bit masks (16 or 32 bits) to BGRA
+	void expandBitfields(const unsigned char* pRows, size_t stride, bool bTopDown, unsigned bpp, const unsigned masks[4], const LAYOUT& dest, DECODED_IMAGE& image)
+	{
+		unsigned shift[4], max[4];
+		for (int c = 0; c < 4; c++)
+		{
+			shift[c] = 0;
+			if (masks[c])
+				while (((masks[c] >> shift[c]) & 1) == 0)
+					shift[c]++;
+			max[c] = masks[c] >> shift[c];
+		}
+
+		std::vector<unsigned char> bgra((size_t)image.width * image.height * 4);
+		for (unsigned y = 0; y < image.height; y++)
+		{
+			const unsigned char* pSrc = pRows + y * stride;
+			unsigned char* pDest = &bgra[(size_t)y * image.width * 4];
+			for (unsigned x = 0; x < image.width; x++, pSrc += bpp / 8)
+			{
+				unsigned pixel = bpp == 16 ? rd16(pSrc) : rd32(pSrc);
+				static const int order[4] = { 2, 1, 0, 3 };		// masks are R, G, B, A
+				for (int c = 0; c < 4; c++)
+					pDest[x * 4 + order[c]] = max[c] ? (unsigned char)(((pixel & masks[c]) >> shift[c]) * 255 / max[c]) : 255;
+			}
+		}
+		convertImage(bgra.data(), (size_t)image.width * 4, bTopDown, c_layoutBGRA, dest, image);
+		keepBuffer(bgra, image);
+	}
+
+	/*********************************************************************************
+	** BMP
+	*/
+
+	bool decodeBMP(const unsigned char* p, size_t size, const LAYOUT& dest, DECODED_IMAGE& image)
+	{
+		if (size < 26 || p[0] != 'B' || p[1] != 'M')
+			return false;
+		size_t offBits = rd32(p + 10);
+		unsigned headerSize = rd32(p + 14);
+		if (headerSize + 14 > size)
+			return false;
+
+		int width, height;
+		unsigned bpp, compression = 0, nColours = 0;
+		const unsigned char* h = p + 14;
+		if (headerSize == 12)					// BITMAPCOREHEADER
+		{
+			width = (short)rd16(h + 4);
+			height = (short)rd16(h + 6);
+			bpp = rd16(h + 10);
+		}
+		else if (headerSize >= 40)				// BITMAPINFOHEADER and later
+		{
+			width = (int)rd32(h + 4);
+			height = (int)rd32(h + 8);
+			bpp = rd16(h + 14);
+			compression = rd32(h + 16);
+			nColours = rd32(h + 32);
+		}
+		else
+			return false;
+
+		bool bTopDown = height < 0;
+		if (width <= 0 || height == 0 || width > 65536 || abs(height) > 65536)
+			return false;
+		image.width = width;
+		image.height = abs(height);
+
+		size_t stride = (((size_t)image.width * bpp + 31) / 32) * 4;
+		if (offBits > size || stride * image.height > size - offBits)
+			return false;
+		const unsigned char* pRows = p + offBits;
+
+		if (compression == 0 && (bpp == 1 || bpp == 4 || bpp == 8))		// BI_RGB, palette
+		{
+			unsigned entrySize = headerSize == 12 ? 3 : 4;
+			if (nColours == 0 || nColours > (1u << bpp))
+				nColours = 1 << bpp;
+			const unsigned char* pPal = h + headerSize;
+			if (pPal + (size_t)nColours * entrySize > p + size)
+				return false;
+			unsigned char palette[256 * 4] = { 0 };
+			for (unsigned i = 0; i < nColours; i++)
+			{
+				memcpy(palette + i * 4, pPal + i * entrySize, 3);
+				palette[i * 4 + 3] = 255;
+			}
+			expandPalette(pRows, stride, bTopDown, bpp, palette, dest, image);
+			return true;
+		}
+		if (compression == 0 && bpp == 24)
+		{
+			convertImage(pRows, stride, bTopDown, c_layoutBGR, dest, image);
+			return true;
+		}
+		if (compression == 0 && bpp == 32)
+		{
+			// the fourth byte is officially unused, but many applications store alpha there
+			bool bAlpha = false;
+			for (unsigned y = 0; y < image.height && !bAlpha; y++)
+				for (unsigned x = 0; x < image.width && !bAlpha; x++)
+					bAlpha = pRows[y * stride + x * 4 + 3] != 0;
+			convertImage(pRows, stride, bTopDown, bAlpha ? c_layoutBGRA : c_layoutBGRX, dest, image);
+			return true;
+		}
+		if ((compression == 0 && bpp == 16) || ((compression == 3 || compression == 6) && (bpp == 16 || bpp == 32)))
+		{
+			unsigned masks[4] = { 0x7c00, 0x03e0, 0x001f, 0 };	// default: 5-5-5
+			if (compression != 0)
+			{
+				// the masks follow the BITMAPINFOHEADER, or are a part of the later headers
+				const unsigned char* pMasks = h + 40;
+				unsigned nMasks = (compression == 6 || headerSize >= 56) ? 4 : 3;
+				if (pMasks + nMasks * 4 > p + size)
+					return false;
+				for (unsigned c = 0; c < nMasks; c++)
+					masks[c] = rd32(pMasks + c * 4);
+				if (nMasks == 3)
+					masks[3] = 0;
+			}
+			if (bpp == 32 && masks[0] == 0xff0000 && masks[1] == 0xff00 && masks[2] == 0xff)
+				convertImage(pRows, stride, bTopDown, masks[3] == 0xff000000 ? c_layoutBGRA : c_layoutBGRX, dest, image);
+			else
+				expandBitfields(pRows, stride, bTopDown, bpp, masks, dest, image);
+			return true;
+		}
+		return false;	// RLE and other compressions: left to WIC
+	}
+
+	/*********************************************************************************
+	** TGA
+	*/
+
+	bool decodeTGA(const unsigned char* p, size_t size, const LAYOUT& dest, DECODED_IMAGE& image)
+	{
+		if (size < 18)
+			return false;
+		unsigned idLength = p[0], colourMapType = p[1], imageType = p[2];
+		unsigned cmFirst = rd16(p + 3), cmLength = rd16(p + 5), cmEntrySize = p[7];
+		unsigned width = rd16(p + 12), height = rd16(p + 14), bpp = p[16], descriptor = p[17];
+
+		// TGA has no signature: the header must be consistent
+		bool bPalette = imageType == 1 || imageType == 9;
+		bool bRLE = imageType >= 9;
+		if (colourMapType > 1 || (imageType != 1 && imageType != 2 && imageType != 3 && imageType != 9 && imageType != 10 && imageType != 11))
+			return false;
+		if (width == 0 || height == 0 || (descriptor & 0xc0) != 0)
+			return false;
+		if (bPalette && (colourMapType != 1 || bpp != 8 || (cmEntrySize != 15 && cmEntrySize != 16 && cmEntrySize != 24 && cmEntrySize != 32)))
+			return false;
+		if (!bPalette && (imageType == 3 || imageType == 11) && bpp != 8)
+			return false;
+		if (!bPalette && (imageType == 2 || imageType == 10) && bpp != 15 && bpp != 16 && bpp != 24 && bpp != 32)
+			return false;
+		if (descriptor & 0x10)
+			return false;		// right-to-left: left to DevIL
+
+		size_t offset = 18 + idLength;
+		const unsigned char* pPal = p + offset;
+		unsigned cmBytes = (cmEntrySize + 7) / 8;
+		if (colourMapType)
+			offset += (size_t)cmLength * cmBytes;
+		if (offset > size)
+			return false;
+		image.width = width;
+		image.height = height;
+		bool bTopDown = (descriptor & 0x20) != 0;
+		unsigned pixelSize = (bpp + 7) / 8;
+		size_t stride = (size_t)width * pixelSize;
+
+		// RLE packets are expanded into raw pixels first
+		const unsigned char* pRows = p + offset;
+		std::vector<unsigned char> raw;
+		if (bRLE)
+		{
+			// a packet expands to at most 128 pixels: a corrupt header must not allocate more than that
+			if (stride * height > (size - offset) * 128)
+				return false;
+			raw.resize(stride * height);
+			const unsigned char* pSrc = pRows, *pEnd = p + size;
+			for (size_t i = 0; i < raw.size(); )
+			{
+				if (pSrc >= pEnd)
+					return false;
+				unsigned header = *pSrc++;
+				size_t count = std::min<size_t>((header & 0x7f) + 1, (raw.size() - i) / pixelSize);
+				if (header & 0x80)
+				{
+					if (pSrc + pixelSize > pEnd)
+						return false;
+					for (size_t j = 0; j < count; j++, i += pixelSize)
+						memcpy(&raw[i], pSrc, pixelSize);
+					pSrc += pixelSize;
+				}
+				else
+				{
+					if (pSrc + count * pixelSize > pEnd)
+						return false;
+					memcpy(&raw[i], pSrc, count * pixelSize);
+					pSrc += count * pixelSize;
+					i += count * pixelSize;
+				}
+			}
+			pRows = raw.data();
+		}
+		else if (stride * height > size - offset)
+			return false;
+
+		// 15 and 16-bit colours are stored as 1-5-5-5
+		auto read16 = [](const unsigned char* pSrc, unsigned char* pDest, bool bAlpha)
+		{
+			unsigned c = rd16(pSrc);
+			pDest[0] = (unsigned char)((c & 0x1f) * 255 / 31);
+			pDest[1] = (unsigned char)(((c >> 5) & 0x1f) * 255 / 31);
+			pDest[2] = (unsigned char)(((c >> 10) & 0x1f) * 255 / 31);
+			pDest[3] = (bAlpha && !(c & 0x8000)) ? 0 : 255;
+		};
+
+		if (bPalette)
+		{
+			unsigned char palette[256 * 4] = { 0 };
+			for (unsigned i = 0; i < cmLength && cmFirst + i < 256; i++)
+			{
+				unsigned char* pEntry = palette + (cmFirst + i) * 4;
+				const unsigned char* pSrc = pPal + i * cmBytes;
+				if (cmBytes == 2)
+					read16(pSrc, pEntry, false);
+				else
+				{
+					memcpy(pEntry, pSrc, 3);
+					pEntry[3] = cmBytes == 4 ? pSrc[3] : 255;
+				}
+			}
+			expandPalette(pRows, stride, bTopDown, 8, palette, dest, image);
+		}
+		else if (bpp == 15 || bpp == 16)
+		{
+			std::vector<unsigned char> bgra((size_t)width * height * 4);
+			for (size_t i = 0; i < (size_t)width * height; i++)
+				read16(pRows + i * 2, &bgra[i * 4], (descriptor & 0x0f) != 0);
+			convertImage(bgra.data(), (size_t)width * 4, bTopDown, c_layoutBGRA, dest, image);
+			keepBuffer(bgra, image);
+		}
+		else
+			convertImage(pRows, stride, bTopDown, bpp == 8 ? c_layoutGrey : bpp == 24 ? c_layoutBGR : c_layoutBGRA, dest, image);
+
+		keepBuffer(raw, image);		// raw pixels of an RLE image
+		return true;
+	}
+
+	/*********************************************************************************
+	** Windows Imaging Component: PNG, JPG and all the other formats supported by the system
+	*/
+
+	bool decodeWIC(const unsigned char* p, size_t size, const LAYOUT& dest, DECODED_IMAGE& image)
+	{
+		// each calling thread needs COM; if it is already initialised in another mode, the existing apartment is used
+		HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+		// WIC decodes directly into the requested layout where it can
+		const GUID* pTarget = &GUID_WICPixelFormat32bppRGBA;
+		switch (dest.format)
+		{
+		case IL_BGRA: pTarget = &GUID_WICPixelFormat32bppBGRA; break;
+		case IL_RGB: pTarget = &GUID_WICPixelFormat24bppRGB; break;
+		case IL_BGR: pTarget = &GUID_WICPixelFormat24bppBGR; break;
+		case IL_LUMINANCE: pTarget = &GUID_WICPixelFormat8bppGray; break;
+		}
+		const LAYOUT& target = *findLayout(pTarget == &GUID_WICPixelFormat32bppRGBA ? IL_RGBA : dest.format);
+
+		IWICImagingFactory* pFactory = NULL;
+		IWICStream* pStream = NULL;
+		IWICBitmapDecoder* pDecoder = NULL;
+		IWICBitmapFrameDecode* pFrame = NULL;
+		IWICFormatConverter* pConverter = NULL;
+		IWICBitmapSource* pSource = NULL;
+		UINT width = 0, height = 0;
+		WICPixelFormatGUID format;
+
+		HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&pFactory));
+		if (SUCCEEDED(hr)) hr = pFactory->CreateStream(&pStream);
+		if (SUCCEEDED(hr)) hr = pStream->InitializeFromMemory(const_cast<BYTE*>(p), (DWORD)size);
+		if (SUCCEEDED(hr)) hr = pFactory->CreateDecoderFromStream(pStream, NULL, WICDecodeMetadataCacheOnDemand, &pDecoder);
+		if (SUCCEEDED(hr)) hr = pDecoder->GetFrame(0, &pFrame);
+		if (SUCCEEDED(hr)) hr = pFrame->GetSize(&width, &height);
+		if (SUCCEEDED(hr)) hr = pFrame->GetPixelFormat(&format);
+		if (SUCCEEDED(hr))
+		{
+			if (IsEqualGUID(format, *pTarget))
+			{
+				pSource = pFrame;
+				pSource->AddRef();
+			}
+			else
+			{
+				hr = pFactory->CreateFormatConverter(&pConverter);
+				if (SUCCEEDED(hr)) hr = pConverter->Initialize(pFrame, *pTarget, WICBitmapDitherTypeNone, NULL, 0, WICBitmapPaletteTypeCustom);
+				if (SUCCEEDED(hr)) hr = pConverter->QueryInterface(IID_PPV_ARGS(&pSource));
+			}
+		}
+
+		std::vector<unsigned char> pixels;
+		size_t stride = (size_t)width * target.size;
+		if (SUCCEEDED(hr))
+		{
+			pixels.resize(stride * height);
+			hr = pSource->CopyPixels(NULL, (UINT)stride, (UINT)pixels.size(), pixels.data());
+		}
+
+		if (pSource) pSource->Release();
+		if (pConverter) pConverter->Release();
+		if (pFrame) pFrame->Release();
+		if (pDecoder) pDecoder->Release();
+		if (pStream) pStream->Release();
+		if (pFactory) pFactory->Release();
+		if (SUCCEEDED(hrCom))
+			CoUninitialize();
+
+		if (FAILED(hr) || width == 0 || height == 0)
+			return false;
+
+		image.width = width;
+		image.height = height;
+		if (&target == &dest)
+		{
+			// already in the requested layout: only the rows need reversing, in place
+			for (unsigned y = 0; y < height / 2; y++)
+				std::swap_ranges(&pixels[y * stride], &pixels[y * stride] + stride, &pixels[(height - 1 - y) * stride]);
+			image.buffer.swap(pixels);
+			image.pBits = image.buffer.data();
+		}
+		else
+			convertImage(pixels.data(), stride, true, target, dest, image);
+		return true;
+	}
+}
+
+bool _3dgl::decodeImage(const void* pData, size_t size, unsigned format, DECODED_IMAGE& image)
+{
+	const LAYOUT* pDest = findLayout(format);
+	if (!pData || !pDest)
+		return false;
+
+	const unsigned char* p = (const unsigned char*)pData;
+	image = DECODED_IMAGE();
+	if (decodeBMP(p, size, *pDest, image))
+		return true;
+	image = DECODED_IMAGE();
+	if (decodeTGA(p, size, *pDest, image))
+		return true;
+	image = DECODED_IMAGE();
+	return decodeWIC(p, size, *pDest, image);
+}
+
+unsigned _3dgl::getPixelSize(unsigned format)
+{
+	const LAYOUT* pLayout = findLayout(format);
+	return pLayout ? pLayout->size : 0;
+}
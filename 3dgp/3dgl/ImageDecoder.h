@@ -0,0 +1,37 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Internal helper: reentrant image decoder used by C3dglBitmap.
+BMP and TGA files are decoded natively, PNG and JPG (and anything else the
+system supports) through the Windows Imaging Component.
+Unlike DevIL, there is no global state: images may be decoded on many threads at once.
+Not a part of the public interface of the library.
+*********************************************************************************/
+#ifndef __3dglImageDecoder_h_
+#define __3dglImageDecoder_h_
+
+#include <vector>
+
+namespace _3dgl
+{
+	// Decoded image, 8 bits per channel, rows bottom-up and tightly packed
+	struct DECODED_IMAGE
+	{
+		unsigned width = 0, height = 0;
+		const unsigned char* pBits = NULL;		// points either to buffer or into the source data
+		std::vector<unsigned char> buffer;
+	};
+
+	// Decodes an image held in memory and converts it to format: IL_RGBA, IL_BGRA, IL_RGB, IL_BGR,
+	// IL_LUMINANCE, IL_LUMINANCE_ALPHA or IL_ALPHA (same values as the corresponding GL formats).
+	// If the source pixels are already stored in this format, image.pBits points into pData and nothing is copied,
+	// so pData must outlive the image. Returns false if the data is not recognised or corrupt.
+	bool decodeImage(const void* pData, size_t size, unsigned format, DECODED_IMAGE& image);
+
+	// Size of a pixel in the format, or 0 for unsupported formats
+	unsigned getPixelSize(unsigned format);
+}; // namespace _3dgl
+
+#endif // __3dglImageDecoder_h_
@@ -0,0 +1,272 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/LightAssigner.h>
+#include <3dgl/Shader.h>
+
+// standard libraries
+#include <chrono>
+#include <cfloat>
+#include <random>
+#include <algorithm>
+
+using namespace _3dgl;
+
+namespace
+{
+	// lights covering more cells than this are not hashed, but tested with every object
+	const unsigned c_maxCellsPerLight = 64;
+
+	// cell coordinates are offset by this to be packed into 21 bits each
+	const int c_keyBias = 1 << 20;
+
+	// how much a light affects a box: its brightness times its fall-off at the nearest point of the box (as in the shader);
+	// negative if out of range
+	float influence(const glm::vec4& light, float weight, const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		glm::vec3 d = glm::vec3(light) - glm::clamp(glm::vec3(light), boxMin, boxMax);
+		float r2 = light.w * light.w;
+		float d2 = glm::dot(d, d);
+		if (d2 >= r2)
+			return -1;
+		float att = 1 - d2 / r2;
+		return weight * att * att;
+	}
+
+	// the strongest first; equal ones by index, so that the order does not depend on the order of testing
+	bool stronger(const std::pair<float, int>& a, const std::pair<float, int>& b)
+	{
+		return a.first > b.first || (a.first == b.first && a.second < b.second);
+	}
+}
+
+C3dglLightAssigner::C3dglLightAssigner(float cellSize, unsigned maxLights) : C3dglObject()
+{
+	m_cellSize = cellSize;
+	m_maxLights = 0;
+	setMaxLights(maxLights);
+	m_stamp = 0;
+	m_nTests = m_nAssigned = m_nDropped = 0;
+	m_buildTime = m_assignTime = 0;
+}
+
+void C3dglLightAssigner::setMaxLights(unsigned maxLights)
+{
+	m_maxLights = std::min(std::max(maxLights, 1u), MAX_OBJECT_LIGHTS);
+	m_lists.clear();
+	m_counts.clear();
+}
+
+unsigned long long C3dglLightAssigner::getKey(glm::ivec3 cell) const
+{
+	glm::ivec3 c = glm::clamp(cell + c_keyBias, 0, 2 * c_keyBias - 1);
+	return ((unsigned long long)c.x << 42) | ((unsigned long long)c.y << 21) | (unsigned long long)c.z;
+}
+
+void C3dglLightAssigner::build(const std::vector<POINT_LIGHT>& lights)
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	m_lights.clear();
+	m_weights.clear();
+	m_cells.clear();
+	m_global.clear();
+	for (unsigned i = 0; i < lights.size(); i++)
+	{
+		const POINT_LIGHT& light = lights[i];
+		m_lights.push_back(glm::vec4(light.position, light.radius));
+		m_weights.push_back(glm::dot(light.color, glm::vec3(0.2126f, 0.7152f, 0.0722f)));
+
+		glm::ivec3 lo = glm::ivec3(glm::floor((light.position - light.radius) / m_cellSize));
+		glm::ivec3 hi = glm::ivec3(glm::floor((light.position + light.radius) / m_cellSize));
+		glm::ivec3 size = hi - lo + 1;
+		if ((size_t)size.x * size.y * size.z > c_maxCellsPerLight)
+		{
+			m_global.push_back(i);
+			continue;
+		}
+		for (int x = lo.x; x <= hi.x; x++)
+			for (int y = lo.y; y <= hi.y; y++)
+				for (int z = lo.z; z <= hi.z; z++)
+					m_cells.push_back(std::make_pair(getKey(glm::ivec3(x, y, z)), i));
+	}
+	std::sort(m_cells.begin(), m_cells.end());
+
+	m_stamps.assign(m_lights.size(), 0);
+	m_stamp = 0;
+
+	m_buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+unsigned C3dglLightAssigner::assign(const glm::vec3& boxMin, const glm::vec3& boxMax, int* indices)
+{
+	// a new stamp for each box - so that a light found in several cells is tested once
+	if (++m_stamp == 0)
+	{
+		std::fill(m_stamps.begin(), m_stamps.end(), 0);
+		m_stamp = 1;
+	}
+
+	m_candidates.clear();
+	if (glm::any(glm::greaterThan(boxMin, boxMax)))
+		return 0;		// empty box
+	auto test = [&](unsigned i)
+	{
+		if (m_stamps[i] == m_stamp)
+			return;
+		m_stamps[i] = m_stamp;
+		m_nTests++;
+		float f = influence(m_lights[i], m_weights[i], boxMin, boxMax);
+		if (f >= 0)
+			m_candidates.push_back(std::make_pair(f, (int)i));
+	};
+
+	glm::ivec3 lo = glm::ivec3(glm::floor(boxMin / m_cellSize));
+	glm::ivec3 hi = glm::ivec3(glm::floor(boxMax / m_cellSize));
+	glm::ivec3 size = hi - lo + 1;
+	if ((double)size.x * size.y * size.z > (double)m_cells.size())
+		// a box bigger than the whole grid: cheaper to test all the lights
+		for (unsigned i = 0; i < m_lights.size(); i++)
+			test(i);
+	else
+	{
+		// cells with the same x and y are consecutive in the key order: one search per column
+		for (int x = lo.x; x <= hi.x; x++)
+			for (int y = lo.y; y <= hi.y; y++)
+			{
+				unsigned long long last = getKey(glm::ivec3(x, y, hi.z));
+				auto it = std::lower_bound(m_cells.begin(), m_cells.end(), std::make_pair(getKey(glm::ivec3(x, y, lo.z)), 0u));
+				for (; it != m_cells.end() && it->first <= last; ++it)
+					test(it->second);
+			}
+		for (unsigned i : m_global)
+			test(i);
+	}
+
+	// the strongest lights
+	unsigned n = std::min((unsigned)m_candidates.size(), m_maxLights);
+	std::partial_sort(m_candidates.begin(), m_candidates.begin() + n, m_candidates.end(), stronger);
+	for (unsigned i = 0; i < n; i++)
+		indices[i] = m_candidates[i].second;
+	m_nAssigned += n;
+	m_nDropped += m_candidates.size() - n;
+	return n;
+}
+
+void C3dglLightAssigner::assign(const std::vector<std::pair<glm::vec3, glm::vec3>>& aabbs)
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	m_nTests = m_nAssigned = m_nDropped = 0;
+	m_counts.resize(aabbs.size());
+	m_lists.resize(aabbs.size() * m_maxLights);
+	for (size_t i = 0; i < aabbs.size(); i++)
+		m_counts[i] = assign(aabbs[i].first, aabbs[i].second, &m_lists[i * m_maxLights]);
+
+	m_assignTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+void C3dglLightAssigner::send(C3dglProgram* pProgram, unsigned object) const
+{
+	if (!pProgram)
+		return;
+	unsigned n = object < m_counts.size() ? m_counts[object] : 0;
+	if (n)
+	{
+		GLint indices[MAX_OBJECT_LIGHTS];
+		std::copy_n(getLights(object), n, indices);
+		pProgram->sendUniform("objectLights", indices, n);
+	}
+	pProgram->sendUniform("objectLightCount", (int)n);
+}
+
+void C3dglLightAssigner::stats() const
+{
+	size_t nObjects = m_counts.size();
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Lights: {} ({} hashed into {} cell entries of {:.2f}, {} tested with every object), Objects: {}",
+		m_lights.size(), m_lights.size() - m_global.size(), m_cells.size(), m_cellSize, m_global.size(), nObjects);
+	C3dglLogger::log("Box-sphere tests: {} ({:.1f} per object, {} for every pair), Lights assigned: {} ({:.1f} per object), Dropped over the limit of {}: {}",
+		m_nTests, nObjects ? (double)m_nTests / nObjects : 0.0, nObjects * m_lights.size(), m_nAssigned, nObjects ? (double)m_nAssigned / nObjects : 0.0,
+		m_maxLights, m_nDropped);
+	C3dglLogger::log("Hashed in {:.3f} ms, assigned in {:.3f} ms", m_buildTime, m_assignTime);
+}
+
+double C3dglLightAssigner::benchmark(unsigned nObjects, unsigned nLights, unsigned nRuns)
+{
+	nRuns = std::max(nRuns, 1u);
+
+	// objects of 0.2 - 2 units and lights of 0.5 - 2 units range, in a 100 x 20 x 100 area
+	std::mt19937 rnd(nObjects + nLights);
+	std::uniform_real_distribution<float> x(-50, 50), y(0, 20), size(0.2f, 2.0f), radius(0.5f, 2.0f), c(0.2f, 1.0f);
+	std::vector<std::pair<glm::vec3, glm::vec3>> aabbs;
+	for (unsigned i = 0; i < nObjects; i++)
+	{
+		glm::vec3 p(x(rnd), y(rnd), x(rnd));
+		aabbs.push_back(std::make_pair(p, p + glm::vec3(size(rnd), size(rnd), size(rnd))));
+	}
+	std::vector<POINT_LIGHT> lights;
+	for (unsigned i = 0; i < nLights; i++)
+		lights.push_back({ glm::vec3(x(rnd), y(rnd), x(rnd)), radius(rnd), glm::vec3(c(rnd), c(rnd), c(rnd)) });
+
+	// returns the best time of nRuns, in ms
+	auto measure = [nRuns](auto fn)
+	{
+		double best = DBL_MAX;
+		for (unsigned i = 0; i < nRuns; i++)
+		{
+			auto t0 = std::chrono::high_resolution_clock::now();
+			fn();
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+		}
+		return best;
+	};
+
+	// the grid - with the cell size about the light diameter
+	C3dglLightAssigner assigner(2.5f);
+	double tGrid = measure([&]()
+		{
+			assigner.build(lights);
+			assigner.assign(aabbs);
+		});
+
+	// every pair
+	std::vector<int> lists(nObjects * (size_t)MAX_OBJECT_LIGHTS);
+	std::vector<unsigned> counts(nObjects);
+	double tPairs = measure([&]()
+		{
+			std::vector<std::pair<float, int>> candidates;
+			for (unsigned i = 0; i < nObjects; i++)
+			{
+				candidates.clear();
+				for (unsigned j = 0; j < nLights; j++)
+				{
+					float f = influence(assigner.m_lights[j], assigner.m_weights[j], aabbs[i].first, aabbs[i].second);
+					if (f >= 0)
+						candidates.push_back(std::make_pair(f, (int)j));
+				}
+				counts[i] = std::min((unsigned)candidates.size(), MAX_OBJECT_LIGHTS);
+				std::partial_sort(candidates.begin(), candidates.begin() + counts[i], candidates.end(), stronger);
+				for (unsigned k = 0; k < counts[i]; k++)
+					lists[i * MAX_OBJECT_LIGHTS + k] = candidates[k].second;
+			}
+		});
+
+	unsigned nMismatches = 0;
+	for (unsigned i = 0; i < nObjects; i++)
+		if (counts[i] != assigner.getLightCount(i) || !std::equal(assigner.getLights(i), assigner.getLights(i) + counts[i], &lists[i * MAX_OBJECT_LIGHTS]))
+			nMismatches++;
+
+	C3dglLogger::log("** Benchmark of the light assignment: {} objects, {} lights", nObjects, nLights);
+	C3dglLogger::log("Grid: {:.3f} ms ({} tests), every pair: {:.3f} ms ({} tests), speed-up: x{:.1f}",
+		tGrid, assigner.getTestCount(), tPairs, (size_t)nObjects * nLights, tPairs / tGrid);
+	if (nMismatches)
+		C3dglLogger::log("Light lists differ for {} objects", nMismatches);
+	else
+		C3dglLogger::log("Light lists identical");
+
+	return tPairs / tGrid;
+}
@@ -0,0 +1,287 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/LightGrid.h>
+#include <3dgl/Shader.h>
+#include <3dgl/MemoryTracker.h>
+
+// standard libraries
+#include <chrono>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define LIGHTGRID_SSE2
+#endif
+
+using namespace _3dgl;
+
+namespace
+{
+	// formats of the texture buffers: lights, clusters, indices
+	const GLenum c_formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+}
+
+C3dglLightGrid::C3dglLightGrid() : C3dglObject()
+{
+	m_tilesX = m_tilesY = m_slices = 0;
+	m_near = 0.02f;
+	m_far = 1000.0f;
+	m_width = m_height = 0;
+	m_projection = glm::mat4(1);
+	std::fill_n(m_idBuffers, 3, 0);
+	std::fill_n(m_idTextures, 3, 0);
+	std::fill_n(m_bufferSizes, 3, 0);
+	m_nLights = m_nNonEmpty = m_maxPerCluster = 0;
+	m_buildTime = 0;
+}
+
+bool C3dglLightGrid::create(unsigned tilesX, unsigned tilesY, unsigned slices)
+{
+	destroy();
+	m_tilesX = std::max(1u, tilesX);
+	m_tilesY = std::max(1u, tilesY);
+	m_slices = std::max(1u, slices);
+	m_lists.resize(getClusterCount());
+
+	glGenBuffers(3, m_idBuffers);
+	glGenTextures(3, m_idTextures);
+	for (unsigned i = 0; i < 3; i++)
+	{
+		GLuint zero[4] = { 0, 0, 0, 0 };
+		glBindBuffer(GL_TEXTURE_BUFFER, m_idBuffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(zero), zero, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, m_idTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, c_formats[i], m_idBuffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return true;
+}
+
+void C3dglLightGrid::destroy()
+{
+	if (m_idBuffers[0])
+	{
+		for (unsigned i = 0; i < 3; i++)
+			C3dglMemoryTracker::getInstance().remove(MEM_DATA_BUFFER, m_idBuffers[i]);
+		glDeleteBuffers(3, m_idBuffers);
+		glDeleteTextures(3, m_idTextures);
+	}
+	std::fill_n(m_idBuffers, 3, 0);
+	std::fill_n(m_idTextures, 3, 0);
+	std::fill_n(m_bufferSizes, 3, 0);
+	m_lists.clear();
+}
+
+void C3dglLightGrid::setProjection(glm::mat4 matrixProjection, float nearPlane, float farPlane, unsigned width, unsigned height)
+{
+	m_projection = matrixProjection;
+	m_near = nearPlane;
+	m_far = farPlane;
+	m_width = width;
+	m_height = height;
+
+	// padded, so that the last cluster may be loaded four at a time
+	size_t n = getClusterCount();
+	for (std::vector<float>* p : { &m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ })
+		p->assign(n + 4, 0);
+
+	// view space directions of the tile corners, scaled to the depth of a slice boundary
+	glm::mat4 inv = glm::inverse(matrixProjection);
+	auto corner = [&](unsigned x, unsigned y, float depth)
+	{
+		glm::vec4 p = inv * glm::vec4(-1 + 2.0f * x / m_tilesX, -1 + 2.0f * y / m_tilesY, -1, 1);
+		glm::vec3 dir = glm::vec3(p) / p.w;
+		return dir * (depth / -dir.z);
+	};
+
+	for (unsigned slice = 0; slice < m_slices; slice++)
+	{
+		float zNear = m_near * std::pow(m_far / m_near, (float)slice / m_slices);
+		float zFar = m_near * std::pow(m_far / m_near, (float)(slice + 1) / m_slices);
+		for (unsigned y = 0; y < m_tilesY; y++)
+			for (unsigned x = 0; x < m_tilesX; x++)
+			{
+				glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+				for (unsigned i = 0; i < 8; i++)
+				{
+					glm::vec3 p = corner(x + (i & 1), y + ((i >> 1) & 1), (i & 4) ? zFar : zNear);
+					lo = glm::min(lo, p);
+					hi = glm::max(hi, p);
+				}
+				size_t cluster = ((size_t)slice * m_tilesY + y) * m_tilesX + x;
+				m_minX[cluster] = lo.x; m_minY[cluster] = lo.y; m_minZ[cluster] = lo.z;
+				m_maxX[cluster] = hi.x; m_maxY[cluster] = hi.y; m_maxZ[cluster] = hi.z;
+			}
+	}
+}
+
+unsigned C3dglLightGrid::getSlice(float depth) const
+{
+	if (depth <= m_near)
+		return 0;
+	int slice = (int)(std::log(depth / m_near) / std::log(m_far / m_near) * m_slices);
+	return (unsigned)std::clamp(slice, 0, (int)m_slices - 1);
+}
+
+void C3dglLightGrid::addLight(unsigned index, glm::vec3 center, float radius)
+{
+	// range of slices
+	float zMin = -center.z - radius, zMax = -center.z + radius;
+	if (zMax < m_near || zMin > m_far)
+		return;
+	unsigned s0 = getSlice(zMin), s1 = getSlice(zMax);
+
+	// range of tiles - from the screen extent of the bounding box; the whole screen if it reaches the near plane
+	unsigned x0 = 0, x1 = m_tilesX - 1, y0 = 0, y1 = m_tilesY - 1;
+	if (zMin > m_near)
+	{
+		glm::vec2 lo(FLT_MAX), hi(-FLT_MAX);
+		for (unsigned i = 0; i < 8; i++)
+		{
+			glm::vec4 p = m_projection * glm::vec4(center + radius * glm::vec3((i & 1) ? 1 : -1, (i & 2) ? 1 : -1, (i & 4) ? 1 : -1), 1);
+			lo = glm::min(lo, glm::vec2(p) / p.w);
+			hi = glm::max(hi, glm::vec2(p) / p.w);
+		}
+		if (hi.x < -1 || lo.x > 1 || hi.y < -1 || lo.y > 1)
+			return;
+		x0 = (unsigned)std::clamp((int)((lo.x + 1) * 0.5f * m_tilesX), 0, (int)m_tilesX - 1);
+		x1 = (unsigned)std::clamp((int)((hi.x + 1) * 0.5f * m_tilesX), 0, (int)m_tilesX - 1);
+		y0 = (unsigned)std::clamp((int)((lo.y + 1) * 0.5f * m_tilesY), 0, (int)m_tilesY - 1);
+		y1 = (unsigned)std::clamp((int)((hi.y + 1) * 0.5f * m_tilesY), 0, (int)m_tilesY - 1);
+	}
+
+	// sphere vs cluster box, four neighbouring clusters at a time
+#ifdef LIGHTGRID_SSE2
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 r2 = _mm_set1_ps(radius * radius), zero = _mm_setzero_ps();
+#endif
+	for (unsigned slice = s0; slice <= s1; slice++)
+		for (unsigned y = y0; y <= y1; y++)
+		{
+			size_t row = ((size_t)slice * m_tilesY + y) * m_tilesX;
+			for (unsigned x = x0; x <= x1; x += 4)
+			{
+				size_t cluster = row + x;
+#ifdef LIGHTGRID_SSE2
+				__m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minX[cluster]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&m_maxX[cluster]))));
+				__m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minY[cluster]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&m_maxY[cluster]))));
+				__m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minZ[cluster]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&m_maxZ[cluster]))));
+				__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmple_ps(d2, r2));
+#else
+				unsigned mask = 0;
+				for (unsigned k = 0; k < 4; k++)
+				{
+					size_t c = cluster + k;
+					float dx = std::max(0.0f, std::max(m_minX[c] - center.x, center.x - m_maxX[c]));
+					float dy = std::max(0.0f, std::max(m_minY[c] - center.y, center.y - m_maxY[c]));
+					float dz = std::max(0.0f, std::max(m_minZ[c] - center.z, center.z - m_maxZ[c]));
+					if (dx * dx + dy * dy + dz * dz <= radius * radius)
+						mask |= 1 << k;
+				}
+#endif
+				mask &= (1u << std::min(4u, x1 - x + 1)) - 1;		// only the tiles in range
+				for (unsigned k = 0; k < 4; k++)
+					if (mask & (1 << k))
+						m_lists[cluster + k].push_back(index);
+			}
+		}
+}
+
+void C3dglLightGrid::build(glm::mat4 matrixView, const std::vector<POINT_LIGHT>& lights, bool bBin)
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	for (auto& list : m_lists)
+		list.clear();
+	m_lightData.clear();
+	m_nLights = (unsigned)lights.size();
+	if (m_minX.size() == getClusterCount() + 4)
+		for (unsigned i = 0; i < lights.size(); i++)
+		{
+			glm::vec3 center = glm::vec3(matrixView * glm::vec4(lights[i].position, 1));
+			m_lightData.push_back(glm::vec4(center, lights[i].radius));
+			m_lightData.push_back(glm::vec4(lights[i].color, 0));
+			if (bBin)
+				addLight(i, center, lights[i].radius);
+		}
+	else
+		m_nLights = 0;		// no projection yet
+
+	// the lists, one after another
+	m_clusterData.resize(2 * (size_t)getClusterCount());
+	m_indices.clear();
+	m_nNonEmpty = m_maxPerCluster = 0;
+	for (size_t cluster = 0; cluster < m_lists.size(); cluster++)
+	{
+		m_clusterData[2 * cluster] = (GLuint)m_indices.size();
+		m_clusterData[2 * cluster + 1] = (GLuint)m_lists[cluster].size();
+		m_indices.insert(m_indices.end(), m_lists[cluster].begin(), m_lists[cluster].end());
+		if (!m_lists[cluster].empty())
+			m_nNonEmpty++;
+		m_maxPerCluster = std::max(m_maxPerCluster, (unsigned)m_lists[cluster].size());
+	}
+
+	m_buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+void C3dglLightGrid::upload()
+{
+	if (!m_idBuffers[0])
+		return;
+
+	// texture buffers may not be empty
+	if (m_lightData.empty())
+		m_lightData.resize(2, glm::vec4(0));
+	if (m_indices.empty())
+		m_indices.push_back(0);
+
+	const void* data[3] = { m_lightData.data(), m_clusterData.data(), m_indices.data() };
+	size_t sizes[3] = { m_lightData.size() * sizeof(glm::vec4), m_clusterData.size() * sizeof(GLuint), m_indices.size() * sizeof(GLuint) };
+	for (unsigned i = 0; i < 3; i++)
+	{
+		// orphaned every frame - the previous contents may still be in use
+		glBindBuffer(GL_TEXTURE_BUFFER, m_idBuffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+		if (sizes[i] != m_bufferSizes[i])
+		{
+			m_bufferSizes[i] = sizes[i];
+			C3dglMemoryTracker::getInstance().add(MEM_DATA_BUFFER, m_idBuffers[i], sizes[i], c_formats[i], getName());
+		}
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void C3dglLightGrid::bind(C3dglProgram* pProgram, GLenum texUnit) const
+{
+	if (!pProgram)
+		return;
+	const char* samplers[3] = { "lightData", "lightClusters", "lightIndices" };
+	for (unsigned i = 0; i < 3; i++)
+	{
+		glActiveTexture(texUnit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, m_idTextures[i]);
+		pProgram->sendUniform(samplers[i], (int)(texUnit + i - GL_TEXTURE0));
+	}
+
+	// slice = log(depth) * scale + bias
+	float scale = m_slices / std::log(m_far / m_near);
+	pProgram->sendUniform("lightCount", (int)m_nLights);
+	pProgram->sendUniform("clusterCount", glm::ivec3(m_tilesX, m_tilesY, m_slices));
+	pProgram->sendUniform("clusterTileSize", glm::vec2((float)m_width / m_tilesX, (float)m_height / m_tilesY));
+	pProgram->sendUniform("clusterDepth", glm::vec2(scale, -std::log(m_near) * scale));
+	pProgram->sendUniform("clusteredLights", 1);
+}
+
+void C3dglLightGrid::stats() const
+{
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Clusters: {}x{}x{} = {}, Lights: {}", m_tilesX, m_tilesY, m_slices, getClusterCount(), m_nLights);
+	C3dglLogger::log("Non-empty clusters: {}, Light indices: {} ({:.1f} per non-empty cluster, {} at most), Binned in {:.3f} ms",
+		m_nNonEmpty, m_nLights ? m_indices.size() : 0, m_nNonEmpty ? (double)m_indices.size() / m_nNonEmpty : 0.0, m_maxPerCluster, m_buildTime);
+}
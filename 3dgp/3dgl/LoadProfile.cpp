@@ -0,0 +1,79 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <fstream>
+#include <3dgl/LoadProfile.h>
+
+using namespace _3dgl;
+
+void C3dglLoadProfile::reset()
+{
+	m_stages.clear();
+	m_index.clear();
+}
+
+void C3dglLoadProfile::add(std::string stage, double ms)
+{
+	auto it = m_index.find(stage);
+	if (it == m_index.end())
+	{
+		m_index[stage] = m_stages.size();
+		m_stages.push_back({ stage, ms, 1 });
+	}
+	else
+	{
+		m_stages[it->second].ms += ms;
+		m_stages[it->second].calls++;
+	}
+}
+
+double C3dglLoadProfile::getTime(std::string stage) const
+{
+	auto it = m_index.find(stage);
+	return it == m_index.end() ? 0 : m_stages[it->second].ms;
+}
+
+double C3dglLoadProfile::getTotalTime() const
+{
+	double total = 0;
+	for (const STAGE& stage : m_stages)
+		total += stage.ms;
+	return total;
+}
+
+void C3dglLoadProfile::stats() const
+{
+	double total = getTotalTime();
+	C3dglLogger::log("Load profile: {:.2f} ms", total);
+	for (const STAGE& stage : m_stages)
+		C3dglLogger::log(" {:<32} {:9.2f} ms {:5.1f}% ({} calls)", stage.name, stage.ms, total > 0 ? 100 * stage.ms / total : 0, stage.calls);
+}
+
+bool C3dglLoadProfile::save(std::string filename, std::string name) const
+{
+	std::ofstream f(filename);
+	if (!f.is_open())
+		return false;
+
+	auto escape = [](std::string s)
+	{
+		std::string res;
+		for (char c : s)
+			if (c == '"' || c == '\\') res += std::string("\\") + c;
+			else if ((unsigned char)c >= 0x20) res += c;
+		return res;
+	};
+
+	f << "{" << std::endl;
+	f << std::format("  \"name\": \"{}\",", escape(name)) << std::endl;
+	f << std::format("  \"total_ms\": {:.3f},", getTotalTime()) << std::endl;
+	f << "  \"stages\": [" << std::endl;
+	for (size_t i = 0; i < m_stages.size(); i++)
+		f << std::format("    {{ \"stage\": \"{}\", \"ms\": {:.3f}, \"calls\": {} }}{}", escape(m_stages[i].name), m_stages[i].ms, m_stages[i].calls, i + 1 < m_stages.size() ? "," : "") << std::endl;
+	f << "  ]" << std::endl;
+	f << "}" << std::endl;
+	return true;
+}
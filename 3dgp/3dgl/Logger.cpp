@@ -11,6 +11,7 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <iostream>
 #include <map>
 #include <set>
+#include <mutex>
 
 #include <GL/glut.h>
 
@@ -18,6 +19,13 @@ using namespace _3dgl;
 
 unsigned C3dglLogger::c_options = LOGGER_COLLAPSE_MESSAGES;
 
+// messages may be logged from worker threads (e.g. by C3dglBitmap::loadParallel)
+static std::recursive_mutex& logMutex()
+{
+	static std::recursive_mutex mutex;
+	return mutex;
+}
+
 C3dglLogger::C3dglLogger()
 {
 	operator[](M3DGL_SUCCESS) = "{}";
@@ -32,6 +40,13 @@ C3dglLogger::C3dglLogger()
 	operator[](M3DGL_SUCCESS_VERIFICATION) = "verification result: {}.";
 	operator[](M3DGL_SUCCESS_LOADED) = "loaded from: {}.";
 	operator[](M3DGL_SUCCESS_LOADED_FROM_EMBED_FILE) = "loaded from embedded file: {}.";
+	operator[](M3DGL_SUCCESS_REUSED) = "reused already loaded resource: {}.";
+	operator[](M3DGL_SUCCESS_BAKED) = "baked: {} ({} bytes).";
+	operator[](M3DGL_SUCCESS_LOADED_FROM_PACK) = "loaded from the asset pack: {}.";
+	operator[](M3DGL_SUCCESS_SAVED) = "saved to: {}.";
+	operator[](M3DGL_SUCCESS_LOADED_FROM_CACHE) = "loaded the mip chain from the cache: {}.";
+	operator[](M3DGL_SUCCESS_TEXARRAY_CREATED) = "created: {} layers of {}x{}, {} textures ({} packed in atlas layers).";
+	operator[](M3DGL_SUCCESS_STREAMED) = "streaming: {} ({} of {} levels resident).";
 
 	operator[](M3DGL_WARNING_GENERIC) = "{}";
 	operator[](M3DGL_WARNING_UNIFORM_NOT_FOUND) = "uniform location not found: {}.";
@@ -78,6 +93,19 @@ C3dglLogger::C3dglLogger()
 	operator[](M3DGL_WARNING_CANNOT_LOAD) = "couldn't load from: {}.";
 	operator[](M3DGL_WARNING_CANNOT_LOAD_FROM_EMBED_FILE) = "couldn't load from embedded file: {}.";
 	operator[](M3DGL_WARNING_EMBED_FILE_UNKNOWN_FORMAT) = "encountered unknown file format {} in embedded file: {}.";
+	operator[](M3DGL_WARNING_MTL_NOT_FOUND) = "couldn't load material library: {}.";
+	operator[](M3DGL_WARNING_MATERIAL_NOT_FOUND) = "uses an undefined material: {}. Default material used instead.";
+	operator[](M3DGL_WARNING_GEOMETRY_MISMATCH) = "differs from the reference in node {}: {}.";
+	operator[](M3DGL_WARNING_CANNOT_BAKE) = "cannot bake {}: {}. Asset skipped.";
+	operator[](M3DGL_WARNING_MANIFEST_SYNTAX) = "syntax error in line {}: {}. Line ignored.";
+	operator[](M3DGL_WARNING_STALE_ASSET) = "is out of date: {} has changed since it was baked. The file is loaded instead - bake the pack again.";
+	operator[](M3DGL_WARNING_CANNOT_CACHE) = "couldn't write the mip chain cache: {}.";
+	operator[](M3DGL_WARNING_FORMAT_NOT_SUPPORTED) = "compressed format 0x{:x} of {} is not supported by the driver. Uncompressed image used instead.";
+	operator[](M3DGL_WARNING_CANNOT_FLIP) = "cannot flip {}: only BC7 mode 6 blocks and heights which are multiples of 4 are supported. None of its levels is flipped - the texture is upside down.";
+	operator[](M3DGL_WARNING_TEXARRAY_MISMATCH) = "texture {} ({}x{}, format 0x{:x}) does not fit in the array. It will be bound on its own.";
+	operator[](M3DGL_WARNING_CANNOT_STREAM) = "cannot read the mip levels of {}. The texture stays at its current resolution.";
+	operator[](M3DGL_WARNING_STREAMING_BUDGET) = "the budget of {} bytes is exceeded by the smallest levels of the textures alone: {} bytes resident.";
+	operator[](M3DGL_WARNING_MEMORY_BUDGET) = "GPU memory use of {:.1f} MB exceeds the budget of {:.1f} MB. The largest resource: {} ({:.1f} MB).";
 
 	operator[](M3DGL_ERROR_GENERIC) = "{}";
 	operator[](M3DGL_ERROR_TYPE_MISMATCH) = "type mismatch in uniform: {}: sending value of {} but {} was expected.";
@@ -93,6 +121,14 @@ C3dglLogger::C3dglLogger()
 	operator[](M3DGL_ERROR_SHADER_NOT_CREATED) = "cannot attach shader: shader not created.";
 	operator[](M3DGL_ERROR_PROGRAM_NOT_CREATED) = "shader program not created.";
 	operator[](M3DGL_ERROR_UNKNOWN_LINKING_ERROR) = "unknown linking error";
+	operator[](M3DGL_ERROR_CANNOT_OPEN_FILE) = "cannot open file: {}.";
+	operator[](M3DGL_ERROR_OBJ_PARSE) = "parse error: {}.";
+	operator[](M3DGL_ERROR_PACK_FORMAT) = "invalid asset pack: {}.";
+	operator[](M3DGL_ERROR_CANNOT_WRITE_FILE) = "cannot write file: {}.";
+	operator[](M3DGL_ERROR_TEXTURE_FILE) = "invalid or unsupported texture file: {}.";
+	operator[](M3DGL_ERROR_DDS_HEIGHT) = "cannot save {}: the height of {} is above 4 and not a multiple of 4, so the image could not be flipped when loaded. Resize the image.";
+	operator[](M3DGL_ERROR_FRAMEBUFFER) = "framebuffer incomplete: status 0x{:x}.";
+	operator[](M3DGL_ERROR_CUBEMAP_FACES) = "cannot build a cube map from {}: the faces must load, be square and of equal size. Use load for separate face textures.";
 
 	operator[](M3DGL_INTERNAL_ERROR) = "INTERNAL ERROR";
 }
@@ -125,6 +161,7 @@ bool C3dglLogger::_log(unsigned nCode, std::string name, std::string message)
 	case 2: msg = std::format("*** Error {}: {} {}", nCode, name, message); break;
 	}
 
+	std::lock_guard<std::recursive_mutex> lock(logMutex());
 	static std::set<std::string> errlookup;	// used to prevent displaying the same message twice
 	bool bFirstTimeSeen = false;					// set to true if first time seen (should not be collapsed)
 	if (errlookup.find(msg) == errlookup.end())
@@ -152,5 +189,6 @@ bool C3dglLogger::_log(unsigned nCode, std::string name, std::string message)
 
 void C3dglLogger::log(std::string msg)
 {
+	std::lock_guard<std::recursive_mutex> lock(logMutex());
 	std::cout << msg << std::endl;
 }
@@ -0,0 +1,107 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Internal helpers: read-only memory-mapped file and a simple parallel loop.
+Not a part of the public interface of the library.
+*********************************************************************************/
+#ifndef __3dglMappedFile_h_
+#define __3dglMappedFile_h_
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+namespace _3dgl
+{
+	// Read-only view of the entire file. The file is mapped, not read: pages are loaded on first access.
+	class C3dglMappedFile
+	{
+		HANDLE m_hFile = INVALID_HANDLE_VALUE;
+		HANDLE m_hMapping = NULL;
+		const char* m_pData = NULL;
+		size_t m_size = 0;
+
+	public:
+		C3dglMappedFile() { }
+		C3dglMappedFile(const char* filename) { open(filename); }
+		C3dglMappedFile(const C3dglMappedFile&) = delete;
+		~C3dglMappedFile() { close(); }
+
+		bool open(const char* filename)
+		{
+			close();
+			m_hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (m_hFile == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_hFile, &size))
+				return close(), false;
+			m_size = (size_t)size.QuadPart;
+			if (m_size == 0)
+				return true;	// empty files cannot be mapped, but they are valid
+
+			m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (m_hMapping)
+				m_pData = (const char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+			if (m_pData == NULL)
+				return close(), false;
+			return true;
+		}
+
+		void close()
+		{
+			if (m_pData) UnmapViewOfFile(m_pData);
+			if (m_hMapping) CloseHandle(m_hMapping);
+			if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle(m_hFile);
+			m_hFile = INVALID_HANDLE_VALUE;
+			m_hMapping = NULL;
+			m_pData = NULL;
+			m_size = 0;
+		}
+
+		bool isOpen() const			{ return m_hFile != INVALID_HANDLE_VALUE; }
+		const char* data() const	{ return m_pData; }
+		size_t size() const			{ return m_size; }
+		const char* begin() const	{ return m_pData; }
+		const char* end() const		{ return m_pData + m_size; }
+	};
+
+	// Calls fn(i) for each i in [0, nTasks), distributing the tasks among up to nThreads worker threads.
+	// nThreads == 0 means: use all hardware threads. The calling thread takes part in the work.
+	template<class FN> void parallelFor(size_t nTasks, FN fn, unsigned nThreads = 0)
+	{
+		if (nThreads == 0)
+			nThreads = std::max(1u, std::thread::hardware_concurrency());
+		nThreads = (unsigned)std::min<size_t>(nThreads, nTasks);
+		if (nThreads <= 1)
+		{
+			for (size_t i = 0; i < nTasks; i++)
+				fn(i);
+			return;
+		}
+
+		std::atomic<size_t> next = 0;
+		auto worker = [&]()
+		{
+			for (size_t i = next++; i < nTasks; i = next++)
+				fn(i);
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < nThreads; i++)
+			threads.emplace_back(worker);
+		worker();
+		for (std::thread& t : threads)
+			t.join();
+	}
+}; // namespace _3dgl
+
+#endif // __3dglMappedFile_h_
@@ -6,9 +6,12 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include "pch.h"
 #include <fstream>
 #include <3dgl/Material.h>
-#include <3dgl/Bitmap.h>
+#include <3dgl/Texture.h>
+#include <3dgl/TextureArray.h>
 #include <3dgl/Model.h>
 #include <3dgl/Shader.h>
+#include <3dgl/ResourceCache.h>
+#include <3dgl/MemoryTracker.h>
 
 // assimp include file
 #include <assimp/scene.h>
@@ -17,9 +20,64 @@ using namespace _3dgl;
 
 unsigned C3dglMaterial::c_idTexBlank = 0xFFFFFFFF;
 
+namespace
+{
+	const unsigned c_nUnits = GL_TEXTURE31 - GL_TEXTURE0 + 1;
+
+	// the texture binding cache - see C3dglMaterial::beginBatch
+	struct BINDINGS
+	{
+		unsigned depth = 0;				// nested batches
+		GLuint bound[c_nUnits];			// current 2D texture bindings, valid if known
+		GLuint original[c_nUnits];		// bindings found when the batch started
+		bool known[c_nUnits] = { };
+		size_t nRequests = 0;
+		size_t nCalls = 0;
+	} c_bindings;
+
+	// queries the current binding of the unit, once in a batch
+	void queryBinding(unsigned unit)
+	{
+		if (c_bindings.known[unit])
+			return;
+		GLint active;
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+		GLenum prevUnit = (GLenum)active;
+		if (prevUnit != GL_TEXTURE0 + unit) glActiveTexture(GL_TEXTURE0 + unit);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*)&c_bindings.bound[unit]);
+		if (prevUnit != GL_TEXTURE0 + unit) glActiveTexture(prevUnit);
+		c_bindings.original[unit] = c_bindings.bound[unit];
+		c_bindings.known[unit] = true;
+	}
+
+	// sends the cached bindings of the units (in ascending order) to OpenGL; with ARB_multi_bind, one call for each run of consecutive units
+	void sendBindings(unsigned count, const unsigned* units)
+	{
+		for (unsigned i = 0; i < count; )
+		{
+			unsigned unit = units[i], n = 1;
+			if (GLEW_ARB_multi_bind && c_bindings.bound[unit] != 0)
+			{
+				// glBindTextures with 0 would unbind all the targets of the unit, not only GL_TEXTURE_2D
+				while (i + n < count && units[i + n] == unit + n && c_bindings.bound[unit + n] != 0)
+					n++;
+				glBindTextures(unit, n, &c_bindings.bound[unit]);
+			}
+			else
+			{
+				glActiveTexture(GL_TEXTURE0 + unit);
+				glBindTexture(GL_TEXTURE_2D, c_bindings.bound[unit]);
+			}
+			c_bindings.nCalls++;
+			i += n;
+		}
+	}
+}
+
 C3dglMaterial::C3dglMaterial(C3dglModel* pOwner) : m_pOwner(pOwner)
 {
 	memset(m_idTexture, 0xFFFFFFFF, sizeof(m_idTexture));
+	m_nUnits = 0;
 	m_bAmb = m_bDiff = m_bSpec = m_bEmiss = m_bShininess = false;
 
 	memset(&m_amb, 0, sizeof(m_amb));
@@ -27,6 +85,9 @@ C3dglMaterial::C3dglMaterial(C3dglModel* pOwner) : m_pOwner(pOwner)
 	memset(&m_spec, 0, sizeof(m_spec));
 	memset(&m_emiss, 0, sizeof(m_emiss));
 	m_shininess = 0.0f;
+
+	m_texLayer = -1;
+	m_texRegion = glm::vec4(1, 1, 0, 0);
 }
 
 void C3dglMaterial::create(const aiMaterial *pMat, const char* pDefTexPath)
@@ -58,28 +119,62 @@ void C3dglMaterial::create(const aiMaterial *pMat, const char* pDefTexPath)
 void C3dglMaterial::destroy()
 {
 	for (unsigned& idTexture : m_idTexture)
-		if (idTexture != 0xffffffff)
+	{
+		// shared textures are released through the cache; the blank texture is never destroyed
+		if (idTexture != 0xffffffff && idTexture != c_idTexBlank && !C3dglResourceCache::getInstance().releaseTexture(idTexture))
+		{
+			C3dglMemoryTracker::getInstance().remove(MEM_TEXTURE, idTexture);
 			glDeleteTextures(1, &idTexture);
+		}
+		idTexture = 0xffffffff;
+	}
+	updateUnits();
+}
+
+void C3dglMaterial::updateUnits()
+{
+	m_nUnits = 0;
+	for (unsigned unit = 0; unit < c_nUnits; unit++)
+		if (m_idTexture[unit] != 0xffffffff)
+			m_units[m_nUnits++] = (unsigned char)unit;
 }
 
 void C3dglMaterial::render(C3dglProgram *pProgram) const
 {
-	for (unsigned texUnit = GL_TEXTURE0; texUnit <= GL_TEXTURE31; texUnit++)
+	if (!pProgram)
+		pProgram = C3dglProgram::getCurrentProgram();
+
+	// with the texture array, the texture is selected by a uniform rather than bound
+	bool bArray = m_texLayer >= 0 && pProgram && pProgram->getUniformLocation(UNI_TEX_LAYER) != -1;
+
+	// only the units whose binding changes are bound; a batch of one material unless already in a batch
+	beginBatch();
+	unsigned units[c_nUnits], count = 0;
+	for (unsigned i = 0; i < m_nUnits; i++)
 	{
-		unsigned idTex;
-		if (getTexture(texUnit, idTex))
+		unsigned unit = m_units[i];
+		if (unit == 0 && bArray)
+			continue;
+		queryBinding(unit);
+		c_bindings.nRequests++;
+		if (c_bindings.bound[unit] != m_idTexture[unit])
 		{
-			glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*) & m_back_idTexture[texUnit - GL_TEXTURE0]);
-			glActiveTexture(texUnit);
-			glBindTexture(GL_TEXTURE_2D, idTex);
+			c_bindings.bound[unit] = m_idTexture[unit];
+			units[count++] = unit;
 		}
 	}
-
-	if (!pProgram)
-		pProgram = C3dglProgram::getCurrentProgram();
+	sendBindings(count, units);
 
 	if (pProgram)
 	{
+		if (bArray)
+		{
+			pProgram->retrieveUniform(UNI_TEX_LAYER, m_back_texLayer);
+			pProgram->retrieveUniform(UNI_TEX_REGION, m_back_texRegion);
+			pProgram->sendUniform(UNI_TEX_LAYER, m_texLayer);
+			pProgram->sendUniform(UNI_TEX_REGION, m_texRegion);
+		}
+
 		if (getAmbient()) pProgram->retrieveUniform(UNI_MAT_AMBIENT, m_back_amb);
 		if (getDiffuse()) pProgram->retrieveUniform(UNI_MAT_DIFFUSE, m_back_diff);
 		if (getSpecular()) pProgram->retrieveUniform(UNI_MAT_SPECULAR, m_back_spec);
@@ -98,20 +193,24 @@ void C3dglMaterial::render(C3dglProgram *pProgram) const
 
 void C3dglMaterial::postRender(C3dglProgram* pProgram) const
 {
-	for (unsigned texUnit = GL_TEXTURE0; texUnit <= GL_TEXTURE31; texUnit++)
-	{
-		if (getTexture(texUnit))
-		{
-			glActiveTexture(texUnit);
-			glBindTexture(GL_TEXTURE_2D, m_back_idTexture[texUnit - GL_TEXTURE0]);
-		}
-	}
-
 	if (!pProgram)
 		pProgram = C3dglProgram::getCurrentProgram();
 
+	bool bArray = m_texLayer >= 0 && pProgram && pProgram->getUniformLocation(UNI_TEX_LAYER) != -1;
+
+	// the previous bindings are restored at the end of the batch
+	for (unsigned i = 0; i < m_nUnits; i++)
+		if (m_units[i] != 0 || !bArray)
+			c_bindings.nRequests++;
+	endBatch();
+
 	if (pProgram)
 	{
+		if (bArray)
+		{
+			pProgram->sendUniform(UNI_TEX_LAYER, m_back_texLayer);
+			pProgram->sendUniform(UNI_TEX_REGION, m_back_texRegion);
+		}
 		if (getAmbient()) pProgram->sendUniform(UNI_MAT_AMBIENT, m_back_amb);
 		if (getDiffuse()) pProgram->sendUniform(UNI_MAT_DIFFUSE, m_back_diff);
 		if (getSpecular()) pProgram->sendUniform(UNI_MAT_SPECULAR, m_back_spec);
@@ -120,6 +219,57 @@ void C3dglMaterial::postRender(C3dglProgram* pProgram) const
 	}
 }
 
+void C3dglMaterial::beginBatch()
+{
+	if (c_bindings.depth++ == 0)
+		memset(c_bindings.known, 0, sizeof(c_bindings.known));
+}
+
+void C3dglMaterial::endBatch()
+{
+	if (c_bindings.depth == 0 || --c_bindings.depth > 0)
+		return;
+
+	unsigned units[c_nUnits], count = 0;
+	for (unsigned unit = 0; unit < c_nUnits; unit++)
+		if (c_bindings.known[unit] && c_bindings.bound[unit] != c_bindings.original[unit])
+		{
+			c_bindings.bound[unit] = c_bindings.original[unit];
+			units[count++] = unit;
+		}
+	sendBindings(count, units);
+}
+
+size_t C3dglMaterial::getBindRequestCount()
+{
+	return c_bindings.nRequests;
+}
+
+size_t C3dglMaterial::getBindCallCount()
+{
+	return c_bindings.nCalls;
+}
+
+void C3dglMaterial::resetBindCounters()
+{
+	c_bindings.nRequests = c_bindings.nCalls = 0;
+}
+
+void C3dglMaterial::setTextureArray(const C3dglTextureArray* pArray)
+{
+	TEXARRAY_REGION region;
+	if (pArray && pArray->getRegion(m_idTexture[0], region))
+	{
+		m_texLayer = (float)region.layer;
+		m_texRegion = region.transform;
+	}
+	else
+	{
+		m_texLayer = -1;
+		m_texRegion = glm::vec4(1, 1, 0, 0);
+	}
+}
+
 void C3dglMaterial::loadTexture(GLenum texUnit, std::string strDefTexPath, std::string strPath)
 {
 	// first of all, check for the embedded texture!
@@ -152,37 +302,23 @@ void C3dglMaterial::loadTexture(GLenum texUnit, std::string strDefTexPath, std::
 
 void C3dglMaterial::loadTexture(GLenum texUnit, std::string strPath)
 {
-	// generate IL image id
-	C3dglBitmap bm;
-	if (bm.load(strPath, GL_RGBA))
+	// textures are shared between all materials (and models) that use the same file
+	GLuint idTex;
+	if (C3dglResourceCache::getInstance().acquireTexture(strPath, idTex, m_pOwner ? &m_pOwner->getLoadProfile() : NULL))
 	{
-		// generate texture id
-		glGenTextures(1, &m_idTexture[texUnit - GL_TEXTURE0]);
-
-		// load texture
-		glActiveTexture(texUnit);
-		glBindTexture(GL_TEXTURE_2D, m_idTexture[texUnit - GL_TEXTURE0]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+		m_idTexture[texUnit - GL_TEXTURE0] = idTex;
+		updateUnits();
 	}
 }
 
 void C3dglMaterial::loadTexture(GLenum texUnit, const aiTexture* pTexture)
 {
 	// generate texture from aiTexture data
-	C3dglBitmap bm;
-	if (bm.load(pTexture, GL_RGBA))
+	C3dglTexture texture;
+	if (texture.load(pTexture, TEX_DEFAULT, m_pOwner ? &m_pOwner->getLoadProfile() : NULL))
 	{
-		// generate texture id
-		glGenTextures(1, &m_idTexture[texUnit - GL_TEXTURE0]);
-
-		// load texture
-		glActiveTexture(texUnit);
-		glBindTexture(GL_TEXTURE_2D, m_idTexture[texUnit - GL_TEXTURE0]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+		m_idTexture[texUnit - GL_TEXTURE0] = texture.detach();
+		updateUnits();
 	}
 }
 
@@ -194,9 +330,12 @@ void C3dglMaterial::loadTexture(GLenum texUnit)
 		glActiveTexture(texUnit);
 		glBindTexture(GL_TEXTURE_2D, c_idTexBlank);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		unsigned char bytes[] = { 255, 255, 255 };
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_BGR, GL_UNSIGNED_BYTE, &bytes);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		unsigned char bytes[] = { 255, 255, 255, 255 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &bytes);	// RGBA8, so that it may join a texture array
+		C3dglMemoryTracker::getInstance().add(MEM_TEXTURE, c_idTexBlank, 4, GL_RGBA8, "Material (blank texture)");
 	}
 	m_idTexture[texUnit - GL_TEXTURE0] = c_idTexBlank;
+	updateUnits();
 }
 
@@ -0,0 +1,227 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <fstream>
+#include <algorithm>
+#include <3dgl/MemoryTracker.h>
+
+using namespace _3dgl;
+
+namespace
+{
+	// textures and buffers have separate names
+	std::pair<bool, GLuint> getKey(MEM_CATEGORY category, GLuint id)
+	{
+		return { category >= MEM_TEXTURE, id };
+	}
+
+	std::string escapeJSON(std::string s)
+	{
+		std::string out;
+		for (char c : s)
+			if (c == '"' || c == '\\')
+				out += std::string("\\") + c;
+			else if ((unsigned char)c < 0x20)
+				out += std::format("\\u{:04x}", (unsigned)c);
+			else
+				out += c;
+		return out;
+	}
+
+	std::string escapeCSV(std::string s)
+	{
+		std::string out = "\"";
+		for (char c : s)
+			out += (c == '"') ? std::string("\"\"") : std::string(1, c);
+		return out + "\"";
+	}
+}
+
+C3dglMemoryTracker& C3dglMemoryTracker::getInstance()
+{
+	// never destroyed: global objects unregister their resources after the static objects are gone
+	static C3dglMemoryTracker* pInst = new C3dglMemoryTracker;
+	return *pInst;
+}
+
+void C3dglMemoryTracker::add(MEM_CATEGORY category, GLuint id, size_t bytes, GLenum format, std::string owner)
+{
+	if (id == 0)
+		return;
+	MEM_RESOURCE& resource = m_resources[getKey(category, id)];
+	m_totals[resource.category] -= resource.bytes;		// if already registered
+	m_total -= resource.bytes;
+	resource = { category, id, bytes, format, owner };
+	m_totals[category] += bytes;
+	m_total += bytes;
+	m_peak = std::max(m_peak, m_total);
+	checkBudget();
+}
+
+bool C3dglMemoryTracker::remove(MEM_CATEGORY category, GLuint id)
+{
+	auto it = m_resources.find(getKey(category, id));
+	if (it == m_resources.end())
+		return false;
+	m_totals[it->second.category] -= it->second.bytes;
+	m_total -= it->second.bytes;
+	m_resources.erase(it);
+	checkBudget();
+	return true;
+}
+
+size_t C3dglMemoryTracker::getSize(MEM_CATEGORY category, GLuint id) const
+{
+	auto it = m_resources.find(getKey(category, id));
+	return it == m_resources.end() ? 0 : it->second.bytes;
+}
+
+void C3dglMemoryTracker::checkBudget()
+{
+	// reported once each time the budget is crossed
+	if (m_budget == 0 || m_total <= m_budget)
+		m_bOverBudget = false;
+	else if (!m_bOverBudget)
+	{
+		m_bOverBudget = true;
+		std::vector<MEM_RESOURCE> top = getTop(1);
+		log(M3DGL_WARNING_MEMORY_BUDGET, m_total / 1048576.0, m_budget / 1048576.0, top[0].owner, top[0].bytes / 1048576.0);
+	}
+}
+
+std::vector<MEM_RESOURCE> C3dglMemoryTracker::getTop(size_t n) const
+{
+	std::vector<MEM_RESOURCE> resources;
+	for (auto& [key, resource] : m_resources)
+		resources.push_back(resource);
+	n = std::min(n, resources.size());
+	std::partial_sort(resources.begin(), resources.begin() + n, resources.end(), [](auto& a, auto& b) { return a.bytes > b.bytes; });
+	resources.resize(n);
+	return resources;
+}
+
+bool C3dglMemoryTracker::exportJSON(std::string filename) const
+{
+	std::ofstream file(filename);
+	if (!file)
+		return log(M3DGL_ERROR_CANNOT_WRITE_FILE, filename);
+
+	file << "{\n";
+	file << std::format("\t\"total\": {},\n\t\"peak\": {},\n\t\"budget\": {},\n", m_total, m_peak, m_budget);
+	file << "\t\"categories\": {\n";
+	for (unsigned category = 0; category < MEM_CATEGORY_COUNT; category++)
+		file << std::format("\t\t\"{}\": {}{}\n", getCategoryName((MEM_CATEGORY)category), m_totals[category], category + 1 < MEM_CATEGORY_COUNT ? "," : "");
+	file << "\t},\n";
+	file << "\t\"resources\": [\n";
+	std::vector<MEM_RESOURCE> resources = getTop(m_resources.size());
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		const MEM_RESOURCE& r = resources[i];
+		file << std::format("\t\t{{ \"category\": \"{}\", \"id\": {}, \"bytes\": {}, \"format\": \"{}\", \"owner\": \"{}\" }}{}\n",
+			getCategoryName(r.category), r.id, r.bytes, getFormatName(r.format), escapeJSON(r.owner), i + 1 < resources.size() ? "," : "");
+	}
+	file << "\t]\n}\n";
+
+	if (!file)
+		return log(M3DGL_ERROR_CANNOT_WRITE_FILE, filename);
+	return log(M3DGL_SUCCESS_SAVED, filename);
+}
+
+bool C3dglMemoryTracker::exportCSV(std::string filename) const
+{
+	std::ofstream file(filename);
+	if (!file)
+		return log(M3DGL_ERROR_CANNOT_WRITE_FILE, filename);
+
+	file << "category,id,bytes,format,owner\n";
+	for (const MEM_RESOURCE& r : getTop(m_resources.size()))
+		file << std::format("{},{},{},{},{}\n", getCategoryName(r.category), r.id, r.bytes, getFormatName(r.format), escapeCSV(r.owner));
+
+	if (!file)
+		return log(M3DGL_ERROR_CANNOT_WRITE_FILE, filename);
+	return log(M3DGL_SUCCESS_SAVED, filename);
+}
+
+size_t C3dglMemoryTracker::getTextureSize(GLenum format, unsigned width, unsigned height, unsigned levels, unsigned layers)
+{
+	size_t size = 0;
+	for (unsigned level = 0; level < levels; level++)
+	{
+		unsigned w = std::max(1u, width >> level), h = std::max(1u, height >> level);
+		switch (format)
+		{
+		case GL_RGBA8:
+		case GL_RGB10_A2:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH24_STENCIL8: size += (size_t)w * h * 4; break;
+		case GL_RGBA16F: size += (size_t)w * h * 8; break;
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1: size += (size_t)((w + 3) / 4) * ((h + 3) / 4) * 8; break;
+		default: size += (size_t)((w + 3) / 4) * ((h + 3) / 4) * 16; break;
+		}
+	}
+	return size * layers;
+}
+
+std::string C3dglMemoryTracker::getCategoryName(MEM_CATEGORY category)
+{
+	switch (category)
+	{
+	case MEM_VERTEX_BUFFER: return "vertex buffers";
+	case MEM_INDEX_BUFFER: return "index buffers";
+	case MEM_DATA_BUFFER: return "data buffers";
+	case MEM_TEXTURE: return "textures";
+	case MEM_TEXTURE_ARRAY: return "texture arrays";
+	case MEM_CUBE_MAP: return "cube maps";
+	case MEM_STREAMED_TEXTURE: return "streamed textures";
+	default: return "unknown";
+	}
+}
+
+std::string C3dglMemoryTracker::getFormatName(GLenum format)
+{
+	switch (format)
+	{
+	case GL_FLOAT: return "float";
+	case GL_INT: return "int";
+	case GL_UNSIGNED_INT: return "uint";
+	case GL_UNSIGNED_SHORT: return "ushort";
+	case GL_RGBA8: return "RGBA8";
+	case GL_RGBA32F: return "RGBA32F";
+	case GL_RG32UI: return "RG32UI";
+	case GL_R32UI: return "R32UI";
+	case GL_DEPTH_COMPONENT24: return "D24";
+	case GL_DEPTH24_STENCIL8: return "D24S8";
+	case GL_RGB10_A2: return "RGB10A2";
+	case GL_RGBA16F: return "RGBA16F";
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return "BC1";
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT: return "BC1 sRGB";
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: return "BC3 sRGB";
+	case GL_COMPRESSED_RED_RGTC1: return "BC4";
+	case GL_COMPRESSED_RG_RGTC2: return "BC5";
+	case GL_COMPRESSED_RGBA_BPTC_UNORM: return "BC7";
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM: return "BC7 sRGB";
+	default: return std::format("0x{:x}", format);
+	}
+}
+
+void C3dglMemoryTracker::stats(size_t nTop) const
+{
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Resources: {}, Total: {:.1f} MB, Peak: {:.1f} MB, Budget: {}", m_resources.size(), m_total / 1048576.0, m_peak / 1048576.0,
+		m_budget ? std::format("{:.1f} MB", m_budget / 1048576.0) : std::string("none"));
+	for (unsigned category = 0; category < MEM_CATEGORY_COUNT; category++)
+		if (m_totals[category])
+			C3dglLogger::log("  {}: {:.1f} MB", getCategoryName((MEM_CATEGORY)category), m_totals[category] / 1048576.0);
+	for (const MEM_RESOURCE& r : getTop(nTop))
+		C3dglLogger::log("  {:.1f} kB - {} #{} ({}) - {}", r.bytes / 1024.0, getCategoryName(r.category), r.id, getFormatName(r.format), r.owner);
+}
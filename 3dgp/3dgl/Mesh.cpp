@@ -190,17 +190,25 @@ void C3dglMesh::create(const aiMesh* pMesh, C3dglProgram* pProgram)
 		return;		// this should never happen!
 	}
 
+	C3dglLoadProfile* pProfile = m_pOwner ? &m_pOwner->getLoadProfile() : NULL;
+
 	// collect buffered attribute data
 	void* attrData[ATTR_COUNT];
 	size_t attrSize[ATTR_COUNT];
+	C3dglProfileTimer timer1(pProfile, "getBuffers");
 	size_t nVertices = getBuffers(pMesh, attrId, attrCount, attrData, attrSize);
+	timer1.stop();
 
 	// collect index buffer data
 	void* indexData;
 	size_t indSize;
+	C3dglProfileTimer timer2(pProfile, "index flattening");
 	size_t nIndices = getIndexBuffer(pMesh, &indexData, &indSize);
+	timer2.stop();
 
+	C3dglProfileTimer timer3(pProfile, "GL upload");
 	C3dglVertexAttrObject::create(attrCount, nVertices, attrData, attrSize, nIndices, indexData, indSize, pProgram);
+	timer3.stop();
 
 	cleanUp(attrCount, attrData, indexData);
 
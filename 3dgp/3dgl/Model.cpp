@@ -7,12 +7,19 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <iostream>
 #include <3dgl/Model.h>
 #include <3dgl/Shader.h>
+#include <3dgl/ObjLoader.h>
+#include <3dgl/AssetPack.h>
+#include <3dgl/TextureStreamer.h>
+#include <3dgl/MemoryTracker.h>
 
 // assimp include file
 #include "assimp/scene.h"
 #include "assimp/postprocess.h"
 #include <assimp/cimport.h>
+#include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
 #include <assimp/DefaultLogger.hpp>
+#include "SceneCompare.h"
 
 // GLM include files
 #include "../glm/vec3.hpp"
@@ -22,10 +29,79 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 
 using namespace _3dgl;
 
+namespace
+{
+	// AssImp post-processing steps, in the order of execution (AssImp 5.x), with their flags.
+	// Internal steps with no flag of their own are marked with 0.
+	const std::pair<const char*, unsigned> c_aiSteps[] = {
+		{ "MakeLeftHanded", aiProcess_MakeLeftHanded }, { "FlipUVs", aiProcess_FlipUVs }, { "FlipWindingOrder", aiProcess_FlipWindingOrder },
+		{ "RemoveComponent", aiProcess_RemoveComponent }, { "RemoveRedundantMaterials", aiProcess_RemoveRedundantMaterials },
+		{ "EmbedTextures", aiProcess_EmbedTextures }, { "FindInstances", aiProcess_FindInstances }, { "OptimizeGraph", aiProcess_OptimizeGraph },
+		{ "GenUVCoords", aiProcess_GenUVCoords }, { "TransformUVCoords", aiProcess_TransformUVCoords }, { "GlobalScale", aiProcess_GlobalScale },
+		{ "PopulateArmatureData", aiProcess_PopulateArmatureData }, { "PreTransformVertices", aiProcess_PreTransformVertices },
+		{ "Triangulate", aiProcess_Triangulate }, { "FindDegenerates", aiProcess_FindDegenerates }, { "SortByPType", aiProcess_SortByPType },
+		{ "FindInvalidData", aiProcess_FindInvalidData }, { "OptimizeMeshes", aiProcess_OptimizeMeshes },
+		{ "FixInfacingNormals", aiProcess_FixInfacingNormals }, { "SplitByBoneCount", aiProcess_SplitByBoneCount },
+		{ "SplitLargeMeshes (triangles)", aiProcess_SplitLargeMeshes }, { "DropNormals", aiProcess_DropNormals }, { "GenNormals", aiProcess_GenNormals },
+		{ "SpatialSort", 0 }, { "GenSmoothNormals", aiProcess_GenSmoothNormals }, { "CalcTangentSpace", aiProcess_CalcTangentSpace },
+		{ "JoinIdenticalVertices", aiProcess_JoinIdenticalVertices }, { "SpatialSort (cleanup)", 0 },
+		{ "SplitLargeMeshes (vertices)", aiProcess_SplitLargeMeshes }, { "Debone", aiProcess_Debone },
+		{ "LimitBoneWeights", aiProcess_LimitBoneWeights }, { "ImproveCacheLocality", aiProcess_ImproveCacheLocality },
+		{ "GenBoundingBoxes", aiProcess_GenBoundingBoxes } };
+
+	// Measures the time of each stage of the AssImp import: the file read and each post-processing step.
+	// AssImp reports the index of each step before it is executed, whether it is active or not.
+	class CImportProgress : public Assimp::ProgressHandler
+	{
+		C3dglLoadProfile* m_pProfile;
+		unsigned m_flags;
+		int m_step = -1;		// current step; -1 = reading the file
+		int m_nSteps = 0;		// total number of steps
+		std::chrono::high_resolution_clock::time_point m_t = std::chrono::high_resolution_clock::now();
+
+	public:
+		CImportProgress(C3dglLoadProfile* pProfile, unsigned flags) : m_pProfile(pProfile), m_flags(flags) { }
+
+		bool Update(float) override { return true; }
+		void UpdatePostProcess(int currentStep, int numberOfSteps) override
+		{
+			m_nSteps = numberOfSteps;
+			finish();
+			m_step = currentStep;
+		}
+
+		// closes the current stage
+		void finish()
+		{
+			auto t = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(t - m_t).count();
+			m_t = t;
+
+			if (m_step < 0)
+				m_pProfile->add("AssImp read", ms);
+			else if (m_step >= m_nSteps)
+				return;
+			else if ((size_t)m_nSteps == std::size(c_aiSteps))
+			{
+				// only active steps are reported
+				auto& step = c_aiSteps[m_step];
+				if ((step.second & m_flags) != 0 || (step.second == 0 && ms >= 0.01))
+					m_pProfile->add(std::string("AssImp ") + step.first, ms);
+			}
+			else if (ms >= 0.01)
+				m_pProfile->add(std::format("AssImp step #{}", m_step), ms);	// unknown version of AssImp
+		}
+	};
+}
+
 C3dglModel::C3dglModel() : C3dglObject(), m_globInvT(1)
 { 
 	m_pScene = NULL; 
+	m_pImporter = NULL;
 	m_bFBXImportPreservePivots = false;
+	m_bNativeOBJImport = true;
+	m_bNativeScene = false;
+	m_bPackedScene = false;
 }
 
 bool C3dglModel::load(const char* filename, unsigned int flags, C3dglProgram* pProgram)
@@ -39,20 +115,60 @@ bool C3dglModel::load(const char* filename, unsigned int flags, C3dglProgram* pP
 	i = m_name.find_last_of(".");
 	if (i != std::string::npos) m_name = m_name.substr(0, i);
 
+	log(M3DGL_SUCCESS_IMPORTING_FILE, filename);
+	m_profile.reset();
+
+	// baked model from a mounted asset pack - falls back to the file if baked with different flags
+	C3dglAssetPack* pPack = C3dglAssetPack::findMounted(filename, ASSET_MODEL);
+	if (pPack)
+	{
+		C3dglProfileTimer timer(&m_profile, "asset pack read");
+		const aiScene* pScene = pPack->loadScene(filename, flags);
+		timer.stop();
+		if (pScene)
+		{
+			create(pScene, pProgram);
+			m_bPackedScene = true;
+			return true;
+		}
+	}
+
+	// native OBJ loader - falls back to AssImp if failed
+	if (m_bNativeOBJImport && C3dglObjLoader::canLoad(filename, flags))
+	{
+		C3dglProfileTimer timer(&m_profile, "native OBJ read");
+		const aiScene* pScene = C3dglObjLoader().load(filename, flags);
+		timer.stop();
+		if (pScene)
+		{
+			create(pScene, pProgram);
+			m_bNativeScene = true;
+			return true;
+		}
+	}
+
 	unsigned logOptions = (C3dglLogger::getOptions() & C3dglLogger::LOGGER_SHOW_ASSIMP_VERBOSE_MESSAGES) >> 2;
 	if (logOptions != 0)
 		Assimp::DefaultLogger::create("", (Assimp::Logger::LogSeverity)(logOptions - 1), aiDefaultLogStream_STDOUT);
 
-	log(M3DGL_SUCCESS_IMPORTING_FILE, filename);
-	aiPropertyStore* ps = ::aiCreatePropertyStore();
-	::aiSetImportPropertyInteger(ps, AI_CONFIG_IMPORT_FBX_PRESERVE_PIVOTS, m_bFBXImportPreservePivots);
-	const aiScene* pScene = aiImportFileExWithProperties(filename, flags, NULL, ps);
+	CImportProgress progress(&m_profile, flags);
+	m_pImporter = new Assimp::Importer;
+	m_pImporter->SetPropertyBool(AI_CONFIG_IMPORT_FBX_PRESERVE_PIVOTS, m_bFBXImportPreservePivots);
+	m_pImporter->SetProgressHandler(&progress);
+	const aiScene* pScene = m_pImporter->ReadFile(filename, flags);
+	progress.finish();
+	m_pImporter->SetProgressHandler(NULL);	// the handler is owned by this function, not by the importer
 	
 	if ((C3dglLogger::getOptions() & C3dglLogger::LOGGER_SHOW_ASSIMP_VERBOSE_MESSAGES) != 0)
 		Assimp::DefaultLogger::kill();
 	
 	if (pScene == NULL)
-		return log(M3DGL_ERROR_AI, aiGetErrorString());
+	{
+		std::string error = m_pImporter->GetErrorString();
+		delete m_pImporter;
+		m_pImporter = NULL;
+		return log(M3DGL_ERROR_AI, error);
+	}
 	create(pScene, pProgram);
 	return true;
 }
@@ -108,14 +224,25 @@ unsigned C3dglModel::loadAnimations(C3dglModel* pCompatibleModel)
 
 void C3dglModel::destroy()
 {
+	C3dglTextureStreamer::getInstance().forget(this);
 	if (m_pScene)
 	{
 		for (C3dglMesh mesh : m_meshes)
 			mesh.destroy();
 		for (C3dglMaterial mat : m_materials)
 			mat.destroy();
-		aiReleaseImport(m_pScene);
+		if (m_pImporter)
+			delete m_pImporter;		// also releases the scene
+		else if (m_bNativeScene)
+			C3dglObjLoader::release(m_pScene);
+		else if (m_bPackedScene)
+			C3dglAssetPack::release(m_pScene);
+		else
+			aiReleaseImport(m_pScene);
 		m_pScene = NULL;
+		m_pImporter = NULL;
+		m_bNativeScene = false;
+		m_bPackedScene = false;
 	}
 }
 
@@ -123,11 +250,13 @@ void C3dglModel::renderNode(aiNode* pNode, glm::mat4 m, GLsizei instances, C3dgl
 {
 	m *= glm::transpose(glm::make_mat4((GLfloat*)&pNode->mTransformation));
 
-	// render all meshes (and their materials)
+	// render all meshes (and their materials - not needed by position-only programs, such as a depth pre-pass)
+	C3dglProgram* pCurrent = pProgram ? pProgram : C3dglProgram::getCurrentProgram();
+	bool bMaterials = !(pCurrent && pCurrent->isPositionOnly());
 	for (unsigned iMesh : std::vector<unsigned>(pNode->mMeshes, pNode->mMeshes + pNode->mNumMeshes))
 	{
 		const C3dglMesh* pMesh = &m_meshes[iMesh];
-		const C3dglMaterial* pMaterial = pMesh->getMaterial();
+		const C3dglMaterial* pMaterial = bMaterials ? pMesh->getMaterial() : NULL;
 		if (pMaterial)
 			pMaterial->render(pProgram);
 		pMesh->render(m, instances, pProgram);
@@ -142,17 +271,29 @@ void C3dglModel::renderNode(aiNode* pNode, glm::mat4 m, GLsizei instances, C3dgl
 
 void C3dglModel::render(glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram) const
 { 
+	// streamed textures: the levels are requested according to the on-screen size
+	if (C3dglTextureStreamer::getInstance().isRunning())
+		C3dglTextureStreamer::getInstance().request(*this, matrix);
+
+	// texture bindings are cached across the meshes, and restored once
+	C3dglMaterial::beginBatch();
 	if (m_pScene->mRootNode) 
 		renderNode(m_pScene->mRootNode, matrix, instances, pProgram);
+	C3dglMaterial::endBatch();
 }
 
 void C3dglModel::render(unsigned iNode, glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram) const
 {
+	if (C3dglTextureStreamer::getInstance().isRunning())
+		C3dglTextureStreamer::getInstance().request(*this, matrix);
+
 	// update transform
 	matrix *= glm::transpose(glm::make_mat4((GLfloat*)&m_pScene->mRootNode->mTransformation));
 
+	C3dglMaterial::beginBatch();
 	if (iNode <= getMainNodeCount())
 		renderNode(m_pScene->mRootNode->mChildren[iNode], matrix, instances, pProgram);
+	C3dglMaterial::endBatch();
 }
 
 unsigned C3dglModel::getMainNodeCount() const
@@ -316,6 +457,23 @@ void C3dglModel::stats(unsigned level) const
 	C3dglLogger::log("** Statistics for the model: {}", getName());
 	C3dglLogger::log("Nodes: {}, Meshes: {}, Materials: {}, Bones: {}, Animations: {}, Channels: {}",
 		nNodes, getMeshCount(), getMaterialCount(), getBoneCount(), getAnimationCount(), hasAnimations() ? m_pScene->mAnimations[0]->mNumChannels : 0);
+
+	// GPU memory; texture sizes as registered in C3dglMemoryTracker, textures shared between materials counted once
+	C3dglMemoryTracker& tracker = C3dglMemoryTracker::getInstance();
+	size_t nBufferBytes = 0, nTextureBytes = 0;
+	for (const C3dglMesh& mesh : m_meshes)
+		nBufferBytes += mesh.getBufferSize();
+	std::set<unsigned> textures;
+	for (const C3dglMaterial& material : m_materials)
+		for (GLenum texUnit = GL_TEXTURE0; texUnit <= GL_TEXTURE31; texUnit++)
+		{
+			unsigned idTex;
+			if (material.getTexture(texUnit, idTex) && textures.insert(idTex).second)
+				nTextureBytes += std::max(tracker.getSize(MEM_TEXTURE, idTex), tracker.getSize(MEM_STREAMED_TEXTURE, idTex));
+		}
+	C3dglLogger::log("GPU memory: {:.1f} kB in buffers, {:.1f} kB in {} textures", nBufferBytes / 1024.0, nTextureBytes / 1024.0, textures.size());
+	if (!m_profile.isEmpty())
+		m_profile.stats();
 	if (level == 0) return;
 
 	auto statNode = [&](auto&& statNode, std::string pred, aiNode* pNode) -> void
@@ -347,3 +505,20 @@ void C3dglModel::stats(unsigned level) const
 		}
 	}
 }
+
+bool C3dglModel::validateImportFlags(const char* filename, unsigned flags, unsigned referenceFlags)
+{
+	C3dglLogger::log("Validating import flags 0x{:x} against 0x{:x}: {}", flags, referenceFlags, filename);
+
+	const aiScene* pScene = aiImportFile(filename, flags);
+	const aiScene* pReference = aiImportFile(filename, referenceFlags);
+	bool bMatch = false;
+	if (pScene && pReference)
+		bMatch = compareSceneGeometry(pScene, pReference, filename);
+	else
+		C3dglLogger::log(M3DGL_ERROR_AI, filename, aiGetErrorString());
+	
+	if (pScene) aiReleaseImport(pScene);
+	if (pReference) aiReleaseImport(pReference);
+	return bMatch;
+}
@@ -0,0 +1,877 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <charconv>
+#include <chrono>
+#include <cfloat>
+#include <3dgl/ObjLoader.h>
+#include "MappedFile.h"
+#include "SceneCompare.h"
+
+// assimp include file
+#include "assimp/scene.h"
+#include "assimp/postprocess.h"
+#include <assimp/cimport.h>
+
+using namespace _3dgl;
+
+const unsigned C3dglObjLoader::c_supportedFlags = aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_Triangulate
+	| aiProcess_GenNormals | aiProcess_GenSmoothNormals | aiProcess_ValidateDataStructure | aiProcess_FindDegenerates
+	| aiProcess_FlipUVs | aiProcess_FlipWindingOrder;
+
+const unsigned C3dglObjLoader::c_defaultFlags = aiProcessPreset_TargetRealtime_MaxQuality & C3dglObjLoader::c_supportedFlags;
+
+namespace
+{
+	const size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+	// OBJ statements that affect the structure of the model
+	enum STATEMENT { OBJ_OBJECT, OBJ_GROUP, OBJ_USEMTL, OBJ_MTLLIB };
+
+	struct EVENT
+	{
+		STATEMENT type;
+		std::string name;
+		size_t face;						// index of the first face that follows the statement
+	};
+
+	// Results of parsing a single, line-aligned chunk of the file
+	struct CHUNK
+	{
+		const char* pBegin, * pEnd;
+		std::vector<float> v, vt, vn;		// 3, 2 and 3 components
+		std::vector<int> corners;			// 3 zero-based indices (v, vt, vn) per face corner, -1 if not present
+		std::vector<unsigned> faces;		// number of corners in each face
+		std::vector<size_t> relative;		// positions in corners that hold relative indices - these are local to the chunk
+		std::vector<EVENT> events;
+	};
+
+	// The entire file, after the chunks are merged
+	struct OBJFILE
+	{
+		std::vector<float> v, vt, vn;
+		std::vector<int> corners;
+		std::vector<size_t> faces;			// index of the first corner of each face, plus one past the last
+		std::vector<EVENT> events;
+	};
+
+	// Mesh and object structure - follows the rules of the AssImp OBJ importer
+	struct MESH
+	{
+		std::string name;
+		unsigned material = 0;
+		std::vector<std::pair<size_t, size_t> > runs = { };	// ranges of faces
+	};
+
+	struct OBJECT
+	{
+		std::string name;
+		std::vector<size_t> meshes = { };
+	};
+
+	// Material parameters (default values after the AssImp OBJ importer)
+	struct MTL
+	{
+		std::string name;
+		aiColor3D ka = aiColor3D(0, 0, 0), kd = aiColor3D(0.6f, 0.6f, 0.6f), ks = aiColor3D(0, 0, 0), ke = aiColor3D(0, 0, 0);
+		float ns = 0, d = 1;
+		int illum = 1;
+		std::vector<std::pair<aiTextureType, std::string> > maps;
+	};
+
+	// Open addressing hash table used to weld vertices: maps keys to consecutive indices
+	template<class KEY> class CWeldTable
+	{
+		std::vector<KEY> m_keys;
+		std::vector<unsigned> m_vals;	// 0xffffffff = empty slot
+		size_t m_mask;
+	public:
+		CWeldTable(size_t nMax)
+		{
+			size_t n = 16;
+			while (n < nMax * 2) n <<= 1;
+			m_keys.resize(n);
+			m_vals.resize(n, 0xffffffff);
+			m_mask = n - 1;
+		}
+
+		// returns the value associated with the key; if the key is new, associates it with newVal
+		unsigned insert(const KEY& key, unsigned newVal)
+		{
+			for (size_t i = key.hash() & m_mask; ; i = (i + 1) & m_mask)
+			{
+				if (m_vals[i] == 0xffffffff)
+				{
+					m_keys[i] = key;
+					m_vals[i] = newVal;
+					return newVal;
+				}
+				if (m_keys[i] == key)
+					return m_vals[i];
+			}
+		}
+	};
+
+	struct CORNER
+	{
+		int v, vt, vn;
+		bool operator==(const CORNER&) const = default;
+		size_t hash() const { size_t h = (size_t)v * 73856093u ^ (size_t)vt * 19349663u ^ (size_t)vn * 83492791u; return h ^ (h >> 16); }
+	};
+
+	// the bits of the coordinates: vertices listed more than once in the file still share their smooth normals, as in AssImp
+	struct POSITION
+	{
+		uint32_t x, y, z;
+		POSITION() = default;
+		POSITION(const float* p)	{ float f[3] = { p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f }; memcpy(&x, &f[0], 4); memcpy(&y, &f[1], 4); memcpy(&z, &f[2], 4); }	// -0 == +0
+		bool operator==(const POSITION&) const = default;
+		size_t hash() const { size_t h = (size_t)x * 73856093u ^ (size_t)y * 19349663u ^ (size_t)z * 83492791u; return h ^ (h >> 16); }
+	};
+
+	// Parsing helpers. None of them ever goes beyond the end of the current line.
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	inline const char* skipBlank(const char* p, const char* pEnd)
+	{
+		while (p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+		return p;
+	}
+
+	inline const char* skipLine(const char* p, const char* pEnd)
+	{
+		while (p < pEnd && *p != '\n') p++;
+		return p < pEnd ? p + 1 : p;
+	}
+
+	// parses up to n floats; the missing values are left untouched
+	inline const char* parseFloats(const char* p, const char* pEnd, float* pVal, int n)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			p = skipBlank(p, pEnd);
+			if (p < pEnd && *p == '+') p++;
+			auto res = std::from_chars(p, pEnd, pVal[i]);
+			if (res.ptr == p) break;
+			p = res.ptr;
+		}
+		return p;
+	}
+
+	inline const char* parseIndex(const char* p, const char* pEnd, int& val)
+	{
+		if (p < pEnd && *p == '+') p++;
+		return std::from_chars(p, pEnd, val).ptr;
+	}
+
+	// the rest of the line, with the leading and trailing white space removed
+	inline std::string parseName(const char* p, const char* pEnd)
+	{
+		p = skipBlank(p, pEnd);
+		const char* q = p;
+		while (q < pEnd && *q != '\n') q++;
+		while (q > p && isspace((unsigned char)q[-1])) q--;
+		return std::string(p, q);
+	}
+
+	inline bool isKeyword(const char* p, const char* pEnd, const char* keyword)
+	{
+		size_t n = strlen(keyword);
+		return (size_t)(pEnd - p) > n && strncmp(p, keyword, n) == 0 && isBlank(p[n]);
+	}
+
+	const char* parseFace(CHUNK& c, const char* p, const char* pEnd)
+	{
+		int counts[3] = { (int)c.v.size() / 3, (int)c.vt.size() / 2, (int)c.vn.size() / 3 };
+		unsigned n = 0;
+		for (p = skipBlank(p, pEnd); p < pEnd && *p != '\n' && *p != '#'; p = skipBlank(p, pEnd))
+		{
+			int idx[3] = { 0, 0, 0 };
+			for (int k = 0; k < 3; k++)
+			{
+				p = parseIndex(p, pEnd, idx[k]);
+				if (p < pEnd && *p == '/') p++;
+				else break;
+			}
+			if (idx[0] == 0)
+				break;	// malformed corner - skip the rest of the line
+
+			for (int k = 0; k < 3; k++)
+			{
+				if (idx[k] < 0)
+				{
+					c.relative.push_back(c.corners.size());
+					c.corners.push_back(counts[k] + idx[k]);
+				}
+				else
+					c.corners.push_back(idx[k] - 1);
+			}
+			n++;
+		}
+		if (n) c.faces.push_back(n);
+		return p;
+	}
+
+	void parseChunk(CHUNK& c)
+	{
+		const char* pEnd = c.pEnd;
+		for (const char* p = c.pBegin; p < pEnd; p = skipLine(p, pEnd))
+		{
+			p = skipBlank(p, pEnd);
+			if (pEnd - p < 2)
+				continue;
+
+			switch (p[0])
+			{
+			case 'v':
+				if (isBlank(p[1]))
+				{
+					float f[3] = { 0, 0, 0 };
+					p = parseFloats(p + 1, pEnd, f, 3);
+					c.v.insert(c.v.end(), f, f + 3);
+				}
+				else if (p[1] == 't' && pEnd - p > 2 && isBlank(p[2]))
+				{
+					float f[2] = { 0, 0 };
+					p = parseFloats(p + 2, pEnd, f, 2);
+					c.vt.insert(c.vt.end(), f, f + 2);
+				}
+				else if (p[1] == 'n' && pEnd - p > 2 && isBlank(p[2]))
+				{
+					float f[3] = { 0, 0, 0 };
+					p = parseFloats(p + 2, pEnd, f, 3);
+					c.vn.insert(c.vn.end(), f, f + 3);
+				}
+				break;
+			case 'f':
+				if (isBlank(p[1]))
+					p = parseFace(c, p + 1, pEnd);
+				break;
+			case 'o':
+				if (isBlank(p[1]))
+					c.events.push_back({ OBJ_OBJECT, parseName(p + 1, pEnd), c.faces.size() });
+				break;
+			case 'g':
+				if (isBlank(p[1]))
+					c.events.push_back({ OBJ_GROUP, parseName(p + 1, pEnd), c.faces.size() });
+				break;
+			case 'u':
+				if (isKeyword(p, pEnd, "usemtl"))
+					c.events.push_back({ OBJ_USEMTL, parseName(p + 6, pEnd), c.faces.size() });
+				break;
+			case 'm':
+				if (isKeyword(p, pEnd, "mtllib"))
+					c.events.push_back({ OBJ_MTLLIB, parseName(p + 6, pEnd), c.faces.size() });
+				break;
+			}
+		}
+	}
+
+	// Parses an MTL file and appends the materials found
+	bool parseMTL(const std::string& filename, std::vector<MTL>& materials)
+	{
+		C3dglMappedFile file;
+		if (!file.open(filename.c_str()))
+			return false;
+
+		const char* pEnd = file.end();
+		for (const char* p = file.begin(); p < pEnd; p = skipLine(p, pEnd))
+		{
+			p = skipBlank(p, pEnd);
+			const char* q = p;
+			while (q < pEnd && !isspace((unsigned char)*q)) q++;
+			std::string keyword(p, q);
+			if (keyword.empty() || keyword[0] == '#')
+				continue;
+
+			if (keyword == "newmtl")
+			{
+				materials.push_back(MTL());
+				materials.back().name = parseName(q, pEnd);
+				continue;
+			}
+			if (materials.empty())
+				continue;
+
+			MTL& m = materials.back();
+			if (keyword == "Ka") parseFloats(q, pEnd, &m.ka.r, 3);
+			else if (keyword == "Kd") parseFloats(q, pEnd, &m.kd.r, 3);
+			else if (keyword == "Ks") parseFloats(q, pEnd, &m.ks.r, 3);
+			else if (keyword == "Ke") parseFloats(q, pEnd, &m.ke.r, 3);
+			else if (keyword == "Ns") parseFloats(q, pEnd, &m.ns, 1);
+			else if (keyword == "d") parseFloats(q, pEnd, &m.d, 1);
+			else if (keyword == "Tr") { parseFloats(q, pEnd, &m.d, 1); m.d = 1 - m.d; }
+			else if (keyword == "illum") parseIndex(skipBlank(q, pEnd), pEnd, m.illum);
+			else
+			{
+				static const std::map<std::string, aiTextureType> maps = {
+					{ "map_Kd", aiTextureType_DIFFUSE }, { "map_Ka", aiTextureType_AMBIENT }, { "map_Ks", aiTextureType_SPECULAR },
+					{ "map_Ke", aiTextureType_EMISSIVE }, { "map_d", aiTextureType_OPACITY }, { "map_Ns", aiTextureType_SHININESS },
+					{ "map_bump", aiTextureType_HEIGHT }, { "map_Bump", aiTextureType_HEIGHT }, { "bump", aiTextureType_HEIGHT },
+					{ "map_Kn", aiTextureType_NORMALS }, { "norm", aiTextureType_NORMALS }, { "disp", aiTextureType_DISPLACEMENT } };
+				auto it = maps.find(keyword);
+				if (it != maps.end())
+				{
+					// texture options (-bm, -o etc.) are not supported: the file name is the last token in the line
+					std::string path = parseName(q, pEnd);
+					size_t i = path.find_last_of(" \t");
+					if (i != std::string::npos) path = path.substr(i + 1);
+					m.maps.push_back({ it->second, path });
+				}
+			}
+		}
+		return true;
+	}
+
+	aiMaterial* createMaterial(const MTL& m)
+	{
+		aiMaterial* pMat = new aiMaterial;
+		aiString name(m.name);
+		pMat->AddProperty(&name, AI_MATKEY_NAME);
+		int shadingMode = m.illum == 0 ? aiShadingMode_NoShading : m.illum == 1 ? aiShadingMode_Gouraud : aiShadingMode_Phong;
+		pMat->AddProperty(&shadingMode, 1, AI_MATKEY_SHADING_MODEL);
+		pMat->AddProperty(&m.ka, 1, AI_MATKEY_COLOR_AMBIENT);
+		pMat->AddProperty(&m.kd, 1, AI_MATKEY_COLOR_DIFFUSE);
+		pMat->AddProperty(&m.ks, 1, AI_MATKEY_COLOR_SPECULAR);
+		pMat->AddProperty(&m.ke, 1, AI_MATKEY_COLOR_EMISSIVE);
+		pMat->AddProperty(&m.ns, 1, AI_MATKEY_SHININESS);
+		pMat->AddProperty(&m.d, 1, AI_MATKEY_OPACITY);
+		for (auto& map : m.maps)
+		{
+			aiString path(map.second);
+			pMat->AddProperty(&path, AI_MATKEY_TEXTURE(map.first, 0));
+		}
+		return pMat;
+	}
+
+	// Builds a triangular mesh; returns NULL if there are no triangles
+	aiMesh* createMesh(const OBJFILE& obj, const MESH& mesh, unsigned flags)
+	{
+		// count the corners and check which attributes are present
+		size_t nCorners = 0, nTriangles = 0;
+		bool bUV = false, bNormals = false;
+		for (auto& run : mesh.runs)
+			for (size_t f = run.first; f < run.second; f++)
+			{
+				size_t n = obj.faces[f + 1] - obj.faces[f];
+				if (n < 3) continue;	// points and lines are not supported
+				nCorners += n;
+				nTriangles += n - 2;
+				for (size_t i = obj.faces[f]; i < obj.faces[f + 1]; i++)
+				{
+					bUV |= obj.corners[i * 3 + 1] >= 0;
+					bNormals |= obj.corners[i * 3 + 2] >= 0;
+				}
+			}
+		if (nTriangles == 0)
+			return NULL;
+
+		bool bWeld = (flags & aiProcess_JoinIdenticalVertices) != 0;
+		bool bGenNormals = !bNormals && (flags & (aiProcess_GenNormals | aiProcess_GenSmoothNormals));
+		bool bFlat = bGenNormals && (flags & aiProcess_GenSmoothNormals) == 0;
+		bool bTangents = bUV && (bNormals || bGenNormals) && (flags & aiProcess_CalcTangentSpace);
+
+		// weld the vertices: each unique (v, vt, vn) combination becomes a single vertex
+		CWeldTable<CORNER> table(bWeld ? nCorners : 0);
+		std::vector<CORNER> vertices;
+		std::vector<unsigned> indices;
+		std::vector<unsigned> ids;
+		vertices.reserve(nCorners);
+		indices.reserve(nTriangles * 3);
+		for (auto& run : mesh.runs)
+			for (size_t f = run.first; f < run.second; f++)
+			{
+				if (obj.faces[f + 1] - obj.faces[f] < 3) continue;
+				ids.clear();
+				for (size_t i = obj.faces[f]; i < obj.faces[f + 1]; i++)
+				{
+					CORNER key = { obj.corners[i * 3], bUV ? obj.corners[i * 3 + 1] : -1, bNormals ? obj.corners[i * 3 + 2] : -1 };
+					if (bFlat) key.vn = -2 - (int)f;	// flat shading: vertices are not shared between faces
+					unsigned id = bWeld ? table.insert(key, (unsigned)vertices.size()) : (unsigned)vertices.size();
+					if (id == vertices.size())
+						vertices.push_back(key);
+					ids.push_back(id);
+				}
+
+				// triangle fan; degenerate triangles are dropped
+				for (size_t i = 1; i + 1 < ids.size(); i++)
+				{
+					unsigned a = ids[0], b = ids[i], c = ids[i + 1];
+					if (vertices[a].v == vertices[b].v || vertices[b].v == vertices[c].v || vertices[c].v == vertices[a].v)
+						continue;
+					if (flags & aiProcess_FlipWindingOrder) std::swap(b, c);
+					indices.push_back(a);
+					indices.push_back(b);
+					indices.push_back(c);
+				}
+			}
+		if (indices.empty())
+			return NULL;
+
+		aiMesh* pMesh = new aiMesh;
+		pMesh->mName = mesh.name;
+		pMesh->mMaterialIndex = mesh.material;
+		pMesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+
+		size_t nVertices = vertices.size();
+		pMesh->mNumVertices = (unsigned)nVertices;
+		pMesh->mVertices = new aiVector3D[nVertices];
+		for (size_t i = 0; i < nVertices; i++)
+		{
+			const float* p = &obj.v[vertices[i].v * 3];
+			pMesh->mVertices[i] = aiVector3D(p[0], p[1], p[2]);
+		}
+
+		if (bUV)
+		{
+			pMesh->mNumUVComponents[0] = 2;
+			pMesh->mTextureCoords[0] = new aiVector3D[nVertices];
+			for (size_t i = 0; i < nVertices; i++)
+				if (vertices[i].vt >= 0)
+				{
+					const float* p = &obj.vt[vertices[i].vt * 2];
+					pMesh->mTextureCoords[0][i] = aiVector3D(p[0], (flags & aiProcess_FlipUVs) ? 1 - p[1] : p[1], 0);
+				}
+		}
+
+		if (bNormals)
+		{
+			pMesh->mNormals = new aiVector3D[nVertices];
+			for (size_t i = 0; i < nVertices; i++)
+				if (vertices[i].vn >= 0)
+				{
+					const float* p = &obj.vn[vertices[i].vn * 3];
+					pMesh->mNormals[i] = aiVector3D(p[0], p[1], p[2]);
+				}
+		}
+
+		size_t nFaces = indices.size() / 3;
+		pMesh->mNumFaces = (unsigned)nFaces;
+		pMesh->mFaces = new aiFace[nFaces];
+		for (size_t i = 0; i < nFaces; i++)
+		{
+			pMesh->mFaces[i].mNumIndices = 3;
+			pMesh->mFaces[i].mIndices = new unsigned[3];
+			memcpy(pMesh->mFaces[i].mIndices, &indices[i * 3], sizeof(unsigned) * 3);
+		}
+
+		glm::vec3* pV = (glm::vec3*)pMesh->mVertices;
+
+		if (bGenNormals)
+		{
+			// average of the unit face normals; smooth normals are shared by all vertices in the same position.
+			// There is no smoothing angle limit - as in AssImp with its default limit (175 degrees).
+			std::vector<unsigned> slots(nVertices);
+			CWeldTable<POSITION> positions(bFlat ? 0 : nVertices);
+			for (size_t i = 0; i < nVertices; i++)
+				slots[i] = bFlat ? (unsigned)i : positions.insert(POSITION(&obj.v[vertices[i].v * 3]), (unsigned)i);
+
+			std::vector<glm::vec3> normals(nVertices, glm::vec3(0));
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				glm::vec3 n = glm::cross(pV[indices[i + 1]] - pV[indices[i]], pV[indices[i + 2]] - pV[indices[i]]);
+				float len = glm::length(n);
+				if (len == 0) continue;
+				for (int j = 0; j < 3; j++)
+					normals[slots[indices[i + j]]] += n / len;
+			}
+
+			pMesh->mNormals = new aiVector3D[nVertices];
+			for (size_t i = 0; i < nVertices; i++)
+			{
+				glm::vec3 n = normals[slots[i]];
+				float len = glm::length(n);
+				if (len > 0) n /= len;
+				pMesh->mNormals[i] = aiVector3D(n.x, n.y, n.z);
+			}
+		}
+
+		if (bTangents)
+		{
+			glm::vec3* pN = (glm::vec3*)pMesh->mNormals;
+			glm::vec3* pUV = (glm::vec3*)pMesh->mTextureCoords[0];
+			std::vector<glm::vec3> tangents(nVertices, glm::vec3(0)), bitangents(nVertices, glm::vec3(0));
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				unsigned a = indices[i], b = indices[i + 1], c = indices[i + 2];
+				glm::vec3 p1 = pV[b] - pV[a], p2 = pV[c] - pV[a];
+				glm::vec3 t1 = pUV[b] - pUV[a], t2 = pUV[c] - pUV[a];
+				float det = t1.x * t2.y - t2.x * t1.y;
+				if (fabs(det) < 1e-12f) continue;
+				float dir = det < 0 ? -1.0f : 1.0f;
+				glm::vec3 t = (p1 * t2.y - p2 * t1.y) * dir;
+				glm::vec3 bt = (p2 * t1.x - p1 * t2.x) * dir;
+				if (glm::length(t) > 0) t = glm::normalize(t);
+				if (glm::length(bt) > 0) bt = glm::normalize(bt);
+				for (unsigned j : { a, b, c })
+				{
+					tangents[j] += t;
+					bitangents[j] += bt;
+				}
+			}
+
+			pMesh->mTangents = new aiVector3D[nVertices];
+			pMesh->mBitangents = new aiVector3D[nVertices];
+			for (size_t i = 0; i < nVertices; i++)
+			{
+				// orthogonalise against the normal
+				glm::vec3 n = pN[i];
+				glm::vec3 t = tangents[i] - n * glm::dot(tangents[i], n);
+				glm::vec3 bt = bitangents[i] - n * glm::dot(bitangents[i], n);
+				if (glm::length(t) > 0) t = glm::normalize(t);
+				else t = glm::normalize(glm::cross(n, fabs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0)));
+				if (glm::length(bt) > 0) bt = glm::normalize(bt);
+				else bt = glm::cross(n, t);
+				pMesh->mTangents[i] = aiVector3D(t.x, t.y, t.z);
+				pMesh->mBitangents[i] = aiVector3D(bt.x, bt.y, bt.z);
+			}
+		}
+
+		return pMesh;
+	}
+
+	void releaseNode(aiNode* pNode)
+	{
+		for (unsigned i = 0; i < pNode->mNumChildren; i++)
+			releaseNode(pNode->mChildren[i]);
+		delete[] pNode->mChildren;
+		delete[] pNode->mMeshes;
+		pNode->mChildren = NULL;
+		pNode->mMeshes = NULL;
+		pNode->mNumChildren = pNode->mNumMeshes = 0;
+		delete pNode;
+	}
+}
+
+bool C3dglObjLoader::canLoad(const char* filename, unsigned flags)
+{
+	if (flags == 0)
+		flags = c_defaultFlags;
+	std::string ext = filename;
+	size_t i = ext.find_last_of(".");
+	ext = (i == std::string::npos) ? "" : ext.substr(i);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower(c); });
+	return ext == ".obj" && (flags & ~c_supportedFlags) == 0;
+}
+
+const aiScene* C3dglObjLoader::load(const char* filename, unsigned flags)
+{
+	if (flags == 0)
+		flags = c_defaultFlags;
+
+	std::string path = filename;
+	size_t i = path.find_last_of("/\\");
+	std::string folder = (i == std::string::npos) ? "" : path.substr(0, i + 1);
+	std::string filetitle = (i == std::string::npos) ? path : path.substr(i + 1);
+	m_name = filetitle.substr(0, filetitle.find_last_of("."));
+
+	C3dglMappedFile file;
+	if (!file.open(filename))
+	{
+		log(M3DGL_ERROR_CANNOT_OPEN_FILE, filename);
+		return NULL;
+	}
+
+	// split the file into line-aligned chunks
+	unsigned nThreads = m_nThreads ? m_nThreads : std::max(1u, std::thread::hardware_concurrency());
+	size_t nChunks = std::clamp(file.size() / MIN_CHUNK_SIZE, (size_t)1, (size_t)nThreads * 4);
+	std::vector<CHUNK> chunks(nChunks);
+	const char* p = file.begin();
+	for (size_t i = 0; i < nChunks; i++)
+	{
+		chunks[i].pBegin = p;
+		p = (i == nChunks - 1) ? file.end() : std::max(p, file.begin() + file.size() * (i + 1) / nChunks);
+		while (p < file.end() && p > file.begin() && p[-1] != '\n') p++;
+		chunks[i].pEnd = p;
+	}
+
+	// parse in parallel
+	parallelFor(nChunks, [&](size_t i) { parseChunk(chunks[i]); }, nThreads);
+
+	// merge the chunks
+	std::vector<size_t> base(nChunks * 5 + 5, 0);	// for each chunk: v, vt, vn, corners, faces offsets
+	for (size_t i = 0; i < nChunks; i++)
+	{
+		base[i * 5 + 5] = base[i * 5 + 0] + chunks[i].v.size();
+		base[i * 5 + 6] = base[i * 5 + 1] + chunks[i].vt.size();
+		base[i * 5 + 7] = base[i * 5 + 2] + chunks[i].vn.size();
+		base[i * 5 + 8] = base[i * 5 + 3] + chunks[i].corners.size();
+		base[i * 5 + 9] = base[i * 5 + 4] + chunks[i].faces.size();
+	}
+
+	OBJFILE obj;
+	obj.v.resize(base[nChunks * 5 + 0]);
+	obj.vt.resize(base[nChunks * 5 + 1]);
+	obj.vn.resize(base[nChunks * 5 + 2]);
+	obj.corners.resize(base[nChunks * 5 + 3]);
+	obj.faces.resize(base[nChunks * 5 + 4] + 1);
+	int counts[3] = { (int)obj.v.size() / 3, (int)obj.vt.size() / 2, (int)obj.vn.size() / 3 };
+
+	std::atomic<size_t> nInvalid = 0;
+	parallelFor(nChunks, [&](size_t i)
+		{
+			CHUNK& c = chunks[i];
+			const size_t* b = &base[i * 5];
+			std::copy(c.v.begin(), c.v.end(), obj.v.begin() + b[0]);
+			std::copy(c.vt.begin(), c.vt.end(), obj.vt.begin() + b[1]);
+			std::copy(c.vn.begin(), c.vn.end(), obj.vn.begin() + b[2]);
+
+			int* pCorners = obj.corners.data() + b[3];
+			std::copy(c.corners.begin(), c.corners.end(), pCorners);
+			int offsets[3] = { (int)b[0] / 3, (int)b[1] / 2, (int)b[2] / 3 };
+			for (size_t pos : c.relative)
+				pCorners[pos] += offsets[pos % 3];
+
+			size_t nInvalidLocal = 0;
+			for (size_t j = 0; j < c.corners.size(); j++)
+				if (pCorners[j] >= counts[j % 3] || (pCorners[j] < 0 && (j % 3 == 0 || pCorners[j] != -1)))
+					nInvalidLocal++;
+			nInvalid += nInvalidLocal;
+
+			// faces are stored as corner offsets
+			size_t corner = b[3] / 3;
+			size_t* pFaces = &obj.faces[b[4]];
+			for (unsigned n : c.faces)
+			{
+				*pFaces++ = corner;
+				corner += n;
+			}
+		}, nThreads);
+	obj.faces.back() = obj.corners.size() / 3;
+
+	if (nInvalid)
+	{
+		log(M3DGL_ERROR_OBJ_PARSE, std::format("{} face indices out of range", (size_t)nInvalid));
+		return NULL;
+	}
+
+	for (size_t i = 0; i < nChunks; i++)
+		for (EVENT& e : chunks[i].events)
+		{
+			e.face += base[i * 5 + 4];
+			obj.events.push_back(std::move(e));
+		}
+	chunks.clear();
+
+	// load materials; the first material is always the default one
+	std::vector<MTL> materials(1);
+	materials[0].name = AI_DEFAULT_MATERIAL_NAME;
+	for (EVENT& e : obj.events)
+		if (e.type == OBJ_MTLLIB && !parseMTL(folder + e.name, materials))
+		{
+			// just like AssImp, try the file with the same name as the model
+			std::string fallback = folder + m_name + ".mtl";
+			if (!parseMTL(fallback, materials))
+				log(M3DGL_WARNING_MTL_NOT_FOUND, e.name);
+		}
+	std::map<std::string, unsigned> materialIds;
+	for (unsigned i = 0; i < materials.size(); i++)
+		materialIds.insert({ materials[i].name, i });
+
+	// build the object and mesh structure, following the rules of the AssImp OBJ importer:
+	// each "g" statement starts a new object, "usemtl" starts a new mesh within the current object
+	std::vector<OBJECT> objects;
+	std::vector<MESH> meshes;
+	OBJECT* pObject = NULL;
+	MESH* pMesh = NULL;
+	unsigned material = 0;
+	std::string activeGroup;
+
+	auto newMesh = [&](std::string name)
+	{
+		meshes.push_back({ name, material });
+		pMesh = &meshes.back();
+		if (pObject) pObject->meshes.push_back(meshes.size() - 1);
+	};
+	auto newObject = [&](std::string name)
+	{
+		objects.push_back({ name });
+		pObject = &objects.back();
+		newMesh(name);
+	};
+	auto addFaces = [&](size_t first, size_t last)
+	{
+		if (first >= last) return;
+		if (!pObject) newObject("defaultobject");
+		if (!pMesh) newMesh("defaultobject");
+		pMesh->runs.push_back({ first, last });
+	};
+
+	meshes.reserve(obj.events.size() + 1);		// pointers to the elements must remain valid
+	objects.reserve(obj.events.size() + 1);
+	size_t face = 0;
+	for (EVENT& e : obj.events)
+	{
+		addFaces(face, e.face);
+		face = e.face;
+		switch (e.type)
+		{
+		case OBJ_GROUP:
+			if (!e.name.empty() && e.name != activeGroup)
+			{
+				newObject(e.name);
+				activeGroup = e.name;
+			}
+			break;
+		case OBJ_OBJECT:
+			pObject = NULL;
+			for (OBJECT& object : objects)
+				if (object.name == e.name)
+					pObject = &object;
+			if (pObject)
+				newMesh(e.name);
+			else
+				newObject(e.name);
+			break;
+		case OBJ_USEMTL:
+		{
+			auto it = materialIds.find(e.name);
+			if (it == materialIds.end())
+			{
+				log(M3DGL_WARNING_MATERIAL_NOT_FOUND, e.name);
+				material = 0;
+			}
+			else if (it->second != material)
+			{
+				material = it->second;
+				if (pMesh && !pMesh->runs.empty())
+					newMesh(e.name);
+				else if (pMesh)
+					pMesh->material = material;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	addFaces(face, obj.faces.size() - 1);
+
+	// create the meshes in parallel
+	std::vector<aiMesh*> aiMeshes(meshes.size(), NULL);
+	parallelFor(meshes.size(), [&](size_t i) { aiMeshes[i] = createMesh(obj, meshes[i], flags); }, nThreads);
+
+	// create the scene
+	aiScene* pScene = new aiScene;
+	pScene->mNumMaterials = (unsigned)materials.size();
+	pScene->mMaterials = new aiMaterial * [materials.size()];
+	for (size_t i = 0; i < materials.size(); i++)
+		pScene->mMaterials[i] = createMaterial(materials[i]);
+
+	pScene->mNumMeshes = (unsigned)std::count_if(aiMeshes.begin(), aiMeshes.end(), [](aiMesh* p) { return p != NULL; });
+	pScene->mMeshes = new aiMesh * [pScene->mNumMeshes];
+
+	pScene->mRootNode = new aiNode;
+	pScene->mRootNode->mName = filetitle;
+	pScene->mRootNode->mNumChildren = (unsigned)objects.size();
+	pScene->mRootNode->mChildren = new aiNode * [objects.size()];
+	unsigned iMesh = 0;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		aiNode* pNode = new aiNode;
+		pNode->mName = objects[i].name;
+		pNode->mParent = pScene->mRootNode;
+		pScene->mRootNode->mChildren[i] = pNode;
+
+		std::vector<unsigned> nodeMeshes;
+		for (size_t j : objects[i].meshes)
+			if (aiMeshes[j])
+			{
+				nodeMeshes.push_back(iMesh);
+				pScene->mMeshes[iMesh++] = aiMeshes[j];
+			}
+		pNode->mNumMeshes = (unsigned)nodeMeshes.size();
+		pNode->mMeshes = new unsigned[nodeMeshes.size()];
+		std::copy(nodeMeshes.begin(), nodeMeshes.end(), pNode->mMeshes);
+	}
+
+	return pScene;
+}
+
+void C3dglObjLoader::release(const aiScene* pConstScene)
+{
+	if (!pConstScene) return;
+
+	// Everything allocated in this module is also freed here rather than in the AssImp DLL,
+	// which may use a different heap (e.g. in the Debug configuration).
+	aiScene* pScene = const_cast<aiScene*>(pConstScene);
+	for (unsigned i = 0; i < pScene->mNumMeshes; i++)
+		delete pScene->mMeshes[i];
+	for (unsigned i = 0; i < pScene->mNumMaterials; i++)
+		delete pScene->mMaterials[i];
+	delete[] pScene->mMeshes;
+	delete[] pScene->mMaterials;
+	pScene->mMeshes = NULL;
+	pScene->mMaterials = NULL;
+	pScene->mNumMeshes = pScene->mNumMaterials = 0;
+	if (pScene->mRootNode)
+		releaseNode(pScene->mRootNode);
+	pScene->mRootNode = NULL;
+	delete pScene;
+}
+
+bool C3dglObjLoader::compare(const char* filename, unsigned flags)
+{
+	if (flags == 0)
+		flags = c_defaultFlags;
+
+	C3dglObjLoader loader;
+	const aiScene* pNative = loader.load(filename, flags);
+	const aiScene* pAssimp = aiImportFile(filename, flags);
+	if (!pNative || !pAssimp)
+	{
+		if (!pAssimp) loader.log(M3DGL_ERROR_AI, aiGetErrorString());
+		release(pNative);
+		aiReleaseImport(pAssimp);
+		return false;
+	}
+
+	C3dglLogger::log("** Comparison of the {} against AssImp", loader.getName());
+	bool bMatch = compareSceneGeometry(pNative, pAssimp, loader.getName());
+
+	release(pNative);
+	aiReleaseImport(pAssimp);
+	return bMatch;
+}
+
+double C3dglObjLoader::benchmark(const char* filename, unsigned flags, unsigned nRuns)
+{
+	if (flags == 0)
+		flags = c_defaultFlags;
+	nRuns = std::max(nRuns, 1u);
+
+	C3dglMappedFile file(filename);
+	double MB = file.size() / (1024.0 * 1024.0);
+	file.close();
+
+	// returns the best time of nRuns, in seconds
+	auto measure = [nRuns](auto fn)
+	{
+		double best = DBL_MAX;
+		for (unsigned i = 0; i < nRuns; i++)
+		{
+			auto t0 = std::chrono::high_resolution_clock::now();
+			fn();
+			best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count());
+		}
+		return best;
+	};
+
+	C3dglObjLoader loader, loader1(1);
+	double tNative = measure([&]() { release(loader.load(filename, flags)); });
+	double tSingle = measure([&]() { release(loader1.load(filename, flags)); });
+	double tAssimp = measure([&]() { aiReleaseImport(aiImportFile(filename, flags)); });
+
+	C3dglLogger::log("** Benchmark of the {}: {:.2f} MB", loader.getName(), MB);
+	C3dglLogger::log("Native ({} threads): {:.1f} ms, {:.1f} MB/s", std::max(1u, std::thread::hardware_concurrency()), tNative * 1000, MB / tNative);
+	C3dglLogger::log("Native (1 thread): {:.1f} ms, {:.1f} MB/s", tSingle * 1000, MB / tSingle);
+	C3dglLogger::log("AssImp: {:.1f} ms, {:.1f} MB/s, speed-up: x{:.1f}", tAssimp * 1000, MB / tAssimp, tAssimp / tNative);
+
+	return MB / tNative;
+}
@@ -0,0 +1,306 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/Primitive.h>
+#include <3dgl/Shader.h>
+
+using namespace _3dgl;
+
+namespace
+{
+	// Geometry under construction
+	struct GEOMETRY
+	{
+		std::vector<glm::vec3> pos, normal, tangent, bitangent;
+		std::vector<glm::vec2> uv;
+		std::vector<GLuint> indices;
+
+		// Adds a grid of (nu + 1) x (nv + 1) vertices and the triangles between them.
+		// fn(u, v, pos, normal, tangent) is called for u, v in [0..1]; the normal must point to the side from which
+		// the u axis is followed by the v axis counterclockwise, so that the triangles are front-facing from that side.
+		template<class FN> void grid(unsigned nu, unsigned nv, FN fn)
+		{
+			GLuint base = (GLuint)pos.size();
+			for (unsigned j = 0; j <= nv; j++)
+				for (unsigned i = 0; i <= nu; i++)
+				{
+					glm::vec3 p, n, t;
+					float u = (float)i / nu, v = (float)j / nv;
+					fn(u, v, p, n, t);
+					pos.push_back(p);
+					normal.push_back(n);
+					tangent.push_back(t);
+					bitangent.push_back(glm::cross(n, t));
+					uv.push_back(glm::vec2(u, v));
+				}
+
+			// triangles - degenerate ones (at the poles) are skipped
+			auto triangle = [this](GLuint a, GLuint b, GLuint c)
+			{
+				auto distinct = [this](GLuint i, GLuint j) { return glm::distance(pos[i], pos[j]) > 1e-6f; };
+				if (distinct(a, b) && distinct(b, c) && distinct(c, a))
+					indices.insert(indices.end(), { a, b, c });
+			};
+			for (unsigned j = 0; j < nv; j++)
+				for (unsigned i = 0; i < nu; i++)
+				{
+					GLuint i0 = base + j * (nu + 1) + i, i1 = i0 + 1, i2 = i0 + nu + 1, i3 = i2 + 1;
+					triangle(i0, i1, i3);
+					triangle(i0, i3, i2);
+				}
+		}
+	};
+
+	// direction of the increasing angle phi around the Y axis, for points (cos phi, 0, -sin phi)
+	glm::vec3 around(float phi)		{ return glm::vec3(-std::sin(phi), 0, -std::cos(phi)); }
+	glm::vec3 radial(float phi)		{ return glm::vec3(std::cos(phi), 0, -std::sin(phi)); }
+
+	// Utah teapot - Bezier patches, as in the original SGI/GLUT implementation. The model is Z-up.
+	// Patches 0-5 are mirrored four times around the Z axis, patches 6-9 (handle and spout) - twice.
+	const int c_teapotPatches[10][16] =
+	{
+		// rim
+		{ 102, 103, 104, 105, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+		// body
+		{ 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27 },
+		{ 24, 25, 26, 27, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40 },
+		// lid
+		{ 96, 96, 96, 96, 97, 98, 99, 100, 101, 101, 101, 101, 0, 1, 2, 3 },
+		{ 0, 1, 2, 3, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117 },
+		// bottom
+		{ 118, 118, 118, 118, 124, 122, 119, 121, 123, 126, 125, 120, 40, 39, 38, 37 },
+		// handle
+		{ 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56 },
+		{ 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 28, 65, 66, 67 },
+		// spout
+		{ 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83 },
+		{ 80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95 }
+	};
+
+	const float c_teapotPoints[127][3] =
+	{
+		{ 0.2f, 0, 2.7f }, { 0.2f, -0.112f, 2.7f }, { 0.112f, -0.2f, 2.7f }, { 0, -0.2f, 2.7f },
+		{ 1.3375f, 0, 2.53125f }, { 1.3375f, -0.749f, 2.53125f }, { 0.749f, -1.3375f, 2.53125f }, { 0, -1.3375f, 2.53125f },
+		{ 1.4375f, 0, 2.53125f }, { 1.4375f, -0.805f, 2.53125f }, { 0.805f, -1.4375f, 2.53125f }, { 0, -1.4375f, 2.53125f },
+		{ 1.5f, 0, 2.4f }, { 1.5f, -0.84f, 2.4f }, { 0.84f, -1.5f, 2.4f }, { 0, -1.5f, 2.4f },
+		{ 1.75f, 0, 1.875f }, { 1.75f, -0.98f, 1.875f }, { 0.98f, -1.75f, 1.875f }, { 0, -1.75f, 1.875f },
+		{ 2, 0, 1.35f }, { 2, -1.12f, 1.35f }, { 1.12f, -2, 1.35f }, { 0, -2, 1.35f },
+		{ 2, 0, 0.9f }, { 2, -1.12f, 0.9f }, { 1.12f, -2, 0.9f }, { 0, -2, 0.9f },
+		{ -2, 0, 0.9f },
+		{ 2, 0, 0.45f }, { 2, -1.12f, 0.45f }, { 1.12f, -2, 0.45f }, { 0, -2, 0.45f },
+		{ 1.5f, 0, 0.225f }, { 1.5f, -0.84f, 0.225f }, { 0.84f, -1.5f, 0.225f }, { 0, -1.5f, 0.225f },
+		{ 1.5f, 0, 0.15f }, { 1.5f, -0.84f, 0.15f }, { 0.84f, -1.5f, 0.15f }, { 0, -1.5f, 0.15f },
+		{ -1.6f, 0, 2.025f }, { -1.6f, -0.3f, 2.025f }, { -1.5f, -0.3f, 2.25f }, { -1.5f, 0, 2.25f },
+		{ -2.3f, 0, 2.025f }, { -2.3f, -0.3f, 2.025f }, { -2.5f, -0.3f, 2.25f }, { -2.5f, 0, 2.25f },
+		{ -2.7f, 0, 2.025f }, { -2.7f, -0.3f, 2.025f }, { -3, -0.3f, 2.25f }, { -3, 0, 2.25f },
+		{ -2.7f, 0, 1.8f }, { -2.7f, -0.3f, 1.8f }, { -3, -0.3f, 1.8f }, { -3, 0, 1.8f },
+		{ -2.7f, 0, 1.575f }, { -2.7f, -0.3f, 1.575f }, { -3, -0.3f, 1.35f }, { -3, 0, 1.35f },
+		{ -2.5f, 0, 1.125f }, { -2.5f, -0.3f, 1.125f }, { -2.65f, -0.3f, 0.9375f }, { -2.65f, 0, 0.9375f },
+		{ -2, -0.3f, 0.9f }, { -1.9f, -0.3f, 0.6f }, { -1.9f, 0, 0.6f },
+		{ 1.7f, 0, 1.425f }, { 1.7f, -0.66f, 1.425f }, { 1.7f, -0.66f, 0.6f }, { 1.7f, 0, 0.6f },
+		{ 2.6f, 0, 1.425f }, { 2.6f, -0.66f, 1.425f }, { 3.1f, -0.66f, 0.825f }, { 3.1f, 0, 0.825f },
+		{ 2.3f, 0, 2.1f }, { 2.3f, -0.25f, 2.1f }, { 2.4f, -0.25f, 2.025f }, { 2.4f, 0, 2.025f },
+		{ 2.7f, 0, 2.4f }, { 2.7f, -0.25f, 2.4f }, { 3.3f, -0.25f, 2.4f }, { 3.3f, 0, 2.4f },
+		{ 2.8f, 0, 2.475f }, { 2.8f, -0.25f, 2.475f }, { 3.525f, -0.25f, 2.49375f }, { 3.525f, 0, 2.49375f },
+		{ 2.9f, 0, 2.475f }, { 2.9f, -0.15f, 2.475f }, { 3.45f, -0.15f, 2.5125f }, { 3.45f, 0, 2.5125f },
+		{ 2.8f, 0, 2.4f }, { 2.8f, -0.15f, 2.4f }, { 3.2f, -0.15f, 2.4f }, { 3.2f, 0, 2.4f },
+		{ 0, 0, 3.15f }, { 0.8f, 0, 3.15f }, { 0.8f, -0.45f, 3.15f }, { 0.45f, -0.8f, 3.15f }, { 0, -0.8f, 3.15f },
+		{ 0, 0, 2.85f },
+		{ 1.4f, 0, 2.4f }, { 1.4f, -0.784f, 2.4f }, { 0.784f, -1.4f, 2.4f }, { 0, -1.4f, 2.4f },
+		{ 0.4f, 0, 2.55f }, { 0.4f, -0.224f, 2.55f }, { 0.224f, -0.4f, 2.55f }, { 0, -0.4f, 2.55f },
+		{ 1.3f, 0, 2.55f }, { 1.3f, -0.728f, 2.55f }, { 0.728f, -1.3f, 2.55f }, { 0, -1.3f, 2.55f },
+		{ 1.3f, 0, 2.4f }, { 1.3f, -0.728f, 2.4f }, { 0.728f, -1.3f, 2.4f }, { 0, -1.3f, 2.4f },
+		{ 0, 0, 0 }, { 1.425f, -0.798f, 0 }, { 1.5f, 0, 0.075f }, { 1.425f, 0, 0 },
+		{ 0.798f, -1.425f, 0 }, { 0, -1.5f, 0.075f }, { 0, -1.425f, 0 }, { 1.5f, -0.84f, 0.075f },
+		{ 0.84f, -1.5f, 0.075f }
+	};
+
+	// cubic Bernstein polynomials and their derivatives
+	void bernstein(float t, float b[4], float d[4])
+	{
+		float s = 1 - t;
+		b[0] = s * s * s; b[1] = 3 * t * s * s; b[2] = 3 * t * t * s; b[3] = t * t * t;
+		d[0] = -3 * s * s; d[1] = 3 * s * s - 6 * t * s; d[2] = 6 * t * s - 3 * t * t; d[3] = 3 * t * t;
+	}
+
+	// evaluates the Bezier patch: position and partial derivatives
+	void evalPatch(const glm::vec3 cp[4][4], float u, float v, glm::vec3& p, glm::vec3& du, glm::vec3& dv)
+	{
+		float bu[4], bv[4], du_[4], dv_[4];
+		bernstein(u, bu, du_);
+		bernstein(v, bv, dv_);
+		p = du = dv = glm::vec3(0);
+		for (int j = 0; j < 4; j++)
+			for (int k = 0; k < 4; k++)
+			{
+				p += bv[j] * bu[k] * cp[j][k];
+				du += bv[j] * du_[k] * cp[j][k];
+				dv += dv_[j] * bu[k] * cp[j][k];
+			}
+	}
+}
+
+/*********************************************************************************
+** class C3dglPrimitive
+*/
+
+C3dglPrimitive::C3dglPrimitive() : C3dglVertexAttrObject(ATTR_COUNT_EXT), m_aabb{ glm::vec3(), glm::vec3() }	// "extended set" of attributes - with tangents and bitangents
+{
+}
+
+void C3dglPrimitive::create(std::string name, size_t nVertices, float** attrData, size_t nIndices, GLuint* indexData, C3dglProgram* pProgram)
+{
+	if (getAttrCount() != ATTR_COUNT_EXT)
+	{
+		log(M3DGL_INTERNAL_ERROR);
+		return;		// this should never happen!
+	}
+
+	destroy();
+	m_name = name;
+
+	// bounding box
+	glm::vec3* pPos = (glm::vec3*)attrData[ATTR_VERTEX];
+	m_aabb[0] = m_aabb[1] = nVertices ? pPos[0] : glm::vec3();
+	for (size_t i = 0; i < nVertices; i++)
+	{
+		m_aabb[0] = glm::min(m_aabb[0], pPos[i]);
+		m_aabb[1] = glm::max(m_aabb[1], pPos[i]);
+	}
+
+	size_t attrSize[ATTR_COUNT_EXT] = { sizeof(glm::vec3), sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3), sizeof(glm::vec3) };
+	C3dglVertexAttrObject::create(ATTR_COUNT_EXT, nVertices, (void**)attrData, attrSize, nIndices, indexData, sizeof(GLuint), pProgram);
+}
+
+// sends the generated geometry to C3dglPrimitive::create
+#define CREATE_FROM(name, g) \
+	{ float* attrData[ATTR_COUNT_EXT] = { (float*)g.pos.data(), (float*)g.normal.data(), (float*)g.uv.data(), (float*)g.tangent.data(), (float*)g.bitangent.data() }; \
+	create(name, g.pos.size(), attrData, g.indices.size(), g.indices.data(), pProgram); }
+
+void C3dglPrimitive::createSphere(float radius, unsigned slices, unsigned stacks, C3dglProgram* pProgram)
+{
+	GEOMETRY g;
+	g.grid(slices, stacks, [radius](float u, float v, glm::vec3& p, glm::vec3& n, glm::vec3& t)
+		{
+			float phi = u * glm::two_pi<float>(), theta = (v - 0.5f) * glm::pi<float>();
+			n = radial(phi) * std::cos(theta) + glm::vec3(0, std::sin(theta), 0);
+			p = radius * n;
+			t = around(phi);
+		});
+	CREATE_FROM("sphere", g);
+}
+
+void C3dglPrimitive::createCube(float size, C3dglProgram* pProgram)
+{
+	// normal, u axis, v axis of each face
+	const glm::vec3 faces[6][3] = {
+		{ { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } }, { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+		{ { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } }, { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+		{ { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } }, { { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } } };
+
+	GEOMETRY g;
+	for (auto& face : faces)
+		g.grid(1, 1, [&face, size](float u, float v, glm::vec3& p, glm::vec3& n, glm::vec3& t)
+			{
+				p = (face[0] + (2 * u - 1) * face[1] + (2 * v - 1) * face[2]) * size / 2.f;
+				n = face[0];
+				t = face[1];
+			});
+	CREATE_FROM("cube", g);
+}
+
+void C3dglPrimitive::createCone(float base, float height, unsigned slices, unsigned stacks, C3dglProgram* pProgram)
+{
+	GEOMETRY g;
+	glm::vec2 slope = glm::normalize(glm::vec2(height, base));
+	g.grid(slices, stacks, [base, height, slope](float u, float v, glm::vec3& p, glm::vec3& n, glm::vec3& t)
+		{
+			float phi = u * glm::two_pi<float>();
+			p = radial(phi) * base * (1 - v) + glm::vec3(0, v * height, 0);
+			n = radial(phi) * slope.x + glm::vec3(0, slope.y, 0);
+			t = around(phi);
+		});
+	g.grid(slices, 1, [base](float u, float v, glm::vec3& p, glm::vec3& n, glm::vec3& t)
+		{
+			float phi = u * glm::two_pi<float>();
+			p = radial(phi) * base * v;
+			n = glm::vec3(0, -1, 0);
+			t = around(phi);
+		});
+	CREATE_FROM("cone", g);
+}
+
+void C3dglPrimitive::createTorus(float innerRadius, float outerRadius, unsigned sides, unsigned rings, C3dglProgram* pProgram)
+{
+	GEOMETRY g;
+	g.grid(rings, sides, [innerRadius, outerRadius](float u, float v, glm::vec3& p, glm::vec3& n, glm::vec3& t)
+		{
+			float phi = u * glm::two_pi<float>(), theta = v * glm::two_pi<float>();
+			n = radial(phi) * std::cos(theta) + glm::vec3(0, std::sin(theta), 0);
+			p = radial(phi) * outerRadius + n * innerRadius;
+			t = around(phi);
+		});
+	CREATE_FROM("torus", g);
+}
+
+void C3dglPrimitive::createPlane(float sizeX, float sizeZ, unsigned divX, unsigned divZ, C3dglProgram* pProgram)
+{
+	GEOMETRY g;
+	g.grid(divX, divZ, [sizeX, sizeZ](float u, float v, glm::vec3& p, glm::vec3& n, glm::vec3& t)
+		{
+			p = glm::vec3((u - 0.5f) * sizeX, 0, (0.5f - v) * sizeZ);
+			n = glm::vec3(0, 1, 0);
+			t = glm::vec3(1, 0, 0);
+		});
+	CREATE_FROM("plane", g);
+}
+
+void C3dglPrimitive::createTeapot(float size, unsigned grid, C3dglProgram* pProgram)
+{
+	// GLUT transformation: rotate 270 deg around X, scale by size / 2, move down by 1.5
+	float scale = size / 2;
+	auto transform = [](glm::vec3 v) { return glm::vec3(v.x, v.z, -v.y); };
+
+	GEOMETRY g;
+	for (int iPatch = 0; iPatch < 10; iPatch++)
+	{
+		// mirrored copies: flip X, flip Y; when flipping only one axis, the rows are reversed to keep the orientation
+		int nCopies = iPatch < 6 ? 4 : 2;
+		const glm::vec2 flips[4] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+		for (int iCopy = 0; iCopy < nCopies; iCopy++)
+		{
+			glm::vec3 cp[4][4];
+			glm::vec2 flip = flips[iCopy];
+			bool bReverse = flip.x * flip.y < 0;
+			for (int j = 0; j < 4; j++)
+				for (int k = 0; k < 4; k++)
+				{
+					const float* pt = c_teapotPoints[c_teapotPatches[iPatch][j * 4 + (bReverse ? 3 - k : k)]];
+					cp[j][k] = glm::vec3(pt[0] * flip.x, pt[1] * flip.y, pt[2]);
+				}
+
+			g.grid(grid, grid, [&cp, scale, transform](float u, float v, glm::vec3& p, glm::vec3& n, glm::vec3& t)
+				{
+					glm::vec3 du, dv;
+					evalPatch(cp, u, v, p, du, dv);
+					n = glm::cross(du, dv);
+					if (glm::length(n) < 1e-6f)
+					{
+						// degenerate point (a pole of the patch): use the derivatives from a point nearby
+						glm::vec3 p1;
+						evalPatch(cp, glm::clamp(u, 0.001f, 0.999f), glm::clamp(v, 0.001f, 0.999f), p1, du, dv);
+						n = glm::cross(du, dv);
+					}
+					if (glm::length(du) < 1e-6f)
+						du = glm::cross(dv, n);
+					p = transform(p - glm::vec3(0, 0, 1.5f)) * scale;
+					n = transform(glm::normalize(n));
+					t = transform(glm::normalize(du));
+				});
+		}
+	}
+	CREATE_FROM("teapot", g);
+}
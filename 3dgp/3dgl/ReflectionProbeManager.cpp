@@ -0,0 +1,162 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/ReflectionProbeManager.h>
+#include <3dgl/Shader.h>
+#include <3dgl/Texture.h>
+
+// standard libraries
+#include <algorithm>
+#include <filesystem>
+
+using namespace _3dgl;
+
+C3dglReflectionProbeManager::C3dglReflectionProbeManager() : C3dglObject()
+{
+	m_bBlending = true;
+	m_nBaked = m_nLoaded = 0;
+}
+
+unsigned C3dglReflectionProbeManager::addStatic(std::string name, glm::vec3 position, glm::vec3 boxMin, glm::vec3 boxMax, unsigned size)
+{
+	std::shared_ptr<C3dglCubeMapRenderer> pRenderer = std::make_shared<C3dglCubeMapRenderer>();
+	if (!pRenderer->create(size))
+		return (unsigned)-1;
+	m_probes.push_back({ PROBE_STATIC, name, position, boxMin, boxMax, false, pRenderer });
+	return (unsigned)m_probes.size() - 1;
+}
+
+unsigned C3dglReflectionProbeManager::addDynamic(glm::vec3 position, glm::vec3 boxMin, glm::vec3 boxMax, unsigned size)
+{
+	std::shared_ptr<C3dglCubeMapRenderer> pRenderer = std::make_shared<C3dglCubeMapRenderer>();
+	if (!pRenderer->create(size))
+		return (unsigned)-1;
+	m_probes.push_back({ PROBE_DYNAMIC, "", position, boxMin, boxMax, false, pRenderer });
+	return (unsigned)m_probes.size() - 1;
+}
+
+void C3dglReflectionProbeManager::destroy()
+{
+	m_probes.clear();
+}
+
+void C3dglReflectionProbeManager::rebake()
+{
+	for (PROBE& probe : m_probes)
+		probe.bReady = false;
+}
+
+void C3dglReflectionProbeManager::invalidate(glm::vec3 center, float radius)
+{
+	for (PROBE& probe : m_probes)
+		if (probe.type == PROBE_DYNAMIC)
+			probe.pRenderer->invalidate(center, radius);
+}
+
+std::string C3dglReflectionProbeManager::getCacheFilename(const PROBE& probe) const
+{
+	if (C3dglTexture::getCacheDirectory().empty() || probe.name.empty())
+		return "";
+	return (std::filesystem::path(C3dglTexture::getCacheDirectory()) / (probe.name + ".cube")).string();
+}
+
+void C3dglReflectionProbeManager::update(std::function<void(C3dglCubeMapRenderer& renderer, glm::vec3 position)> capture)
+{
+	for (PROBE& probe : m_probes)
+		if (probe.type == PROBE_DYNAMIC)
+			capture(*probe.pRenderer, probe.position);
+		else if (!probe.bReady)
+		{
+			// static probes: from the cache, if possible; otherwise captured once and cached
+			std::string filename = getCacheFilename(probe);
+			if (!filename.empty() && probe.pRenderer->load(filename))
+				m_nLoaded++;
+			else
+			{
+				probe.pRenderer->invalidate();
+				capture(*probe.pRenderer, probe.position);
+				m_nBaked++;
+				if (!filename.empty())
+					probe.pRenderer->save(filename);
+			}
+			probe.bReady = true;
+		}
+}
+
+bool C3dglReflectionProbeManager::contains(const PROBE& probe, glm::vec3 position) const
+{
+	return glm::all(glm::lessThan(probe.boxMin, probe.boxMax))
+		&& glm::all(glm::greaterThanEqual(position, probe.boxMin)) && glm::all(glm::lessThanEqual(position, probe.boxMax));
+}
+
+bool C3dglReflectionProbeManager::select(glm::vec3 position, unsigned& probe1, unsigned& probe2, float& blend) const
+{
+	if (m_probes.empty())
+		return false;
+
+	// the probes containing the position first, then the nearest
+	std::vector<unsigned> probes;
+	for (unsigned i = 0; i < m_probes.size(); i++)
+		probes.push_back(i);
+	auto key = [&](unsigned i) { return std::make_pair(!contains(m_probes[i], position), glm::distance(m_probes[i].position, position)); };
+	std::sort(probes.begin(), probes.end(), [&](unsigned a, unsigned b) { return key(a) < key(b); });
+
+	probe1 = probe2 = probes[0];
+	blend = 0;
+
+	// blended with the second nearest, unless only the nearest contains the position
+	if (m_bBlending && probes.size() > 1 && contains(m_probes[probes[0]], position) == contains(m_probes[probes[1]], position))
+	{
+		float d1 = glm::distance(m_probes[probes[0]].position, position);
+		float d2 = glm::distance(m_probes[probes[1]].position, position);
+		probe2 = probes[1];
+		blend = d1 + d2 > 0 ? d1 / (d1 + d2) : 0.5f;
+	}
+	return true;
+}
+
+void C3dglReflectionProbeManager::send(C3dglProgram* pProgram, unsigned probe, std::string uniform, std::string sampler, GLenum texUnit) const
+{
+	const PROBE& p = m_probes[probe];
+	p.pRenderer->bind(texUnit);
+	pProgram->sendUniform(sampler, (int)(texUnit - GL_TEXTURE0));
+	pProgram->sendUniform(uniform + ".position", p.position);
+	pProgram->sendUniform(uniform + ".boxMin", p.boxMin);
+	pProgram->sendUniform(uniform + ".boxMax", p.boxMax);
+}
+
+bool C3dglReflectionProbeManager::bind(C3dglProgram* pProgram, glm::vec3 position, GLenum texUnit1, GLenum texUnit2) const
+{
+	unsigned probe1, probe2;
+	float blend;
+	if (!pProgram || !select(position, probe1, probe2, blend))
+		return false;
+
+	send(pProgram, probe1, "probe1", "textureCubeMap", texUnit1);
+	send(pProgram, probe2, "probe2", "textureCubeMap2", texUnit2);
+	pProgram->sendUniform("probeBlend", blend);
+	return true;
+}
+
+void C3dglReflectionProbeManager::bind(C3dglProgram* pProgram, unsigned probe, GLenum texUnit1) const
+{
+	if (!pProgram || probe >= m_probes.size())
+		return;
+	send(pProgram, probe, "probe1", "textureCubeMap", texUnit1);
+	pProgram->sendUniform("probeBlend", 0.0f);
+}
+
+void C3dglReflectionProbeManager::stats() const
+{
+	unsigned nStatic = (unsigned)std::count_if(m_probes.begin(), m_probes.end(), [](const PROBE& probe) { return probe.type == PROBE_STATIC; });
+	unsigned long long nFaces = 0;
+	for (const PROBE& probe : m_probes)
+		if (probe.type == PROBE_DYNAMIC)
+			nFaces += probe.pRenderer->getFacesUpdated();
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Probes: {} static, {} dynamic; Blending: {}", nStatic, m_probes.size() - nStatic, m_bBlending ? "on" : "off");
+	C3dglLogger::log("Static probes baked: {}, loaded from the cache: {}; Faces captured by the dynamic probes: {}", m_nBaked, m_nLoaded, nFaces);
+}
@@ -0,0 +1,318 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/RenderQueue.h>
+#include <3dgl/Material.h>
+#include <3dgl/Shader.h>
+#include <3dgl/MemoryTracker.h>
+
+// standard libraries
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace _3dgl;
+
+namespace
+{
+	// the sort key, from the most significant bits: pass (4), program (6), material (12), texture set (12), instanced (1), mesh (13), depth (16)
+	const unsigned c_shifts[STATE_COUNT] = { 54, 42, 30, 16 };
+	const unsigned c_bits[STATE_COUNT] = { 6, 12, 12, 13 };
+	const unsigned c_passShift = 60, c_passBits = 4;
+	const unsigned c_instancedShift = 29;
+	const char* c_stateNames[STATE_COUNT] = { "program", "material", "texture set", "mesh" };
+
+	// the indices above the width of their fields are wrapped: the packets still sort, but the key alone cannot tell them apart
+	unsigned long long field(unsigned value, unsigned shift, unsigned bits)
+	{
+		return (unsigned long long)(value & ((1u << bits) - 1)) << shift;
+	}
+
+	// true if a dictionary has outgrown its key field
+	bool full(size_t size, unsigned bits)
+	{
+		return size >= (1ull << bits);
+	}
+
+	// the top 16 bits of a positive float keep its order
+	unsigned depthBits(float depth)
+	{
+		depth = std::max(depth, 0.0f);
+		unsigned bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits >> 15;
+	}
+}
+
+C3dglRenderQueue::C3dglRenderQueue() : C3dglObject()
+{
+	m_bInstancing = false;
+	m_instanceUnit = GL_TEXTURE11;
+	m_idBuffer = m_idTexture = 0;
+	m_bufferSize = 0;
+	m_nPackets = m_nDraws = m_nInstancedDraws = m_nInstanced = 0;
+	std::fill_n(m_changesSubmitted, STATE_COUNT, 0);
+	std::fill_n(m_changesSorted, STATE_COUNT, 0);
+	m_sortTime = 0;
+}
+
+void C3dglRenderQueue::destroy()
+{
+	if (m_idBuffer)
+	{
+		C3dglMemoryTracker::getInstance().remove(MEM_DATA_BUFFER, m_idBuffer);
+		glDeleteBuffers(1, &m_idBuffer);
+		glDeleteTextures(1, &m_idTexture);
+	}
+	m_idBuffer = m_idTexture = 0;
+	m_bufferSize = 0;
+}
+
+void C3dglRenderQueue::clear()
+{
+	m_packets.clear();
+	m_instances.clear();
+	m_materials[0].clear();
+	m_materials[1].clear();
+	m_meshes.clear();
+
+	// the dictionaries which keep their indices grow with every new value (e.g. an animated colour); once they outgrow
+	// their fields, they are started anew - this frame indexes its own values only
+	if (full(m_programs.size(), c_bits[STATE_PROGRAM]))
+		m_programs.clear();
+	if (full(m_materialValues.size() + 1, c_bits[STATE_MATERIAL]))
+		m_materialValues.clear();
+	if (full(m_textureSets.size() + 1, c_bits[STATE_TEXTURES]))
+		m_textureSets.clear();
+}
+
+void C3dglRenderQueue::submit(unsigned pass, C3dglProgram* pProgram, const C3dglMaterial* pMaterial, std::pair<const void*, int> mesh, float depth, unsigned item,
+	const glm::mat4* pMatrixModelView)
+{
+	unsigned program = (unsigned)m_programs.emplace(pProgram, (unsigned)m_programs.size()).first->second;
+	bool bInstanced = m_bInstancing && pMatrixModelView && pProgram;
+
+	// materials with the same values share the index, whichever object they are; the same for the textures.
+	// The instanced draws take their diffuse and emissive colours from the instance data - the other values must match.
+	unsigned material = 0, textures = 0;
+	if (pMaterial)
+	{
+		auto& materials = m_materials[bInstanced ? 1 : 0];
+		auto it = materials.find(pMaterial);
+		if (it == materials.end())
+		{
+			std::vector<float> values = { bInstanced ? 1.0f : 0.0f };
+			glm::vec3 colour;
+			float f;
+			for (bool bSet : { pMaterial->getAmbient(colour), pMaterial->getSpecular(colour) })
+				if (values.push_back(bSet ? 1.0f : 0.0f), bSet)
+					values.insert(values.end(), { colour.r, colour.g, colour.b });
+			if (!bInstanced)
+				for (bool bSet : { pMaterial->getDiffuse(colour), pMaterial->getEmissive(colour) })
+					if (values.push_back(bSet ? 1.0f : 0.0f), bSet)
+						values.insert(values.end(), { colour.r, colour.g, colour.b });
+			values.push_back(pMaterial->getShininess(f) ? f : -1.0f);
+			values.push_back(pMaterial->getTextureLayer(f) ? f : -1.0f);
+
+			std::vector<unsigned> ids;
+			for (unsigned unit = 0; unit <= GL_TEXTURE31 - GL_TEXTURE0; unit++)
+			{
+				unsigned id;
+				if (pMaterial->getTexture(GL_TEXTURE0 + unit, id))
+					ids.insert(ids.end(), { unit, id });
+			}
+
+			// index 0 stands for no material
+			unsigned iValues = m_materialValues.emplace(values, (unsigned)m_materialValues.size() + 1).first->second;
+			unsigned iTextures = m_textureSets.emplace(ids, (unsigned)m_textureSets.size() + 1).first->second;
+			it = materials.emplace(pMaterial, std::make_pair(iValues, iTextures)).first;
+		}
+		material = it->second.first;
+		textures = it->second.second;
+	}
+	unsigned iMesh = (unsigned)m_meshes.emplace(mesh, (unsigned)m_meshes.size()).first->second;
+
+	unsigned long long key = field(pass, c_passShift, c_passBits)
+		| field(program, c_shifts[STATE_PROGRAM], c_bits[STATE_PROGRAM])
+		| field(material, c_shifts[STATE_MATERIAL], c_bits[STATE_MATERIAL])
+		| field(textures, c_shifts[STATE_TEXTURES], c_bits[STATE_TEXTURES])
+		| field(bInstanced ? 1 : 0, c_instancedShift, 1)
+		| field(iMesh, c_shifts[STATE_MESH], c_bits[STATE_MESH])
+		| field(depthBits(depth), 0, 16);
+
+	int instance = -1;
+	if (bInstanced)
+	{
+		glm::vec3 diffuse, emissive;
+		bool bDiffuse = pMaterial && pMaterial->getDiffuse(diffuse);
+		bool bEmissive = pMaterial && pMaterial->getEmissive(emissive);
+		instance = (int)m_instances.size();
+		m_instances.push_back({ *pMatrixModelView, glm::vec4(bDiffuse ? diffuse : glm::vec3(0), bDiffuse ? 1 : 0),
+			glm::vec4(bEmissive ? emissive : glm::vec3(0), bEmissive ? 1 : 0) });
+	}
+	m_packets.push_back({ key, pProgram, pMaterial, item, instance, { program, material, textures, iMesh } });
+}
+
+bool C3dglRenderQueue::sameState(const PACKET& a, const PACKET& b, unsigned long long mask, unsigned nStates)
+{
+	return (a.key & mask) == (b.key & mask) && std::equal(a.state, a.state + nStates, b.state);
+}
+
+void C3dglRenderQueue::countChanges(const std::vector<unsigned long long>& keys, const std::vector<unsigned>& order, size_t changes[STATE_COUNT])
+{
+	std::fill_n(changes, STATE_COUNT, 0);
+	for (size_t i = 0; i < order.size(); i++)
+		for (unsigned state = 0; state < STATE_COUNT; state++)
+		{
+			unsigned long long mask = (((1ull << c_bits[state]) - 1) << c_shifts[state]);
+			if (i == 0 || (keys[order[i]] & mask) != (keys[order[i - 1]] & mask))
+				changes[state]++;
+		}
+}
+
+void C3dglRenderQueue::sort()
+{
+	size_t n = m_packets.size();
+	m_keys.resize(n);
+	m_order.resize(n);
+	m_temp.resize(n);
+	for (unsigned i = 0; i < n; i++)
+	{
+		m_keys[i] = m_packets[i].key;
+		m_order[i] = i;
+	}
+	countChanges(m_keys, m_order, m_changesSubmitted);
+
+	// LSD radix sort, 8 bits at a time; the digits all packets share are skipped
+	for (unsigned shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[257] = { };
+		for (unsigned i : m_order)
+			counts[((m_keys[i] >> shift) & 0xff) + 1]++;
+		if (std::find(counts + 1, counts + 257, n) != counts + 257)
+			continue;
+		for (unsigned d = 1; d < 257; d++)
+			counts[d] += counts[d - 1];
+		for (unsigned i : m_order)
+			m_temp[counts[(m_keys[i] >> shift) & 0xff]++] = i;
+		m_order.swap(m_temp);
+	}
+
+	countChanges(m_keys, m_order, m_changesSorted);
+}
+
+void C3dglRenderQueue::upload()
+{
+	// the instance data in the sorted order - each instanced draw takes a contiguous range
+	m_stream.clear();
+	for (unsigned i : m_order)
+		if (m_packets[i].instance >= 0)
+			m_stream.push_back(m_instances[m_packets[i].instance]);
+	if (m_stream.empty())
+		return;
+
+	if (!m_idBuffer)
+	{
+		glGenBuffers(1, &m_idBuffer);
+		glGenTextures(1, &m_idTexture);
+		glBindBuffer(GL_TEXTURE_BUFFER, m_idBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, m_idTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_idBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// orphaned at each execute - the previous contents may still be in use
+	size_t size = m_stream.size() * sizeof(INSTANCE);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_idBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, m_stream.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if (size != m_bufferSize)
+	{
+		m_bufferSize = size;
+		C3dglMemoryTracker::getInstance().add(MEM_DATA_BUFFER, m_idBuffer, size, GL_RGBA32F, getName());
+	}
+
+	glActiveTexture(m_instanceUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_idTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void C3dglRenderQueue::execute(std::function<void(unsigned item, GLsizei instances)> draw)
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+	sort();
+	m_nPackets = m_packets.size();
+	m_sortTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+	upload();
+
+	// the material, and its textures, are sent at the first packet of each group, and restored at its end;
+	// instanced packets with the same key but the depth are drawn at once. The fields are compared in full,
+	// in case there were more programs, materials or meshes than the key can tell apart.
+	const unsigned long long stateMask = ~((1ull << (c_shifts[STATE_MESH] + c_bits[STATE_MESH])) - 1);
+	const unsigned long long instanceMask = ~0xffffull;
+	const unsigned texelsPerInstance = sizeof(INSTANCE) / sizeof(glm::vec4);
+	const PACKET* pApplied = NULL;
+	size_t nStreamed = 0;
+	m_nDraws = m_nInstancedDraws = m_nInstanced = 0;
+	C3dglMaterial::beginBatch();
+	for (size_t i = 0; i < m_order.size(); )
+	{
+		const PACKET& packet = m_packets[m_order[i]];
+		if (!pApplied || !sameState(packet, *pApplied, stateMask, STATE_MESH))
+		{
+			if (pApplied && pApplied->pMaterial)
+				pApplied->pMaterial->postRender(pApplied->pProgram);
+			if (packet.pProgram && !packet.pProgram->isUsed())
+				packet.pProgram->use();
+			if (packet.pMaterial)
+				packet.pMaterial->render(packet.pProgram);
+			pApplied = &packet;
+		}
+		m_nDraws++;
+
+		if (packet.instance < 0)
+		{
+			draw(packet.item, 0);
+			i++;
+			continue;
+		}
+
+		size_t n = 1;
+		while (i + n < m_order.size() && sameState(m_packets[m_order[i + n]], packet, instanceMask, STATE_COUNT))
+			n++;
+		packet.pProgram->sendUniform("instanceData", (int)(m_instanceUnit - GL_TEXTURE0));
+		packet.pProgram->sendUniform("instanceBase", (int)(nStreamed * texelsPerInstance));
+		draw(packet.item, (GLsizei)n);
+		packet.pProgram->sendUniform("instanceBase", -1);
+		nStreamed += n;
+		m_nInstancedDraws++;
+		m_nInstanced += n;
+		i += n;
+	}
+	if (pApplied && pApplied->pMaterial)
+		pApplied->pMaterial->postRender(pApplied->pProgram);
+	C3dglMaterial::endBatch();
+}
+
+size_t C3dglRenderQueue::getChangesSaved() const
+{
+	size_t saved = 0;
+	for (unsigned state = 0; state < STATE_COUNT; state++)
+		saved += m_changesSubmitted[state] - m_changesSorted[state];
+	return saved;
+}
+
+void C3dglRenderQueue::stats() const
+{
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Packets: {}, sorted in {:.3f} ms; programs: {}, material values: {}, texture sets: {}",
+		m_nPackets, m_sortTime, m_programs.size(), m_materialValues.size(), m_textureSets.size());
+	C3dglLogger::log("Draw calls: {}, of which instanced: {} for {} packets (instancing {})",
+		m_nDraws, m_nInstancedDraws, m_nInstanced, m_bInstancing ? "on" : "off");
+	for (unsigned state = 0; state < STATE_COUNT; state++)
+		C3dglLogger::log("Changes of the {}: {} in the submission order, {} sorted", c_stateNames[state], m_changesSubmitted[state], m_changesSorted[state]);
+	C3dglLogger::log("State changes saved by sorting: {}", getChangesSaved());
+}
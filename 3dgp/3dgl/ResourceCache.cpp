@@ -0,0 +1,171 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <filesystem>
+#include <algorithm>
+#include <3dgl/ResourceCache.h>
+#include <3dgl/Model.h>
+#include <3dgl/Shader.h>
+#include <3dgl/Texture.h>
+#include <3dgl/TextureStreamer.h>
+#include <3dgl/MemoryTracker.h>
+
+using namespace _3dgl;
+
+C3dglResourceCache& C3dglResourceCache::getInstance()
+{
+	static C3dglResourceCache inst;
+	return inst;
+}
+
+std::string C3dglResourceCache::getKey(std::string filename, unsigned flags)
+{
+	std::error_code ec;
+	std::filesystem::path path = std::filesystem::weakly_canonical(std::filesystem::path(filename), ec);
+	std::string key = ec ? filename : path.string();
+
+	// file names are not case sensitive in Windows
+	std::transform(key.begin(), key.end(), key.begin(), [](char c) { return (char)tolower(c); });
+	std::replace(key.begin(), key.end(), '/', '\\');
+	return std::format("{}|{:x}", key, flags);
+}
+
+std::shared_ptr<C3dglModel> C3dglResourceCache::getModel(std::string filename, unsigned flags, C3dglProgram* pProgram)
+{
+	if (pProgram == NULL)
+		pProgram = C3dglProgram::getCurrentProgram();
+
+	// vertex buffers are bound to the attribute locations of the program - so the program is a part of the key
+	std::string key = std::format("{}|{}", getKey(filename, flags), pProgram ? pProgram->getId() : 0);
+
+	auto it = m_models.find(key);
+	if (it != m_models.end())
+	{
+		std::shared_ptr<C3dglModel> pModel = it->second.ptr.lock();
+		if (pModel)
+		{
+			m_nHits++;
+			m_nBytesSaved += it->second.bytes;
+			log(M3DGL_SUCCESS_REUSED, filename);
+			return pModel;
+		}
+	}
+
+	std::shared_ptr<C3dglModel> pModel = std::make_shared<C3dglModel>();
+	if (!pModel->load(filename.c_str(), flags, pProgram))
+		return NULL;
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < pModel->getMeshCount(); i++)
+		bytes += pModel->getMesh(i)->getBufferSize();
+
+	m_nLoads++;
+	m_models[key] = { pModel, bytes };
+	return pModel;
+}
+
+bool C3dglResourceCache::acquireTexture(std::string filename, GLuint& idTex, C3dglLoadProfile* pProfile)
+{
+	std::string key = getKey(filename, GL_RGBA);
+
+	auto it = m_textures.find(key);
+	if (it != m_textures.end())
+	{
+		it->second.refCount++;
+		m_nHits++;
+		m_nBytesSaved += it->second.bytes;
+		idTex = it->second.id;
+		log(M3DGL_SUCCESS_REUSED, filename);
+		return true;
+	}
+
+	// streamed texture - only its smallest levels are loaded now
+	C3dglTextureStreamer& streamer = C3dglTextureStreamer::getInstance();
+	if (streamer.isRunning() && (idTex = streamer.load(filename)) != 0)
+	{
+		m_nLoads++;
+		m_textures[key] = { idTex, 1, 0 };
+		m_textureKeys[idTex] = key;
+		return true;
+	}
+
+	// mip-mapped texture - from a mounted asset pack, the mip cache or an image file
+	C3dglTexture texture;
+	if (!texture.load(filename, TEX_DEFAULT, pProfile))
+		return false;
+
+	m_nLoads++;
+	m_textures[key] = { texture.getId(), 1, texture.getSize() };
+	m_textureKeys[texture.getId()] = key;
+	idTex = texture.detach();		// from now on, the texture is owned by the cache
+	return true;
+}
+
+bool C3dglResourceCache::releaseTexture(GLuint idTex)
+{
+	auto itKey = m_textureKeys.find(idTex);
+	if (itKey == m_textureKeys.end())
+		return false;
+
+	auto it = m_textures.find(itKey->second);
+	if (it != m_textures.end() && --it->second.refCount == 0)
+	{
+		if (!C3dglTextureStreamer::getInstance().release(idTex))
+		{
+			C3dglMemoryTracker::getInstance().remove(MEM_TEXTURE, idTex);
+			glDeleteTextures(1, &idTex);
+		}
+		m_textures.erase(it);
+		m_textureKeys.erase(itKey);
+	}
+	return true;
+}
+
+std::shared_ptr<C3dglProgram> C3dglResourceCache::getProgram(std::string vertexShader, std::string fragmentShader, std::string std_attrib_names, std::string std_uni_names)
+{
+	std::string key = getKey(vertexShader) + "|" + getKey(fragmentShader) + "|" + std_attrib_names + "|" + std_uni_names;
+
+	auto it = m_programs.find(key);
+	if (it != m_programs.end())
+	{
+		std::shared_ptr<C3dglProgram> pProgram = it->second.ptr.lock();
+		if (pProgram)
+		{
+			m_nHits++;
+			m_nBytesSaved += it->second.bytes;
+			log(M3DGL_SUCCESS_REUSED, vertexShader + " + " + fragmentShader);
+			return pProgram;
+		}
+	}
+
+	C3dglShader vertex, fragment;
+	if (!vertex.create(GL_VERTEX_SHADER) || !vertex.loadFromFile(vertexShader) || !vertex.compile())
+		return NULL;
+	if (!fragment.create(GL_FRAGMENT_SHADER) || !fragment.loadFromFile(fragmentShader) || !fragment.compile())
+		return NULL;
+
+	std::shared_ptr<C3dglProgram> pProgram = std::make_shared<C3dglProgram>();
+	if (!pProgram->create() || !pProgram->attach(vertex) || !pProgram->attach(fragment) || !pProgram->link(std_attrib_names, std_uni_names))
+		return NULL;
+
+	// the binary size is the best available approximation of the memory used by the driver
+	GLint bytes = 0;
+	glGetProgramiv(pProgram->getId(), GL_PROGRAM_BINARY_LENGTH, &bytes);
+
+	m_nLoads++;
+	m_programs[key] = { pProgram, (size_t)bytes };
+	return pProgram;
+}
+
+void C3dglResourceCache::stats() const
+{
+	size_t nModels = std::count_if(m_models.begin(), m_models.end(), [](auto& p) { return !p.second.ptr.expired(); });
+	size_t nPrograms = std::count_if(m_programs.begin(), m_programs.end(), [](auto& p) { return !p.second.ptr.expired(); });
+
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Models: {}, Textures: {}, Programs: {}", nModels, m_textures.size(), nPrograms);
+	C3dglLogger::log("Loaded: {}, Reused: {}, Saved: {:.1f} kB", m_nLoads, m_nHits, m_nBytesSaved / 1024.0);
+}
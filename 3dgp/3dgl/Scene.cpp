@@ -0,0 +1,341 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/Scene.h>
+#include <3dgl/Model.h>
+#include <3dgl/Primitive.h>
+#include <3dgl/Shader.h>
+#include <3dgl/RenderQueue.h>
+
+// GLM include files
+#include "../glm/gtc/matrix_transform.hpp"
+
+// standard libraries
+#include <cfloat>
+#include <algorithm>
+
+using namespace _3dgl;
+
+C3dglScene::NODE::NODE(int parent) : parent(parent), material(NULL)
+{
+	position = glm::vec3(0);
+	rotation = glm::quat(1, 0, 0, 0);
+	scale = glm::vec3(1);
+	bDirty = true;
+	world = glm::mat4(1);
+	aabb[0] = worldAABB[0] = changedAABB[0] = glm::vec3(FLT_MAX);
+	aabb[1] = worldAABB[1] = changedAABB[1] = glm::vec3(-FLT_MAX);
+	pModel = NULL;
+	iModelNode = -1;
+	pPrimitive = NULL;
+	bMaterial = false;
+	bDynamic = false;
+	bVisible = true;
+}
+
+C3dglScene::C3dglScene() : C3dglObject()
+{
+	m_nUpdated = m_nUpdates = m_nRendered = 0;
+}
+
+void C3dglScene::destroy()
+{
+	for (NODE& node : m_nodes)
+		node.material.destroy();
+	m_nodes.clear();
+	m_dirty.clear();
+	m_updated.clear();
+}
+
+unsigned C3dglScene::addNode(int parent, const glm::vec3* aabb)
+{
+	unsigned id = (unsigned)m_nodes.size();
+	if (parent >= (int)id)
+		parent = -1;
+	m_nodes.push_back(NODE(parent));
+	if (parent >= 0)
+		m_nodes[parent].children.push_back(id);
+	if (aabb)
+	{
+		m_nodes[id].aabb[0] = aabb[0];
+		m_nodes[id].aabb[1] = aabb[1];
+	}
+	m_dirty.push_back(id);
+	return id;
+}
+
+unsigned C3dglScene::addModel(const C3dglModel* pModel, int iModelNode, int parent)
+{
+	glm::vec3 aabb[2];
+	if (iModelNode < 0)
+		pModel->getAABB(aabb);
+	else
+		pModel->getAABB((unsigned)iModelNode, aabb);
+	unsigned id = addNode(parent, aabb);
+	m_nodes[id].pModel = pModel;
+	m_nodes[id].iModelNode = iModelNode;
+	return id;
+}
+
+unsigned C3dglScene::addPrimitive(const C3dglPrimitive* pPrimitive, int parent)
+{
+	glm::vec3 aabb[2];
+	pPrimitive->getAABB(aabb);
+	unsigned id = addNode(parent, aabb);
+	m_nodes[id].pPrimitive = pPrimitive;
+	return id;
+}
+
+unsigned C3dglScene::addFunction(std::function<void(glm::mat4 matrixModelView)> render, glm::vec3 aabb[2], int parent)
+{
+	unsigned id = addNode(parent, aabb);
+	m_nodes[id].render = render;
+	return id;
+}
+
+void C3dglScene::markDirty(unsigned node)
+{
+	if (!m_nodes[node].bDirty)
+	{
+		m_nodes[node].bDirty = true;
+		m_dirty.push_back(node);
+	}
+}
+
+void C3dglScene::setPosition(unsigned node, glm::vec3 position)
+{
+	if (m_nodes[node].position == position)
+		return;
+	m_nodes[node].position = position;
+	markDirty(node);
+}
+
+void C3dglScene::setRotation(unsigned node, glm::quat rotation)
+{
+	if (m_nodes[node].rotation == rotation)
+		return;
+	m_nodes[node].rotation = rotation;
+	markDirty(node);
+}
+
+void C3dglScene::setScale(unsigned node, glm::vec3 scale)
+{
+	if (m_nodes[node].scale == scale)
+		return;
+	m_nodes[node].scale = scale;
+	markDirty(node);
+}
+
+void C3dglScene::setTransform(unsigned node, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	setPosition(node, position);
+	setRotation(node, rotation);
+	setScale(node, scale);
+}
+
+void C3dglScene::setUniform(unsigned node, std::string name, float value)
+{
+	for (auto& uniform : m_nodes[node].floats)
+		if (uniform.first == name)
+		{
+			uniform.second = value;
+			return;
+		}
+	m_nodes[node].floats.push_back(std::make_pair(name, value));
+}
+
+void C3dglScene::setUniform(unsigned node, std::string name, glm::vec3 value)
+{
+	for (auto& uniform : m_nodes[node].vec3s)
+		if (uniform.first == name)
+		{
+			uniform.second = value;
+			return;
+		}
+	m_nodes[node].vec3s.push_back(std::make_pair(name, value));
+}
+
+void C3dglScene::updateSubtree(unsigned node)
+{
+	NODE& n = m_nodes[node];
+	n.bDirty = false;
+	glm::mat4 local = glm::scale(glm::translate(glm::mat4(1), n.position) * glm::mat4_cast(n.rotation), n.scale);
+	n.world = n.parent >= 0 ? m_nodes[n.parent].world * local : local;
+	m_nUpdated++;
+	m_updated.push_back(node);
+
+	// world space bounding box - of the eight corners of the local one
+	n.changedAABB[0] = n.worldAABB[0];
+	n.changedAABB[1] = n.worldAABB[1];
+	n.worldAABB[0] = glm::vec3(FLT_MAX);
+	n.worldAABB[1] = glm::vec3(-FLT_MAX);
+	if (n.aabb[0].x <= n.aabb[1].x)
+		for (unsigned i = 0; i < 8; i++)
+		{
+			glm::vec3 p = glm::vec3(n.world * glm::vec4(n.aabb[i & 1].x, n.aabb[(i >> 1) & 1].y, n.aabb[(i >> 2) & 1].z, 1));
+			n.worldAABB[0] = glm::min(n.worldAABB[0], p);
+			n.worldAABB[1] = glm::max(n.worldAABB[1], p);
+		}
+	n.changedAABB[0] = glm::min(n.changedAABB[0], n.worldAABB[0]);
+	n.changedAABB[1] = glm::max(n.changedAABB[1], n.worldAABB[1]);
+
+	for (unsigned child : n.children)
+		updateSubtree(child);
+}
+
+void C3dglScene::update()
+{
+	m_nUpdated = 0;
+	m_nRendered = 0;
+	m_updated.clear();
+	for (unsigned node : m_dirty)
+	{
+		// already done as a part of the subtree of a dirty ancestor
+		if (!m_nodes[node].bDirty)
+			continue;
+		// a dirty ancestor will update this subtree
+		bool bAncestorDirty = false;
+		for (int parent = m_nodes[node].parent; parent >= 0 && !bAncestorDirty; parent = m_nodes[parent].parent)
+			bAncestorDirty = m_nodes[parent].bDirty;
+		if (!bAncestorDirty)
+			updateSubtree(node);
+	}
+	m_dirty.clear();
+	m_nUpdates += m_nUpdated;
+}
+
+void C3dglScene::draw(unsigned node, glm::mat4 matrixModelView, C3dglProgram* pProgram, bool bMaterial, GLsizei instances) const
+{
+	const NODE& n = m_nodes[node];
+	m_nRendered += instances;
+
+	bMaterial = bMaterial && n.bMaterial && !(pProgram && pProgram->isPositionOnly());
+	if (bMaterial)
+		n.material.render(pProgram);
+	if (pProgram)
+	{
+		m_backFloats.resize(n.floats.size());
+		m_backVec3s.resize(n.vec3s.size());
+		for (size_t i = 0; i < n.floats.size(); i++)
+		{
+			pProgram->retrieveUniform(n.floats[i].first, m_backFloats[i]);
+			pProgram->sendUniform(n.floats[i].first, n.floats[i].second);
+		}
+		for (size_t i = 0; i < n.vec3s.size(); i++)
+		{
+			pProgram->retrieveUniform(n.vec3s[i].first, m_backVec3s[i]);
+			pProgram->sendUniform(n.vec3s[i].first, n.vec3s[i].second);
+		}
+	}
+
+	if (n.pModel && n.iModelNode < 0)
+		n.pModel->render(matrixModelView, instances, pProgram);
+	else if (n.pModel)
+		n.pModel->render((unsigned)n.iModelNode, matrixModelView, instances, pProgram);
+	else if (n.pPrimitive)
+		n.pPrimitive->render(matrixModelView, instances, pProgram);
+	else
+		n.render(matrixModelView);
+
+	if (pProgram)
+	{
+		for (size_t i = 0; i < n.floats.size(); i++)
+			pProgram->sendUniform(n.floats[i].first, m_backFloats[i]);
+		for (size_t i = 0; i < n.vec3s.size(); i++)
+			pProgram->sendUniform(n.vec3s[i].first, m_backVec3s[i]);
+	}
+	if (bMaterial)
+		n.material.postRender(pProgram);
+}
+
+void C3dglScene::render(glm::mat4 matrixView, C3dglProgram* pProgram, const std::vector<unsigned>* pNodes, std::function<void(unsigned node)> prepare) const
+{
+	if (!pProgram)
+		pProgram = C3dglProgram::getCurrentProgram();
+
+	auto renderNode = [&](unsigned node)
+	{
+		if (!isRenderable(node) || !m_nodes[node].bVisible)
+			return;
+		if (prepare)
+			prepare(node);
+		draw(node, matrixView * m_nodes[node].world, pProgram, true);
+	};
+
+	if (pNodes)
+		for (unsigned node : *pNodes)
+			renderNode(node);
+	else
+		for (unsigned node = 0; node < m_nodes.size(); node++)
+			renderNode(node);
+}
+
+void C3dglScene::render(C3dglRenderQueue& queue, glm::mat4 matrixView, C3dglProgram* pProgram, const std::vector<unsigned>* pNodes, std::function<void(unsigned node)> prepare) const
+{
+	if (!pProgram)
+		pProgram = C3dglProgram::getCurrentProgram();
+	bool bPositionOnly = pProgram && pProgram->isPositionOnly();
+
+	queue.clear();
+	auto submitNode = [&](unsigned node)
+	{
+		const NODE& n = m_nodes[node];
+		if (!isRenderable(node) || !n.bVisible)
+			return;
+
+		// the vertex data: the primitive, the model (or its main node) or the node itself
+		std::pair<const void*, int> mesh(&n, -1);
+		if (n.pPrimitive)
+			mesh.first = n.pPrimitive;
+		else if (n.pModel)
+			mesh = std::make_pair((const void*)n.pModel, n.iModelNode);
+
+		// the distance to the centre of the box, for the front-to-back order
+		glm::mat4 matrixModelView = matrixView * n.world;
+		glm::vec3 centre = n.aabb[0].x <= n.aabb[1].x ? (n.aabb[0] + n.aabb[1]) * 0.5f : glm::vec3(0);
+		float depth = -(matrixModelView * glm::vec4(centre, 1)).z;
+
+		// the models and the primitives may be instanced - unless they have their own uniforms. The decision depends
+		// on the node only, so that every pass (e.g. the depth pre-pass and the colour pass) draws it the same way.
+		bool bInstanced = !n.render && n.floats.empty() && n.vec3s.empty();
+		queue.submit(0, pProgram, n.bMaterial && !bPositionOnly ? &n.material : NULL, mesh, depth, node, bInstanced ? &matrixModelView : NULL);
+	};
+
+	if (pNodes)
+		for (unsigned node : *pNodes)
+			submitNode(node);
+	else
+		for (unsigned node = 0; node < m_nodes.size(); node++)
+			submitNode(node);
+
+	// the materials are sent by the queue, once per group; the instanced draws get their matrices from the instance data
+	queue.execute([&](unsigned node, GLsizei instances)
+		{
+			if (instances)
+				draw(node, glm::mat4(1), pProgram, false, instances);
+			else
+			{
+				if (prepare)
+					prepare(node);
+				draw(node, matrixView * m_nodes[node].world, pProgram, false);
+			}
+		});
+}
+
+void C3dglScene::stats() const
+{
+	size_t nRenderable = 0, nDynamic = 0;
+	for (unsigned i = 0; i < m_nodes.size(); i++)
+	{
+		if (isRenderable(i))
+			nRenderable++;
+		if (m_nodes[i].bDynamic)
+			nDynamic++;
+	}
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Nodes: {} ({} renderable, {} dynamic)", m_nodes.size(), nRenderable, nDynamic);
+	C3dglLogger::log("World matrices updated in the last update: {} ({} in total), nodes rendered since: {}", m_nUpdated, m_nUpdates, m_nRendered);
+}
@@ -0,0 +1,129 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cfloat>
+#include <3dgl/Logger.h>
+#include "SceneCompare.h"
+
+// assimp include file
+#include "assimp/scene.h"
+
+using namespace _3dgl;
+
+namespace
+{
+	// Geometry of a single main node, in a form suitable for comparison
+	struct NODEGEOMETRY
+	{
+		std::vector<glm::vec3> pos, normal;
+		std::vector<glm::vec2> uv;
+		size_t nTriangles = 0;
+		glm::vec3 aabb[2] = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+	};
+
+	// collects non-degenerate triangles and the vertices they use
+	void collectGeometry(const aiScene* pScene, const aiNode* pNode, NODEGEOMETRY& g)
+	{
+		for (unsigned i = 0; i < pNode->mNumMeshes; i++)
+		{
+			const aiMesh* pMesh = pScene->mMeshes[pNode->mMeshes[i]];
+			auto P = [pMesh](unsigned j) { return glm::vec3(pMesh->mVertices[j].x, pMesh->mVertices[j].y, pMesh->mVertices[j].z); };
+
+			std::vector<bool> used(pMesh->mNumVertices, false);
+			for (unsigned j = 0; j < pMesh->mNumFaces; j++)
+			{
+				const aiFace& f = pMesh->mFaces[j];
+				if (f.mNumIndices != 3 || glm::length(glm::cross(P(f.mIndices[1]) - P(f.mIndices[0]), P(f.mIndices[2]) - P(f.mIndices[0]))) == 0)
+					continue;
+				g.nTriangles++;
+				used[f.mIndices[0]] = used[f.mIndices[1]] = used[f.mIndices[2]] = true;
+			}
+
+			for (unsigned j = 0; j < pMesh->mNumVertices; j++)
+			{
+				if (!used[j]) continue;
+				g.pos.push_back(P(j));
+				g.aabb[0] = glm::min(g.aabb[0], P(j));
+				g.aabb[1] = glm::max(g.aabb[1], P(j));
+				g.normal.push_back(pMesh->mNormals ? glm::vec3(pMesh->mNormals[j].x, pMesh->mNormals[j].y, pMesh->mNormals[j].z) : glm::vec3(0));
+				g.uv.push_back(pMesh->mTextureCoords[0] ? glm::vec2(pMesh->mTextureCoords[0][j].x, pMesh->mTextureCoords[0][j].y) : glm::vec2(0));
+			}
+		}
+		for (unsigned i = 0; i < pNode->mNumChildren; i++)
+			collectGeometry(pScene, pNode->mChildren[i], g);
+	}
+
+	// counts vertices in a that have no matching vertex in b; also finds the largest normal deviation (in degrees)
+	size_t countUnmatched(const NODEGEOMETRY& a, const NODEGEOMETRY& b, float eps, float& maxAngle)
+	{
+		auto cell = [eps](glm::vec3 p) { return glm::ivec3(glm::floor(p / eps)); };
+		auto hash = [](glm::ivec3 c) { return ((size_t)c.x * 73856093u) ^ ((size_t)c.y * 19349663u) ^ ((size_t)c.z * 83492791u); };
+		std::unordered_multimap<size_t, size_t> grid;
+		for (size_t i = 0; i < b.pos.size(); i++)
+			grid.insert({ hash(cell(b.pos[i])), i });
+
+		size_t nUnmatched = 0;
+		for (size_t i = 0; i < a.pos.size(); i++)
+		{
+			float bestDot = -2;
+			glm::ivec3 c = cell(a.pos[i]);
+			for (int dx = -1; dx <= 1; dx++) for (int dy = -1; dy <= 1; dy++) for (int dz = -1; dz <= 1; dz++)
+			{
+				auto range = grid.equal_range(hash(c + glm::ivec3(dx, dy, dz)));
+				for (auto it = range.first; it != range.second; it++)
+				{
+					size_t j = it->second;
+					if (glm::length(a.pos[i] - b.pos[j]) <= eps && glm::length(a.uv[i] - b.uv[j]) <= 1e-4f)
+						bestDot = std::max(bestDot, glm::dot(a.normal[i], b.normal[j]));
+				}
+			}
+			if (bestDot < -1)
+				nUnmatched++;
+			else
+				maxAngle = std::max(maxAngle, glm::degrees(std::acos(std::clamp(bestDot, -1.0f, 1.0f))));
+		}
+		return nUnmatched;
+	}
+}
+
+bool _3dgl::compareSceneGeometry(const aiScene* pScene, const aiScene* pReference, std::string name)
+{
+	bool bMatch = true;
+	unsigned nNodes = pScene->mRootNode->mNumChildren;
+	if (nNodes != pReference->mRootNode->mNumChildren)
+	{
+		C3dglLogger::log(M3DGL_WARNING_GEOMETRY_MISMATCH, name, "(root)", std::format("{} main nodes, expected {}", nNodes, pReference->mRootNode->mNumChildren));
+		bMatch = false;
+		nNodes = std::min(nNodes, pReference->mRootNode->mNumChildren);
+	}
+
+	for (unsigned i = 0; i < nNodes; i++)
+	{
+		NODEGEOMETRY geom, ref;
+		collectGeometry(pScene, pScene->mRootNode->mChildren[i], geom);
+		collectGeometry(pReference, pReference->mRootNode->mChildren[i], ref);
+		std::string nodeName = pScene->mRootNode->mChildren[i]->mName.C_Str();
+
+		// position tolerance relative to the size of the node
+		float eps = ref.pos.empty() ? 1e-5f : std::max(1e-5f * glm::length(ref.aabb[1] - ref.aabb[0]), 1e-7f);
+		float maxAngle = 0;
+		size_t nUnmatched = countUnmatched(geom, ref, eps, maxAngle);
+		size_t nUnmatchedRef = countUnmatched(ref, geom, eps, maxAngle);
+
+		C3dglLogger::log("Node {} \"{}\": triangles: {} / {}, vertices: {} / {}, unmatched vertices: {} / {}, max normal deviation: {:.2f} deg",
+			i, nodeName, geom.nTriangles, ref.nTriangles, geom.pos.size(), ref.pos.size(), nUnmatched, nUnmatchedRef, maxAngle);
+
+		if (geom.nTriangles != ref.nTriangles || nUnmatched || nUnmatchedRef || maxAngle > 2.0f)
+		{
+			C3dglLogger::log(M3DGL_WARNING_GEOMETRY_MISMATCH, name, nodeName, "see the report above");
+			bMatch = false;
+		}
+	}
+	C3dglLogger::log("Result: {}", bMatch ? "MATCH" : "MISMATCH");
+	return bMatch;
+}
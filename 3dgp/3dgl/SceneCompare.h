@@ -0,0 +1,24 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Internal helper: geometry comparison of two AssImp scenes.
+Not a part of the public interface of the library.
+*********************************************************************************/
+#ifndef __3dglSceneCompare_h_
+#define __3dglSceneCompare_h_
+
+#include <string>
+
+struct aiScene;
+
+namespace _3dgl
+{
+	// Compares the geometry of each main node of two scenes: the triangles and the vertices they use, with their
+	// normals and texture coordinates. The order of vertices and triangles is ignored, and so are degenerate triangles,
+	// so scenes that render the same are reported as matching. The detailed report is sent to the logger.
+	bool compareSceneGeometry(const aiScene* pScene, const aiScene* pReference, std::string name);
+}; // namespace _3dgl
+
+#endif // __3dglSceneCompare_h_
@@ -5,6 +5,7 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 *********************************************************************************/
 #include "pch.h"
 #include <3dgl/Shader.h>
+#include <3dgl/AssetPack.h>
 
 #include <fstream>
 #include <vector>
@@ -125,6 +126,12 @@ bool C3dglShader::load(std::string source)
 bool C3dglShader::loadFromFile(std::string fname)
 {
 	m_fname = fname;
+
+	// pre-processed source from a mounted asset pack
+	C3dglAssetPack* pPack = C3dglAssetPack::findMounted(fname, ASSET_SHADER);
+	if (pPack)
+		return load(std::string(pPack->getShader(fname)));
+
 	std::ifstream file(m_fname.c_str());
 	std::string source(std::istreambuf_iterator<char>(file), (std::istreambuf_iterator<char>()));
 	return load(source);
@@ -313,7 +320,9 @@ bool C3dglProgram::link(std::string std_attrib_names, std::string std_uni_names)
 		"mat_diffuse|material_diffuse|mat_Diffuse|material_Diffuse|matdiffuse|materialdiffuse|matDiffuse|materialDiffuse",
 		"mat_specular|material_specular|mat_Specular|material_Specular|matspecular|materialspecular|matSpecular|materialSpecular",
 		"mat_emissive|material_emissive|mat_Emissive|material_Emissive|matemissive|materialemissive|matEmissive|materialEmissive",
-		"shininess|Shininess|mat_shininess|material_shininess|mat_Shininess|material_Shininess|matshininess|materialshininess|matShininess|materialShininess"
+		"shininess|Shininess|mat_shininess|material_shininess|mat_Shininess|material_Shininess|matshininess|materialshininess|matShininess|materialShininess",
+		"textureLayer|texture_layer|texLayer|tex_layer",
+		"textureRegion|texture_region|texRegion|tex_region"
 	};
 	size_t lstart = 0, lend = 0;
 	std_uni_names += ";";
@@ -373,6 +382,16 @@ bool C3dglProgram::use(bool bValidate)
 	return log(M3DGL_SUCCESS_VERIFICATION, (info.size() <= 1 ? "OK" : std::string(info.begin(), info.end())));
 }
 
+bool C3dglProgram::isPositionOnly() const
+{
+	if (m_stdAttr[ATTR_VERTEX] == -1)
+		return false;
+	for (size_t attr = 0; attr < m_stdAttrNum; attr++)
+		if (attr != ATTR_VERTEX && m_stdAttr[attr] != -1)
+			return false;
+	return true;
+}
+
 GLint C3dglProgram::getAttribLocation(std::string idAttrib) const
 {
 	auto i = m_attribs.find(idAttrib);
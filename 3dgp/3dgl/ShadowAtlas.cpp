@@ -0,0 +1,329 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/ShadowAtlas.h>
+#include <3dgl/Shader.h>
+#include <3dgl/MemoryTracker.h>
+
+// GLM include files
+#include "../glm/gtc/matrix_transform.hpp"
+
+// standard libraries
+#include <chrono>
+#include <algorithm>
+
+using namespace _3dgl;
+
+namespace
+{
+	// cube faces of a point light: +X, -X, +Y, -Y, +Z, -Z - the order in which the shader selects them
+	const glm::vec3 c_faceDirections[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const glm::vec3 c_faceUps[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+}
+
+C3dglShadowAtlas::C3dglShadowAtlas() : C3dglObject()
+{
+	m_size = m_tileSize = m_tilesPerRow = 0;
+	std::fill_n(m_idFBO, 2, 0);
+	std::fill_n(m_idDepth, 2, 0);
+	m_nTiles = 0;
+	std::fill_n(m_idQueries, 2, 0);
+	std::fill_n(m_pending, 2, false);
+	std::fill_n(m_time, 2, 0.0f);
+	m_cpuTime = 0;
+	m_nStaticTiles = m_nStaticUpdates = m_nFrames = 0;
+}
+
+bool C3dglShadowAtlas::create(unsigned size, unsigned tileSize)
+{
+	destroy();
+	m_tileSize = std::max(1u, std::min(tileSize, size));
+	m_tilesPerRow = std::max(1u, size / m_tileSize);
+	m_size = m_tilesPerRow * m_tileSize;
+
+	// preserve the currently bound texture and framebuffer
+	GLuint prevTex, prevFBO;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*)&prevTex);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*)&prevFBO);
+
+	glGenTextures(2, m_idDepth);
+	glGenFramebuffers(2, m_idFBO);
+	GLenum status = GL_FRAMEBUFFER_COMPLETE;
+	for (unsigned i = 0; i < 2; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, m_idDepth[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_size, m_size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// the final atlas is sampled with the depth comparison - linear filtering gives a 2x2 PCF for free
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, i ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, i ? GL_LINEAR : GL_NEAREST);
+		if (i)
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		C3dglMemoryTracker::getInstance().add(MEM_TEXTURE, m_idDepth[i], C3dglMemoryTracker::getTextureSize(GL_DEPTH_COMPONENT24, m_size, m_size), GL_DEPTH_COMPONENT24, getName());
+
+		glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_idDepth[i], 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (status == GL_FRAMEBUFFER_COMPLETE)
+			status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	}
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		log(M3DGL_ERROR_FRAMEBUFFER, status);
+		destroy();
+		return false;
+	}
+
+	glGenQueries(2, m_idQueries);
+
+	// lights added before are placed again
+	std::vector<SHADOW_LIGHT> lights;
+	lights.swap(m_lights);
+	m_nTiles = 0;
+	m_views.clear();
+	m_projections.clear();
+	m_matrices.clear();
+	m_regions.clear();
+	for (SHADOW_LIGHT& light : lights)
+		if (light.bPoint)
+			addPointLight(light.position, light.nearPlane, light.farPlane);
+		else
+			addDirectionalLight(light.position, light.center, light.farPlane);
+	return true;
+}
+
+void C3dglShadowAtlas::destroy()
+{
+	if (m_idFBO[0])
+		glDeleteFramebuffers(2, m_idFBO);
+	for (GLuint& id : m_idDepth)
+		if (id)
+		{
+			C3dglMemoryTracker::getInstance().remove(MEM_TEXTURE, id);
+			glDeleteTextures(1, &id);
+		}
+	if (m_idQueries[0])
+		glDeleteQueries(2, m_idQueries);
+	std::fill_n(m_idFBO, 2, 0);
+	std::fill_n(m_idDepth, 2, 0);
+	std::fill_n(m_idQueries, 2, 0);
+	std::fill_n(m_pending, 2, false);
+	m_size = m_tileSize = m_tilesPerRow = 0;
+}
+
+int C3dglShadowAtlas::addPointLight(glm::vec3 position, float nearPlane, float farPlane)
+{
+	unsigned capacity = std::min(m_tilesPerRow * m_tilesPerRow, MAX_SHADOW_TILES);
+	if (m_nTiles + 6 > capacity)
+		return -1;
+	m_lights.push_back({ true, position, glm::vec3(0), nearPlane, farPlane, m_nTiles, 6, false });
+	m_nTiles += 6;
+	updateMatrices((unsigned)m_lights.size() - 1);
+	return (int)m_lights.size() - 1;
+}
+
+int C3dglShadowAtlas::addDirectionalLight(glm::vec3 direction, glm::vec3 center, float radius)
+{
+	unsigned capacity = std::min(m_tilesPerRow * m_tilesPerRow, MAX_SHADOW_TILES);
+	if (m_nTiles + 1 > capacity)
+		return -1;
+	m_lights.push_back({ false, glm::normalize(direction), center, 0, radius, m_nTiles, 1, false });
+	m_nTiles += 1;
+	updateMatrices((unsigned)m_lights.size() - 1);
+	return (int)m_lights.size() - 1;
+}
+
+void C3dglShadowAtlas::setPosition(unsigned light, glm::vec3 position)
+{
+	if (light >= m_lights.size() || m_lights[light].position == position)
+		return;
+	m_lights[light].position = position;
+	updateMatrices(light);
+}
+
+void C3dglShadowAtlas::setDirection(unsigned light, glm::vec3 direction)
+{
+	setPosition(light, glm::normalize(direction));
+}
+
+void C3dglShadowAtlas::invalidate(int light)
+{
+	for (unsigned i = 0; i < m_lights.size(); i++)
+		if (light < 0 || (unsigned)light == i)
+			m_lights[i].bStaticValid = false;
+}
+
+void C3dglShadowAtlas::updateMatrices(unsigned light)
+{
+	SHADOW_LIGHT& l = m_lights[light];
+	l.bStaticValid = false;
+
+	m_views.resize(m_nTiles);
+	m_projections.resize(m_nTiles);
+	m_matrices.resize(m_nTiles);
+	m_regions.resize(m_nTiles);
+	for (unsigned i = 0; i < l.nTiles; i++)
+	{
+		unsigned tile = l.firstTile + i;
+		if (l.bPoint)
+		{
+			// slightly wider than 90 degrees: a border for the PCF kernel at the seams between the faces
+			float fov = 2 * std::atan(1.0f + 4.0f / std::max(m_tileSize, 8u));
+			m_views[tile] = glm::lookAt(l.position, l.position + c_faceDirections[i], c_faceUps[i]);
+			m_projections[tile] = glm::perspective(fov, 1.0f, l.nearPlane, l.farPlane);
+		}
+		else
+		{
+			float r = l.farPlane;
+			glm::vec3 up = std::abs(l.position.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+			m_views[tile] = glm::lookAt(l.center + l.position * r, l.center, up);
+			m_projections[tile] = glm::ortho(-r, r, -r, r, 0.0f, 2 * r);
+		}
+
+		// clip space to the tile in the atlas: xy from [-1, 1] to the tile, z from [-1, 1] to [0, 1]
+		glm::vec2 offset = glm::vec2(float(tile % m_tilesPerRow), float(tile / m_tilesPerRow)) * (float)m_tileSize / (float)m_size;
+		float scale = (float)m_tileSize / (float)m_size;
+		glm::mat4 bias(1);
+		bias[0][0] = bias[1][1] = 0.5f * scale;
+		bias[2][2] = 0.5f;
+		bias[3] = glm::vec4(offset + 0.5f * scale, 0.5f, 1);
+		m_matrices[tile] = bias * m_projections[tile] * m_views[tile];
+		m_regions[tile] = glm::vec4(offset, offset + scale);
+	}
+}
+
+void C3dglShadowAtlas::collectQueries()
+{
+	for (unsigned i = 0; i < 2; i++)
+		if (m_pending[i])
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(m_idQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(m_idQueries[i], GL_QUERY_RESULT, &ns);
+				m_time[i] = ns / 1000000.0f;
+				m_pending[i] = false;
+			}
+		}
+}
+
+void C3dglShadowAtlas::render(std::function<void(unsigned light, glm::mat4 matrixView, glm::mat4 matrixProjection)> renderStatic,
+	std::function<void(unsigned light, glm::mat4 matrixView, glm::mat4 matrixProjection)> renderDynamic)
+{
+	if (!m_idFBO[0])
+		return;
+	auto t0 = std::chrono::high_resolution_clock::now();
+	collectQueries();
+
+	GLint prevFBO, viewport[4];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean bScissor = glIsEnabled(GL_SCISSOR_TEST);
+	glEnable(GL_SCISSOR_TEST);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(1.1f, 4.0f);
+	glDepthMask(GL_TRUE);
+
+	auto setTile = [&](unsigned tile)
+	{
+		GLint x = (tile % m_tilesPerRow) * m_tileSize, y = (tile / m_tilesPerRow) * m_tileSize;
+		glViewport(x, y, m_tileSize, m_tileSize);
+		glScissor(x, y, m_tileSize, m_tileSize);
+	};
+
+	// static casters - only the lights which have moved, or were invalidated
+	m_nStaticTiles = 0;
+	bool bTimed = !m_pending[0];
+	glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO[0]);
+	for (unsigned light = 0; light < m_lights.size(); light++)
+	{
+		SHADOW_LIGHT& l = m_lights[light];
+		if (l.bStaticValid)
+			continue;
+		if (m_nStaticTiles == 0 && bTimed)
+			glBeginQuery(GL_TIME_ELAPSED, m_idQueries[0]);
+		for (unsigned tile = l.firstTile; tile < l.firstTile + l.nTiles; tile++)
+		{
+			setTile(tile);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			if (renderStatic)
+				renderStatic(light, m_views[tile], m_projections[tile]);
+			m_nStaticTiles++;
+		}
+		l.bStaticValid = true;
+	}
+	if (m_nStaticTiles)
+	{
+		m_nStaticUpdates++;
+		if (bTimed)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			m_pending[0] = true;
+		}
+	}
+
+	// the final atlas: a copy of the static one, then the dynamic casters
+	bTimed = !m_pending[1];
+	if (bTimed)
+		glBeginQuery(GL_TIME_ELAPSED, m_idQueries[1]);
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_idFBO[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_idFBO[1]);
+	glBlitFramebuffer(0, 0, m_size, m_size, 0, 0, m_size, m_size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_idFBO[1]);
+	glEnable(GL_SCISSOR_TEST);
+	if (renderDynamic)
+		for (unsigned light = 0; light < m_lights.size(); light++)
+			for (unsigned tile = m_lights[light].firstTile; tile < m_lights[light].firstTile + m_lights[light].nTiles; tile++)
+			{
+				setTile(tile);
+				renderDynamic(light, m_views[tile], m_projections[tile]);
+			}
+	if (bTimed)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_pending[1] = true;
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	if (!bScissor)
+		glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	m_nFrames++;
+	m_cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+void C3dglShadowAtlas::bind(C3dglProgram* pProgram, GLenum texUnit) const
+{
+	if (!pProgram || !m_nTiles)
+		return;
+	glActiveTexture(texUnit);
+	glBindTexture(GL_TEXTURE_2D, m_idDepth[1]);
+	pProgram->sendUniform("shadowAtlas", (int)(texUnit - GL_TEXTURE0));
+	pProgram->sendUniform("shadowMatrices", const_cast<glm::mat4*>(m_matrices.data()), m_nTiles);
+	pProgram->sendUniform("shadowRegions", const_cast<glm::vec4*>(m_regions.data()), m_nTiles);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void C3dglShadowAtlas::stats() const
+{
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Atlas: {0}x{0}, tiles: {1}x{1} texels, {2} used by {3} lights, {4:.1f} MB for both layers",
+		m_size, m_tileSize, m_nTiles, m_lights.size(), 2 * C3dglMemoryTracker::getTextureSize(GL_DEPTH_COMPONENT24, m_size, m_size) / (1024.0 * 1024.0));
+	C3dglLogger::log("Static layer rendered in {} of {} frames ({} tiles last frame), GPU time: static {:.3f} ms (when rendered), dynamic and copy {:.3f} ms, CPU time {:.3f} ms",
+		m_nStaticUpdates, m_nFrames, m_nStaticTiles, m_time[0], m_time[1], m_cpuTime);
+}
@@ -5,42 +5,17 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 *********************************************************************************/
 #include "pch.h"
 #include <3dgl/Shader.h>
+#include <3dgl/Texture.h>
 #include <3dgl/Bitmap.h>
 #include <3dgl/SkyBox.h>
+#include <3dgl/MemoryTracker.h>
+#include "MappedFile.h"
 
 using namespace _3dgl;
 
-C3dglSkyBox::C3dglSkyBox() : C3dglVertexAttrObject(ATTR_COUNT_BASIC)
-{
-	std::fill(m_idTex, m_idTex + 6, 0);
-}
-
-bool C3dglSkyBox::load(const char* pFd, const char* pRt, const char* pBk, const char* pLt, const char* pUp, const char* pDn, C3dglProgram* pProgram)
+namespace
 {
-	if (getAttrCount() != ATTR_COUNT_BASIC)
-	{
-		log(M3DGL_INTERNAL_ERROR);
-		return false;		// this should never happen!
-	}
-
-	glGenTextures(6, m_idTex);
-
-	// load six textures
-	glActiveTexture(GL_TEXTURE0);
-	const char*pFilenames[] = { pBk, pRt, pFd, pLt, pUp, pDn };
-	for (int i = 0; i < 6; ++i)
-	{
-		C3dglBitmap bm(pFilenames[i], GL_RGBA);
-		glGenTextures(1, &m_idTex[i]);
-		glBindTexture(GL_TEXTURE_2D, m_idTex[i]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), abs(bm.getHeight()), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
-	}
-
-	float vertices[] = 
+	const float c_vertices[] =
 	{
 		-1.0f,-1.0f,-1.0f,	 1.0f,-1.0f,-1.0f,	 1.0f, 1.0f,-1.0f,	-1.0f, 1.0f,-1.0f,	//Back
 		-1.0f,-1.0f,-1.0f,	-1.0f, 1.0f,-1.0f,	-1.0f, 1.0f, 1.0f,	-1.0f,-1.0f, 1.0f,	//Left
@@ -50,7 +25,7 @@ bool C3dglSkyBox::load(const char* pFd, const char* pRt, const char* pBk, const
 		 1.0f,-1.0f, -1.0f,	-1.0f,-1.0f, -1.0f,	-1.0f,-1.0f,  1.0f,	 1.0f,-1.0f,  1.0f	//Bottom
 	};
 
-	float normals[] = 
+	const float c_normals[] =
 	{
 		0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1,			//Back
 		1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0,			//Left
@@ -60,7 +35,7 @@ bool C3dglSkyBox::load(const char* pFd, const char* pRt, const char* pBk, const
 		0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0			//Bottom
 	};
 
-	float texCoords[] = 
+	const float c_texCoords[] =
 	{
 		0.0f, 0.0f,		1.0f, 0.0f,		1.0f, 1.0f,		0.0f, 1.0f,		//Back
 		1.0f, 0.0f,		1.0f, 1.0f,		0.0f, 1.0f,		0.0f, 0.0f,		//Left
@@ -70,18 +45,192 @@ bool C3dglSkyBox::load(const char* pFd, const char* pRt, const char* pBk, const
 		0.0f, 0.0f,		1.0f, 0.0f,		1.0f, 1.0f,		0.0f, 1.0f		//Bottom
 	};
 
-	float* attrData[] = { vertices, normals,  texCoords };
+	// Direction of the texel (sc, tc) of a cube map face, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+	glm::vec3 getCubeMapDirection(unsigned face, float sc, float tc)
+	{
+		switch (face)
+		{
+		case 0: return glm::vec3(1, -tc, -sc);
+		case 1: return glm::vec3(-1, -tc, sc);
+		case 2: return glm::vec3(sc, 1, tc);
+		case 3: return glm::vec3(sc, -1, -tc);
+		case 4: return glm::vec3(sc, -tc, 1);
+		default: return glm::vec3(-sc, -tc, -1);
+		}
+	}
+
+	// The quad (as in c_vertices) lying on the same side of the cube as the point p
+	unsigned findQuad(glm::vec3 p)
+	{
+		for (unsigned quad = 0; quad < 6; quad++)
+		{
+			const float* v = c_vertices + quad * 12;
+			for (unsigned axis = 0; axis < 3; axis++)
+				if (v[axis] == v[3 + axis] && v[axis] == v[6 + axis] && v[axis] == v[9 + axis] && v[axis] == p[axis])
+					return quad;
+		}
+		return 0;
+	}
+}
+
+C3dglSkyBox::C3dglSkyBox() : C3dglVertexAttrObject(ATTR_COUNT_BASIC)
+{
+	std::fill(m_idTex, m_idTex + 6, 0);
+	m_idCubeMap = 0;
+}
+
+C3dglSkyBox::~C3dglSkyBox()
+{
+	destroy();
+}
+
+bool C3dglSkyBox::load(const char* pFd, const char* pRt, const char* pBk, const char* pLt, const char* pUp, const char* pDn, C3dglProgram* pProgram)
+{
+	if (getAttrCount() != ATTR_COUNT_BASIC)
+	{
+		log(M3DGL_INTERNAL_ERROR);
+		return false;		// this should never happen!
+	}
+
+	// load six textures - clamped at the edges so that the seams are not visible
+	const char*pFilenames[] = { pBk, pRt, pFd, pLt, pUp, pDn };
+	for (int i = 0; i < 6; ++i)
+	{
+		C3dglTexture texture;
+		texture.load(pFilenames[i], TEX_CLAMP);
+		C3dglMemoryTracker::getInstance().add(MEM_TEXTURE, texture.getId(), texture.getSize(), texture.getFormat(), getName());
+		m_idTex[i] = texture.detach();
+	}
+
+	createGeometry(false, pProgram);
+
+	return true;
+}
+
+bool C3dglSkyBox::loadCubeMap(const char* pFd, const char* pRt, const char* pBk, const char* pLt, const char* pUp, const char* pDn, C3dglProgram* pProgram)
+{
+	if (getAttrCount() != ATTR_COUNT_BASIC)
+	{
+		log(M3DGL_INTERNAL_ERROR);
+		return false;		// this should never happen!
+	}
+
+	// decode the faces, in parallel; same order as the quads
+	const char* pFilenames[] = { pBk, pRt, pFd, pLt, pUp, pDn };
+	std::string filenames[6];
+	for (int i = 0; i < 6; ++i)
+		filenames[i] = pFilenames[i];
+	C3dglBitmap bitmaps[6];
+	bool bValid = C3dglBitmap::loadParallel(6, bitmaps, filenames, GL_RGBA) == 6;
+	unsigned size = bValid ? (unsigned)bitmaps[0].getWidth() : 0;
+	for (C3dglBitmap& bm : bitmaps)
+		if (!bm.getBits() || (unsigned)bm.getWidth() != size || (unsigned)abs(bm.getHeight()) != size)
+			bValid = false;
+	if (!bValid)
+		return log(M3DGL_ERROR_CUBEMAP_FACES, pFd);	// not the six textures of load: a samplerCube shader could not render them
+
+	// remap the quad images to the cube map faces: each face texel takes the quad texel seen in the same direction,
+	// which is an exact texel-to-texel copy (only the orientation differs); then the mip chains
+	unsigned levels = C3dglTexture::getLevelCount(size, size);
+	std::vector<std::vector<unsigned char>> faces[6];
+	parallelFor(6, [&](size_t face)
+		{
+			std::vector<unsigned char> image((size_t)size * size * 4);
+			for (unsigned j = 0; j < size; j++)
+				for (unsigned i = 0; i < size; i++)
+				{
+					glm::vec3 p = getCubeMapDirection((unsigned)face, 2 * (i + 0.5f) / size - 1, 2 * (j + 0.5f) / size - 1);
+					unsigned quad = findQuad(p);
+					const float* v = c_vertices + quad * 12;
+					const float* uv = c_texCoords + quad * 8;
+					glm::vec3 v0(v[0], v[1], v[2]), e1 = glm::vec3(v[3], v[4], v[5]) - v0, e3 = glm::vec3(v[9], v[10], v[11]) - v0;
+					float a = glm::dot(p - v0, e1) / 4, b = glm::dot(p - v0, e3) / 4;
+					float u = uv[0] + a * (uv[2] - uv[0]) + b * (uv[6] - uv[0]);
+					float t = uv[1] + a * (uv[3] - uv[1]) + b * (uv[7] - uv[1]);
+					unsigned x = std::min(size - 1, (unsigned)(u * size)), y = std::min(size - 1, (unsigned)(t * size));
+					memcpy(&image[((size_t)j * size + i) * 4], (unsigned char*)bitmaps[quad].getBits() + ((size_t)y * size + x) * 4, 4);
+				}
+			C3dglTexture::generateMipChain(size, size, image.data(), faces[face]);
+		});
+
+	// preserve the currently bound texture
+	GLuint prevTex;
+	glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, (GLint*)&prevTex);
+
+	glGenTextures(1, &m_idCubeMap);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+	bool bStorage = GLEW_ARB_texture_storage;
+	if (bStorage)
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGBA8, size, size);
+	for (unsigned face = 0; face < 6; face++)
+		for (unsigned level = 0; level < levels; level++)
+		{
+			GLsizei w = std::max(1u, size >> level);
+			if (bStorage)
+				glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, w, w, GL_RGBA, GL_UNSIGNED_BYTE, faces[face][level].data());
+			else
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA8, w, w, 0, GL_RGBA, GL_UNSIGNED_BYTE, faces[face][level].data());
+		}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, prevTex);
+	C3dglMemoryTracker::getInstance().add(MEM_CUBE_MAP, m_idCubeMap, C3dglMemoryTracker::getTextureSize(GL_RGBA8, size, size, levels, 6), GL_RGBA8, getName());
+
+	// filtering across the face edges
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	createGeometry(true, pProgram);
+
+	return true;
+}
+
+void C3dglSkyBox::createGeometry(bool bIndexed, C3dglProgram* pProgram)
+{
+	const float* attrData[] = { c_vertices, c_normals, c_texCoords };
 	size_t attrSize[] = { 3 * sizeof(float), 3 * sizeof(float), 2 * sizeof(float) };
 	size_t nVertices = 24;
 
+	// the cube map version is drawn as triangles, in a single call
+	unsigned indices[36];
+	for (unsigned quad = 0; quad < 6; quad++)
+	{
+		unsigned fan[] = { 0, 1, 2, 0, 2, 3 };
+		for (unsigned i = 0; i < 6; i++)
+			indices[quad * 6 + i] = quad * 4 + fan[i];
+	}
+
 	// additional warning - only checked for skyboxes...
-	if (pProgram && pProgram->getAttribLocation(ATTR_TEXCOORD) == -1
-	|| !pProgram && C3dglProgram::getCurrentProgram() && C3dglProgram::getCurrentProgram()->getAttribLocation(ATTR_TEXCOORD) == -1)
-		log(M3DGL_WARNING_TEXCOORDS_COORDS_NOT_IMPLEMENTED);
+	if (!bIndexed)
+		if ((pProgram && pProgram->getAttribLocation(ATTR_TEXCOORD) == -1)
+		|| (!pProgram && C3dglProgram::getCurrentProgram() && C3dglProgram::getCurrentProgram()->getAttribLocation(ATTR_TEXCOORD) == -1))
+			log(M3DGL_WARNING_TEXCOORDS_COORDS_NOT_IMPLEMENTED);
 
-	create(getAttrCount(), nVertices, (void**)attrData, attrSize, 0, NULL, 0, pProgram);
+	if (bIndexed)
+		create(getAttrCount(), nVertices, (void**)attrData, attrSize, 36, indices, sizeof(unsigned), pProgram);
+	else
+		create(getAttrCount(), nVertices, (void**)attrData, attrSize, 0, NULL, 0, pProgram);
+}
 
-	return true;
+void C3dglSkyBox::destroy()
+{
+	for (unsigned int& idTex : m_idTex)
+		if (idTex)
+		{
+			C3dglMemoryTracker::getInstance().remove(MEM_TEXTURE, idTex);
+			glDeleteTextures(1, &idTex);
+			idTex = 0;
+		}
+	if (m_idCubeMap)
+	{
+		C3dglMemoryTracker::getInstance().remove(MEM_CUBE_MAP, m_idCubeMap);
+		glDeleteTextures(1, &m_idCubeMap);
+	}
+	m_idCubeMap = 0;
+	C3dglVertexAttrObject::destroy();
 }
 
 void C3dglSkyBox::render(GLsizei instances) const
@@ -91,19 +240,28 @@ void C3dglSkyBox::render(GLsizei instances) const
 	::glGetBooleanv(GL_DEPTH_WRITEMASK, &bDepthMask);
 	glDepthMask(GL_FALSE);
 
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	glBindVertexArray(getVAOid());
 	glActiveTexture(GL_TEXTURE0);
-	for (int i = 0; i < 6; ++i)
+	if (m_idCubeMap)
+	{
+		// a single bind and a single draw call
+		glBindTexture(GL_TEXTURE_CUBE_MAP, m_idCubeMap);
+		C3dglVertexAttrObject::render(instances);
+	}
+	else
 	{
-		glBindTexture(GL_TEXTURE_2D, m_idTex[i]);
-		if (instances == 1)
-			glDrawArrays(GL_TRIANGLE_FAN, i * 4, 4);
-		else
-			glDrawArraysInstanced(GL_TRIANGLE_FAN, i * 4, 4, instances);
+		GLuint prevVAO;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
+		glBindVertexArray(getVAOid());
+		for (int i = 0; i < 6; ++i)
+		{
+			glBindTexture(GL_TEXTURE_2D, m_idTex[i]);
+			if (instances == 1)
+				glDrawArrays(GL_TRIANGLE_FAN, i * 4, 4);
+			else
+				glDrawArraysInstanced(GL_TRIANGLE_FAN, i * 4, 4, instances);
+		}
+		glBindVertexArray(prevVAO);
 	}
-	glBindVertexArray(prevVAO);
 
 	// enable depth-buffer write cycle
 	glDepthMask(bDepthMask);
@@ -0,0 +1,337 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/StaticBatch.h>
+#include <3dgl/Model.h>
+#include <3dgl/Mesh.h>
+#include <3dgl/Material.h>
+#include <3dgl/Shader.h>
+#include "MappedFile.h"
+
+// assimp include files
+#include "assimp/scene.h"
+
+// GLM include files
+#include "../glm/gtc/type_ptr.hpp"
+#include "../glm/gtc/matrix_inverse.hpp"
+
+// standard libraries
+#include <chrono>
+#include <cfloat>
+#include <set>
+#include <functional>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define STATICBATCH_SSE2
+#endif
+
+using namespace _3dgl;
+
+namespace
+{
+	// vertices transformed by one task
+	const size_t c_verticesPerTask = 4096;
+
+	// the merged buffers of a batch
+	class CBatchVAO : public C3dglVertexAttrObject
+	{
+	public:
+		CBatchVAO() : C3dglVertexAttrObject(ATTR_COUNT)	{ }
+		~CBatchVAO()									{ destroy(); }
+		std::string getName() const						{ return "Static Batch Buffers"; }
+	};
+
+	// dst = m * (src, w) for count vectors of three floats; w is 1 for points, 0 for directions
+	void transform(const glm::mat4& m, float w, const float* src, float* dst, size_t count)
+	{
+#ifdef STATICBATCH_SSE2
+		__m128 c0 = _mm_loadu_ps(&m[0][0]), c1 = _mm_loadu_ps(&m[1][0]), c2 = _mm_loadu_ps(&m[2][0]);
+		__m128 c3 = _mm_mul_ps(_mm_loadu_ps(&m[3][0]), _mm_set1_ps(w));
+		alignas(16) float out[4];
+		for (size_t i = 0; i < count; i++, src += 3, dst += 3)
+		{
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(src[0])), _mm_mul_ps(c1, _mm_set1_ps(src[1]))),
+				_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(src[2])), c3));
+			_mm_store_ps(out, r);
+			dst[0] = out[0];
+			dst[1] = out[1];
+			dst[2] = out[2];
+		}
+#else
+		for (size_t i = 0; i < count; i++, src += 3, dst += 3)
+		{
+			glm::vec4 r = m * glm::vec4(src[0], src[1], src[2], w);
+			dst[0] = r.x;
+			dst[1] = r.y;
+			dst[2] = r.z;
+		}
+#endif
+	}
+}
+
+C3dglStaticBatch::C3dglStaticBatch() : C3dglObject()
+{
+	m_nSourceDraws = m_nSourceMeshes = 0;
+	m_sourceBytes = m_batchBytes = 0;
+	m_nVertices = m_nIndices = 0;
+	m_nThreads = 0;
+	m_buildTime = 0;
+	m_nDraws = m_nRanges = 0;
+}
+
+unsigned C3dglStaticBatch::add(const C3dglModel* pModel, glm::mat4 world, const C3dglMaterial* pMaterial, int iModelNode)
+{
+	ENTRY entry = { pModel, iModelNode, world, pMaterial };
+	m_entries.push_back(entry);
+	return (unsigned)m_entries.size() - 1;
+}
+
+void C3dglStaticBatch::destroy()
+{
+	for (GROUP& group : m_groups)
+		delete group.pVAO;
+	m_groups.clear();
+	m_entries.clear();
+	m_nSourceDraws = m_nSourceMeshes = 0;
+	m_sourceBytes = m_batchBytes = 0;
+	m_nVertices = m_nIndices = 0;
+}
+
+bool C3dglStaticBatch::build(C3dglProgram* pProgram, unsigned nThreads)
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	for (GROUP& group : m_groups)
+		delete group.pVAO;
+	m_groups.clear();
+	for (ENTRY& e : m_entries)
+	{
+		e.aabb[0] = glm::vec3(FLT_MAX);
+		e.aabb[1] = glm::vec3(-FLT_MAX);
+	}
+	if (!pProgram)
+		pProgram = C3dglProgram::getCurrentProgram();
+
+	// the pieces: each mesh of each entry, with its accumulated transform, in the order of the entries
+	struct PIECE
+	{
+		unsigned entry, group;
+		const aiMesh* pMesh;
+		glm::mat4 matrix, normalMatrix;
+		size_t firstVertex, firstIndex;
+	};
+	struct DATA
+	{
+		std::vector<glm::vec3> positions, normals;
+		std::vector<glm::vec2> texCoords;
+		std::vector<GLuint> indices;
+	};
+	std::vector<PIECE> pieces;
+	std::vector<DATA> data;
+	std::set<const C3dglMesh*> sources;
+	m_sourceBytes = 0;
+
+	for (unsigned entry = 0; entry < m_entries.size(); entry++)
+	{
+		const ENTRY& e = m_entries[entry];
+		const aiScene* pScene = e.pModel ? e.pModel->getScene() : NULL;
+		if (!pScene || !pScene->mRootNode)
+			continue;
+
+		// as in C3dglModel::renderNode
+		std::function<void(const aiNode*, glm::mat4)> collect = [&](const aiNode* pNode, glm::mat4 m)
+		{
+			m *= glm::transpose(glm::make_mat4((const GLfloat*)&pNode->mTransformation));
+			for (unsigned iMesh : std::vector<unsigned>(pNode->mMeshes, pNode->mMeshes + pNode->mNumMeshes))
+			{
+				const aiMesh* pMesh = pScene->mMeshes[iMesh];
+				if (pMesh->mNumVertices == 0 || pMesh->mNumFaces == 0 || pMesh->mFaces[0].mNumIndices != 3)
+					continue;		// not rendered by the model either
+
+				const C3dglMesh* pSource = e.pModel->getMesh(iMesh);
+				if (sources.insert(pSource).second)
+					m_sourceBytes += pSource->getBufferSize();
+
+				const C3dglMaterial* pMeshMaterial = pSource->getMaterial();
+				unsigned group = 0;
+				while (group < m_groups.size() && (m_groups[group].pMaterial != e.pMaterial || m_groups[group].pMeshMaterial != pMeshMaterial))
+					group++;
+				if (group == m_groups.size())
+				{
+					m_groups.push_back({ e.pMaterial, pMeshMaterial });
+					data.push_back(DATA());
+				}
+
+				DATA& d = data[group];
+				PIECE piece = { entry, group, pMesh, m, glm::mat4(glm::inverseTranspose(glm::mat3(m))), d.positions.size(), d.indices.size() };
+				pieces.push_back(piece);
+				d.positions.resize(d.positions.size() + pMesh->mNumVertices);
+				d.indices.resize(d.indices.size() + pMesh->mNumFaces * 3);
+				m_groups[group].ranges.push_back({ entry, (GLsizei)piece.firstIndex, (GLsizei)pMesh->mNumFaces * 3 });
+			}
+			for (const aiNode* p : std::vector<aiNode*>(pNode->mChildren, pNode->mChildren + pNode->mNumChildren))
+				collect(p, m);
+		};
+		if (e.iModelNode < 0)
+			collect(pScene->mRootNode, e.world);
+		else if ((unsigned)e.iModelNode < pScene->mRootNode->mNumChildren)
+			collect(pScene->mRootNode->mChildren[e.iModelNode], e.world * glm::transpose(glm::make_mat4((const GLfloat*)&pScene->mRootNode->mTransformation)));
+	}
+	for (DATA& d : data)
+	{
+		d.normals.resize(d.positions.size());
+		d.texCoords.resize(d.positions.size());
+	}
+
+	// the tasks: up to c_verticesPerTask vertices of a piece each; the first one of each piece takes its indices too
+	struct TASK
+	{
+		size_t piece, first, count;
+		glm::vec3 aabb[2] = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+	};
+	std::vector<TASK> tasks;
+	for (size_t i = 0; i < pieces.size(); i++)
+		for (size_t first = 0; first < pieces[i].pMesh->mNumVertices; first += c_verticesPerTask)
+			tasks.push_back({ i, first, std::min<size_t>(c_verticesPerTask, pieces[i].pMesh->mNumVertices - first) });
+
+	m_nThreads = nThreads ? nThreads : std::max(1u, std::thread::hardware_concurrency());
+	parallelFor(tasks.size(), [&](size_t i)
+		{
+			TASK& task = tasks[i];
+			const PIECE& piece = pieces[task.piece];
+			const aiMesh* pMesh = piece.pMesh;
+			DATA& d = data[piece.group];
+			size_t base = piece.firstVertex + task.first;
+
+			glm::vec3* pPositions = &d.positions[base];
+			transform(piece.matrix, 1, &pMesh->mVertices[task.first].x, &pPositions->x, task.count);
+			for (size_t v = 0; v < task.count; v++)
+			{
+				task.aabb[0] = glm::min(task.aabb[0], pPositions[v]);
+				task.aabb[1] = glm::max(task.aabb[1], pPositions[v]);
+			}
+
+			if (pMesh->mNormals)
+			{
+				glm::vec3* pNormals = &d.normals[base];
+				transform(piece.normalMatrix, 0, &pMesh->mNormals[task.first].x, &pNormals->x, task.count);
+				for (size_t v = 0; v < task.count; v++)
+					if (glm::dot(pNormals[v], pNormals[v]) > 0)
+						pNormals[v] = glm::normalize(pNormals[v]);
+			}
+			if (pMesh->mTextureCoords[0])
+				for (size_t v = 0; v < task.count; v++)
+					d.texCoords[base + v] = glm::vec2(pMesh->mTextureCoords[0][task.first + v].x, pMesh->mTextureCoords[0][task.first + v].y);
+
+			if (task.first == 0)
+			{
+				GLuint* pIndices = &d.indices[piece.firstIndex];
+				for (unsigned f = 0; f < pMesh->mNumFaces; f++)
+					for (unsigned k = 0; k < 3; k++)
+						*pIndices++ = (GLuint)piece.firstVertex + pMesh->mFaces[f].mIndices[k];
+			}
+		}, m_nThreads);
+
+	for (const TASK& task : tasks)
+	{
+		ENTRY& e = m_entries[pieces[task.piece].entry];
+		e.aabb[0] = glm::min(e.aabb[0], task.aabb[0]);
+		e.aabb[1] = glm::max(e.aabb[1], task.aabb[1]);
+	}
+
+	// the buffers - and the ranges of each entry merged, where the pieces are adjacent
+	m_nVertices = m_nIndices = m_batchBytes = 0;
+	m_nSourceDraws = pieces.size();
+	m_nSourceMeshes = sources.size();
+	for (size_t i = 0; i < m_groups.size(); i++)
+	{
+		GROUP& group = m_groups[i];
+		DATA& d = data[i];
+		void* attrData[ATTR_COUNT] = { d.positions.data(), d.normals.data(), d.texCoords.data() };
+		size_t attrSize[ATTR_COUNT] = { sizeof(glm::vec3), sizeof(glm::vec3), sizeof(glm::vec2) };
+		group.pVAO = new CBatchVAO;
+		group.pVAO->create(ATTR_COUNT, d.positions.size(), attrData, attrSize, d.indices.size(), d.indices.data(), sizeof(GLuint), pProgram);
+		m_nVertices += d.positions.size();
+		m_nIndices += d.indices.size();
+		m_batchBytes += group.pVAO->getBufferSize();
+
+		std::vector<RANGE> ranges;
+		for (const RANGE& range : group.ranges)
+			if (!ranges.empty() && ranges.back().entry == range.entry && ranges.back().first + ranges.back().count == range.first)
+				ranges.back().count += range.count;
+			else
+				ranges.push_back(range);
+		group.ranges.swap(ranges);
+	}
+
+	m_buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+	return !m_groups.empty();
+}
+
+void C3dglStaticBatch::render(glm::mat4 matrixView, C3dglProgram* pProgram, const std::vector<bool>* pVisible) const
+{
+	if (!pProgram)
+		pProgram = C3dglProgram::getCurrentProgram();
+	bool bMaterials = !(pProgram && pProgram->isPositionOnly());
+
+	m_nDraws = m_nRanges = 0;
+	C3dglMaterial::beginBatch();
+	for (const GROUP& group : m_groups)
+	{
+		// the ranges of the visible entries; the adjacent ones are drawn as one
+		m_visible.clear();
+		for (const RANGE& range : group.ranges)
+		{
+			if (pVisible && (range.entry >= pVisible->size() || !(*pVisible)[range.entry]))
+				continue;
+			if (!m_visible.empty() && m_visible.back().first + m_visible.back().second == range.first)
+				m_visible.back().second += range.count;
+			else
+				m_visible.push_back(std::make_pair(range.first, range.count));
+		}
+		if (m_visible.empty())
+			continue;
+
+		if (bMaterials && group.pMaterial)
+			group.pMaterial->render(pProgram);
+		if (bMaterials && group.pMeshMaterial)
+			group.pMeshMaterial->render(pProgram);
+		group.pVAO->render(matrixView, m_visible, pProgram);
+		if (bMaterials && group.pMeshMaterial)
+			group.pMeshMaterial->postRender(pProgram);
+		if (bMaterials && group.pMaterial)
+			group.pMaterial->postRender(pProgram);
+		m_nDraws++;
+		m_nRanges += m_visible.size();
+	}
+	C3dglMaterial::endBatch();
+}
+
+void C3dglStaticBatch::getAABB(glm::vec3 aabb[2]) const
+{
+	aabb[0] = glm::vec3(FLT_MAX);
+	aabb[1] = glm::vec3(-FLT_MAX);
+	for (const ENTRY& entry : m_entries)
+	{
+		aabb[0] = glm::min(aabb[0], entry.aabb[0]);
+		aabb[1] = glm::max(aabb[1], entry.aabb[1]);
+	}
+}
+
+void C3dglStaticBatch::stats() const
+{
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Entries: {}, meshes: {} ({} distinct), batches: {} - {} vertices, {} indices; built in {:.3f} ms on {} threads",
+		m_entries.size(), m_nSourceDraws, m_nSourceMeshes, m_groups.size(), m_nVertices, m_nIndices, m_buildTime, m_nThreads);
+	C3dglLogger::log("Draw calls per pass: {} without batching, {} batched ({} in the last render, {} index ranges)",
+		m_nSourceDraws, m_groups.size(), m_nDraws, m_nRanges);
+	size_t nSaved = m_nSourceDraws > m_groups.size() ? m_nSourceDraws - m_groups.size() : 0;
+	C3dglLogger::log("Memory: {:.1f} KB of the distinct source meshes, {:.1f} KB batched (x{:.1f}) - {:.1f} KB more for each draw call saved",
+		m_sourceBytes / 1024.0, m_batchBytes / 1024.0, m_sourceBytes ? (double)m_batchBytes / m_sourceBytes : 0.0,
+		nSaved ? ((double)m_batchBytes - (double)m_sourceBytes) / 1024.0 / nSaved : 0.0);
+}
@@ -0,0 +1,552 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <3dgl/Texture.h>
+#include <3dgl/TextureFile.h>
+#include <3dgl/Bitmap.h>
+#include <3dgl/AssetPack.h>
+#include <3dgl/LoadProfile.h>
+#include <3dgl/MemoryTracker.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTURE_SSE2
+#endif
+
+using namespace _3dgl;
+
+float C3dglTexture::c_anisotropy = 8.0f;
+std::string C3dglTexture::c_cacheDir;
+
+namespace
+{
+	// A single RGBA pixel in the floating point, linear space
+#ifdef TEXTURE_SSE2
+	typedef __m128 PIXEL;
+	inline PIXEL pxLoad(const float* p)				{ return _mm_loadu_ps(p); }
+	inline void pxStore(float* p, PIXEL a)			{ _mm_storeu_ps(p, a); }
+	inline PIXEL pxZero()							{ return _mm_setzero_ps(); }
+	inline PIXEL pxAdd(PIXEL a, PIXEL b)			{ return _mm_add_ps(a, b); }
+	inline PIXEL pxMul(PIXEL a, float f)			{ return _mm_mul_ps(a, _mm_set1_ps(f)); }
+#else
+	typedef glm::vec4 PIXEL;
+	inline PIXEL pxLoad(const float* p)				{ return glm::vec4(p[0], p[1], p[2], p[3]); }
+	inline void pxStore(float* p, PIXEL a)			{ p[0] = a.x; p[1] = a.y; p[2] = a.z; p[3] = a.w; }
+	inline PIXEL pxZero()							{ return glm::vec4(0); }
+	inline PIXEL pxAdd(PIXEL a, PIXEL b)			{ return a + b; }
+	inline PIXEL pxMul(PIXEL a, float f)			{ return a * f; }
+#endif
+
+	// sRGB <=> linear conversion tables
+	struct GAMMA
+	{
+		float toLinear[256];
+		unsigned char fromLinear[4096];
+
+		GAMMA()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; i++)
+			{
+				float c = i / 4095.0f;
+				c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1 / 2.4f) - 0.055f;
+				fromLinear[i] = (unsigned char)(c * 255 + 0.5f);
+			}
+		}
+	};
+	const GAMMA& gamma()
+	{
+		static GAMMA g;
+		return g;
+	}
+
+	// Image in the floating point, linear space: 4 floats per pixel
+	struct IMAGE
+	{
+		unsigned w, h;
+		std::vector<float> data;
+
+		IMAGE(unsigned w, unsigned h) : w(w), h(h), data((size_t)w * h * 4)	{ }
+		float* at(unsigned x, unsigned y)				{ return &data[((size_t)y * w + x) * 4]; }
+	};
+
+	void toFloat(const unsigned char* pSrc, IMAGE& img, bool bLinear)
+	{
+		const float* pLUT = gamma().toLinear;
+		for (size_t i = 0; i < img.data.size(); i++)
+			img.data[i] = (bLinear || i % 4 == 3) ? pSrc[i] / 255.0f : pLUT[pSrc[i]];
+	}
+
+	void fromFloat(const IMAGE& img, std::vector<unsigned char>& dest, bool bLinear)
+	{
+		const unsigned char* pLUT = gamma().fromLinear;
+		dest.resize(img.data.size());
+		for (size_t i = 0; i < img.data.size(); i++)
+		{
+			float c = std::clamp(img.data[i], 0.0f, 1.0f);
+			dest[i] = (bLinear || i % 4 == 3) ? (unsigned char)(c * 255 + 0.5f) : pLUT[(int)(c * 4095 + 0.5f)];
+		}
+	}
+
+	// 2x2 box filter; for odd sizes, the last row/column is clamped
+	IMAGE downsampleBox(IMAGE& src)
+	{
+		IMAGE dest(std::max(1u, src.w / 2), std::max(1u, src.h / 2));
+		for (unsigned y = 0; y < dest.h; y++)
+		{
+			unsigned y0 = std::min(2 * y, src.h - 1), y1 = std::min(2 * y + 1, src.h - 1);
+			for (unsigned x = 0; x < dest.w; x++)
+			{
+				unsigned x0 = std::min(2 * x, src.w - 1), x1 = std::min(2 * x + 1, src.w - 1);
+				PIXEL p = pxAdd(pxAdd(pxLoad(src.at(x0, y0)), pxLoad(src.at(x1, y0))), pxAdd(pxLoad(src.at(x0, y1)), pxLoad(src.at(x1, y1))));
+				pxStore(dest.at(x, y), pxMul(p, 0.25f));
+			}
+		}
+		return dest;
+	}
+
+	// Kaiser-windowed sinc filter, 8 taps per output pixel, applied separably
+	const int c_kaiserTaps = 8;
+	const float* kaiserWeights()
+	{
+		static float weights[c_kaiserTaps] = { 0 };
+		if (weights[0] == 0)
+		{
+			const float alpha = 4.0f, halfWidth = 2.0f;
+			auto bessel0 = [](float x)
+			{
+				float sum = 1, term = 1;
+				for (int k = 1; k < 20; k++)
+				{
+					term *= (x / (2 * k)) * (x / (2 * k));
+					sum += term;
+				}
+				return sum;
+			};
+			float total = 0;
+			for (int i = 0; i < c_kaiserTaps; i++)
+			{
+				float d = (i - c_kaiserTaps / 2 + 0.5f) / 2;	// distance from the output pixel centre, in output pixels
+				float t = d / halfWidth;
+				float sinc = glm::pi<float>() * d;
+				sinc = std::sin(sinc) / sinc;
+				weights[i] = sinc * bessel0(alpha * std::sqrt(std::max(0.0f, 1 - t * t))) / bessel0(alpha);
+				total += weights[i];
+			}
+			for (float& w : weights)
+				w /= total;
+		}
+		return weights;
+	}
+
+	IMAGE downsampleKaiser(IMAGE& src)
+	{
+		const float* weights = kaiserWeights();
+		auto filter = [weights](IMAGE& src, IMAGE& dest, bool bHorz)
+		{
+			unsigned srcLen = bHorz ? src.w : src.h;
+			for (unsigned y = 0; y < dest.h; y++)
+				for (unsigned x = 0; x < dest.w; x++)
+				{
+					if (srcLen == 1)
+					{
+						pxStore(dest.at(x, y), pxLoad(src.at(x, y)));
+						continue;
+					}
+					PIXEL p = pxZero();
+					int first = 2 * (bHorz ? x : y) - c_kaiserTaps / 2 + 1;
+					for (int i = 0; i < c_kaiserTaps; i++)
+					{
+						unsigned j = (unsigned)std::clamp(first + i, 0, (int)srcLen - 1);
+						p = pxAdd(p, pxMul(pxLoad(bHorz ? src.at(j, y) : src.at(x, j)), weights[i]));
+					}
+					pxStore(dest.at(x, y), p);
+				}
+		};
+		IMAGE tmp(std::max(1u, src.w / 2), src.h);
+		filter(src, tmp, true);
+		IMAGE dest(tmp.w, std::max(1u, src.h / 2));
+		filter(tmp, dest, false);
+		return dest;
+	}
+
+	// Mip chain cache file header; levels follow, in order, with no padding
+	struct MIPCACHE_HEADER
+	{
+		char magic[8];				// "3DGLMIP"
+		uint32_t version;
+		uint32_t options;			// options relevant to the filtering
+		uint64_t sourceSize;		// size and time stamp of the source image
+		int64_t sourceTime;
+		uint32_t width, height, levels;
+	};
+	const uint32_t c_mipCacheVersion = 1;
+	const unsigned c_cacheOptions = TEX_LINEAR_DATA | TEX_MIPS_KAISER;
+
+	bool getSourceStamp(std::string filename, uint64_t& size, int64_t& time)
+	{
+		std::error_code ec;
+		size = std::filesystem::file_size(filename, ec);
+		if (ec) return false;
+		time = std::filesystem::last_write_time(filename, ec).time_since_epoch().count();
+		return !ec;
+	}
+}
+
+/*********************************************************************************
+** class C3dglTexture
+*/
+
+C3dglTexture::C3dglTexture() : C3dglObject()
+{
+	m_id = 0;
+	m_format = GL_RGBA8;
+	m_width = m_height = m_levels = 0;
+	m_options = TEX_DEFAULT;
+}
+
+unsigned C3dglTexture::getLevelCount(unsigned width, unsigned height)
+{
+	unsigned levels = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+		levels++;
+	}
+	return levels;
+}
+
+void C3dglTexture::generateMipChain(unsigned width, unsigned height, const void* pRGBA, std::vector<std::vector<unsigned char>>& levels, unsigned options)
+{
+	bool bLinear = (options & TEX_LINEAR_DATA) != 0;
+	levels.clear();
+	levels.reserve(getLevelCount(width, height));
+	levels.emplace_back((const unsigned char*)pRGBA, (const unsigned char*)pRGBA + (size_t)width * height * 4);
+
+	// each level is filtered from the previous one, kept in the linear floating point space to avoid the quantization errors
+	IMAGE img(width, height);
+	toFloat((const unsigned char*)pRGBA, img, bLinear);
+	while (img.w > 1 || img.h > 1)
+	{
+		img = (options & TEX_MIPS_KAISER) ? downsampleKaiser(img) : downsampleBox(img);
+		levels.emplace_back();
+		fromFloat(img, levels.back(), bLinear);
+	}
+}
+
+bool C3dglTexture::load(std::string filename, unsigned options, C3dglLoadProfile* pProfile)
+{
+	// baked texture from a mounted asset pack: the mip chain is uploaded directly from the mapped file
+	ASSETPACK_TEXTURE texture;
+	C3dglAssetPack* pPack = C3dglAssetPack::findMounted(filename, ASSET_TEXTURE);
+	if (pPack && pPack->getTexture(filename, texture))
+	{
+		C3dglProfileTimer timer(pProfile, "texture upload");
+		create(texture.width, texture.height, (options & TEX_NO_MIPS) ? 1 : texture.levels, texture.pLevels, options, filename);
+		return log(M3DGL_SUCCESS_LOADED_FROM_PACK, filename);
+	}
+
+	// compressed version of the image - all levels uploaded directly from the mapped file
+	std::string compressed = (options & TEX_UNCOMPRESSED) ? "" : C3dglTextureFile::findCompressed(filename);
+	if (!compressed.empty())
+	{
+		C3dglProfileTimer timer(pProfile, "texture upload");
+		C3dglTextureFile file;
+		if (file.open(compressed))
+		{
+			if (file.isSupported())
+			{
+				create(file, options);
+				return log(M3DGL_SUCCESS_LOADED, compressed);
+			}
+			log(M3DGL_WARNING_FORMAT_NOT_SUPPORTED, file.getFormat(), compressed);
+		}
+	}
+
+	// mip chain generated in one of the previous runs
+	bool bCache = !c_cacheDir.empty() && (options & (TEX_NO_MIPS | TEX_MIPS_GPU | TEX_NO_CACHE)) == 0;
+	if (bCache)
+	{
+		C3dglProfileTimer timer(pProfile, "texture upload");
+		m_options = options;
+		if (loadFromCache(filename))
+			return true;
+	}
+
+	C3dglBitmap bm;
+	C3dglProfileTimer timer(pProfile, "texture decode");
+	if (!bm.load(filename, GL_RGBA) || !bm.getBits())
+		return false;
+	timer.stop();
+
+	unsigned width = (unsigned)bm.getWidth(), height = (unsigned)abs(bm.getHeight());
+	if (options & (TEX_NO_MIPS | TEX_MIPS_GPU))
+	{
+		C3dglProfileTimer timer(pProfile, "texture upload");
+		return create(width, height, bm.getBits(), options, filename);
+	}
+
+	C3dglProfileTimer timerMips(pProfile, "mip generation");
+	std::vector<std::vector<unsigned char>> levels;
+	generateMipChain(width, height, bm.getBits(), levels, options);
+	timerMips.stop();
+
+	C3dglProfileTimer timerUpload(pProfile, "texture upload");
+	std::vector<const void*> pLevels;
+	for (auto& level : levels)
+		pLevels.push_back(level.data());
+	if (!create(width, height, (unsigned)levels.size(), pLevels.data(), options, filename))
+		return false;
+	timerUpload.stop();
+
+	if (bCache)
+		saveToCache(filename, levels);
+	return true;
+}
+
+bool C3dglTexture::load(const aiTexture* pTexture, unsigned options, C3dglLoadProfile* pProfile)
+{
+	C3dglBitmap bm;
+	C3dglProfileTimer timer(pProfile, "texture decode");
+	if (!bm.load(pTexture, GL_RGBA) || !bm.getBits())
+		return false;
+	timer.stop();
+
+	C3dglProfileTimer timerUpload(pProfile, "texture upload");
+	return create((unsigned)bm.getWidth(), (unsigned)abs(bm.getHeight()), bm.getBits(), options, "embedded");
+}
+
+bool C3dglTexture::create(unsigned width, unsigned height, const void* pRGBA, unsigned options, std::string name)
+{
+	if (options & (TEX_NO_MIPS | TEX_MIPS_GPU))
+	{
+		destroy();
+		m_name = name;
+		m_options = options;
+		upload(GL_RGBA8, width, height, (options & TEX_NO_MIPS) ? 1 : getLevelCount(width, height), &pRGBA, NULL, (options & TEX_MIPS_GPU) != 0);
+		return true;
+	}
+
+	std::vector<std::vector<unsigned char>> levels;
+	generateMipChain(width, height, pRGBA, levels, options);
+	std::vector<const void*> pLevels;
+	for (auto& level : levels)
+		pLevels.push_back(level.data());
+	return create(width, height, (unsigned)levels.size(), pLevels.data(), options, name);
+}
+
+bool C3dglTexture::create(unsigned width, unsigned height, unsigned levels, const void* const* pLevels, unsigned options, std::string name)
+{
+	destroy();
+	m_name = name;
+	m_options = options;
+	upload(GL_RGBA8, width, height, levels, pLevels, NULL, false);
+	return true;
+}
+
+bool C3dglTexture::create(const C3dglTextureFile& file, unsigned options)
+{
+	destroy();
+	m_name = file.getName();
+	m_options = options;
+
+	unsigned levels = (options & TEX_NO_MIPS) ? 1 : file.getLevelCount();
+	std::vector<const void*> pLevels(levels);
+	std::vector<size_t> sizes(levels);
+	for (unsigned level = 0; level < levels; level++)
+		pLevels[level] = file.getLevel(level, sizes[level]);
+
+	// DDS and KTX2 files are usually stored top-down, OpenGL textures - bottom-up.
+	// All levels are flipped or none, so that they all have the same orientation.
+	std::vector<std::vector<unsigned char>> flipped;
+	if (file.isTopDown())
+	{
+		bool bFlip = true;
+		for (unsigned level = 0; level < levels && bFlip; level++)
+			bFlip = canFlipBlocks(file.getFormat(), std::max(1u, file.getWidth() >> level), std::max(1u, file.getHeight() >> level), pLevels[level]);
+		if (bFlip)
+		{
+			flipped.resize(levels);
+			for (unsigned level = 0; level < levels; level++)
+			{
+				flipped[level].resize(sizes[level]);
+				flipBlocks(file.getFormat(), std::max(1u, file.getWidth() >> level), std::max(1u, file.getHeight() >> level), pLevels[level], flipped[level].data());
+				pLevels[level] = flipped[level].data();
+			}
+		}
+		else
+			log(M3DGL_WARNING_CANNOT_FLIP, file.getName());
+	}
+
+	upload(file.getFormat(), file.getWidth(), file.getHeight(), levels, pLevels.data(), sizes.data(), false);
+	return true;
+}
+
+void C3dglTexture::upload(GLenum format, unsigned width, unsigned height, unsigned levels, const void* const* pLevels, const size_t* pSizes, bool bGenerate)
+{
+	// preserve the currently bound texture
+	GLuint prevTex;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*)&prevTex);
+
+	glGenTextures(1, &m_id);
+	glBindTexture(GL_TEXTURE_2D, m_id);
+
+	// immutable storage where available
+	bool bStorage = GLEW_ARB_texture_storage;
+	if (bStorage)
+		glTexStorage2D(GL_TEXTURE_2D, levels, format, width, height);
+
+	for (unsigned level = 0; level < (bGenerate ? 1 : levels); level++)
+	{
+		GLsizei w = std::max(1u, width >> level), h = std::max(1u, height >> level);
+		if (format == GL_RGBA8 && bStorage)
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pLevels[level]);
+		else if (format == GL_RGBA8)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pLevels[level]);
+		else if (bStorage)
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, format, (GLsizei)pSizes[level], pLevels[level]);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, w, h, 0, (GLsizei)pSizes[level], pLevels[level]);
+	}
+	if (bGenerate)
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+	// trilinear and anisotropic sampling
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	GLint wrap = (m_options & TEX_CLAMP) ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+	if (GLEW_EXT_texture_filter_anisotropic && levels > 1 && c_anisotropy > 1)
+	{
+		float maxAnisotropy = 1;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(c_anisotropy, maxAnisotropy));
+	}
+
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+
+	m_format = format;
+	m_width = width;
+	m_height = height;
+	m_levels = levels;
+	C3dglMemoryTracker::getInstance().add(MEM_TEXTURE, m_id, getSize(), format, getName());
+}
+
+void C3dglTexture::destroy()
+{
+	if (m_id)
+	{
+		C3dglMemoryTracker::getInstance().remove(MEM_TEXTURE, m_id);
+		glDeleteTextures(1, &m_id);
+	}
+	m_id = 0;
+	m_width = m_height = m_levels = 0;
+}
+
+GLuint C3dglTexture::detach()
+{
+	GLuint id = m_id;
+	m_id = 0;
+	destroy();
+	return id;
+}
+
+void C3dglTexture::bind(GLenum texUnit) const
+{
+	glActiveTexture(texUnit);
+	glBindTexture(GL_TEXTURE_2D, m_id);
+}
+
+size_t C3dglTexture::getSize() const
+{
+	return C3dglMemoryTracker::getTextureSize(m_format, m_width, m_height, m_levels);
+}
+
+std::string C3dglTexture::getCacheFilename(std::string filename, unsigned options)
+{
+	std::error_code ec;
+	std::filesystem::path path = std::filesystem::weakly_canonical(std::filesystem::path(filename), ec);
+	std::string key = ec ? filename : path.string();
+	std::transform(key.begin(), key.end(), key.begin(), [](char c) { return (char)tolower(c); });
+	size_t hash = std::hash<std::string>()(std::format("{}|{:x}", key, options & c_cacheOptions));
+	return (std::filesystem::path(c_cacheDir) / std::format("{:016x}.mip", (uint64_t)hash)).string();
+}
+
+bool C3dglTexture::findCache(std::string filename, unsigned options, std::string& cacheFilename, unsigned& width, unsigned& height, size_t& offset)
+{
+	if (c_cacheDir.empty() || (options & (TEX_NO_MIPS | TEX_MIPS_GPU | TEX_NO_CACHE)))
+		return false;
+
+	MIPCACHE_HEADER header;
+	uint64_t size;
+	int64_t time;
+	cacheFilename = getCacheFilename(filename, options);
+	std::ifstream file(cacheFilename, std::ios::binary);
+	if (!file || !getSourceStamp(filename, size, time)
+		|| !file.read((char*)&header, sizeof(header))
+		|| memcmp(header.magic, "3DGLMIP", 8) != 0 || header.version != c_mipCacheVersion || header.options != (options & c_cacheOptions)
+		|| header.sourceSize != size || header.sourceTime != time
+		|| header.levels != getLevelCount(header.width, header.height))
+		return false;		// missing or out of date
+
+	width = header.width;
+	height = header.height;
+	offset = sizeof(header);
+	return true;
+}
+
+bool C3dglTexture::loadFromCache(std::string filename)
+{
+	std::string cacheFilename;
+	unsigned width, height;
+	size_t offset;
+	if (!findCache(filename, m_options, cacheFilename, width, height, offset))
+		return false;
+
+	std::ifstream file(cacheFilename, std::ios::binary);
+	file.seekg(offset);
+	unsigned levelCount = getLevelCount(width, height);
+	std::vector<std::vector<unsigned char>> levels(levelCount);
+	std::vector<const void*> pLevels;
+	for (unsigned level = 0; level < levelCount; level++)
+	{
+		levels[level].resize((size_t)std::max(1u, width >> level) * std::max(1u, height >> level) * 4);
+		if (!file.read((char*)levels[level].data(), levels[level].size()))
+			return false;
+		pLevels.push_back(levels[level].data());
+	}
+
+	create(width, height, levelCount, pLevels.data(), m_options, filename);
+	return log(M3DGL_SUCCESS_LOADED_FROM_CACHE, filename);
+}
+
+void C3dglTexture::saveToCache(std::string filename, const std::vector<std::vector<unsigned char>>& levels) const
+{
+	MIPCACHE_HEADER header = { "3DGLMIP", c_mipCacheVersion, m_options & c_cacheOptions, 0, 0, m_width, m_height, (uint32_t)levels.size() };
+	if (!getSourceStamp(filename, header.sourceSize, header.sourceTime))
+		return;		// not a file - e.g. an asset pack entry
+
+	std::error_code ec;
+	std::filesystem::create_directories(c_cacheDir, ec);
+	std::string cacheFilename = getCacheFilename(filename, m_options);
+	std::ofstream file(cacheFilename, std::ios::binary);
+	file.write((char*)&header, sizeof(header));
+	for (auto& level : levels)
+		file.write((char*)level.data(), level.size());
+	if (!file)
+		log(M3DGL_WARNING_CANNOT_CACHE, cacheFilename);
+}
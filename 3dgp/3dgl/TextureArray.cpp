@@ -0,0 +1,290 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/TextureArray.h>
+#include <3dgl/Texture.h>
+#include <3dgl/Model.h>
+#include <3dgl/MemoryTracker.h>
+
+using namespace _3dgl;
+
+namespace
+{
+	// Source texture, as found on the GPU
+	struct SOURCE
+	{
+		GLuint id;
+		unsigned width, height, levels;
+		GLenum format;
+		bool bCompressed;
+		GLint layer = -1;
+		unsigned x = 0, y = 0;
+	};
+
+	bool isPowerOfTwo(unsigned n)
+	{
+		return n && (n & (n - 1)) == 0;
+	}
+
+	unsigned floorLog2(unsigned n)
+	{
+		unsigned l = 0;
+		while (n >>= 1) l++;
+		return l;
+	}
+}
+
+C3dglTextureArray::C3dglTextureArray() : C3dglObject()
+{
+	m_id = 0;
+	m_format = GL_RGBA8;
+	m_width = m_height = m_layers = m_levels = 0;
+}
+
+bool C3dglTextureArray::create(size_t count, const GLuint* pIds, unsigned width, unsigned height)
+{
+	destroy();
+
+	// preserve the currently bound textures
+	GLuint prevTex, prevArray;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*)&prevTex);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, (GLint*)&prevArray);
+
+	// query the source textures
+	std::vector<SOURCE> sources;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!glIsTexture(pIds[i]) || std::find_if(sources.begin(), sources.end(), [&](const SOURCE& s) { return s.id == pIds[i]; }) != sources.end())
+			continue;
+		SOURCE source;
+		GLint w = 0, h = 0, format = 0, compressed = GL_FALSE, maxLevel = 0;
+		source.id = pIds[i];
+		glBindTexture(GL_TEXTURE_2D, source.id);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+		if (w <= 0 || h <= 0)
+			continue;
+		source.width = w;
+		source.height = h;
+		source.format = format;
+		source.bCompressed = compressed == GL_TRUE;
+
+		// levels actually defined (the max level of a texture without mip-maps is 1000 by default)
+		source.levels = 1;
+		for (GLint level = 1; level <= maxLevel && (w > 1 || h > 1); level++, source.levels++)
+		{
+			GLint lw = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &lw);
+			if (lw == 0) break;
+			w = std::max(1, w / 2); h = std::max(1, h / 2);
+		}
+		sources.push_back(source);
+	}
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+	if (sources.empty())
+		return false;
+
+	// layer size and format: the ones shared by the most textures
+	std::map<std::tuple<unsigned, unsigned, GLenum>, size_t> histogram;
+	for (SOURCE& source : sources)
+		if ((width == 0 || source.width == width) && (height == 0 || source.height == height))
+			histogram[{ source.width, source.height, source.format }]++;
+	if (histogram.empty())
+		for (SOURCE& source : sources)
+			histogram[{ width ? width : source.width, height ? height : source.height, source.format }]++;
+	auto mode = std::max_element(histogram.begin(), histogram.end(), [](auto& a, auto& b) { return a.second < b.second; })->first;
+	m_width = std::get<0>(mode);
+	m_height = std::get<1>(mode);
+	m_format = std::get<2>(mode);
+	bool bCompressed = std::find_if(sources.begin(), sources.end(), [&](const SOURCE& s) { return s.format == m_format; })->bCompressed;
+
+	// mip levels: the longest chain of the full size textures
+	m_levels = 1;
+	for (SOURCE& source : sources)
+		if (source.width == m_width && source.height == m_height && source.format == m_format)
+			m_levels = std::max(m_levels, source.levels);
+	m_levels = std::min(m_levels, C3dglTexture::getLevelCount(m_width, m_height));
+
+	// full size textures take a layer each; their chains must be complete
+	std::vector<SOURCE*> atlas;
+	for (SOURCE& source : sources)
+		if (source.format != m_format || source.width > m_width || source.height > m_height)
+			log(M3DGL_WARNING_TEXARRAY_MISMATCH, source.id, source.width, source.height, source.format);
+		else if (source.width == m_width && source.height == m_height)
+		{
+			if (source.levels < m_levels)
+				log(M3DGL_WARNING_TEXARRAY_MISMATCH, source.id, source.width, source.height, source.format);
+			else
+				source.layer = m_layers++;
+		}
+		else if (bCompressed || !isPowerOfTwo(source.width) || !isPowerOfTwo(source.height)
+			|| !isPowerOfTwo(m_width) || !isPowerOfTwo(m_height)
+			|| source.levels < std::min(m_levels, floorLog2(std::min(source.width, source.height)) + 1))
+			log(M3DGL_WARNING_TEXARRAY_MISMATCH, source.id, source.width, source.height, source.format);
+		else
+			atlas.push_back(&source);
+
+	// smaller textures packed into shelves; power-of-two sizes in descending order keep each region
+	// aligned to its own size, so that mip level L of the region is exactly the region >> L
+	std::sort(atlas.begin(), atlas.end(), [](SOURCE* a, SOURCE* b) { return a->height != b->height ? a->height > b->height : a->width > b->width; });
+	unsigned x = 0, y = 0, shelf = 0;
+	GLint layer = -1;
+	for (SOURCE* pSource : atlas)
+	{
+		x = (x + pSource->width - 1) / pSource->width * pSource->width;
+		if (layer < 0 || x + pSource->width > m_width)
+		{
+			x = 0;
+			y += shelf;
+			shelf = pSource->height;
+			if (layer < 0 || y + pSource->height > m_height)
+			{
+				layer = m_layers++;
+				y = 0;
+			}
+		}
+		pSource->layer = layer;
+		pSource->x = x;
+		pSource->y = y;
+		x += pSource->width;
+	}
+
+	if (m_layers == 0)
+	{
+		m_width = m_height = m_levels = 0;
+		return false;
+	}
+
+	// allocate the storage
+	glGenTextures(1, &m_id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_id);
+	if (GLEW_ARB_texture_storage)
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, m_levels, m_format, m_width, m_height, m_layers);
+	else
+		for (unsigned level = 0; level < m_levels; level++)
+		{
+			GLsizei w = std::max(1u, m_width >> level), h = std::max(1u, m_height >> level);
+			if (bCompressed)
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, m_format, w, h, m_layers, 0, (GLsizei)C3dglMemoryTracker::getTextureSize(m_format, w, h, 1, m_layers), NULL);
+			else
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, m_format, w, h, m_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+	C3dglMemoryTracker::getInstance().add(MEM_TEXTURE_ARRAY, m_id, C3dglMemoryTracker::getTextureSize(m_format, m_width, m_height, m_levels, m_layers), m_format, getName());
+
+	// copy the textures; atlas regions need no levels smaller than the region (see the LOD clamp in the shader)
+	size_t nAtlas = 0;
+	for (SOURCE& source : sources)
+		if (source.layer >= 0)
+		{
+			unsigned levels = std::min(m_levels, source.levels);
+			if (source.width != m_width || source.height != m_height)
+			{
+				levels = std::min(levels, floorLog2(std::min(source.width, source.height)) + 1);
+				nAtlas++;
+			}
+			copy(source.id, source.layer, source.x, source.y, source.width, source.height, levels, bCompressed);
+
+			TEXARRAY_REGION region;
+			region.layer = source.layer;
+			region.transform = glm::vec4((float)source.width / m_width, (float)source.height / m_height, (float)source.x / m_width, (float)source.y / m_height);
+			m_regions[source.id] = region;
+		}
+
+	// trilinear and anisotropic sampling, same as C3dglTexture
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, m_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	if (GLEW_EXT_texture_filter_anisotropic && m_levels > 1 && C3dglTexture::getAnisotropy() > 1)
+	{
+		float maxAnisotropy = 1;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(C3dglTexture::getAnisotropy(), maxAnisotropy));
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, prevArray);
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+
+	log(M3DGL_SUCCESS_TEXARRAY_CREATED, m_layers, m_width, m_height, m_regions.size(), nAtlas);
+	return true;
+}
+
+bool C3dglTextureArray::create(std::vector<C3dglModel*> models, unsigned width, unsigned height)
+{
+	std::vector<GLuint> ids;
+	for (C3dglModel* pModel : models)
+		for (size_t i = 0; i < pModel->getMaterialCount(); i++)
+		{
+			unsigned idTex;
+			if (pModel->getMaterial(i)->getTexture(GL_TEXTURE0, idTex))
+				ids.push_back(idTex);
+		}
+	if (!create(ids.size(), ids.data(), width, height))
+		return false;
+	for (C3dglModel* pModel : models)
+		pModel->setTextureArray(this);
+	return true;
+}
+
+void C3dglTextureArray::copy(GLuint idSrc, GLint layer, unsigned x, unsigned y, unsigned width, unsigned height, unsigned levels, bool bCompressed)
+{
+	std::vector<unsigned char> buf;
+	for (unsigned level = 0; level < levels; level++)
+	{
+		GLsizei w = std::max(1u, width >> level), h = std::max(1u, height >> level);
+		if (GLEW_ARB_copy_image)
+		{
+			// GPU to GPU, no round trip through the client memory
+			glCopyImageSubData(idSrc, GL_TEXTURE_2D, level, 0, 0, 0, m_id, GL_TEXTURE_2D_ARRAY, level, x >> level, y >> level, layer, w, h, 1);
+			continue;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, idSrc);
+		if (bCompressed)
+		{
+			buf.resize(C3dglMemoryTracker::getTextureSize(m_format, w, h));
+			glGetCompressedTexImage(GL_TEXTURE_2D, level, buf.data());
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x >> level, y >> level, layer, w, h, 1, m_format, (GLsizei)buf.size(), buf.data());
+		}
+		else
+		{
+			buf.resize((size_t)w * h * 4);
+			glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, buf.data());
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x >> level, y >> level, layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, buf.data());
+		}
+	}
+}
+
+void C3dglTextureArray::destroy()
+{
+	if (m_id)
+	{
+		C3dglMemoryTracker::getInstance().remove(MEM_TEXTURE_ARRAY, m_id);
+		glDeleteTextures(1, &m_id);
+	}
+	m_id = 0;
+	m_width = m_height = m_layers = m_levels = 0;
+	m_regions.clear();
+}
+
+bool C3dglTextureArray::getRegion(GLuint idTex, TEXARRAY_REGION& region) const
+{
+	auto it = m_regions.find(idTex);
+	if (it == m_regions.end())
+		return false;
+	region = it->second;
+	return true;
+}
+
+void C3dglTextureArray::bind(GLenum texUnit) const
+{
+	glActiveTexture(texUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_id);
+}
@@ -0,0 +1,352 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <3dgl/TextureFile.h>
+#include "MappedFile.h"
+
+using namespace _3dgl;
+
+namespace
+{
+	// DDS file structures, as defined by DirectX
+	struct DDS_PIXELFORMAT
+	{
+		uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+	};
+
+	struct DDS_HEADER
+	{
+		uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount, reserved1[11];
+		DDS_PIXELFORMAT ddspf;
+		uint32_t caps, caps2, caps3, caps4, reserved2;
+	};
+
+	struct DDS_HEADER_DXT10
+	{
+		uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+	};
+
+	constexpr uint32_t fourCC(const char s[5])	{ return s[0] | (s[1] << 8) | (s[2] << 16) | (s[3] << 24); }
+
+	const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+	const uint32_t DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_VOLUME = 0x200000;
+	const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+	// DXGI and Vulkan format codes of the supported formats
+	struct FORMAT
+	{
+		GLenum glFormat;
+		uint32_t dxgiFormat;
+		uint32_t vkFormat;
+	};
+	const FORMAT c_formats[] =
+	{
+		{ GL_COMPRESSED_RGB_S3TC_DXT1_EXT,				0,	131 },
+		{ GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,				0,	132 },
+		{ GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,				71,	133 },
+		{ GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,		72,	134 },
+		{ GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,				77,	137 },
+		{ GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,		78,	138 },
+		{ GL_COMPRESSED_RED_RGTC1,						80,	139 },
+		{ GL_COMPRESSED_RG_RGTC2,						83,	141 },
+		{ GL_COMPRESSED_RGBA_BPTC_UNORM,				98,	145 },
+		{ GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,			99,	146 },
+	};
+
+	size_t getGLBlockSize(GLenum glFormat)
+	{
+		switch (glFormat)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1:
+			return 8;
+		default:
+			return 16;
+		}
+	}
+
+	const unsigned char c_ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// KTX2 file structures, as defined by Khronos
+	struct KTX2_HEADER
+	{
+		unsigned char identifier[12];
+		uint32_t vkFormat, typeSize, pixelWidth, pixelHeight, pixelDepth, layerCount, faceCount, levelCount, supercompressionScheme;
+		uint32_t dfdByteOffset, dfdByteLength, kvdByteOffset, kvdByteLength;
+		uint64_t sgdByteOffset, sgdByteLength;
+	};
+
+	struct KTX2_LEVEL
+	{
+		uint64_t byteOffset, byteLength, uncompressedByteLength;
+	};
+}
+
+/*********************************************************************************
+** class C3dglTextureFile
+*/
+
+C3dglTextureFile::C3dglTextureFile() : C3dglObject()
+{
+	m_pFile = NULL;
+	m_format = 0;
+	m_width = m_height = 0;
+	m_bTopDown = true;
+}
+
+bool C3dglTextureFile::open(std::string filename)
+{
+	close();
+	m_filename = filename;
+	m_pFile = new C3dglMappedFile();
+	if (!m_pFile->open(filename.c_str()))
+	{
+		close();
+		return log(M3DGL_ERROR_CANNOT_OPEN_FILE, filename);
+	}
+
+	bool bResult = false;
+	if (m_pFile->size() >= 4 && memcmp(m_pFile->data(), "DDS ", 4) == 0)
+		bResult = openDDS();
+	else if (m_pFile->size() >= sizeof(c_ktx2Identifier) && memcmp(m_pFile->data(), c_ktx2Identifier, sizeof(c_ktx2Identifier)) == 0)
+		bResult = openKTX2();
+	else
+		log(M3DGL_ERROR_TEXTURE_FILE, "neither DDS nor KTX2 file");
+
+	if (!bResult)
+		close();
+	return bResult;
+}
+
+bool C3dglTextureFile::openDDS()
+{
+	const char* p = m_pFile->data() + 4;
+	const char* pEnd = m_pFile->end();
+	if (p + sizeof(DDS_HEADER) > pEnd)
+		return log(M3DGL_ERROR_TEXTURE_FILE, "file too short");
+	const DDS_HEADER* pHeader = (const DDS_HEADER*)p;
+	p += sizeof(DDS_HEADER);
+	if (pHeader->size != sizeof(DDS_HEADER) || !(pHeader->ddspf.flags & DDPF_FOURCC))
+		return log(M3DGL_ERROR_TEXTURE_FILE, "not a block-compressed image");
+	if (pHeader->caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME))
+		return log(M3DGL_ERROR_TEXTURE_FILE, "only 2D textures are supported");
+
+	switch (pHeader->ddspf.fourCC)
+	{
+	case fourCC("DXT1"): m_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+	case fourCC("DXT5"): m_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+	case fourCC("ATI1"):
+	case fourCC("BC4U"): m_format = GL_COMPRESSED_RED_RGTC1; break;
+	case fourCC("ATI2"):
+	case fourCC("BC5U"): m_format = GL_COMPRESSED_RG_RGTC2; break;
+	case fourCC("DX10"):
+	{
+		if (p + sizeof(DDS_HEADER_DXT10) > pEnd)
+			return log(M3DGL_ERROR_TEXTURE_FILE, "file too short");
+		const DDS_HEADER_DXT10* pHeader10 = (const DDS_HEADER_DXT10*)p;
+		p += sizeof(DDS_HEADER_DXT10);
+		if (pHeader10->resourceDimension != DDS_DIMENSION_TEXTURE2D || pHeader10->arraySize > 1)
+			return log(M3DGL_ERROR_TEXTURE_FILE, "only 2D textures are supported");
+		auto it = std::find_if(std::begin(c_formats), std::end(c_formats), [pHeader10](const FORMAT& f) { return f.dxgiFormat && f.dxgiFormat == pHeader10->dxgiFormat; });
+		if (it == std::end(c_formats))
+			return log(M3DGL_ERROR_TEXTURE_FILE, std::format("unsupported DXGI format {}", pHeader10->dxgiFormat));
+		m_format = it->glFormat;
+		break;
+	}
+	default:
+		return log(M3DGL_ERROR_TEXTURE_FILE, "unsupported format");
+	}
+
+	// mip levels follow the headers, without padding
+	m_width = pHeader->width;
+	m_height = pHeader->height;
+	unsigned nLevels = std::max(1u, (pHeader->flags & DDSD_MIPMAPCOUNT) ? pHeader->mipMapCount : 1u);
+	for (unsigned level = 0; level < nLevels; level++)
+	{
+		unsigned w = std::max(1u, m_width >> level), h = std::max(1u, m_height >> level);
+		size_t size = (size_t)((w + 3) / 4) * ((h + 3) / 4) * getGLBlockSize(m_format);
+		if (p + size > pEnd)
+			return log(M3DGL_ERROR_TEXTURE_FILE, "file too short");
+		m_levels.push_back(p);
+		m_levelSizes.push_back(size);
+		p += size;
+	}
+	m_bTopDown = true;
+	return true;
+}
+
+bool C3dglTextureFile::openKTX2()
+{
+	const char* pData = m_pFile->data();
+	size_t fileSize = m_pFile->size();
+	if (fileSize < sizeof(KTX2_HEADER))
+		return log(M3DGL_ERROR_TEXTURE_FILE, "file too short");
+	const KTX2_HEADER* pHeader = (const KTX2_HEADER*)pData;
+	if (pHeader->pixelDepth > 0 || pHeader->layerCount > 0 || pHeader->faceCount != 1)
+		return log(M3DGL_ERROR_TEXTURE_FILE, "only 2D textures are supported");
+	if (pHeader->supercompressionScheme != 0)
+		return log(M3DGL_ERROR_TEXTURE_FILE, "supercompressed files are not supported");
+
+	auto it = std::find_if(std::begin(c_formats), std::end(c_formats), [pHeader](const FORMAT& f) { return f.vkFormat == pHeader->vkFormat; });
+	if (it == std::end(c_formats))
+		return log(M3DGL_ERROR_TEXTURE_FILE, std::format("unsupported Vulkan format {}", pHeader->vkFormat));
+	m_format = it->glFormat;
+	m_width = pHeader->pixelWidth;
+	m_height = std::max(1u, pHeader->pixelHeight);
+
+	// level index follows the header
+	unsigned nLevels = std::max(1u, pHeader->levelCount);
+	if (sizeof(KTX2_HEADER) + nLevels * sizeof(KTX2_LEVEL) > fileSize)
+		return log(M3DGL_ERROR_TEXTURE_FILE, "file too short");
+	const KTX2_LEVEL* pLevels = (const KTX2_LEVEL*)(pData + sizeof(KTX2_HEADER));
+	for (unsigned level = 0; level < nLevels; level++)
+	{
+		unsigned w = std::max(1u, m_width >> level), h = std::max(1u, m_height >> level);
+		size_t size = (size_t)((w + 3) / 4) * ((h + 3) / 4) * getGLBlockSize(m_format);
+		if (pLevels[level].byteLength < size || pLevels[level].byteOffset + pLevels[level].byteLength > fileSize)
+			return log(M3DGL_ERROR_TEXTURE_FILE, "invalid level index");
+		m_levels.push_back(pData + pLevels[level].byteOffset);
+		m_levelSizes.push_back(size);
+	}
+
+	// orientation: "rd" (top-down, the default) or "ru" (bottom-up)
+	m_bTopDown = true;
+	if ((uint64_t)pHeader->kvdByteOffset + pHeader->kvdByteLength <= fileSize)
+	{
+		const char* p = pData + pHeader->kvdByteOffset;
+		const char* pEnd = p + pHeader->kvdByteLength;
+		while (p + 4 <= pEnd)
+		{
+			uint32_t length;
+			memcpy(&length, p, 4);
+			const char* pKey = p + 4;
+			if (pKey + length > pEnd)
+				break;
+			std::string_view kv(pKey, length);
+			if (kv.starts_with("KTXorientation") && kv.size() > 16)
+				m_bTopDown = kv[15] != 'r' || kv[16] != 'u';
+			p = pKey + ((length + 3) & ~3);
+		}
+	}
+	return true;
+}
+
+void C3dglTextureFile::close()
+{
+	if (m_pFile)
+		delete m_pFile;
+	m_pFile = NULL;
+	m_format = 0;
+	m_width = m_height = 0;
+	m_levels.clear();
+	m_levelSizes.clear();
+}
+
+bool C3dglTextureFile::isSupported() const
+{
+	switch (m_format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return GLEW_EXT_texture_compression_s3tc;
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+	case GL_COMPRESSED_RED_RGTC1:
+	case GL_COMPRESSED_RG_RGTC2:
+		return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+		return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+	default:
+		return false;
+	}
+}
+
+std::string C3dglTextureFile::findCompressed(std::string filename)
+{
+	std::filesystem::path path(filename);
+	std::string ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower(c); });
+	if (ext == ".dds" || ext == ".ktx2")
+		return filename;
+
+	std::error_code ec;
+	for (const char* pExt : { ".ktx2", ".dds" })
+		if (std::filesystem::exists(path.replace_extension(pExt), ec))
+			return path.string();
+	return "";
+}
+
+bool C3dglTextureFile::saveDDS(std::string filename, BC_FORMAT format, unsigned width, unsigned height, const std::vector<std::vector<unsigned char>>& levels)
+{
+	std::string name = "Texture File \"" + filename + "\"";
+
+	// the levels are flipped back when loaded - this is only possible for the heights up to 4 and the multiples of 4.
+	// The chain ends before the first level which could not be flipped, so that all levels have the same orientation.
+	if (height > 4 && height % 4 != 0)
+		return C3dglLogger::log(M3DGL_ERROR_DDS_HEIGHT, name, filename, height);
+	unsigned nLevels = 0;
+	while (nLevels < levels.size() && (std::max(1u, height >> nLevels) <= 4 || (height >> nLevels) % 4 == 0))
+		nLevels++;
+
+	DDS_HEADER header = { };
+	header.size = sizeof(DDS_HEADER);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.width = width;
+	header.height = height;
+	header.pitchOrLinearSize = (uint32_t)getCompressedSize(format, width, height);
+	header.mipMapCount = nLevels;
+	header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+	header.ddspf.flags = DDPF_FOURCC;
+	header.caps = DDSCAPS_TEXTURE | (nLevels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	// BC1, BC3 and BC5 have their legacy codes; BC7 requires the DX10 extended header
+	DDS_HEADER_DXT10 header10 = { 98, DDS_DIMENSION_TEXTURE2D, 0, 1, 0 };
+	switch (format)
+	{
+	case BC1: header.ddspf.fourCC = fourCC("DXT1"); break;
+	case BC3: header.ddspf.fourCC = fourCC("DXT5"); break;
+	case BC5: header.ddspf.fourCC = fourCC("ATI2"); break;
+	case BC7: header.ddspf.fourCC = fourCC("DX10"); break;
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write("DDS ", 4);
+	file.write((const char*)&header, sizeof(header));
+	if (format == BC7)
+		file.write((const char*)&header10, sizeof(header10));
+
+	std::vector<unsigned char> flipped, blocks;
+	for (unsigned level = 0; level < nLevels; level++)
+	{
+		// DDS rows are stored top-down
+		unsigned w = std::max(1u, width >> level), h = std::max(1u, height >> level);
+		size_t rowSize = (size_t)w * 4;
+		flipped.resize(rowSize * h);
+		for (unsigned y = 0; y < h; y++)
+			memcpy(flipped.data() + y * rowSize, levels[level].data() + (h - 1 - y) * rowSize, rowSize);
+
+		blocks.resize(getCompressedSize(format, w, h));
+		compressBlocks(format, w, h, flipped.data(), blocks.data());
+		file.write((const char*)blocks.data(), blocks.size());
+	}
+
+	if (!file)
+		return C3dglLogger::log(M3DGL_ERROR_CANNOT_WRITE_FILE, name, filename);
+	return C3dglLogger::log(M3DGL_SUCCESS_SAVED, name, filename);
+}
@@ -0,0 +1,598 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <3dgl/TextureStreamer.h>
+#include <3dgl/TextureFile.h>
+#include <3dgl/Bitmap.h>
+#include <3dgl/AssetPack.h>
+#include <3dgl/Model.h>
+#include <3dgl/MemoryTracker.h>
+
+using namespace _3dgl;
+
+// Where the levels of a streamed texture come from. Shared with the I/O thread; the decoded image
+// (IMAGE sources) and the flip decision (COMPRESSED sources) are written by the I/O thread only,
+// before the first request for the texture completes.
+struct C3dglTextureStreamer::SOURCE
+{
+	enum { PACK, COMPRESSED, CACHE, IMAGE } type;
+	std::string filename;			// the image, or its mip cache file
+	unsigned options;
+	GLenum format = GL_RGBA8;
+	unsigned width = 0, height = 0, levels = 0;
+	unsigned tailSize;
+
+	ASSETPACK_TEXTURE pack;			// PACK: levels in the mapped asset pack
+	C3dglTextureFile file;			// COMPRESSED: levels in the mapped DDS or KTX2 file
+	bool bFlipChecked = false;		// COMPRESSED: bFlip decided for all levels, so that they all have the same orientation
+	bool bFlip = false;
+	size_t offset = 0;				// CACHE: position of level 0 in the cache file
+	std::vector<std::vector<unsigned char>> chain;	// IMAGE: the decoded mip chain
+};
+
+namespace
+{
+	// the finest level no larger than tailSize
+	unsigned getTail(unsigned width, unsigned height, unsigned levels, unsigned tailSize)
+	{
+		unsigned level = 0;
+		while (level + 1 < levels && std::max(width >> level, height >> level) > tailSize)
+			level++;
+		return level;
+	}
+
+	double getTime()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+C3dglTextureStreamer& C3dglTextureStreamer::getInstance()
+{
+	static C3dglTextureStreamer inst;
+	return inst;
+}
+
+void C3dglTextureStreamer::start(size_t budget)
+{
+	m_budget = budget;
+	if (m_bRunning)
+		return;
+	m_bQuit = false;
+	m_bRunning = true;
+	m_lastUpdate = getTime();
+	m_thread = std::thread(&C3dglTextureStreamer::run, this);
+}
+
+void C3dglTextureStreamer::stop()
+{
+	if (!m_bRunning)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bQuit = true;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+	m_bRunning = false;
+
+	// requests not completed are dropped; the textures keep the levels they have
+	m_queue.clear();
+	m_done.clear();
+	for (auto& [id, texture] : m_textures)
+		texture.bPending = false;
+	m_nPending = 0;
+	m_pendingBytes = 0;
+	m_aabbs.clear();
+}
+
+void C3dglTextureStreamer::run()
+{
+	for (;;)
+	{
+		std::shared_ptr<REQUEST> pRequest;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this] { return m_bQuit || !m_queue.empty(); });
+			if (m_bQuit)
+				return;
+
+			// the largest on-screen texture first
+			auto it = std::max_element(m_queue.begin(), m_queue.end(), [](auto& a, auto& b) { return a->priority < b->priority; });
+			pRequest = *it;
+			m_queue.erase(it);
+		}
+
+		read(*pRequest);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_done.push_back(pRequest);
+	}
+}
+
+void C3dglTextureStreamer::read(REQUEST& request)
+{
+	SOURCE& source = *request.pSource;
+	request.bOK = false;
+
+	// the image is decoded and its mip chain generated with the first request; the tail is then returned
+	if (source.type == SOURCE::IMAGE && source.chain.empty())
+	{
+		C3dglBitmap bm;
+		if (!bm.load(source.filename, GL_RGBA) || !bm.getBits())
+			return;
+		source.width = (unsigned)bm.getWidth();
+		source.height = (unsigned)abs(bm.getHeight());
+		C3dglTexture::generateMipChain(source.width, source.height, bm.getBits(), source.chain, source.options);
+		source.levels = (unsigned)source.chain.size();
+		request.first = getTail(source.width, source.height, source.levels, source.tailSize);
+		request.last = source.levels - 1;
+	}
+
+	// top-down files are flipped if all of their levels can be, otherwise none is
+	if (source.type == SOURCE::COMPRESSED && !source.bFlipChecked)
+	{
+		source.bFlip = source.file.isTopDown();
+		for (unsigned level = 0; level < source.levels && source.bFlip; level++)
+		{
+			size_t size;
+			source.bFlip = canFlipBlocks(source.format, std::max(1u, source.width >> level), std::max(1u, source.height >> level), source.file.getLevel(level, size));
+		}
+		if (source.file.isTopDown() && !source.bFlip)
+			C3dglLogger::log(M3DGL_WARNING_CANNOT_FLIP, "Texture Streamer", source.file.getName());
+		source.bFlipChecked = true;
+	}
+
+	std::ifstream file;
+	if (source.type == SOURCE::CACHE)
+	{
+		file.open(source.filename, std::ios::binary);
+		size_t offset = source.offset;
+		for (unsigned level = 0; level < request.first; level++)
+			offset += (size_t)std::max(1u, source.width >> level) * std::max(1u, source.height >> level) * 4;
+		file.seekg(offset);
+	}
+
+	request.data.resize(request.last - request.first + 1);
+	for (unsigned level = request.first; level <= request.last; level++)
+	{
+		std::vector<unsigned char>& data = request.data[level - request.first];
+		unsigned w = std::max(1u, source.width >> level), h = std::max(1u, source.height >> level);
+		switch (source.type)
+		{
+		case SOURCE::PACK:
+			data.assign((const unsigned char*)source.pack.pLevels[level], (const unsigned char*)source.pack.pLevels[level] + source.pack.levelSizes[level]);
+			break;
+		case SOURCE::COMPRESSED:
+		{
+			// reading from the mapping here brings the pages in on this thread rather than during the upload
+			size_t size;
+			const unsigned char* p = (const unsigned char*)source.file.getLevel(level, size);
+			data.resize(size);
+			if (source.bFlip)
+				flipBlocks(source.format, w, h, p, data.data());
+			else
+				memcpy(data.data(), p, size);
+			break;
+		}
+		case SOURCE::CACHE:
+			data.resize((size_t)w * h * 4);
+			if (!file.read((char*)data.data(), data.size()))
+				return;
+			break;
+		case SOURCE::IMAGE:
+			data = source.chain[level];
+			break;
+		}
+	}
+	request.bOK = true;
+}
+
+size_t C3dglTextureStreamer::getLevelSize(const SOURCE& source, unsigned level) const
+{
+	return C3dglMemoryTracker::getTextureSize(source.format, std::max(1u, source.width >> level), std::max(1u, source.height >> level));
+}
+
+void C3dglTextureStreamer::track(GLuint id, const TEXTURE& texture) const
+{
+	size_t bytes = 0;
+	if (texture.bReady)
+		for (unsigned level = texture.base; level < texture.levels; level++)
+			bytes += getLevelSize(*texture.pSource, level);
+	C3dglMemoryTracker::getInstance().add(MEM_STREAMED_TEXTURE, id, bytes, texture.pSource->format, "Streamed " + texture.filename);
+}
+
+GLuint C3dglTextureStreamer::load(std::string filename, unsigned options)
+{
+	if (options & (TEX_NO_MIPS | TEX_MIPS_GPU))
+		return 0;
+
+	// find the source: as in C3dglTexture::load, but nothing is read beyond the headers
+	std::shared_ptr<SOURCE> pSource = std::make_shared<SOURCE>();
+	SOURCE& source = *pSource;
+	source.filename = filename;
+	source.options = options;
+	source.tailSize = m_tailSize;
+	C3dglAssetPack* pPack = C3dglAssetPack::findMounted(filename, ASSET_TEXTURE);
+	std::string compressed = (options & TEX_UNCOMPRESSED) ? "" : C3dglTextureFile::findCompressed(filename);
+	std::string cacheFilename;
+	if (pPack && pPack->getTexture(filename, source.pack))
+	{
+		source.type = SOURCE::PACK;
+		source.width = source.pack.width;
+		source.height = source.pack.height;
+		source.levels = source.pack.levels;
+	}
+	else if (!compressed.empty() && source.file.open(compressed) && source.file.isSupported())
+	{
+		source.type = SOURCE::COMPRESSED;
+		source.format = source.file.getFormat();
+		source.width = source.file.getWidth();
+		source.height = source.file.getHeight();
+		source.levels = source.file.getLevelCount();
+	}
+	else if (C3dglTexture::findCache(filename, options, cacheFilename, source.width, source.height, source.offset))
+	{
+		source.type = SOURCE::CACHE;
+		source.filename = cacheFilename;
+		source.levels = C3dglTexture::getLevelCount(source.width, source.height);
+	}
+	else if (std::filesystem::exists(filename))
+		source.type = SOURCE::IMAGE;		// decoded on the I/O thread
+	else
+		return 0;
+	if (source.type != SOURCE::COMPRESSED)
+		source.file.close();		// opened, but the format is not supported
+
+	// preserve the currently bound texture
+	GLuint prevTex;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*)&prevTex);
+
+	// mutable storage: levels may be defined and deleted one by one
+	GLuint id;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	GLint wrap = (options & TEX_CLAMP) ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+	if (GLEW_EXT_texture_filter_anisotropic && C3dglTexture::getAnisotropy() > 1)
+	{
+		float maxAnisotropy = 1;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(C3dglTexture::getAnisotropy(), maxAnisotropy));
+	}
+
+	TEXTURE& texture = m_textures[id];
+	texture.pSource = pSource;
+	texture.filename = filename;
+	texture.width = source.width;
+	texture.height = source.height;
+	texture.levels = source.levels;
+	texture.priority = 0;
+	texture.lastUsed = m_frame;
+	texture.minLod = 0;
+	texture.bPending = false;
+	texture.generation = ++m_generation;
+
+	if (source.type == SOURCE::IMAGE)
+	{
+		// until decoded, a grey placeholder
+		unsigned char grey[] = { 128, 128, 128, 255 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		texture.base = texture.tail = texture.wanted = 0;
+		texture.bReady = false;
+
+		std::shared_ptr<REQUEST> pRequest = std::make_shared<REQUEST>();
+		*pRequest = { id, texture.generation, pSource, 0, 0, FLT_MAX, 0, false, { } };
+		texture.bPending = true;
+		m_nPending++;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_queue.push_back(pRequest);
+		}
+		m_cv.notify_one();
+	}
+	else
+	{
+		// the tail is read at once - it is small
+		texture.base = texture.tail = texture.wanted = getTail(source.width, source.height, source.levels, m_tailSize);
+		texture.bReady = true;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, source.levels - 1);
+
+		REQUEST request = { id, texture.generation, pSource, texture.tail, source.levels - 1, 0, 0, false, { } };
+		read(request);
+		if (request.bOK)
+			upload(id, texture, request.first, request.last, request.data);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+
+	if (m_residentBytes > m_budget && !m_bOverBudget)
+	{
+		m_bOverBudget = true;
+		log(M3DGL_WARNING_STREAMING_BUDGET, m_budget, m_residentBytes);
+	}
+	log(M3DGL_SUCCESS_STREAMED, filename, texture.levels - texture.base, texture.levels);
+	return id;
+}
+
+bool C3dglTextureStreamer::release(GLuint idTex)
+{
+	auto it = m_textures.find(idTex);
+	if (it == m_textures.end())
+		return false;
+
+	// the requests waiting are cancelled; the one being read is dropped when it completes - the id may be reused by then,
+	// so it is told by the generation
+	TEXTURE& texture = it->second;
+	if (texture.bPending)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto cancelled = std::remove_if(m_queue.begin(), m_queue.end(), [&](auto& pRequest) { return pRequest->id == idTex && pRequest->generation == texture.generation; });
+		for (auto p = cancelled; p != m_queue.end(); p++)
+		{
+			m_nPending--;
+			m_pendingBytes -= (*p)->bytes;
+		}
+		m_queue.erase(cancelled, m_queue.end());
+	}
+	if (texture.bReady)
+		for (unsigned level = texture.base; level < texture.levels; level++)
+			m_residentBytes -= getLevelSize(*texture.pSource, level);
+	C3dglMemoryTracker::getInstance().remove(MEM_STREAMED_TEXTURE, idTex);
+	glDeleteTextures(1, &idTex);
+	m_textures.erase(it);
+	m_aabbs.clear();		// the models may be going too - their addresses may be reused
+	return true;
+}
+
+void C3dglTextureStreamer::upload(GLuint id, TEXTURE& texture, unsigned first, unsigned last, const std::vector<std::vector<unsigned char>>& data)
+{
+	const SOURCE& source = *texture.pSource;
+	glBindTexture(GL_TEXTURE_2D, id);
+	for (unsigned level = first; level <= last; level++)
+	{
+		GLsizei w = std::max(1u, source.width >> level), h = std::max(1u, source.height >> level);
+		const std::vector<unsigned char>& level_data = data[level - first];
+		if (source.format == GL_RGBA8)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, level_data.data());
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, source.format, w, h, 0, (GLsizei)level_data.size(), level_data.data());
+		m_residentBytes += getLevelSize(source, level);
+		m_nUploaded++;
+	}
+
+	// the new levels are faded in: the LOD clamp keeps the previous level at first
+	if (texture.bReady && first < texture.base)
+		texture.minLod = m_fadeSpeed > 0 ? (float)(texture.base - first) : 0;
+	texture.base = std::min(texture.base, first);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.base);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, texture.minLod);
+	track(id, texture);
+}
+
+void C3dglTextureStreamer::evict(GLuint id, TEXTURE& texture)
+{
+	const SOURCE& source = *texture.pSource;
+	unsigned level = texture.base++;
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.base);
+	texture.minLod = 0;
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 0);
+
+	// a zero-sized image releases the memory of the level
+	if (source.format == GL_RGBA8)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	else
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, source.format, 0, 0, 0, 0, NULL);
+	m_residentBytes -= getLevelSize(source, level);
+	m_nEvicted++;
+	track(id, texture);
+}
+
+bool C3dglTextureStreamer::makeRoom(size_t bytes)
+{
+	while (m_residentBytes + m_pendingBytes + bytes > m_budget)
+	{
+		// least recently used first; only the levels not needed in this frame
+		auto victim = m_textures.end();
+		for (auto it = m_textures.begin(); it != m_textures.end(); it++)
+		{
+			TEXTURE& texture = it->second;
+			if (!texture.bReady || texture.bPending || texture.base >= texture.tail || (texture.lastUsed >= m_frame && texture.base >= texture.wanted))
+				continue;
+			if (victim == m_textures.end() || texture.lastUsed < victim->second.lastUsed
+				|| (texture.lastUsed == victim->second.lastUsed && getLevelSize(*texture.pSource, texture.base) > getLevelSize(*victim->second.pSource, victim->second.base)))
+				victim = it;
+		}
+		if (victim == m_textures.end())
+			return false;
+		evict(victim->first, victim->second);
+	}
+	return true;
+}
+
+void C3dglTextureStreamer::request(GLuint idTex, float pixels)
+{
+	auto it = m_textures.find(idTex);
+	if (it == m_textures.end() || !it->second.bReady || pixels <= 0)
+		return;
+
+	TEXTURE& texture = it->second;
+	float lod = std::log2(std::max(texture.width, texture.height) / pixels);
+	unsigned level = lod <= 0 ? 0 : std::min(texture.tail, (unsigned)lod);
+	texture.wanted = std::min(texture.wanted, level);
+	texture.priority = std::max(texture.priority, pixels);
+	if (level <= texture.base)
+		texture.lastUsed = m_frame;
+}
+
+void C3dglTextureStreamer::request(const C3dglModel& model, glm::mat4 matrix)
+{
+	auto it = m_aabbs.find(&model);
+	if (it == m_aabbs.end())
+	{
+		glm::vec3 aabb[2];
+		model.getAABB(aabb);
+		it = m_aabbs.insert({ &model, { aabb[0], aabb[1] } }).first;
+	}
+	glm::vec3 aabb[2] = { it->second.first, it->second.second };
+
+	// on-screen size of the bounding box; not requested at all if outside the view frustum
+	glm::vec2 minNDC(FLT_MAX), maxNDC(-FLT_MAX);
+	unsigned outside[6] = { 0, 0, 0, 0, 0, 0 };
+	bool bBehind = false;
+	for (unsigned i = 0; i < 8; i++)
+	{
+		glm::vec4 p = m_projection * matrix * glm::vec4(aabb[i & 1].x, aabb[(i >> 1) & 1].y, aabb[(i >> 2) & 1].z, 1);
+		for (unsigned axis = 0; axis < 3; axis++)
+		{
+			if (p[axis] < -p.w) outside[axis * 2]++;
+			if (p[axis] > p.w) outside[axis * 2 + 1]++;
+		}
+		if (p.w <= 0)
+			bBehind = true;
+		else
+		{
+			minNDC = glm::min(minNDC, glm::vec2(p) / p.w);
+			maxNDC = glm::max(maxNDC, glm::vec2(p) / p.w);
+		}
+	}
+	for (unsigned plane = 0; plane < 6; plane++)
+		if (outside[plane] == 8)
+			return;
+	float pixels = bBehind ? std::max(m_viewWidth, m_viewHeight)
+		: std::max((maxNDC.x - minNDC.x) * 0.5f * m_viewWidth, (maxNDC.y - minNDC.y) * 0.5f * m_viewHeight);
+
+	for (size_t i = 0; i < model.getMaterialCount(); i++)
+		for (GLenum texUnit = GL_TEXTURE0; texUnit <= GL_TEXTURE31; texUnit++)
+		{
+			unsigned idTex;
+			if (model.getMaterial(i)->getTexture(texUnit, idTex))
+				request(idTex, pixels);
+		}
+}
+
+void C3dglTextureStreamer::update()
+{
+	if (!m_bRunning)
+		return;
+
+	double time = getTime();
+	float deltaTime = (float)(time - m_lastUpdate);
+	m_lastUpdate = time;
+
+	// preserve the currently bound texture
+	GLuint prevTex;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*)&prevTex);
+
+	// upload the levels read
+	std::deque<std::shared_ptr<REQUEST>> done;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		done.swap(m_done);
+	}
+	for (auto& pRequest : done)
+	{
+		m_nPending--;
+		m_pendingBytes -= pRequest->bytes;
+
+		auto it = m_textures.find(pRequest->id);
+		if (it == m_textures.end() || it->second.generation != pRequest->generation)
+			continue;		// released in the meantime - the id may belong to another texture now
+		TEXTURE& texture = it->second;
+		texture.bPending = false;
+		if (!pRequest->bOK)
+		{
+			log(M3DGL_WARNING_CANNOT_STREAM, texture.filename);
+			continue;
+		}
+		for (auto& data : pRequest->data)
+			m_nLoadedBytes += data.size();
+
+		if (!texture.bReady)
+		{
+			// the image has just been decoded: its tail replaces the placeholder
+			const SOURCE& source = *texture.pSource;
+			texture.width = source.width;
+			texture.height = source.height;
+			texture.levels = source.levels;
+			texture.base = texture.tail = texture.wanted = pRequest->first;
+			upload(pRequest->id, texture, pRequest->first, pRequest->last, pRequest->data);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+			texture.bReady = true;
+			track(pRequest->id, texture);
+		}
+		else
+			upload(pRequest->id, texture, pRequest->first, pRequest->last, pRequest->data);
+	}
+
+	// fade in
+	for (auto& [id, texture] : m_textures)
+		if (texture.minLod > 0)
+		{
+			texture.minLod = std::max(0.0f, texture.minLod - m_fadeSpeed * deltaTime);
+			glBindTexture(GL_TEXTURE_2D, id);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, texture.minLod);
+		}
+
+	// stay within the budget
+	makeRoom(0);
+
+	// new requests, the largest on-screen textures first; if the budget is short, fewer levels are requested
+	std::vector<std::pair<GLuint, TEXTURE*>> candidates;
+	for (auto& [id, texture] : m_textures)
+		if (texture.bReady && !texture.bPending && texture.wanted < texture.base)
+			candidates.push_back({ id, &texture });
+	std::sort(candidates.begin(), candidates.end(), [](auto& a, auto& b) { return a.second->priority > b.second->priority; });
+	for (auto& [id, pTexture] : candidates)
+	{
+		TEXTURE& texture = *pTexture;
+		unsigned first = texture.wanted;
+		size_t bytes = 0;
+		for (unsigned level = first; level < texture.base; level++)
+			bytes += getLevelSize(*texture.pSource, level);
+		while (first < texture.base && !makeRoom(bytes))
+			bytes -= getLevelSize(*texture.pSource, first++);
+		if (first == texture.base)
+			continue;	// no room, even for a single level
+
+		std::shared_ptr<REQUEST> pRequest = std::make_shared<REQUEST>();
+		*pRequest = { id, texture.generation, texture.pSource, first, texture.base - 1, texture.priority, bytes, false, { } };
+		texture.bPending = true;
+		m_nPending++;
+		m_pendingBytes += bytes;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(pRequest);
+	}
+	m_cv.notify_one();
+
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+
+	// the next frame
+	for (auto& [id, texture] : m_textures)
+	{
+		texture.wanted = texture.tail;
+		texture.priority = 0;
+	}
+	m_frame++;
+}
+
+void C3dglTextureStreamer::stats() const
+{
+	C3dglLogger::log("** Statistics for the {}", getName());
+	C3dglLogger::log("Textures: {}, Resident: {:.1f} MB of {:.1f} MB budget", m_textures.size(), m_residentBytes / 1048576.0, m_budget / 1048576.0);
+	C3dglLogger::log("Pending: {} requests ({:.1f} kB), Uploaded: {} levels, Evicted: {} levels, Read: {:.1f} MB", m_nPending, m_pendingBytes / 1024.0, m_nUploaded, m_nEvicted, m_nLoadedBytes / 1048576.0);
+}
@@ -7,6 +7,7 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <iostream>
 #include <3dgl/VAO.h>
 #include <3dgl/Shader.h>
+#include <3dgl/MemoryTracker.h>
 
 // GLM include files
 #include "../glm/gtc/type_ptr.hpp"
@@ -38,6 +39,28 @@ bool C3dglVertexAttrObject::getVertexBufferId(GLint attrLocation, GLuint& buffer
 		return false;
 }
 
+size_t C3dglVertexAttrObject::getBufferSize() const
+{
+	GLuint prevBuffer;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, (GLint*)&prevBuffer);
+
+	size_t nSize = 0;
+	std::set<GLuint> buffers;	// the same buffer may be used by many attributes - see addAttribPointer
+	for (auto it = m_mapBuffers.begin(); it != m_mapBuffers.end(); it++)
+		buffers.insert(it->second);
+	if (m_idIndex)
+		buffers.insert(m_idIndex);
+	for (GLuint bufferId : buffers)
+	{
+		GLint size = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+		glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		nSize += size;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, prevBuffer);
+	return nSize;
+}
 
 void C3dglVertexAttrObject::create(size_t attrCount, size_t nVertices, void** attrData, size_t* attrSize, size_t nIndices, void* indexData, size_t indSize, C3dglProgram* pProgram)
 {
@@ -114,6 +137,7 @@ void C3dglVertexAttrObject::create(size_t attrCount, size_t nVertices, void** at
 		glGenBuffers(1, &m_idIndex);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idIndex);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indSize * m_nIndices, indexData, GL_STATIC_DRAW);
+		C3dglMemoryTracker::getInstance().add(MEM_INDEX_BUFFER, m_idIndex, indSize * m_nIndices, indSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, getName());
 	}
 
 	// Reset VAO & buffers
@@ -125,14 +149,24 @@ void C3dglVertexAttrObject::create(size_t attrCount, size_t nVertices, void** at
 void C3dglVertexAttrObject::destroy()
 {
 	for (auto it = m_mapBuffers.begin(); it != m_mapBuffers.end(); it++)
+	{
+		C3dglMemoryTracker::getInstance().remove(MEM_VERTEX_BUFFER, it->second);
 		glDeleteBuffers(1, &it->second);
+	}
 	m_mapBuffers.clear();
 	if (m_idIndex != 0)
+	{
+		C3dglMemoryTracker::getInstance().remove(MEM_INDEX_BUFFER, m_idIndex);
 		glDeleteBuffers(1, &m_idIndex);
+	}
 	m_idIndex = 0;
 	if (&m_idVAO != 0)
 		glDeleteVertexArrays(1, &m_idVAO);
 	m_idVAO = 0;
+	if (m_idPositionVAO)
+		glDeleteVertexArrays(1, &m_idPositionVAO);
+	m_idPositionVAO = 0;
+	m_positionAttr = -1;
 	m_nVertices = m_nIndices = 0;
 }
 
@@ -158,6 +192,7 @@ GLuint C3dglVertexAttrObject::createVertexBuffer(GLint attrLocation, size_t inst
 	m_mapBuffers[attrLocation] = bufferId;
 	glBindBuffer(GL_ARRAY_BUFFER, bufferId);
 	glBufferData(GL_ARRAY_BUFFER, instances * stride, data, usage);
+	C3dglMemoryTracker::getInstance().add(MEM_VERTEX_BUFFER, bufferId, instances * stride, GL_FLOAT, getName());
 
 	glEnableVertexAttribArray(attrLocation);
 	glVertexAttribPointer(attrLocation, size, GL_FLOAT, GL_FALSE, stride, 0);
@@ -194,6 +229,7 @@ GLuint C3dglVertexAttrObject::createVertexBuffer(GLint attrLocation, size_t inst
 	m_mapBuffers[attrLocation] = bufferId;
 	glBindBuffer(GL_ARRAY_BUFFER, bufferId);
 	glBufferData(GL_ARRAY_BUFFER, instances * stride, data, usage);
+	C3dglMemoryTracker::getInstance().add(MEM_VERTEX_BUFFER, bufferId, instances * stride, GL_INT, getName());
 
 	glEnableVertexAttribArray(attrLocation);
 	glVertexAttribIPointer(attrLocation, size, GL_INT, stride, 0);
@@ -248,6 +284,8 @@ GLuint C3dglVertexAttrObject::createVertexBuffer(GLenum cap, size_t instances, f
 		glDeleteBuffers(1, &bufferId);
 		break;
 	}
+	if (cap == ATTR_VERTEX || cap == ATTR_NORMAL || cap == ATTR_TEXCOORD)
+		C3dglMemoryTracker::getInstance().add(MEM_VERTEX_BUFFER, bufferId, instances * stride, GL_FLOAT, getName());
 
 	// Reset VAO & buffers
 	if (prevVAO != m_idVAO)
@@ -312,6 +350,7 @@ void C3dglVertexAttrObject::destroyVertexBuffer(GLint attrLocation)
 	auto it = m_mapBuffers.find(attrLocation);
 	if (it != m_mapBuffers.end())
 	{
+		C3dglMemoryTracker::getInstance().remove(MEM_VERTEX_BUFFER, it->second);
 		glDeleteBuffers(1, &it->second);
 		m_mapBuffers.erase(it);
 	}
@@ -328,7 +367,7 @@ void C3dglVertexAttrObject::render(glm::mat4 matrix, GLsizei instances, C3dglPro
 	if (pProgram != m_pLastProgramUsed)		// first conditional is used to bypass the check if the current program is the same as the last program used
 	{
 		m_pLastProgramUsed = pProgram;
-		if (pProgram != m_pProgram)	// no checks needed if the current program is the same as the loading program
+		if (pProgram != m_pProgram && !(pProgram && pProgram->isPositionOnly()))	// no checks needed if the current program is the same as the loading program, or position-only
 		{
 			const GLint* pLoadSignature = m_pProgram->getShaderSignature();
 			const GLint* pRenderSignature = pProgram->getShaderSignature();
@@ -359,7 +398,42 @@ void C3dglVertexAttrObject::render(glm::mat4 matrix, GLsizei instances, C3dglPro
 		glMultMatrixf((GLfloat*)&matrix);
 	}
 
-	render(instances);
+	if (pProgram && m_pProgram && pProgram->isPositionOnly())
+		renderPositionOnly(pProgram->getAttribLocation(ATTR_VERTEX), instances);
+	else
+		render(instances);
+}
+
+void C3dglVertexAttrObject::render(glm::mat4 matrix, const std::vector<std::pair<GLsizei, GLsizei>>& ranges, C3dglProgram* pProgram) const
+{
+	if (ranges.empty())
+		return;
+	m_pRanges = &ranges;
+	render(matrix, 1, pProgram);
+	m_pRanges = NULL;
+}
+
+void C3dglVertexAttrObject::drawElements(GLsizei instances) const
+{
+	if (m_pRanges)
+	{
+		std::vector<GLsizei> counts;
+		std::vector<const void*> offsets;
+		for (auto& range : *m_pRanges)
+		{
+			counts.push_back(range.second);
+			offsets.push_back((const void*)(range.first * sizeof(GLuint)));
+		}
+		if (instances == 1)
+			glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)counts.size());
+		else
+			for (size_t i = 0; i < counts.size(); i++)
+				glDrawElementsInstanced(GL_TRIANGLES, counts[i], GL_UNSIGNED_INT, offsets[i], instances);
+	}
+	else if (instances == 1)
+		glDrawElements(GL_TRIANGLES, (GLsizei)m_nIndices, GL_UNSIGNED_INT, 0);
+	else
+		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)m_nIndices, GL_UNSIGNED_INT, 0, instances);
 }
 
 void C3dglVertexAttrObject::render(GLsizei instances) const
@@ -368,11 +442,61 @@ void C3dglVertexAttrObject::render(GLsizei instances) const
 	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
 	if (prevVAO != m_idVAO)
 		glBindVertexArray(m_idVAO);
-	if (instances == 1)
-		glDrawElements(GL_TRIANGLES, (GLsizei)m_nIndices, GL_UNSIGNED_INT, 0);
-	else
-		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)m_nIndices, GL_UNSIGNED_INT, 0, instances);
+	drawElements(instances);
 	if (prevVAO != m_idVAO)
 		glBindVertexArray(prevVAO);
 }
 
+bool C3dglVertexAttrObject::preparePositionVAO(GLint attrLocation) const
+{
+	GLint source = m_pProgram ? m_pProgram->getAttribLocation(ATTR_VERTEX) : -1;
+	if (source == -1 || attrLocation == -1 || m_idVAO == 0)
+		return false;
+	if (m_idPositionVAO && m_positionAttr == attrLocation)
+		return true;
+
+	GLuint prevVAO, prevBuffer;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, (GLint*)&prevBuffer);
+
+	// the vertex stream, as set up in the main VAO - possibly interleaved with other attributes
+	GLint buffer = 0, size = 3, type = GL_FLOAT, stride = 0;
+	void* pointer = NULL;
+	glBindVertexArray(m_idVAO);
+	glGetVertexAttribiv(source, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+	glGetVertexAttribiv(source, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+	glGetVertexAttribiv(source, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+	glGetVertexAttribiv(source, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+	glGetVertexAttribPointerv(source, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+
+	if (m_idPositionVAO == 0)
+		glGenVertexArrays(1, &m_idPositionVAO);
+	glBindVertexArray(m_idPositionVAO);
+	if (m_positionAttr != -1)
+		glDisableVertexAttribArray(m_positionAttr);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glEnableVertexAttribArray(attrLocation);
+	glVertexAttribPointer(attrLocation, size, type, GL_FALSE, stride, pointer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idIndex);
+	m_positionAttr = attrLocation;
+
+	// Reset VAO & buffers
+	glBindVertexArray(prevVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, prevBuffer);
+	return true;
+}
+
+void C3dglVertexAttrObject::renderPositionOnly(GLint attrLocation, GLsizei instances) const
+{
+	if (!preparePositionVAO(attrLocation))
+	{
+		render(instances);
+		return;
+	}
+
+	GLuint prevVAO;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
+	glBindVertexArray(m_idPositionVAO);
+	drawElements(instances);
+	glBindVertexArray(prevVAO);
+}
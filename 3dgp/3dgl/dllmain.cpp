@@ -10,6 +10,7 @@
 #pragma comment (lib, "glew32.lib")
 #pragma comment (lib, "assimp-vc143-mt.lib") 
 #pragma comment (lib, "DevIL.lib") 
+#pragma comment (lib, "windowscodecs.lib")
 
 BOOL APIENTRY DllMain( HMODULE hModule,
                        DWORD  ul_reason_for_call,
@@ -0,0 +1,63 @@
+/*********************************************************************************
+3DGL Asset Baker
+Bakes the assets listed in a manifest into a single, memory-mappable asset pack,
+or compresses a single image into a DDS file, with its mip chain (see C3dglTextureFile::saveDDS).
+Usage: 3dgl-bake <manifest> <pack file>
+       3dgl-bake -bc1|-bc3|-bc5|-bc7 <image> [<dds file>]
+See C3dglAssetPackWriter::bakeManifest for the format of the manifest.
+The default name of the DDS file is the name of the image with the .dds extension,
+which is where C3dglTexture::load looks for the compressed version of the image.
+*********************************************************************************/
+#include <iostream>
+#include <filesystem>
+#include <GL/glew.h>
+#include <3dgl/AssetPack.h>
+#include <3dgl/Bitmap.h>
+#include <3dgl/Texture.h>
+#include <3dgl/TextureFile.h>
+
+using namespace _3dgl;
+
+int compress(BC_FORMAT format, std::string image, std::string dds)
+{
+	C3dglBitmap bm;
+	if (!bm.load(image, GL_RGBA) || !bm.getBits())
+		return 1;
+
+	// BC5 is used for normal maps - these are not sRGB encoded
+	unsigned w = (unsigned)bm.getWidth(), h = (unsigned)abs(bm.getHeight());
+	std::vector<std::vector<unsigned char>> levels;
+	C3dglTexture::generateMipChain(w, h, bm.getBits(), levels, format == BC5 ? TEX_LINEAR_DATA : TEX_DEFAULT);
+
+	if (dds.empty())
+		dds = std::filesystem::path(image).replace_extension(".dds").string();
+	if (!C3dglTextureFile::saveDDS(dds, format, w, h, levels))
+		return 1;
+
+	C3dglLogger::log("{} compressed into {}", image, dds);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: 3dgl-bake <manifest> <pack file>" << std::endl;
+		std::cout << "       3dgl-bake -bc1|-bc3|-bc5|-bc7 <image> [<dds file>]" << std::endl;
+		return 1;
+	}
+
+	std::string mode = argv[1];
+	if (mode == "-bc1") return compress(BC1, argv[2], argc > 3 ? argv[3] : "");
+	if (mode == "-bc3") return compress(BC3, argv[2], argc > 3 ? argv[3] : "");
+	if (mode == "-bc5") return compress(BC5, argv[2], argc > 3 ? argv[3] : "");
+	if (mode == "-bc7") return compress(BC7, argv[2], argc > 3 ? argv[3] : "");
+
+	C3dglAssetPackWriter writer;
+	bool bResult = writer.bakeManifest(argv[1]);
+	if (writer.getItemCount() == 0 || !writer.save(argv[2]))
+		return 1;
+
+	C3dglLogger::log("{} assets baked into {}", writer.getItemCount(), argv[2]);
+	return bResult ? 0 : 2;	// 2 = some assets were skipped
+}
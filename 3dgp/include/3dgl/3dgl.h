@@ -33,6 +33,25 @@ freely, subject to the following restrictions:
 #include "Terrain.h"
 #include "SkyBox.h"
 #include "Bitmap.h"
+#include "ResourceCache.h"
+#include "ObjLoader.h"
+#include "LoadProfile.h"
+#include "AssetPack.h"
+#include "Primitive.h"
+#include "Texture.h"
+#include "TextureFile.h"
+#include "TextureArray.h"
+#include "TextureStreamer.h"
+#include "MemoryTracker.h"
+#include "CubeMapRenderer.h"
+#include "ReflectionProbeManager.h"
+#include "LightGrid.h"
+#include "DeferredRenderer.h"
+#include "LightAssigner.h"
+#include "ShadowAtlas.h"
+#include "Scene.h"
+#include "RenderQueue.h"
+#include "StaticBatch.h"
 
 // link with AssImp and DevIL libraries
 #pragma comment (lib, "assimp-vc143-mt.lib") 
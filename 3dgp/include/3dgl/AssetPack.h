@@ -0,0 +1,183 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Implementation of the Asset Pack
+A single file containing pre-processed (baked) models, textures and shaders.
+The pack is memory-mapped and its entries are accessed in place, without copying.
+Packs are created offline with C3dglAssetPackWriter (see the 3dgl-bake tool).
+Once mounted, the pack is used transparently by C3dglModel::load,
+C3dglShader::loadFromFile, C3dglBitmap::load and C3dglResourceCache.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglAssetPack_h_
+#define __3dglAssetPack_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <map>
+#include <string_view>
+#include <cstdint>
+
+struct aiScene;
+
+namespace _3dgl
+{
+	class C3dglMappedFile;
+
+	enum ASSET_TYPE { ASSET_RAW, ASSET_MODEL, ASSET_TEXTURE, ASSET_SHADER };
+
+	// Pack file layout: HEADER at offset 0, entries at 4 KB-aligned offsets, then the index (ENTRY table + names)
+	struct ASSETPACK_HEADER
+	{
+		char magic[8];				// "3DGLPAK"
+		uint32_t version;
+		uint32_t nEntries;
+		uint64_t indexOffset;		// offset of the ENTRY table
+		uint64_t namesOffset;		// offset of the name strings
+	};
+
+	struct ASSETPACK_ENTRY
+	{
+		uint64_t offset;			// 4 KB-aligned offset of the data
+		uint64_t size;				// size of the data in bytes
+		uint32_t type;				// ASSET_TYPE
+		uint32_t param;				// for models: AssImp post-processing flags used
+		uint32_t nameOffset;		// offset of the name, relative to namesOffset
+		uint32_t nameLength;
+		int64_t sourceTime;			// last write time of the source file, as baked
+		uint64_t sourceSize;		// size of the source file, as baked
+	};
+
+	// Zero-copy view of a baked texture: RGBA, 8 bits per channel, lower left origin, full mip chain
+	struct ASSETPACK_TEXTURE
+	{
+		unsigned width, height;		// size of level 0
+		unsigned levels;			// number of mip levels
+		const void* pLevels[32];	// pixels of each level, in the mapped file
+		size_t levelSizes[32];
+	};
+
+	class MY3DGL_API C3dglAssetPack : public C3dglObject
+	{
+		std::string m_filename;
+		C3dglMappedFile* m_pFile;
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::map<std::string, const ASSETPACK_ENTRY*> m_index;	// entry name => entry (in the mapped file)
+#pragma warning(pop)
+
+	public:
+		static const uint32_t c_version = 2;
+		static const uint64_t c_alignment = 4096;
+
+		C3dglAssetPack();
+		C3dglAssetPack(const C3dglAssetPack&) = delete;
+		~C3dglAssetPack()					{ close(); }
+
+		// maps the pack file into the memory; the file stays mapped until close is called
+		bool open(std::string filename);
+		void close();
+		bool isOpen() const					{ return m_pFile != NULL; }
+
+		// Mounted packs are searched by the library loaders before the loose files are opened.
+		// The pack must stay open (and mounted) as long as any asset loaded from it is in use.
+		static void mount(C3dglAssetPack* pPack);
+		static void unmount(C3dglAssetPack* pPack);
+		// finds the first mounted pack with the given asset, NULL if none. Assets whose file exists and has changed
+		// since they were baked are skipped with a warning - the loose file is loaded instead.
+		static C3dglAssetPack* findMounted(std::string filename, ASSET_TYPE type);
+
+		// converts a file name to the entry name: forward slashes, lower case, no "." or ".." segments
+		static std::string getEntryName(std::string filename);
+
+		// Entries
+		size_t getEntryCount() const		{ return m_index.size(); }
+		const ASSETPACK_ENTRY* findEntry(std::string filename) const;
+		bool hasAsset(std::string filename, ASSET_TYPE type) const;
+		// true if the file exists and its time or size differs from the ones it was baked from
+		bool isStale(std::string filename) const;
+
+		// Returns a pointer to the entry data in the mapped file, NULL if not found
+		const void* getData(std::string filename, size_t& size) const;
+		// Returns the shader source as a view of the mapped file, empty if not found
+		std::string_view getShader(std::string filename) const;
+		// Fills in the texture view, false if not found
+		bool getTexture(std::string filename, ASSETPACK_TEXTURE& texture) const;
+		// Creates an AssImp scene with vertex and index arrays pointing into the mapped file.
+		// flags must match the flags the model was baked with (0 = aiProcessPreset_TargetRealtime_MaxQuality).
+		// The scene must be destroyed with C3dglAssetPack::release - never with aiReleaseImport!
+		const aiScene* loadScene(std::string filename, unsigned flags = 0) const;
+		static void release(const aiScene* pScene);
+
+		std::string getName() const			{ return "Asset Pack \"" + m_filename + "\""; }
+	};
+
+	class MY3DGL_API C3dglAssetPackWriter : public C3dglObject
+	{
+		struct ITEM
+		{
+			std::string name;		// entry name
+			ASSET_TYPE type;
+			unsigned param;
+			std::vector<char> data;
+			int64_t sourceTime;
+			uint64_t sourceSize;
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<ITEM> m_items;
+#pragma warning(pop)
+
+	public:
+		C3dglAssetPackWriter() : C3dglObject()	{ }
+
+		// Bakes all the assets listed in the manifest, which is a text file with lines in the form:
+		//		model <filename> [flags]	- AssImp scene after post-processing (flags in hex; default: MaxQuality)
+		//		texture <filename>			- RGBA texture with a full mip chain
+		//		shader <filename>			- shader source with comments and blank lines removed
+		//		raw <filename>				- any file, stored as it is
+		// File names are relative to the manifest file and are stored as written. # starts a comment.
+		// Returns false if any of the assets could not be baked.
+		bool bakeManifest(std::string manifest);
+
+		// The entry name is created from the filename; pass basePath to open the file from another directory
+		bool bakeModel(std::string filename, unsigned flags = 0, std::string basePath = "");
+		bool bakeTexture(std::string filename, std::string basePath = "");
+		bool bakeShader(std::string filename, std::string basePath = "");
+		bool bakeRaw(std::string filename, std::string basePath = "");
+
+		size_t getItemCount() const				{ return m_items.size(); }
+
+		// writes the pack file
+		bool save(std::string filename) const;
+
+		std::string getName() const				{ return "Asset Pack Writer"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglAssetPack_h_
@@ -0,0 +1,69 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Block compression (BCn) encoder
+Compresses RGBA, 8 bits per channel images into BC1, BC3, BC5 or BC7 blocks.
+Each 4x4 block is encoded independently; the blocks are processed in parallel.
+BC7 uses mode 6 only (single subset, 4-bit indices, RGBA 7.7.7.7 + p-bits).
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglBlockCompress_h_
+#define __3dglBlockCompress_h_
+
+// Include 3DGL API import/export settings
+#include "3dglapi.h"
+
+namespace _3dgl
+{
+	// BC1: RGB, 4 bits per pixel; BC3: RGBA, 8 bpp; BC5: two channels (RG - normal maps), 8 bpp; BC7: RGBA, 8 bpp, high quality
+	enum BC_FORMAT { BC1 = 1, BC3 = 3, BC5 = 5, BC7 = 7 };
+
+	// size of a single 4x4 block, in bytes
+	size_t MY3DGL_API getBlockSize(BC_FORMAT format);
+
+	// size of a compressed image, in bytes
+	size_t MY3DGL_API getCompressedSize(BC_FORMAT format, unsigned width, unsigned height);
+
+	// OpenGL internal format of the BCn format (linear colour space)
+	GLenum MY3DGL_API getGLFormat(BC_FORMAT format);
+
+	// Compresses an RGBA, 8 bits per channel image; pDest must be at least getCompressedSize bytes long.
+	// Partial blocks at the right and bottom edges are padded by repeating the edge pixels.
+	// nThreads == 0 means: use all hardware threads.
+	void MY3DGL_API compressBlocks(BC_FORMAT format, unsigned width, unsigned height, const void* pRGBA, void* pDest, unsigned nThreads = 0);
+
+	// Flips a compressed image upside down (top-down DDS/KTX2 rows <=> bottom-up OpenGL rows) without decoding.
+	// glFormat is the OpenGL internal format. Returns false if any of the blocks could not be flipped:
+	// this is the case for unknown formats, BC7 blocks other than mode 6 and heights above 4 which are not
+	// multiples of 4. In this case, the image is copied unflipped (unknown formats are not copied at all).
+	// Flip either all levels of a texture or none - check them all with canFlipBlocks first.
+	bool MY3DGL_API flipBlocks(GLenum glFormat, unsigned width, unsigned height, const void* pSrc, void* pDest);
+
+	// true if flipBlocks can flip the image: a supported format, the height no more than 4 or a multiple of 4
+	// and, for BC7, mode 6 blocks only
+	bool MY3DGL_API canFlipBlocks(GLenum glFormat, unsigned width, unsigned height, const void* pSrc);
+}; // namespace _3dgl
+
+#endif // __3dglBlockCompress_h_
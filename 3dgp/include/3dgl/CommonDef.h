@@ -56,6 +56,8 @@ namespace _3dgl
 		UNI_MAT_SPECULAR,
 		UNI_MAT_EMISSIVE,
 		UNI_MAT_SHININESS,
+		UNI_TEX_LAYER,						// texture array layer of the material texture (see C3dglTextureArray)
+		UNI_TEX_REGION,						// atlas region of the material texture within its layer
 		
 		UNI_COUNT							// total standard unoform count
 	};
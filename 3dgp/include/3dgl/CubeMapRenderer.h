@@ -0,0 +1,177 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Render-to-cube-map: dynamic environment maps
+A persistent framebuffer object renders straight into the faces of an immutable
+cube map (colour and depth), either in six passes or in a single layered pass
+through a geometry shader. The mip chain may be generated after each rendering,
+so that rough surfaces may sample blurred reflections.
+Update policies limit the cost of a dynamic environment map: faces may be updated
+only when invalidated by moving objects, at most n faces per frame (the stalest
+first), or within a GPU time budget. The staleness may be checked by comparing
+the cube map with a freshly rendered one.
+Objects may be binned into the faces with a single test of their bounding box
+against all six face frustums, so that each face draws only what it sees.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglCubeMapRenderer_h_
+#define __3dglCubeMapRenderer_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+
+// standard libraries
+#include <functional>
+#include <vector>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+
+	class MY3DGL_API C3dglCubeMapRenderer : public C3dglObject
+	{
+		GLuint m_idFBO;
+		GLuint m_idCubeMap;			// colour, RGBA8
+		GLuint m_idDepth;			// depth cube map - layered rendering needs a layered depth attachment
+		GLuint m_idReference;		// freshly rendered faces for measureError, created on demand
+		unsigned m_size, m_levels;
+		float m_near, m_far;
+
+		// update policy
+		bool m_bChangeDriven;		// faces are updated only when invalidated
+		unsigned m_facesPerFrame;	// at most this many faces per frame
+		float m_timeBudget;			// GPU time per frame, in ms; 0 = no budget
+		float m_radius;				// objects farther than this do not invalidate the faces
+		glm::vec3 m_position;		// position of the last update
+		bool m_dirty[6];
+		unsigned m_age[6];			// frames since the face was updated
+
+		// timing and statistics
+		GLuint m_idQueries[6];		// GL_TIME_ELAPSED for each face
+		bool m_pending[6];
+		float m_faceCost;			// ms per face, running average; 0 until measured
+		unsigned long long m_nFaces;
+		unsigned m_nWindowFaces;
+		double m_windowStart;
+		float m_facesPerSecond;
+		float m_error;				// the last measured visual error, or -1
+
+		// culling counters
+		unsigned m_nBinned;			// objects binned in the last update
+		unsigned m_nVisible[6];		// objects seen by each face in the last update
+		unsigned long long m_nTested, m_nCulled;	// object-face pairs, in total
+
+		// binds the FBO and sets the viewport; the previous ones are stored in prevFBO and viewport
+		void begin(GLint& prevFBO, GLint viewport[4]) const;
+		void end(GLint prevFBO, const GLint viewport[4]) const;
+		void generateMipmap() const;
+
+		// reads the finished timer queries
+		void collectQueries();
+		// ages the faces and marks them as stale as required by the policy; invalidates all if the position changed
+		void beginFrame(glm::vec3 position);
+		void countFaces(unsigned n);
+
+	public:
+		C3dglCubeMapRenderer();
+		C3dglCubeMapRenderer(const C3dglCubeMapRenderer&) = delete;
+		~C3dglCubeMapRenderer()						{ destroy(); }
+
+		// Creates the cube map, size x size texels per face. With bMipmaps, the mip chain is generated after each rendering.
+		bool create(unsigned size, bool bMipmaps = true, float nearPlane = 0.02f, float farPlane = 1000.0f);
+		void destroy();
+
+		// Update policy. By default, all faces are updated in every frame. When change driven, the faces are updated only when invalidated.
+		// The stale faces are updated stalest first, at most facesPerFrame of them (1 = round robin), and no more than fit in timeBudget ms
+		// of GPU time (at least one face per frame, though). Objects farther than radius (by default, the far plane) do not invalidate the faces.
+		void setChangeDriven(bool bChangeDriven)			{ m_bChangeDriven = bChangeDriven; }
+		void setFacesPerFrame(unsigned facesPerFrame)		{ m_facesPerFrame = facesPerFrame ? facesPerFrame : 1; }
+		void setTimeBudget(float ms)						{ m_timeBudget = ms; }
+		void setRadius(float radius)						{ m_radius = radius; }
+		bool isChangeDriven() const							{ return m_bChangeDriven; }
+		unsigned getFacesPerFrame() const					{ return m_facesPerFrame; }
+		float getTimeBudget() const							{ return m_timeBudget; }
+		float getRadius() const								{ return m_radius; }
+
+		// Marks all faces as stale
+		void invalidate();
+		// Marks the faces which see the bounding sphere of a moved object as stale - call when its transform changes
+		void invalidate(glm::vec3 center, float radius);
+
+		// Six passes: render is called for each face to be updated (0..5 as in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) with the face bound
+		// and cleared, and with the view and projection matrices of the face. Call in every frame; returns the number of faces updated.
+		unsigned render(glm::vec3 position, std::function<void(unsigned face, glm::mat4 matrixView, glm::mat4 matrixProjection)> render);
+
+		// Single pass: all faces are rendered at once, by a geometry shader which writes gl_Layer (see shaders/cubemap.geom).
+		// render is called once, with the view matrix translating to position and the identity projection matrix;
+		// the matrices of the faces (projection * face rotation) are sent to pProgram as matrixCubeFaces[6], and cubeFaces is set to 6
+		// for the time of rendering (0 afterwards). Returns false, rendering nothing, if pProgram has no matrixCubeFaces uniform.
+		// All faces are updated at once, so the per-frame limits of the update policy do not apply; change driven updates do.
+		bool renderLayered(glm::vec3 position, C3dglProgram* pProgram, std::function<void(glm::mat4 matrixView, glm::mat4 matrixProjection)> render);
+
+		// Rotation of the view looking through the face
+		static glm::mat4 getFaceRotation(unsigned face);
+		glm::mat4 getProjection() const;
+
+		void bind(GLenum texUnit) const;
+
+		// The cube map with all its levels, stored in a file (RGBA, 8 bits per channel) - e.g. to bake static environments.
+		// load fails if the file is missing or does not match the size and the level count of the cube map.
+		bool save(std::string filename) const;
+		bool load(std::string filename);
+
+		// Per-face culling. Returns the mask of the faces (bit 0 = positive x, as in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
+		// which see the bounding box (in world coordinates), from the given position.
+		unsigned getFaceMask(glm::vec3 position, const glm::vec3 aabb[2]) const;
+		// Bins the objects, given by their bounding boxes: faces[face] receives the indices of the objects seen by the face.
+		// Call once per update, then draw faces[face] for each face rendered. Updates the culling counters.
+		void bin(glm::vec3 position, const std::vector<std::pair<glm::vec3, glm::vec3>>& aabbs, std::vector<unsigned> faces[6]);
+
+		// Visual error of the stale faces: all faces are rendered afresh (from the position of the last update) and compared with the cube map.
+		// Returns the RMS difference of the colours, 0..1. Reads back the textures - for diagnostics only.
+		float measureError(std::function<void(unsigned face, glm::mat4 matrixView, glm::mat4 matrixProjection)> render);
+
+		// Statistics
+		unsigned long long getFacesUpdated() const			{ return m_nFaces; }
+		float getFacesPerSecond() const						{ return m_facesPerSecond; }
+		float getFaceCost() const							{ return m_faceCost; }
+		unsigned getMaxAge() const;							// frames since the stalest face was updated
+		float getError() const								{ return m_error; }
+		unsigned getVisibleCount(unsigned face) const		{ return m_nVisible[face]; }
+		unsigned getBinnedCount() const						{ return m_nBinned; }
+		void stats() const;
+
+		GLuint getId() const						{ return m_idCubeMap; }
+		GLuint getDepthId() const					{ return m_idDepth; }
+		unsigned getSize() const					{ return m_size; }
+		unsigned getLevelCount() const				{ return m_levels; }
+
+		std::string getName() const					{ return "Cube Map Renderer"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglCubeMapRenderer_h_
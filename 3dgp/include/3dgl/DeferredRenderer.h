@@ -0,0 +1,116 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Deferred shading
+The scene is first rendered into a compact G-buffer (12 bytes per pixel): albedo
+and specular intensity (RGBA8), octahedral normal and shininess (RGB10_A2) and
+depth; the position is reconstructed from the depth. The lighting is then resolved
+in one full-screen pass, plus one instanced draw of light volumes (spheres) for the
+local point lights, so that the cost of shading depends on the screen pixels lit,
+not on the overdraw times the number of lights.
+See shaders/gbuffer.frag, shaders/deferred.vert and shaders/deferred.frag.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglDeferredRenderer_h_
+#define __3dglDeferredRenderer_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+#include "LightGrid.h"
+
+// standard libraries
+#include <vector>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+
+	class MY3DGL_API C3dglDeferredRenderer : public C3dglObject
+	{
+		GLuint m_idFBO;
+		GLuint m_idAlbedo;			// RGBA8: albedo, specular intensity
+		GLuint m_idNormal;			// RGB10_A2: octahedral normal (view space), shininess / 128, emissive flag
+		GLuint m_idDepth;			// DEPTH24_STENCIL8 - as the default framebuffer, so that it may be blitted there
+		GLuint m_idLight;			// RGBA16F: light accumulation
+		unsigned m_width, m_height;
+
+		// light volumes: an icosahedron enclosing the unit sphere, instanced
+		GLuint m_idVAO, m_idVolume, m_idVolumeIndices, m_idInstances;
+		GLuint m_idEmptyVAO;		// for the full-screen pass
+		size_t m_instanceSize;
+
+		// state stored by beginGeometry
+		GLint m_prevFBO, m_viewport[4];
+
+		// timing (GL_TIME_ELAPSED) of the geometry and lighting passes
+		GLuint m_idQueries[2];
+		bool m_pending[2];
+		float m_time[2];			// ms
+		unsigned m_nLights;
+
+		void collectQueries();
+
+	public:
+		C3dglDeferredRenderer();
+		C3dglDeferredRenderer(const C3dglDeferredRenderer&) = delete;
+		~C3dglDeferredRenderer()					{ destroy(); }
+
+		// Creates the G-buffer - call again whenever the window is resized
+		bool create(unsigned width, unsigned height);
+		void destroy();
+
+		// Geometry pass: everything rendered between these calls goes to the G-buffer, with a program using shaders/gbuffer.frag.
+		// beginGeometry binds and clears the G-buffer; endGeometry restores the framebuffer and the viewport.
+		void beginGeometry();
+		void endGeometry();
+
+		// Lighting pass, with a program using shaders/deferred.vert and deferred.frag: a full-screen pass (lightVolume = 0) for the ambient,
+		// directional and other global lights sent by the caller, then the light volumes of the point lights (lightVolume = 1), added.
+		// The G-buffer is bound to texUnit and the two following units. The result, and the depth, are copied to the framebuffer
+		// bound at beginGeometry - so that forward rendered objects may be drawn over it.
+		void resolve(C3dglProgram* pProgram, glm::mat4 matrixView, glm::mat4 matrixProjection, const std::vector<POINT_LIGHT>& lights, GLenum texUnit = GL_TEXTURE7);
+
+		// Binds the G-buffer textures: albedo, normal, depth to texUnit, texUnit + 1, texUnit + 2
+		void bind(GLenum texUnit) const;
+
+		// Statistics
+		unsigned getBytesPerPixel() const			{ return 12; }
+		float getGeometryTime() const				{ return m_time[0]; }
+		float getLightingTime() const				{ return m_time[1]; }
+		void stats() const;
+
+		GLuint getAlbedoId() const					{ return m_idAlbedo; }
+		GLuint getNormalId() const					{ return m_idNormal; }
+		GLuint getDepthId() const					{ return m_idDepth; }
+		unsigned getWidth() const					{ return m_width; }
+		unsigned getHeight() const					{ return m_height; }
+
+		std::string getName() const					{ return "Deferred Renderer"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglDeferredRenderer_h_
@@ -0,0 +1,123 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Per-object light lists
+For each object, the point lights whose range intersects its world space bounding
+box are found on the CPU, and up to MAX_OBJECT_LIGHTS of them, the strongest, are
+sent with its draw call - so that the shader loops over these lights only.
+The lights are first hashed into a uniform grid of world space cells, so that each
+box is tested against the lights of the cells it overlaps, not against all lights.
+See clusteredLights == 3 in shaders/basic.frag.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglLightAssigner_h_
+#define __3dglLightAssigner_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+#include "LightGrid.h"
+
+// standard libraries
+#include <vector>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+
+	// size of the objectLights array in shaders/basic.frag
+	const unsigned MAX_OBJECT_LIGHTS = 8;
+
+	class MY3DGL_API C3dglLightAssigner : public C3dglObject
+	{
+		float m_cellSize;
+		unsigned m_maxLights;
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<glm::vec4> m_lights;						// position and radius
+		std::vector<float> m_weights;							// brightness of the colour - to choose the strongest lights
+		// the grid: (cell key, light) pairs sorted by the key; lights covering too many cells are tested with every object instead
+		std::vector<std::pair<unsigned long long, unsigned>> m_cells;
+		std::vector<unsigned> m_global;
+		std::vector<unsigned> m_stamps;							// to test each light once per object
+		unsigned m_stamp;
+		std::vector<std::pair<float, int>> m_candidates;		// lights in range of the current object and their influence
+
+		// the lists: m_maxLights entries per object
+		std::vector<int> m_lists;
+		std::vector<unsigned> m_counts;
+#pragma warning(pop)
+
+		// statistics of the last build and assign
+		size_t m_nTests, m_nAssigned, m_nDropped;
+		double m_buildTime, m_assignTime;		// ms
+
+		unsigned long long getKey(glm::ivec3 cell) const;
+
+	public:
+		C3dglLightAssigner(float cellSize = 1.0f, unsigned maxLights = MAX_OBJECT_LIGHTS);
+
+		// Cell size of the grid - about the typical light diameter works best
+		void setCellSize(float cellSize)						{ m_cellSize = cellSize; }
+		float getCellSize() const								{ return m_cellSize; }
+		// Lights per object, up to MAX_OBJECT_LIGHTS
+		void setMaxLights(unsigned maxLights);
+		unsigned getMaxLights() const							{ return m_maxLights; }
+
+		// Hashes the lights into the grid - call once per frame, whenever the lights move
+		void build(const std::vector<POINT_LIGHT>& lights);
+
+		// Finds the lights affecting a world space box, the strongest first; returns their number (up to getMaxLights, none for an empty box)
+		unsigned assign(const glm::vec3& boxMin, const glm::vec3& boxMax, int* indices);
+		// Finds the lights of all the objects, given their world space boxes
+		void assign(const std::vector<std::pair<glm::vec3, glm::vec3>>& aabbs);
+
+		// Light lists of the objects, as assigned; the indices refer to the lights passed to build
+		unsigned getObjectCount() const							{ return (unsigned)m_counts.size(); }
+		unsigned getLightCount(unsigned object) const			{ return m_counts[object]; }
+		const int* getLights(unsigned object) const				{ return &m_lists[(size_t)object * m_maxLights]; }
+
+		// Sends the light list of an object to the shader (objectLights, objectLightCount) - before its draw call
+		void send(C3dglProgram* pProgram, unsigned object) const;
+
+		// Statistics
+		size_t getTestCount() const								{ return m_nTests; }
+		size_t getAssignedCount() const							{ return m_nAssigned; }
+		size_t getDroppedCount() const							{ return m_nDropped; }
+		double getBuildTime() const								{ return m_buildTime; }
+		double getAssignTime() const							{ return m_assignTime; }
+		void stats() const;
+
+		// Assigns nLights random lights to nObjects random boxes with the grid and with a test of every pair,
+		// logs both times and checks that the lists are the same; returns the speed-up of the grid
+		static double benchmark(unsigned nObjects = 4096, unsigned nLights = 512, unsigned nRuns = 3);
+
+		std::string getName() const								{ return "Light Assigner"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglLightAssigner_h_
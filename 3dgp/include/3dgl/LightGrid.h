@@ -0,0 +1,120 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Clustered point lights
+The view frustum is divided into clusters: screen tiles by logarithmic depth slices.
+Each frame, the lights are binned into the clusters on the CPU (bounding sphere vs
+cluster box, four clusters at a time with SSE2) and the light and index lists are
+uploaded to texture buffers. The fragment shader evaluates only the lights of its
+own cluster - see ClusteredLights in shaders/basic.frag.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglLightGrid_h_
+#define __3dglLightGrid_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+
+	struct POINT_LIGHT
+	{
+		glm::vec3 position;		// world coordinates
+		float radius;			// range - no light beyond it
+		glm::vec3 color;		// intensity included
+	};
+
+	class MY3DGL_API C3dglLightGrid : public C3dglObject
+	{
+		unsigned m_tilesX, m_tilesY, m_slices;
+		float m_near, m_far;
+		unsigned m_width, m_height;
+		glm::mat4 m_projection;
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		// cluster boxes in view space, structure of arrays, padded for SIMD; cluster = (slice * tilesY + y) * tilesX + x
+		std::vector<float> m_minX, m_minY, m_minZ, m_maxX, m_maxY, m_maxZ;
+		std::vector<std::vector<unsigned>> m_lists;		// light indices of each cluster
+
+		// data for the texture buffers
+		std::vector<glm::vec4> m_lightData;		// two texels per light: view space position and radius, colour
+		std::vector<GLuint> m_clusterData;		// offset and count of each cluster
+		std::vector<GLuint> m_indices;
+#pragma warning(pop)
+		GLuint m_idBuffers[3], m_idTextures[3];
+		size_t m_bufferSizes[3];
+
+		// statistics of the last build
+		unsigned m_nLights, m_nNonEmpty, m_maxPerCluster;
+		double m_buildTime;		// ms
+
+		unsigned getSlice(float depth) const;
+		void addLight(unsigned index, glm::vec3 center, float radius);
+
+	public:
+		C3dglLightGrid();
+		C3dglLightGrid(const C3dglLightGrid&) = delete;
+		~C3dglLightGrid()								{ destroy(); }
+
+		// Creates the texture buffers; the grid has tilesX x tilesY screen tiles and the given number of depth slices
+		bool create(unsigned tilesX = 16, unsigned tilesY = 9, unsigned slices = 24);
+		void destroy();
+
+		// Builds the cluster boxes - call whenever the projection or the viewport changes
+		void setProjection(glm::mat4 matrixProjection, float nearPlane, float farPlane, unsigned width, unsigned height);
+
+		// Bins the lights into the clusters (CPU only) - call once per frame, then upload
+		// With bBin false, only the light data is prepared - for the lights indexed in another way (see C3dglLightAssigner)
+		void build(glm::mat4 matrixView, const std::vector<POINT_LIGHT>& lights, bool bBin = true);
+		// Sends the light and index lists to the texture buffers
+		void upload();
+		// Binds the texture buffers to texUnit and the two following units, sends the grid parameters to the shader
+		// and switches the clustered lights on (clusteredLights = 1)
+		void bind(C3dglProgram* pProgram, GLenum texUnit = GL_TEXTURE4) const;
+
+		unsigned getClusterCount() const				{ return m_tilesX * m_tilesY * m_slices; }
+		unsigned getLightCount() const					{ return m_nLights; }
+		size_t getIndexCount() const					{ return m_indices.size(); }
+		unsigned getNonEmptyCount() const				{ return m_nNonEmpty; }
+		unsigned getMaxPerCluster() const				{ return m_maxPerCluster; }
+		double getBuildTime() const						{ return m_buildTime; }
+		// Light indices of a cluster, as built
+		const std::vector<unsigned>& getLights(unsigned x, unsigned y, unsigned slice) const { return m_lists[(slice * m_tilesY + y) * m_tilesX + x]; }
+
+		void stats() const;
+
+		std::string getName() const						{ return "Light Grid"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglLightGrid_h_
@@ -0,0 +1,99 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Implementation of a load-time profiler
+Collects the time spent in each stage of loading a model: file import, AssImp
+post-processing steps, vertex buffer preparation, GPU upload and texture decoding.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglLoadProfile_h_
+#define __3dglLoadProfile_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <map>
+#include <chrono>
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglLoadProfile
+	{
+		struct STAGE
+		{
+			std::string name;	// stage name
+			double ms;			// total time in milliseconds
+			unsigned calls;		// number of times the stage was measured
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<STAGE> m_stages;				// in order of first appearance
+		std::map<std::string, size_t> m_index;		// stage name => index in m_stages
+#pragma warning(pop)
+
+	public:
+		// clears all the measurements
+		void reset();
+		// adds time (in milliseconds) to the stage; new stages are created as needed
+		void add(std::string stage, double ms);
+
+		bool isEmpty() const						{ return m_stages.empty(); }
+		size_t getStageCount() const				{ return m_stages.size(); }
+		std::string getStageName(size_t i) const	{ return i < m_stages.size() ? m_stages[i].name : ""; }
+		double getStageTime(size_t i) const			{ return i < m_stages.size() ? m_stages[i].ms : 0; }
+		unsigned getStageCalls(size_t i) const		{ return i < m_stages.size() ? m_stages[i].calls : 0; }
+		double getTime(std::string stage) const;	// 0 if the stage was never measured
+		double getTotalTime() const;				// sum of all stages
+
+		// sends the table of stages to the logger
+		void stats() const;
+		// saves the table of stages as a JSON file
+		bool save(std::string filename, std::string name = "") const;
+	};
+
+	// Measures the time between its construction and destruction (or the call to stop) and adds it to the profile.
+	// If the profile is NULL, nothing is measured.
+	class C3dglProfileTimer
+	{
+		C3dglLoadProfile* m_pProfile;
+		std::string m_stage;
+		std::chrono::high_resolution_clock::time_point m_t0;
+
+	public:
+		C3dglProfileTimer(C3dglLoadProfile* pProfile, std::string stage) : m_pProfile(pProfile), m_stage(stage), m_t0(std::chrono::high_resolution_clock::now()) { }
+		~C3dglProfileTimer() { stop(); }
+
+		void stop()
+		{
+			if (m_pProfile)
+				m_pProfile->add(m_stage, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_t0).count());
+			m_pProfile = NULL;
+		}
+	};
+}; // namespace _3dgl
+
+#endif // __3dglLoadProfile_h_
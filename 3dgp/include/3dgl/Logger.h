@@ -51,6 +51,13 @@ namespace _3dgl
 		M3DGL_SUCCESS_VERIFICATION,
 		M3DGL_SUCCESS_LOADED,
 		M3DGL_SUCCESS_LOADED_FROM_EMBED_FILE,
+		M3DGL_SUCCESS_REUSED,							// resourcecache.cpp
+		M3DGL_SUCCESS_BAKED,							// assetpack.cpp
+		M3DGL_SUCCESS_LOADED_FROM_PACK,
+		M3DGL_SUCCESS_SAVED,
+		M3DGL_SUCCESS_LOADED_FROM_CACHE,				// texture.cpp
+		M3DGL_SUCCESS_TEXARRAY_CREATED,					// texturearray.cpp
+		M3DGL_SUCCESS_STREAMED,							// texturestreamer.cpp
 
 		// Warnings
 		M3DGL_WARNING_GENERIC = 200,
@@ -98,6 +105,19 @@ namespace _3dgl
 		M3DGL_WARNING_CANNOT_LOAD,					// bitmap.cpp
 		M3DGL_WARNING_CANNOT_LOAD_FROM_EMBED_FILE,
 		M3DGL_WARNING_EMBED_FILE_UNKNOWN_FORMAT,
+		M3DGL_WARNING_MTL_NOT_FOUND,					// objloader.cpp
+		M3DGL_WARNING_MATERIAL_NOT_FOUND,
+		M3DGL_WARNING_GEOMETRY_MISMATCH,				// scenecompare.cpp
+		M3DGL_WARNING_CANNOT_BAKE,						// assetpack.cpp
+		M3DGL_WARNING_MANIFEST_SYNTAX,
+		M3DGL_WARNING_STALE_ASSET,
+		M3DGL_WARNING_CANNOT_CACHE,						// texture.cpp
+		M3DGL_WARNING_FORMAT_NOT_SUPPORTED,
+		M3DGL_WARNING_CANNOT_FLIP,
+		M3DGL_WARNING_TEXARRAY_MISMATCH,				// texturearray.cpp
+		M3DGL_WARNING_CANNOT_STREAM,					// texturestreamer.cpp
+		M3DGL_WARNING_STREAMING_BUDGET,
+		M3DGL_WARNING_MEMORY_BUDGET,					// memorytracker.cpp
 
 		// Errors
 		M3DGL_ERROR_GENERIC = 500,
@@ -114,6 +134,14 @@ namespace _3dgl
 		M3DGL_ERROR_SHADER_NOT_CREATED,
 		M3DGL_ERROR_PROGRAM_NOT_CREATED,
 		M3DGL_ERROR_UNKNOWN_LINKING_ERROR,
+		M3DGL_ERROR_CANNOT_OPEN_FILE,					// objloader.cpp
+		M3DGL_ERROR_OBJ_PARSE,
+		M3DGL_ERROR_PACK_FORMAT,						// assetpack.cpp
+		M3DGL_ERROR_CANNOT_WRITE_FILE,
+		M3DGL_ERROR_TEXTURE_FILE,						// texturefile.cpp
+		M3DGL_ERROR_DDS_HEIGHT,
+		M3DGL_ERROR_FRAMEBUFFER,						// cubemaprenderer.cpp, deferredrenderer.cpp
+		M3DGL_ERROR_CUBEMAP_FACES,						// skybox.cpp
 
 		M3DGL_INTERNAL_ERROR
 	};
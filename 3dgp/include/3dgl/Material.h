@@ -42,6 +42,7 @@ namespace _3dgl
 {
 	class C3dglProgram;
 	class C3dglModel;
+	class C3dglTextureArray;
 
 	class MY3DGL_API C3dglMaterial
 	{
@@ -51,6 +52,8 @@ namespace _3dgl
 
 		// texture id
 		unsigned m_idTexture[GL_TEXTURE31 - GL_TEXTURE0 + 1];
+		unsigned char m_units[GL_TEXTURE31 - GL_TEXTURE0 + 1];	// the texture units populated, in ascending order
+		unsigned m_nUnits;
 
 		// materials
 		bool m_bAmb, m_bDiff, m_bSpec, m_bEmiss, m_bShininess;
@@ -58,10 +61,17 @@ namespace _3dgl
 		float m_shininess;
 		mutable glm::vec3 m_back_amb, m_back_diff, m_back_spec, m_back_emiss;
 		mutable float m_back_shininess;
-		mutable unsigned m_back_idTexture[GL_TEXTURE31 - GL_TEXTURE0 + 1];
+
+		// location of the GL_TEXTURE0 texture in a texture array (layer -1 if none)
+		float m_texLayer;
+		glm::vec4 m_texRegion;
+		mutable float m_back_texLayer;
+		mutable glm::vec4 m_back_texRegion;
 
 		static unsigned c_idTexBlank;
 
+		void updateUnits();
+
 	public:
 		C3dglMaterial(C3dglModel *pOwner);
 		void create(const aiMaterial* pMat, const char* pDefTexPath);
@@ -70,6 +80,19 @@ namespace _3dgl
 		void render(C3dglProgram*) const;
 		void postRender(C3dglProgram*) const;
 
+		// Texture binding cache. Between beginBatch and endBatch (C3dglModel::render makes a batch) the bindings are tracked,
+		// only the texture units which change are bound - with a single glBindTextures call where available - and the bindings
+		// found at beginBatch are restored at endBatch rather than after each material. Outside a batch, postRender restores them.
+		// Do not bind 2D textures with OpenGL calls inside a batch.
+		static void beginBatch();
+		static void endBatch();
+
+		// Counters of 2D texture bindings: requested by the materials (all bound and restored one by one without the cache)
+		// and actually sent to OpenGL (glBindTexture and glBindTextures calls)
+		static size_t getBindRequestCount();
+		static size_t getBindCallCount();
+		static void resetBindCounters();
+
 		bool getAmbient(glm::vec3& val)	const	{ if (!m_bAmb) return false; val = m_amb; return true;  }
 		bool getDiffuse(glm::vec3& val)	const	{ if (!m_bDiff) return false; val = m_diff; return true; }
 		bool getSpecular(glm::vec3& val) const	{ if (!m_bSpec) return false; val = m_spec; return true; }
@@ -91,6 +114,11 @@ namespace _3dgl
 		void setEmissive(glm::vec3 colour)	{ m_bEmiss = true; m_emiss = colour; }
 		void setShininess(float s)			{ m_bShininess = true; m_shininess = s; }
 
+		// If the GL_TEXTURE0 texture is found in the array, it is not bound while rendering with a program
+		// which declares the textureLayer uniform: the layer and the region are sent instead. NULL to detach.
+		void setTextureArray(const C3dglTextureArray* pArray);
+		bool getTextureLayer(float& layer) const	{ if (m_texLayer < 0) return false; layer = m_texLayer; return true; }
+
 		void loadTexture(GLenum texUnit, std::string strPath);
 		void loadTexture(GLenum texUnit, std::string strTexRootPath, std::string strPath);
 		void loadTexture(GLenum texUnit, const aiTexture* pTexture);
@@ -0,0 +1,120 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+GPU memory accounting
+Every buffer and texture created by the library is registered with its size, format,
+owner and category. The table may be queried at runtime (totals, the largest resources),
+exported as JSON or CSV, and a warning is logged when the total exceeds the budget.
+Sizes are calculated from the dimensions and formats; the driver may use more.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglMemoryTracker_h_
+#define __3dglMemoryTracker_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <map>
+#include <vector>
+
+namespace _3dgl
+{
+	enum MEM_CATEGORY
+	{
+		MEM_VERTEX_BUFFER,
+		MEM_INDEX_BUFFER,
+		MEM_DATA_BUFFER,		// texture buffers and other shader data
+		MEM_TEXTURE,			// textures from this one on share the OpenGL texture names
+		MEM_TEXTURE_ARRAY,
+		MEM_CUBE_MAP,
+		MEM_STREAMED_TEXTURE,
+		MEM_CATEGORY_COUNT
+	};
+
+	struct MEM_RESOURCE
+	{
+		MEM_CATEGORY category;
+		GLuint id;				// OpenGL buffer or texture name
+		size_t bytes;
+		GLenum format;			// internal format of textures, data type of buffers
+		std::string owner;		// name of the object that created the resource
+	};
+
+	class MY3DGL_API C3dglMemoryTracker : public C3dglObject
+	{
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::map<std::pair<bool, GLuint>, MEM_RESOURCE> m_resources;	// (texture?, name) => resource
+#pragma warning(pop)
+		size_t m_totals[MEM_CATEGORY_COUNT] = { };
+		size_t m_total = 0;
+		size_t m_peak = 0;
+		size_t m_budget = 0;
+		bool m_bOverBudget = false;
+
+		C3dglMemoryTracker() : C3dglObject() { }
+		C3dglMemoryTracker(const C3dglMemoryTracker&) = delete;
+
+		void checkBudget();
+
+	public:
+		static C3dglMemoryTracker& getInstance();
+
+		// Registers a buffer or a texture; if already registered, its size (and the other data) is updated
+		void add(MEM_CATEGORY category, GLuint id, size_t bytes, GLenum format, std::string owner);
+		// Unregisters the resource - call when deleted. Returns false if not registered
+		bool remove(MEM_CATEGORY category, GLuint id);
+		// Size of a registered resource, or 0
+		size_t getSize(MEM_CATEGORY category, GLuint id) const;
+
+		// Totals
+		size_t getTotal() const							{ return m_total; }
+		size_t getTotal(MEM_CATEGORY category) const	{ return m_totals[category]; }
+		size_t getPeak() const							{ return m_peak; }
+		size_t getCount() const							{ return m_resources.size(); }
+		// The n largest resources, largest first
+		std::vector<MEM_RESOURCE> getTop(size_t n) const;
+
+		// Budget, in bytes; 0 = no budget. A warning is logged each time the total exceeds it.
+		void setBudget(size_t budget)					{ m_budget = budget; checkBudget(); }
+		size_t getBudget() const						{ return m_budget; }
+
+		// Export of the whole table, largest resources first
+		bool exportJSON(std::string filename) const;
+		bool exportCSV(std::string filename) const;
+
+		// Size of a texture of the given internal format (GL_RGBA8, GL_DEPTH_COMPONENT24 or block compressed), with all its levels and layers
+		static size_t getTextureSize(GLenum format, unsigned width, unsigned height, unsigned levels = 1, unsigned layers = 1);
+		static std::string getCategoryName(MEM_CATEGORY category);
+		static std::string getFormatName(GLenum format);
+
+		// Logs the totals per category and the nTop largest resources
+		void stats(size_t nTop = 10) const;
+
+		std::string getName() const						{ return "Memory Tracker"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglMemoryTracker_h_
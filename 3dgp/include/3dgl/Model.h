@@ -42,15 +42,18 @@ freely, subject to the following restrictions:
 #include "Material.h"
 #include "Mesh.h"
 #include "Animation.h"
+#include "LoadProfile.h"
 
 // standard libraries
 #include <vector>
 #include <map>
 
 #include "../glm/mat4x4.hpp"
+#include "../assimp/postprocess.h"
 
 struct aiScene;
 struct aiNode;
+namespace Assimp { class Importer; }
 
 namespace _3dgl
 {
@@ -59,8 +62,13 @@ namespace _3dgl
 	class MY3DGL_API C3dglModel : public C3dglObject
 	{
 		const aiScene* m_pScene;					// parent scene (the main AssImp object)
+		Assimp::Importer* m_pImporter;				// AssImp importer; if not NULL, it owns m_pScene
 		std::string m_name;							// model name (derived from the filename)
 		bool m_bFBXImportPreservePivots;			// binary flag needed to tweak some quirky effects in AssImp FBX importer. Should be set to false
+		bool m_bNativeOBJImport;					// if true, OBJ files are loaded with the native C3dglObjLoader rather than AssImp
+		bool m_bNativeScene;						// true if m_pScene was created by C3dglObjLoader
+		bool m_bPackedScene;						// true if m_pScene was created by C3dglAssetPack
+		C3dglLoadProfile m_profile;					// time spent in each stage of loading
 
 		// vectrors of meshes, materials and animations
 #pragma warning(push)
@@ -76,6 +84,18 @@ namespace _3dgl
 #pragma warning(pop)
 
 	public:
+		// Import profiles: sets of AssImp post-processing flags to be passed to the load function.
+		// IMPORT_FAST and IMPORT_BALANCED skip the steps that only repair or reorganise data; use validateImportFlags
+		// to check if a model renders the same as with IMPORT_MAX (the default).
+		enum : unsigned
+		{
+			IMPORT_FAST = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace
+				| aiProcess_SortByPType | aiProcess_LimitBoneWeights,
+			IMPORT_BALANCED = IMPORT_FAST | aiProcess_ImproveCacheLocality | aiProcess_RemoveRedundantMaterials | aiProcess_GenUVCoords
+				| aiProcess_TransformUVCoords,
+			IMPORT_MAX = aiProcessPreset_TargetRealtime_MaxQuality
+		};
+
 		C3dglModel();
 		~C3dglModel() { destroy(); }
 
@@ -100,6 +120,21 @@ namespace _3dgl
 		bool getFBXImportPreservePivotsFlag() const	 { return m_bFBXImportPreservePivots; }
 		void setFBXImportPreservePivotsFlag(bool b)	 { m_bFBXImportPreservePivots = b; }
 
+		// Controls the native OBJ loader (see C3dglObjLoader). By default set to true. If false, or if the load flags are not
+		// supported by the native loader, OBJ files are imported with AssImp - this includes the default flags (IMPORT_MAX);
+		// pass C3dglObjLoader::c_defaultFlags to use the native loader. Note: this flag should be set before calling load funcion!
+		bool getNativeOBJImportFlag() const			 { return m_bNativeOBJImport; }
+		void setNativeOBJImportFlag(bool b)			 { m_bNativeOBJImport = b; }
+
+		// Load profile: time spent in each stage of load, create and loadMaterials. Also reported by stats.
+		// Call getLoadProfile().save(filename) to save it as a JSON file.
+		C3dglLoadProfile& getLoadProfile()				{ return m_profile; }
+		const C3dglLoadProfile& getLoadProfile() const	{ return m_profile; }
+
+		// Imports the file with both sets of flags and compares the geometry of each main node.
+		// Returns true if both versions render the same. The detailed report is sent to the logger.
+		static bool validateImportFlags(const char* filename, unsigned flags, unsigned referenceFlags = IMPORT_MAX);
+
 		// Rendering
 		// render the entire model
 		void render(glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL) const;
@@ -122,6 +157,7 @@ namespace _3dgl
 		bool hasMeshes() const						{ return m_meshes.size() > 0; }
 		size_t getMeshCount() const					{ return m_meshes.size(); }
 		C3dglMesh *getMesh(size_t i)				{ return (i < m_meshes.size()) ? &m_meshes[i] : NULL; }
+		const C3dglMesh *getMesh(size_t i) const	{ return (i < m_meshes.size()) ? &m_meshes[i] : NULL; }
 		size_t getMeshIndex(const C3dglMesh* p) const { return p - &m_meshes[0]; }
 		size_t createNewMesh()						{ size_t nIndex = m_meshes.size(); m_meshes.push_back(C3dglMesh(this)); return nIndex; }
 
@@ -129,8 +165,11 @@ namespace _3dgl
 		bool hasMaterials() const					{ return m_materials.size() > 0; }
 		size_t getMaterialCount() const				{ return m_materials.size(); }
 		C3dglMaterial *getMaterial(size_t i)		{ return (i < m_materials.size()) ? &m_materials[i] : NULL; }
+		const C3dglMaterial *getMaterial(size_t i) const	{ return (i < m_materials.size()) ? &m_materials[i] : NULL; }
 		size_t getMaterialIndex(C3dglMaterial* p) const { return p - &m_materials[0]; }
 		size_t createNewMaterial()					{ size_t nIndex = m_materials.size(); m_materials.push_back(C3dglMaterial(this)); return nIndex; }
+		// attaches all materials to the texture array (see C3dglTextureArray); NULL to detach
+		void setTextureArray(const C3dglTextureArray* pArray)	{ for (C3dglMaterial& material : m_materials) material.setTextureArray(pArray); }
 
 		// Animation functions
 		bool hasAnimations()  const					{ return m_animations.size() > 0; }
@@ -0,0 +1,82 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Implementation of a native Wavefront OBJ/MTL loader
+Used by C3dglModel::load as a fast path for .obj files. The file is memory-mapped,
+split into line-aligned chunks and parsed in parallel. The result is an AssImp
+scene with the same node, mesh and material layout as the AssImp OBJ importer
+would produce, so that it can be passed directly to C3dglModel::create.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglObjLoader_h_
+#define __3dglObjLoader_h_
+
+#include "Object.h"
+
+struct aiScene;
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglObjLoader : public C3dglObject
+	{
+		std::string m_name;		// model name (derived from the filename)
+		unsigned m_nThreads;	// number of worker threads, 0 = all hardware threads
+
+	public:
+		C3dglObjLoader(unsigned nThreads = 0) : C3dglObject(), m_nThreads(nThreads) { }
+
+		// AssImp post-processing flags honoured by the native loader. Triangulation is always performed. Any other flag
+		// (e.g. the optimisation steps of aiProcessPreset_TargetRealtime_MaxQuality) makes C3dglModel::load use AssImp.
+		// Remaining differences from AssImp: degenerate triangles are always dropped, rather than turned into lines
+		// and points with aiProcess_FindDegenerates; points and lines are not loaded; smooth normals have no smoothing
+		// angle limit, which is the case with AssImp's default limit (175 degrees) only.
+		static const unsigned c_supportedFlags;
+		// Used when the flags are 0: aiProcessPreset_TargetRealtime_MaxQuality without the steps the loader does not support
+		static const unsigned c_defaultFlags;
+
+		// true if the file is an OBJ file and all the flags are supported by the native loader
+		static bool canLoad(const char* filename, unsigned flags);
+
+		// Loads the OBJ file and returns an AssImp scene, or NULL if failed.
+		// The scene must be destroyed with C3dglObjLoader::release - never with aiReleaseImport!
+		const aiScene* load(const char* filename, unsigned flags = 0);
+		static void release(const aiScene* pScene);
+
+		// Diagnostics
+		// Loads the file with both the native loader and AssImp and compares the geometry of each main node.
+		// Returns true if both versions match. The detailed report is sent to the logger.
+		static bool compare(const char* filename, unsigned flags = 0);
+		// Measures the throughput of the native loader (multi- and single-threaded) and AssImp.
+		// Returns the throughput of the native loader in MB/s. The detailed report is sent to the logger.
+		static double benchmark(const char* filename, unsigned flags = 0, unsigned nRuns = 3);
+
+		unsigned getThreadCount() const		{ return m_nThreads; }
+		void setThreadCount(unsigned n)		{ m_nThreads = n; }
+
+		std::string getName() const			{ return "OBJ Loader \"" + m_name + "\""; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglObjLoader_h_
@@ -0,0 +1,79 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Procedural primitives: sphere, cube, cone, torus, plane and teapot.
+The geometry is generated once and stored in a VAO, with normals, texture coords,
+tangents and bitangents, and rendered like any other mesh.
+Usage:
+createXxx to generate the geometry (once, after the shader program is linked)
+render to render the primitive
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglPrimitive_h_
+#define __3dglPrimitive_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "VAO.h"
+
+namespace _3dgl
+{
+	class C3dglProgram;
+
+	class MY3DGL_API C3dglPrimitive : public C3dglVertexAttrObject
+	{
+		std::string m_name;			// primitive name, e.g. "sphere"
+		glm::vec3 m_aabb[2];		// bounding box
+
+	protected:
+		// creates the VAO from the vertex attributes (extended set) and the triangle index buffer
+		void create(std::string name, size_t nVertices, float** attrData, size_t nIndices, GLuint* indexData, C3dglProgram* pProgram);
+
+	public:
+		C3dglPrimitive();
+		virtual ~C3dglPrimitive() { destroy(); }
+
+		// All primitives are centred at the origin, with the Y axis pointing up, unless stated otherwise.
+		// Sphere: slices around the Y axis, stacks from the south to the north pole
+		void createSphere(float radius = 1, unsigned slices = 32, unsigned stacks = 32, C3dglProgram* pProgram = NULL);
+		// Cube: each face has its own vertices, texture coords cover each face
+		void createCube(float size = 1, C3dglProgram* pProgram = NULL);
+		// Cone: base at y = 0, apex at y = height; the base is closed
+		void createCone(float base = 1, float height = 1, unsigned slices = 32, unsigned stacks = 8, C3dglProgram* pProgram = NULL);
+		// Torus: lies in the XZ plane; innerRadius is the radius of the tube, outerRadius - the distance from the centre to the tube axis
+		void createTorus(float innerRadius = 0.25f, float outerRadius = 1, unsigned sides = 16, unsigned rings = 32, C3dglProgram* pProgram = NULL);
+		// Plane: lies in the XZ plane, facing up; texture coords span [0..1]
+		void createPlane(float sizeX = 1, float sizeZ = 1, unsigned divX = 1, unsigned divZ = 1, C3dglProgram* pProgram = NULL);
+		// Utah teapot: the same size and orientation as glutSolidTeapot; grid = subdivisions of each Bezier patch
+		void createTeapot(float size = 1, unsigned grid = 10, C3dglProgram* pProgram = NULL);
+
+		void getAABB(glm::vec3 aabb[2]) const	{ aabb[0] = m_aabb[0]; aabb[1] = m_aabb[1]; }
+
+		std::string getName() const				{ return "Primitive (" + m_name + ")"; }
+	};
+}; // namespace _3dgl
+
+#endif
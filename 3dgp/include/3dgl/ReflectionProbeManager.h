@@ -0,0 +1,122 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Reflection probes
+Static probes are captured once and cached on disk with their whole mip chain, so
+that static environments cost no capture at all in the following runs. Dynamic
+probes are captured as often as their update policy says (see C3dglCubeMapRenderer).
+Each reflective object uses the nearest probe, or a blend of the two nearest ones,
+and the shader corrects the reflection vector for the parallax within the box of
+the probe (box projection).
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglReflectionProbeManager_h_
+#define __3dglReflectionProbeManager_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+#include "CubeMapRenderer.h"
+
+// standard libraries
+#include <vector>
+#include <memory>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+
+	enum PROBE_TYPE { PROBE_STATIC, PROBE_DYNAMIC };
+
+	class MY3DGL_API C3dglReflectionProbeManager : public C3dglObject
+	{
+		struct PROBE
+		{
+			PROBE_TYPE type;
+			std::string name;			// static probes: the cache file name
+			glm::vec3 position;
+			glm::vec3 boxMin, boxMax;	// the influence and parallax box; an empty box means an infinitely distant environment
+			bool bReady;				// static probes: baked or loaded from the cache
+			std::shared_ptr<C3dglCubeMapRenderer> pRenderer;
+		};
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<PROBE> m_probes;
+#pragma warning(pop)
+		bool m_bBlending;
+		unsigned m_nBaked, m_nLoaded;
+
+		bool contains(const PROBE& probe, glm::vec3 position) const;
+		std::string getCacheFilename(const PROBE& probe) const;
+		void send(C3dglProgram* pProgram, unsigned probe, std::string uniform, std::string sampler, GLenum texUnit) const;
+
+	public:
+		C3dglReflectionProbeManager();
+		C3dglReflectionProbeManager(const C3dglReflectionProbeManager&) = delete;
+
+		// Adds a probe; returns its index, or (unsigned)-1 if the cube map could not be created.
+		// Static probes are cached in the texture cache directory (see C3dglTexture::setCacheDirectory) under their name.
+		unsigned addStatic(std::string name, glm::vec3 position, glm::vec3 boxMin = glm::vec3(0), glm::vec3 boxMax = glm::vec3(0), unsigned size = 256);
+		unsigned addDynamic(glm::vec3 position, glm::vec3 boxMin = glm::vec3(0), glm::vec3 boxMax = glm::vec3(0), unsigned size = 256);
+		void destroy();
+
+		size_t getCount() const										{ return m_probes.size(); }
+		PROBE_TYPE getType(unsigned probe) const					{ return m_probes[probe].type; }
+		glm::vec3 getPosition(unsigned probe) const					{ return m_probes[probe].position; }
+		// the cube map renderer of the probe - e.g. to set the update policy of a dynamic probe
+		C3dglCubeMapRenderer& getRenderer(unsigned probe)			{ return *m_probes[probe].pRenderer; }
+
+		// Static probes are baked again in the next update (and cached again)
+		void rebake(unsigned probe)									{ m_probes[probe].bReady = false; }
+		void rebake();
+		// Forwarded to the dynamic probes - call when a moving object changes its transform
+		void invalidate(glm::vec3 center, float radius);
+
+		// Captures the probes which need it: the dynamic ones, and the static ones neither baked nor found in the cache.
+		// capture should render the scene into the renderer (see C3dglCubeMapRenderer::render and renderLayered), from the given position.
+		void update(std::function<void(C3dglCubeMapRenderer& renderer, glm::vec3 position)> capture);
+
+		// Blending of the two nearest probes. If disabled, the nearest probe is always used alone.
+		void setBlending(bool bBlending)							{ m_bBlending = bBlending; }
+		bool isBlending() const										{ return m_bBlending; }
+
+		// Selects the probes for an object at the given position: the nearest of the probes whose boxes contain it (or of all the probes,
+		// if none does), and the second nearest, with its blend weight (0 if not blended). Returns false if there are no probes.
+		bool select(glm::vec3 position, unsigned& probe1, unsigned& probe2, float& blend) const;
+
+		// Binds the probes selected for the position and sends them to the shader: textureCubeMap and probe1 (on texUnit1),
+		// textureCubeMap2 and probe2 (on texUnit2), and probeBlend. See shaders/basic.frag.
+		bool bind(C3dglProgram* pProgram, glm::vec3 position, GLenum texUnit1 = GL_TEXTURE1, GLenum texUnit2 = GL_TEXTURE3) const;
+		// Binds a single probe, not blended
+		void bind(C3dglProgram* pProgram, unsigned probe, GLenum texUnit1 = GL_TEXTURE1) const;
+
+		void stats() const;
+
+		std::string getName() const									{ return "Reflection Probe Manager"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglReflectionProbeManager_h_
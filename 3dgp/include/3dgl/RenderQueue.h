@@ -0,0 +1,152 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Render queue
+Draws are submitted as packets with a 64-bit sort key - pass, program, material,
+texture set, mesh and depth (front to back), most significant first - radix-sorted
+and executed so that the program and the material are changed only where the key
+changes. The state changes of the sorted order are counted against the ones the
+submission order would have caused.
+With instancing on, the draws which come with their model-view matrix and share
+the whole key but the depth are collapsed into one instanced draw. Their matrices
+and colours are streamed through a texture buffer, refilled at each execute, and
+read by the vertex shader from instanceBase (see basic.vert).
+See also C3dglScene::render.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglRenderQueue_h_
+#define __3dglRenderQueue_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+	class C3dglMaterial;
+
+	// Fields of the sort key: changes of the state they stand for
+	enum RENDER_STATE { STATE_PROGRAM, STATE_MATERIAL, STATE_TEXTURES, STATE_MESH, STATE_COUNT };
+
+	class MY3DGL_API C3dglRenderQueue : public C3dglObject
+	{
+		struct PACKET
+		{
+			unsigned long long key;
+			C3dglProgram* pProgram;
+			const C3dglMaterial* pMaterial;
+			unsigned item;
+			int instance;				// index of the instance data, -1 if not to be instanced
+			unsigned state[STATE_COUNT];	// the key fields in full - they may not fit in the key
+		};
+
+		// six texels of the instance buffer: model-view matrix, diffuse and emissive colour (w = 0 if not set by the material)
+		struct INSTANCE
+		{
+			glm::mat4 matrixModelView;
+			glm::vec4 diffuse, emissive;
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<PACKET> m_packets;
+		std::vector<unsigned long long> m_keys;				// radix sort buffers: key and packet index
+		std::vector<unsigned> m_order, m_temp;
+		std::vector<INSTANCE> m_instances, m_stream;		// as submitted, in the sorted order
+
+		// dictionaries of the key fields; programs, material values and texture sets keep their indices from frame to frame
+		std::unordered_map<const C3dglProgram*, unsigned> m_programs;
+		std::map<std::vector<float>, unsigned> m_materialValues;
+		std::map<std::vector<unsigned>, unsigned> m_textureSets;
+		// this frame: material => values, texture set; [1] for the instanced draws - without the colours streamed per instance
+		std::unordered_map<const C3dglMaterial*, std::pair<unsigned, unsigned>> m_materials[2];
+		std::map<std::pair<const void*, int>, unsigned> m_meshes;							// this frame
+#pragma warning(pop)
+
+		// instancing
+		bool m_bInstancing;
+		GLenum m_instanceUnit;
+		GLuint m_idBuffer, m_idTexture;
+		size_t m_bufferSize;
+
+		// statistics of the last execute
+		size_t m_nPackets;
+		size_t m_nDraws, m_nInstancedDraws, m_nInstanced;
+		size_t m_changesSubmitted[STATE_COUNT], m_changesSorted[STATE_COUNT];
+		double m_sortTime;		// ms
+
+		void sort();
+		void upload();
+		static bool sameState(const PACKET& a, const PACKET& b, unsigned long long mask, unsigned nStates);
+		static void countChanges(const std::vector<unsigned long long>& keys, const std::vector<unsigned>& order, size_t changes[STATE_COUNT]);
+
+	public:
+		C3dglRenderQueue();
+		~C3dglRenderQueue()									{ destroy(); }
+
+		// Releases the instance buffer
+		void destroy();
+
+		// Instancing: the instance data is bound to texUnit, sent as the instanceData sampler
+		void setInstancing(bool bInstancing, GLenum texUnit = GL_TEXTURE11)	{ m_bInstancing = bInstancing; m_instanceUnit = texUnit; }
+		bool isInstancing() const							{ return m_bInstancing; }
+
+		// Starts a new frame (or pass) - removes all packets
+		void clear();
+
+		// Submits a draw: item is passed back to the draw function at execute. pMaterial may be NULL, mesh identifies the vertex data:
+		// an object (a VAO, model etc.) and its part (e.g. a main node of the model, -1 for all of it). depth is the view space distance.
+		// Draws of the lower passes are executed first.
+		// If pMatrixModelView is given and instancing is on, the draw may be instanced (pProgram must read the instance data).
+		void submit(unsigned pass, C3dglProgram* pProgram, const C3dglMaterial* pMaterial, std::pair<const void*, int> mesh, float depth, unsigned item,
+			const glm::mat4* pMatrixModelView = NULL);
+
+		// Sorts the packets and executes them: the program is used and the material is sent (and restored after) only where they change.
+		// draw is called with instances = 0 to render the item with its own matrix, or instances > 0 to render instances of it
+		// with the identity matrix - the model-view matrices of the items collapsed into the draw are streamed to the shader.
+		void execute(std::function<void(unsigned item, GLsizei instances)> draw);
+
+		// Statistics
+		size_t getPacketCount() const						{ return m_nPackets; }
+		size_t getDrawCount() const							{ return m_nDraws; }
+		size_t getChangesSubmitted(RENDER_STATE state) const	{ return m_changesSubmitted[state]; }
+		size_t getChangesSorted(RENDER_STATE state) const	{ return m_changesSorted[state]; }
+		size_t getChangesSaved() const;
+		double getSortTime() const							{ return m_sortTime; }
+		void stats() const;
+
+		std::string getName() const							{ return "Render Queue"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglRenderQueue_h_
@@ -0,0 +1,115 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Implementation of a reference-counted resource cache
+Models, textures and shader programs loaded through the cache are identified
+by their canonical file path and the load flags. Repeated requests for the same
+resource return a shared handle instead of loading it again.
+Note that C3dglModel keeps no per-instance state: transforms and animation times
+are passed to the render and getAnimData functions, so it is safe to share.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglResourceCache_h_
+#define __3dglResourceCache_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <map>
+#include <memory>
+
+namespace _3dgl
+{
+	class C3dglModel;
+	class C3dglProgram;
+	class C3dglLoadProfile;
+
+	class MY3DGL_API C3dglResourceCache : public C3dglObject
+	{
+		struct TEXTURE
+		{
+			GLuint id;				// OpenGL texture id
+			unsigned refCount;		// number of handles given out
+			size_t bytes;			// estimated size in the GPU memory
+		};
+
+		template<class T> struct SHARED
+		{
+			std::weak_ptr<T> ptr;	// shared resource - expires when the last handle is released
+			size_t bytes;			// estimated size in the GPU memory
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::map<std::string, SHARED<C3dglModel> > m_models;		// key => model
+		std::map<std::string, SHARED<C3dglProgram> > m_programs;	// key => program
+		std::map<std::string, TEXTURE> m_textures;					// key => texture
+		std::map<GLuint, std::string> m_textureKeys;				// texture id => key
+#pragma warning(pop)
+
+		// statistics
+		size_t m_nLoads = 0;		// number of resources actually loaded
+		size_t m_nHits = 0;			// number of requests served from the cache
+		size_t m_nBytesSaved = 0;	// total size of all the duplicates that were not created
+
+		C3dglResourceCache() : C3dglObject() { }
+		C3dglResourceCache(const C3dglResourceCache&) = delete;
+
+	public:
+		static C3dglResourceCache& getInstance();
+
+		// Builds a cache key from the filename and load flags. The filename is converted to its canonical form,
+		// so that "models\\lamp.obj" and "./models/lamp.obj" are recognised as the same file.
+		static std::string getKey(std::string filename, unsigned flags = 0);
+
+		// Models
+		// Returns a shared model. If the model has been loaded with the same flags and shader program,
+		// the existing model is returned. Returns an empty pointer if loading failed.
+		// Call loadMaterials or loadAnimations on the returned model only if hasMaterials/hasAnimations is false.
+		std::shared_ptr<C3dglModel> getModel(std::string filename, unsigned flags = 0, C3dglProgram* pProgram = NULL);
+
+		// Textures
+		// Loads or reuses a 2D texture. The texture is valid until each call to acquireTexture is matched by a call to releaseTexture.
+		// If pProfile is given, the time of decoding and uploading the texture is added to it.
+		bool acquireTexture(std::string filename, GLuint& idTex, C3dglLoadProfile* pProfile = NULL);
+		// Releases the texture; returns false if the texture was not created by the cache (it should be then destroyed by the caller)
+		bool releaseTexture(GLuint idTex);
+
+		// Programs
+		// Returns a shared program, compiled from the given vertex and fragment shader files and linked.
+		// The program is not activated - call use() when appropriate. Returns an empty pointer if any of the stages failed.
+		std::shared_ptr<C3dglProgram> getProgram(std::string vertexShader, std::string fragmentShader, std::string std_attrib_names = "", std::string std_uni_names = "");
+
+		// Statistics
+		size_t getLoadCount() const		{ return m_nLoads; }
+		size_t getHitCount() const		{ return m_nHits; }
+		size_t getBytesSaved() const	{ return m_nBytesSaved; }
+		void stats() const;
+
+		std::string getName() const		{ return "Resource Cache"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglResourceCache_h_
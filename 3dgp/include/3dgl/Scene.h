@@ -0,0 +1,189 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Retained scene graph
+A hierarchy of nodes, each with its local position, rotation and scale, and
+optionally something to render: a model (or one of its main nodes), a primitive
+or a rendering function, with its own material and uniforms. The world matrices
+and bounding boxes are cached: changing a node marks it dirty, and update()
+recomputes the subtrees of the dirty nodes only - static nodes cost nothing.
+render() multiplies each world matrix by the view matrix once per view.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglScene_h_
+#define __3dglScene_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+#include "../glm/gtc/quaternion.hpp"
+
+#include "Object.h"
+#include "Material.h"
+
+// standard libraries
+#include <vector>
+#include <functional>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+	class C3dglModel;
+	class C3dglPrimitive;
+	class C3dglRenderQueue;
+
+	class MY3DGL_API C3dglScene : public C3dglObject
+	{
+		struct NODE
+		{
+			int parent;
+#pragma warning(push)
+#pragma warning(disable: 4251)
+			std::vector<unsigned> children;
+
+			// local transform: translate * rotate * scale
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+			bool bDirty;					// the local transform has changed since the last update
+
+			// cached
+			glm::mat4 world;
+			glm::vec3 aabb[2];				// local box; empty (min > max) if nothing to render
+			glm::vec3 worldAABB[2];
+			glm::vec3 changedAABB[2];		// the world boxes before and after the last update of the node, together
+
+			// what to render
+			const C3dglModel* pModel;
+			int iModelNode;					// main node of the model, or -1 for the whole model
+			const C3dglPrimitive* pPrimitive;
+			std::function<void(glm::mat4 matrixModelView)> render;
+			C3dglMaterial material;
+			bool bMaterial;
+			std::vector<std::pair<std::string, float>> floats;
+			std::vector<std::pair<std::string, glm::vec3>> vec3s;
+#pragma warning(pop)
+			bool bDynamic;
+			bool bVisible;
+
+			NODE(int parent);
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<NODE> m_nodes;
+		std::vector<unsigned> m_dirty;			// the nodes marked dirty since the last update
+		std::vector<unsigned> m_updated;		// the nodes whose world matrices were recomputed in the last update
+		// values of the per-object uniforms to restore after each node
+		mutable std::vector<float> m_backFloats;
+		mutable std::vector<glm::vec3> m_backVec3s;
+#pragma warning(pop)
+
+		// statistics
+		size_t m_nUpdated, m_nUpdates;			// world matrices recomputed: in the last update, in total
+		mutable size_t m_nRendered;				// nodes rendered since the last update
+
+		unsigned addNode(int parent, const glm::vec3* aabb);
+		void markDirty(unsigned node);
+		void updateSubtree(unsigned node);
+		void draw(unsigned node, glm::mat4 matrixModelView, C3dglProgram* pProgram, bool bMaterial, GLsizei instances = 1) const;
+
+	public:
+		C3dglScene();
+		C3dglScene(const C3dglScene&) = delete;
+		~C3dglScene()												{ destroy(); }
+
+		// Releases the textures of the node materials and removes all nodes
+		void destroy();
+
+		// Add nodes - return the node id. The parent must be added before its children; -1 for no parent.
+		// The models and the primitives are not owned by the scene - they must outlive it.
+		unsigned addNode(int parent = -1)							{ return addNode(parent, NULL); }
+		unsigned addModel(const C3dglModel* pModel, int iModelNode = -1, int parent = -1);
+		unsigned addPrimitive(const C3dglPrimitive* pPrimitive, int parent = -1);
+		// Rendered by a function (e.g. with plain OpenGL calls), called with the model-view matrix; aabb is the local bounding box
+		unsigned addFunction(std::function<void(glm::mat4 matrixModelView)> render, glm::vec3 aabb[2], int parent = -1);
+
+		// Local transform; the world matrices are updated by update()
+		void setPosition(unsigned node, glm::vec3 position);
+		void setRotation(unsigned node, glm::quat rotation);
+		void setRotation(unsigned node, float angle, glm::vec3 axis)	{ setRotation(node, glm::angleAxis(angle, glm::normalize(axis))); }
+		void setScale(unsigned node, glm::vec3 scale);
+		void setScale(unsigned node, float scale)					{ setScale(node, glm::vec3(scale)); }
+		void setTransform(unsigned node, glm::vec3 position, glm::quat rotation, glm::vec3 scale);
+
+		glm::vec3 getPosition(unsigned node) const					{ return m_nodes[node].position; }
+		glm::quat getRotation(unsigned node) const					{ return m_nodes[node].rotation; }
+		glm::vec3 getScale(unsigned node) const						{ return m_nodes[node].scale; }
+
+		// The material is sent before the node is rendered and restored after it (see C3dglMaterial); the textures belong to the scene
+		C3dglMaterial& getMaterial(unsigned node)					{ m_nodes[node].bMaterial = true; return m_nodes[node].material; }
+
+		// Per-object uniforms: sent before the node is rendered and restored after it
+		void setUniform(unsigned node, std::string name, float value);
+		void setUniform(unsigned node, std::string name, glm::vec3 value);
+
+		// Dynamic nodes are expected to move - a hint for the passes which cache static objects (e.g. shadows)
+		void setDynamic(unsigned node, bool bDynamic = true)		{ m_nodes[node].bDynamic = bDynamic; }
+		bool isDynamic(unsigned node) const							{ return m_nodes[node].bDynamic; }
+
+		// Hidden nodes are not rendered (their children are, unless hidden too)
+		void setVisible(unsigned node, bool bVisible = true)		{ m_nodes[node].bVisible = bVisible; }
+		bool isVisible(unsigned node) const							{ return m_nodes[node].bVisible; }
+
+		// Recomputes the world matrices and bounding boxes of the dirty nodes and their subtrees - call once per frame, before rendering
+		void update();
+
+		// Renders the nodes which have anything to render: all of them or the ones listed. The world matrix of each node
+		// is multiplied by the view matrix once. prepare, if given, is called before each node is rendered.
+		void render(glm::mat4 matrixView, C3dglProgram* pProgram = NULL, const std::vector<unsigned>* pNodes = NULL,
+			std::function<void(unsigned node)> prepare = nullptr) const;
+		// The same, through a render queue: the nodes are sorted by material and mesh, then front to back,
+		// and the materials are sent once per group of nodes which share them. If the queue is instancing,
+		// the models and primitives without their own uniforms are instanced, whatever the pass. prepare is called before
+		// the nodes drawn on their own only: if it sends uniforms which differ from node to node, turn instancing off in all passes.
+		void render(C3dglRenderQueue& queue, glm::mat4 matrixView, C3dglProgram* pProgram = NULL, const std::vector<unsigned>* pNodes = NULL,
+			std::function<void(unsigned node)> prepare = nullptr) const;
+
+		unsigned getNodeCount() const								{ return (unsigned)m_nodes.size(); }
+		int getParent(unsigned node) const							{ return m_nodes[node].parent; }
+		const glm::mat4& getWorldMatrix(unsigned node) const		{ return m_nodes[node].world; }
+		// World space bounding box of the node (not including its children), as of the last update
+		void getAABB(unsigned node, glm::vec3 aabb[2]) const		{ aabb[0] = m_nodes[node].worldAABB[0]; aabb[1] = m_nodes[node].worldAABB[1]; }
+
+		// The nodes moved by the last update (the dirty ones and their subtrees), e.g. to invalidate the cached views which see them.
+		// getChangedAABB is the box of the node before and after the last update, together - the space it may have left or entered.
+		const std::vector<unsigned>& getUpdatedNodes() const		{ return m_updated; }
+		void getChangedAABB(unsigned node, glm::vec3 aabb[2]) const	{ aabb[0] = m_nodes[node].changedAABB[0]; aabb[1] = m_nodes[node].changedAABB[1]; }
+		bool isRenderable(unsigned node) const						{ return m_nodes[node].pModel || m_nodes[node].pPrimitive || m_nodes[node].render; }
+
+		// Statistics
+		size_t getUpdatedCount() const								{ return m_nUpdated; }
+		void stats() const;
+
+		std::string getName() const									{ return "Scene"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglScene_h_
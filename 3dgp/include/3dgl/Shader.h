@@ -142,6 +142,9 @@ namespace _3dgl
 		// shader "signature" - array of all standard attribute locations which defines the shader program functionality
 		const GLint* getShaderSignature() const				{ return m_stdAttr; }
 		size_t getShaderSignatureLength() const				{ return m_stdAttrNum; }
+		// true if the vertex position is the only standard attribute used - e.g. a depth pre-pass program;
+		// models are rendered with it through position-only VAOs, and without their materials
+		bool isPositionOnly() const;
 
 		// numerical locations and types for attribute and uniform names
 		GLint getUniformLocation(std::string idUniform) const;
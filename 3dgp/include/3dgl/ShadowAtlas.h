@@ -0,0 +1,136 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Shadow map atlas
+The shadow maps of all the lights share a single depth texture, divided into square
+tiles: one tile for a directional light, six (the faces of a cube) for a point light.
+The static casters are rendered into a separate atlas of the same size, only when
+a light or a static object moves; every frame it is copied to the final atlas and
+the dynamic casters are rendered over it. The shader filters the shadows with PCF.
+See Shadow() in shaders/basic.frag.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglShadowAtlas_h_
+#define __3dglShadowAtlas_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <functional>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+
+	// size of the shadowMatrices and shadowRegions arrays in shaders/basic.frag
+	const unsigned MAX_SHADOW_TILES = 16;
+
+	class MY3DGL_API C3dglShadowAtlas : public C3dglObject
+	{
+		struct SHADOW_LIGHT
+		{
+			bool bPoint;
+			glm::vec3 position;			// point light: its position; directional light: the direction towards the light
+			glm::vec3 center;			// directional light: the sphere covered by the shadow map
+			float nearPlane, farPlane;	// point light: depth range; directional light: near plane unused, far plane = radius
+			unsigned firstTile, nTiles;
+			bool bStaticValid;			// the static casters are rendered
+		};
+
+		unsigned m_size, m_tileSize, m_tilesPerRow;
+		GLuint m_idFBO[2];				// static casters, final atlas
+		GLuint m_idDepth[2];
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<SHADOW_LIGHT> m_lights;
+		std::vector<glm::mat4> m_views, m_projections;	// per tile
+		std::vector<glm::mat4> m_matrices;				// per tile: world space to atlas coordinates
+		std::vector<glm::vec4> m_regions;				// per tile: min and max atlas coordinates
+#pragma warning(pop)
+		unsigned m_nTiles;
+
+		// instrumentation: GL_TIME_ELAPSED of the static and the dynamic pass, CPU time of both
+		GLuint m_idQueries[2];
+		bool m_pending[2];
+		float m_time[2];				// ms
+		double m_cpuTime;				// ms
+		unsigned m_nStaticTiles;		// static tiles re-rendered in the last frame
+		unsigned m_nStaticUpdates, m_nFrames;
+
+		void collectQueries();
+		void updateMatrices(unsigned light);
+
+	public:
+		C3dglShadowAtlas();
+		C3dglShadowAtlas(const C3dglShadowAtlas&) = delete;
+		~C3dglShadowAtlas()								{ destroy(); }
+
+		// Creates both depth atlases, size x size texels, divided into tiles of tileSize (up to MAX_SHADOW_TILES of them)
+		bool create(unsigned size = 4096, unsigned tileSize = 1024);
+		void destroy();
+
+		// Add lights - return the light id, or -1 if there are not enough free tiles
+		int addPointLight(glm::vec3 position, float nearPlane = 0.05f, float farPlane = 20.0f);
+		int addDirectionalLight(glm::vec3 direction, glm::vec3 center, float radius);
+		// Move lights - their static casters are rendered again if the light has moved
+		void setPosition(unsigned light, glm::vec3 position);
+		void setDirection(unsigned light, glm::vec3 direction);
+
+		// The static casters have moved: renders them again, for one light or (by default) all lights.
+		// Not detected automatically - call when a static caster changes its transform (see C3dglScene::getUpdatedNodes).
+		void invalidate(int light = -1);
+
+		// Renders the shadow maps. The static casters are rendered only for the lights invalidated, the dynamic ones every frame.
+		// The callbacks render the casters with a depth-only program, using the matrices given, for the given light.
+		void render(std::function<void(unsigned light, glm::mat4 matrixView, glm::mat4 matrixProjection)> renderStatic,
+			std::function<void(unsigned light, glm::mat4 matrixView, glm::mat4 matrixProjection)> renderDynamic);
+
+		// Binds the atlas to texUnit, sends shadowAtlas, shadowMatrices and shadowRegions
+		void bind(C3dglProgram* pProgram, GLenum texUnit = GL_TEXTURE10) const;
+
+		// The index of the first tile of a light, as expected by the shader (shadowPoint1, shadowDir etc.); -1 if no such light
+		int getFirstTile(int light) const				{ return light >= 0 && light < (int)m_lights.size() ? (int)m_lights[light].firstTile : -1; }
+		unsigned getLightCount() const					{ return (unsigned)m_lights.size(); }
+		unsigned getTileCount() const					{ return m_nTiles; }
+		unsigned getSize() const						{ return m_size; }
+		GLuint getId() const							{ return m_idDepth[1]; }
+
+		// Statistics
+		float getStaticTime() const						{ return m_time[0]; }
+		float getDynamicTime() const					{ return m_time[1]; }
+		double getCPUTime() const						{ return m_cpuTime; }
+		unsigned getStaticTileCount() const				{ return m_nStaticTiles; }
+		void stats() const;
+
+		std::string getName() const						{ return "Shadow Atlas"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglShadowAtlas_h_
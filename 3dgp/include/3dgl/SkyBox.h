@@ -41,11 +41,23 @@ namespace _3dgl
     class MY3DGL_API C3dglSkyBox : public C3dglVertexAttrObject
     {
         unsigned int  m_idTex[6];
+        unsigned int  m_idCubeMap;
+
+        void createGeometry(bool bIndexed, C3dglProgram* pProgram);
 
     public:
         C3dglSkyBox();
+        ~C3dglSkyBox();
 
+	    // Six separate face textures, rendered with six texture binds and six draw calls
 	    bool load(const char* pFd, const char* pRt, const char* pBk, const char* pLt, const char* pUp, const char* pDn, C3dglProgram *pProgram = NULL);
+	    // The faces are combined into a single cube map texture, rendered with one bind and one draw call.
+	    // The shader must sample a samplerCube (texture unit 0) with the vertex position as the direction.
+	    // The faces must be square and of equal size - returns false otherwise, with nothing loaded.
+	    bool loadCubeMap(const char* pFd, const char* pRt, const char* pBk, const char* pLt, const char* pUp, const char* pDn, C3dglProgram *pProgram = NULL);
+	    virtual void destroy();
+
+	    unsigned int getCubeMapId() const { return m_idCubeMap; }
 	    
         void render(glm::mat4 matrix, C3dglProgram* pProgram = NULL) const;
         virtual void render(GLsizei instances = 1) const;
@@ -0,0 +1,132 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Static geometry batching
+Static props - models, or their main nodes, placed with their world matrices - are
+pre-transformed on the CPU, in parallel and with SSE2 where available, and merged
+into one vertex and index buffer per material: one draw call per material in place
+of one per mesh of each prop. The index range of each source is kept, so that the
+invisible ones may be skipped. The price is memory: every copy of a model has its
+own vertices - see stats() for the trade-off.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglStaticBatch_h_
+#define __3dglStaticBatch_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <cfloat>
+
+namespace _3dgl
+{
+	class C3dglProgram;
+	class C3dglModel;
+	class C3dglMaterial;
+	class C3dglVertexAttrObject;
+
+	class MY3DGL_API C3dglStaticBatch : public C3dglObject
+	{
+		struct ENTRY
+		{
+			const C3dglModel* pModel = NULL;
+			int iModelNode = -1;			// main node of the model, or -1 for the whole model
+			glm::mat4 world = glm::mat4(1);
+			const C3dglMaterial* pMaterial = NULL;
+			glm::vec3 aabb[2] = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };	// world space, as built; empty until then
+		};
+
+		// index range of a source entry within a batch
+		struct RANGE
+		{
+			unsigned entry;
+			GLsizei first, count;
+		};
+
+		// one batch for each pair of materials: of the entry, and of the model mesh
+		struct GROUP
+		{
+			const C3dglMaterial* pMaterial = NULL;
+			const C3dglMaterial* pMeshMaterial = NULL;
+			C3dglVertexAttrObject* pVAO = NULL;
+#pragma warning(push)
+#pragma warning(disable: 4251)
+			std::vector<RANGE> ranges = { };	// in the order of the entries
+#pragma warning(pop)
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<ENTRY> m_entries;
+		std::vector<GROUP> m_groups;
+		mutable std::vector<std::pair<GLsizei, GLsizei>> m_visible;		// ranges to draw, reused by render
+#pragma warning(pop)
+
+		// statistics
+		size_t m_nSourceDraws, m_nSourceMeshes;		// meshes of all the entries, distinct ones
+		size_t m_sourceBytes, m_batchBytes;			// buffers of the distinct source meshes, of the batches
+		size_t m_nVertices, m_nIndices;
+		unsigned m_nThreads;
+		double m_buildTime;							// ms
+		mutable size_t m_nDraws, m_nRanges;			// in the last render
+
+	public:
+		C3dglStaticBatch();
+		C3dglStaticBatch(const C3dglStaticBatch&) = delete;
+		~C3dglStaticBatch()									{ destroy(); }
+
+		// Adds a model, or one of its main nodes (see C3dglModel::getMainNodeCount), with its world matrix and material (may be NULL).
+		// The meshes keep their own materials too, sent after the entry material as in C3dglModel::render. Returns the entry id.
+		unsigned add(const C3dglModel* pModel, glm::mat4 world, const C3dglMaterial* pMaterial, int iModelNode = -1);
+
+		// Builds the batches of all the entries added, with the attributes of pProgram (the current program if NULL),
+		// on nThreads threads (0: all hardware threads). The models may be destroyed afterwards - but not the materials.
+		bool build(C3dglProgram* pProgram = NULL, unsigned nThreads = 0);
+
+		// Releases the batches and removes all entries
+		void destroy();
+
+		// Renders the batches. The vertices are in world space: the view matrix serves as the model-view matrix.
+		// pVisible, if given, tells which entries to render (by the entry id); the ranges of the others are skipped.
+		void render(glm::mat4 matrixView, C3dglProgram* pProgram = NULL, const std::vector<bool>* pVisible = NULL) const;
+
+		unsigned getEntryCount() const						{ return (unsigned)m_entries.size(); }
+		size_t getBatchCount() const						{ return m_groups.size(); }
+		// World space bounding box of an entry, or of all of them
+		void getAABB(unsigned entry, glm::vec3 aabb[2]) const	{ aabb[0] = m_entries[entry].aabb[0]; aabb[1] = m_entries[entry].aabb[1]; }
+		void getAABB(glm::vec3 aabb[2]) const;
+
+		// Statistics: draw calls and memory, with and without batching
+		void stats() const;
+
+		std::string getName() const							{ return "Static Batch"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglStaticBatch_h_
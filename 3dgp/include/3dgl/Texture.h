@@ -0,0 +1,134 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Implementation of the C3dglTexture class
+A 2D texture with immutable storage and a full mip chain.
+The mip chain is generated on the CPU (box or Kaiser filter, gamma-aware for
+colour data) or by the GPU, and may be cached on disk between the runs.
+Sampling is trilinear, with anisotropic filtering where available.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglTexture_h_
+#define __3dglTexture_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <string>
+
+struct aiTexture;
+
+namespace _3dgl
+{
+	class C3dglLoadProfile;
+	class C3dglTextureFile;
+
+	// Texture creation options. Use any combination with an '|' operator
+	enum TEXTURE_OPTIONS
+	{
+		TEX_DEFAULT = 0,			// colour data, CPU-generated mip chain (box filter), repeat, cached if the cache is enabled
+		TEX_LINEAR_DATA = 1,		// non-colour data (normal maps, masks): filtered without gamma correction
+		TEX_MIPS_KAISER = 2,		// Kaiser-windowed sinc filter: sharper minification than the box filter
+		TEX_MIPS_GPU = 4,			// mip chain generated with glGenerateMipmap instead of the CPU
+		TEX_NO_MIPS = 8,			// a single level, no mip-mapping
+		TEX_CLAMP = 16,				// GL_CLAMP_TO_EDGE wrapping
+		TEX_NO_CACHE = 32,			// do not use the mip chain disk cache
+		TEX_UNCOMPRESSED = 64		// do not look for the compressed version (.ktx2 or .dds) of the image file
+	};
+
+	class MY3DGL_API C3dglTexture : public C3dglObject
+	{
+		GLuint m_id;
+		GLenum m_format;			// internal format: GL_RGBA8 or one of the compressed formats
+		unsigned m_width, m_height, m_levels;
+		unsigned m_options;
+		std::string m_name;
+
+		static float c_anisotropy;
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		static std::string c_cacheDir;
+#pragma warning(pop)
+
+		// allocates the storage and uploads the levels; with bGenerate, only level 0 is uploaded and the rest generated by the GPU.
+		// For compressed formats, pSizes contains the sizes of the levels.
+		void upload(GLenum format, unsigned width, unsigned height, unsigned levels, const void* const* pLevels, const size_t* pSizes, bool bGenerate);
+
+		// mip chain disk cache
+		static std::string getCacheFilename(std::string filename, unsigned options);
+		bool loadFromCache(std::string filename);
+		void saveToCache(std::string filename, const std::vector<std::vector<unsigned char>>& levels) const;
+
+	public:
+		C3dglTexture();
+		C3dglTexture(const C3dglTexture&) = delete;
+		~C3dglTexture()							{ destroy(); }
+
+		// Loads the texture from a mounted asset pack, the compressed version of the file (.ktx2 or .dds, if exists),
+		// the mip cache or the image file itself (through DevIL)
+		bool load(std::string filename, unsigned options = TEX_DEFAULT, C3dglLoadProfile* pProfile = NULL);
+		bool load(const aiTexture* pTexture, unsigned options = TEX_DEFAULT, C3dglLoadProfile* pProfile = NULL);
+
+		// Creates the texture from RGBA, 8 bits per channel data; the mip chain is generated according to the options
+		bool create(unsigned width, unsigned height, const void* pRGBA, unsigned options = TEX_DEFAULT, std::string name = "");
+		// Creates the texture from a complete, pre-generated mip chain (RGBA, 8 bits per channel)
+		bool create(unsigned width, unsigned height, unsigned levels, const void* const* pLevels, unsigned options = TEX_DEFAULT, std::string name = "");
+		// Creates the texture from a compressed texture file; all its levels are uploaded as they are
+		bool create(const C3dglTextureFile& file, unsigned options = TEX_DEFAULT);
+		void destroy();
+
+		// Releases the ownership of the texture object: it will not be deleted by destroy. Returns the texture id.
+		GLuint detach();
+
+		void bind(GLenum texUnit = GL_TEXTURE0) const;
+
+		GLuint getId() const					{ return m_id; }
+		unsigned getWidth() const				{ return m_width; }
+		unsigned getHeight() const				{ return m_height; }
+		unsigned getLevelCount() const			{ return m_levels; }
+		GLenum getFormat() const				{ return m_format; }
+		size_t getSize() const;					// memory size of all levels, in bytes
+
+		// Default anisotropy applied to all textures created afterwards; clamped to the maximum supported value
+		static void setAnisotropy(float anisotropy)			{ c_anisotropy = anisotropy; }
+		static float getAnisotropy()						{ return c_anisotropy; }
+
+		// Directory for the mip chain cache; empty string (default) disables the cache
+		static void setCacheDirectory(std::string dir)		{ c_cacheDir = dir; }
+		static std::string getCacheDirectory()				{ return c_cacheDir; }
+		// Finds the up-to-date mip chain cache of the image. The levels follow one another from offset on (RGBA, 8 bits per channel).
+		static bool findCache(std::string filename, unsigned options, std::string& cacheFilename, unsigned& width, unsigned& height, size_t& offset);
+
+		// Mip chain generation (RGBA, 8 bits per channel). The levels vector receives all levels, starting from level 0.
+		// Only TEX_LINEAR_DATA and TEX_MIPS_KAISER options are relevant.
+		static unsigned getLevelCount(unsigned width, unsigned height);
+		static void generateMipChain(unsigned width, unsigned height, const void* pRGBA, std::vector<std::vector<unsigned char>>& levels, unsigned options = TEX_DEFAULT);
+
+		std::string getName() const				{ return "Texture (" + m_name + ")"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglTexture_h_
@@ -0,0 +1,104 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Texture arrays: many material textures collected in a single GL_TEXTURE_2D_ARRAY
+Textures of the layer size take a layer each; smaller textures are packed together
+into atlas layers. Materials of the models attached to the array do not bind their
+textures, they send the layer (textureLayer) and the atlas region (textureRegion)
+uniforms instead, so all of them may be rendered without a single texture bind.
+The shader samples the array with: texture(textureArray, vec3(fract(uv) * region.xy + region.zw, layer))
+(see shaders/basic.frag for the mip-mapping details).
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglTextureArray_h_
+#define __3dglTextureArray_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+// Include 3DGL API import/export settings
+#include "3dglapi.h"
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <map>
+
+namespace _3dgl
+{
+	class C3dglModel;
+
+	// Location of a texture within the array: uv' = fract(uv) * transform.xy + transform.zw, sampled at layer
+	struct TEXARRAY_REGION
+	{
+		GLint layer;
+		glm::vec4 transform;
+	};
+
+	class MY3DGL_API C3dglTextureArray : public C3dglObject
+	{
+		GLuint m_id;
+		GLenum m_format;
+		unsigned m_width, m_height, m_layers, m_levels;
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::map<GLuint, TEXARRAY_REGION> m_regions;		// source texture id => region
+#pragma warning(pop)
+
+		// copies a rectangle of a source texture into the array, the given number of levels
+		void copy(GLuint idSrc, GLint layer, unsigned x, unsigned y, unsigned width, unsigned height, unsigned levels, bool bCompressed);
+
+	public:
+		C3dglTextureArray();
+		C3dglTextureArray(const C3dglTextureArray&) = delete;
+		~C3dglTextureArray()					{ destroy(); }
+
+		// Collects the textures (GL_TEXTURE_2D objects) into the array; they are copied on the GPU and may be deleted afterwards.
+		// The layer size is width x height; if 0, the size (and the format) shared by the most textures is used.
+		// Textures of a different format, larger than the layer or with an incomplete mip chain are left out; smaller textures
+		// are packed into atlas layers if both they and the layer are power-of-two in size and uncompressed.
+		bool create(size_t count, const GLuint* pIds, unsigned width = 0, unsigned height = 0);
+		// Collects the diffuse (GL_TEXTURE0) textures of all the materials of the models and attaches the models to the array
+		bool create(std::vector<C3dglModel*> models, unsigned width = 0, unsigned height = 0);
+		void destroy();
+
+		// Finds the region of a source texture. Returns false if the texture is not in the array.
+		bool getRegion(GLuint idTex, TEXARRAY_REGION& region) const;
+
+		void bind(GLenum texUnit = GL_TEXTURE0) const;
+
+		GLuint getId() const					{ return m_id; }
+		GLenum getFormat() const				{ return m_format; }
+		unsigned getWidth() const				{ return m_width; }
+		unsigned getHeight() const				{ return m_height; }
+		unsigned getLayerCount() const			{ return m_layers; }
+		unsigned getLevelCount() const			{ return m_levels; }
+		size_t getTextureCount() const			{ return m_regions.size(); }
+
+		std::string getName() const				{ return "Texture Array"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglTextureArray_h_
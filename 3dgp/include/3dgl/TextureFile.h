@@ -0,0 +1,97 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Compressed texture files: DDS and KTX2 containers
+The file is memory-mapped and its mip levels are uploaded directly with
+glCompressedTexImage2D (see C3dglTexture). Supported formats: BC1, BC3, BC4,
+BC5 and BC7, linear and sRGB. DDS files can be written with saveDDS
+(see the 3dgl-bake tool).
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglTextureFile_h_
+#define __3dglTextureFile_h_
+
+#include "Object.h"
+#include "BlockCompress.h"
+
+// standard libraries
+#include <vector>
+#include <string>
+
+namespace _3dgl
+{
+	class C3dglMappedFile;
+
+	class MY3DGL_API C3dglTextureFile : public C3dglObject
+	{
+		std::string m_filename;
+		C3dglMappedFile* m_pFile;
+		GLenum m_format;			// OpenGL internal format
+		unsigned m_width, m_height;
+		bool m_bTopDown;			// rows stored top to bottom (the standard for DDS and KTX2 files)
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<const void*> m_levels;
+		std::vector<size_t> m_levelSizes;
+#pragma warning(pop)
+
+		bool openDDS();
+		bool openKTX2();
+
+	public:
+		C3dglTextureFile();
+		C3dglTextureFile(const C3dglTextureFile&) = delete;
+		~C3dglTextureFile()					{ close(); }
+
+		// maps the DDS or KTX2 file into the memory; the file type is recognised by its contents
+		bool open(std::string filename);
+		void close();
+		bool isOpen() const					{ return m_pFile != NULL; }
+
+		GLenum getFormat() const			{ return m_format; }
+		unsigned getWidth() const			{ return m_width; }
+		unsigned getHeight() const			{ return m_height; }
+		unsigned getLevelCount() const		{ return (unsigned)m_levels.size(); }
+		bool isTopDown() const				{ return m_bTopDown; }
+		// compressed data of the mip level, in the mapped file
+		const void* getLevel(unsigned level, size_t& size) const	{ size = m_levelSizes[level]; return m_levels[level]; }
+
+		// true if the format is supported by the OpenGL driver
+		bool isSupported() const;
+
+		// Finds the compressed version of an image file: the same name with .ktx2 or .dds extension.
+		// Returns the filename itself if it already is a DDS or KTX2 file; empty string if none found.
+		static std::string findCompressed(std::string filename);
+
+		// Compresses all levels of the RGBA mip chain (bottom-up, as used in 3DGL) and writes a standard, top-down DDS file.
+		// The height must be at most 4 or a multiple of 4, or the file could not be flipped back when loaded; for the same reason,
+		// the chain ends before the first level which is taller than 4 and not a multiple of 4 (e.g. 12x12, 6x6 and below).
+		static bool saveDDS(std::string filename, BC_FORMAT format, unsigned width, unsigned height, const std::vector<std::vector<unsigned char>>& levels);
+
+		std::string getName() const			{ return "Texture File \"" + m_filename + "\""; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglTextureFile_h_
@@ -0,0 +1,197 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Texture streaming: mip levels loaded on demand, within a memory budget
+A streamed texture starts with its small mip levels only (the "tail"); GL_TEXTURE_BASE_LEVEL
+points at the finest level resident. Finer levels are read on a background I/O thread
+from an asset pack, a compressed texture file, the mip cache or the image itself,
+in the order of the on-screen size of the models using them, and faded in with the LOD clamp.
+When the budget is exceeded, the finest levels of the least recently used textures are evicted.
+Once started, the streamer is used by C3dglResourceCache for all material textures,
+and models report their projected size when rendered. Call update once a frame.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+#ifndef __3dglTextureStreamer_h_
+#define __3dglTextureStreamer_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+#include "Texture.h"
+
+// standard libraries
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace _3dgl
+{
+	class C3dglModel;
+
+	class MY3DGL_API C3dglTextureStreamer : public C3dglObject
+	{
+	public:
+		struct SOURCE;
+
+	private:
+		// streamed texture, accessed from the rendering thread only
+		struct TEXTURE
+		{
+			std::shared_ptr<SOURCE> pSource;
+			std::string filename;
+			unsigned width, height, levels;
+			unsigned base;				// finest level resident (GL_TEXTURE_BASE_LEVEL)
+			unsigned tail;				// finest level of the tail - never evicted
+			unsigned wanted;			// finest level needed in the current frame
+			float priority;				// on-screen size in the current frame, in pixels
+			uint64_t lastUsed;			// the last frame in which the finest resident level was needed
+			float minLod;				// LOD clamp, fading in the new levels
+			bool bPending;				// I/O request in progress
+			bool bReady;				// the tail is resident (false only until the image is decoded)
+			uint64_t generation;		// tells the texture from a later one with the same (reused) id
+		};
+
+		// I/O request: levels first to last of a texture
+		struct REQUEST
+		{
+			GLuint id;
+			uint64_t generation;		// of the texture - the request is dropped if it does not match any more
+			std::shared_ptr<SOURCE> pSource;
+			unsigned first, last;
+			float priority;
+			size_t bytes;
+			bool bOK;
+#pragma warning(push)
+#pragma warning(disable: 4251)
+			std::vector<std::vector<unsigned char>> data;
+#pragma warning(pop)
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::map<GLuint, TEXTURE> m_textures;
+		std::map<const C3dglModel*, std::pair<glm::vec3, glm::vec3>> m_aabbs;	// model AABB's, cached
+
+		// I/O thread and its queues
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::deque<std::shared_ptr<REQUEST>> m_queue;		// requests waiting
+		std::deque<std::shared_ptr<REQUEST>> m_done;		// requests completed, waiting to upload
+#pragma warning(pop)
+		bool m_bRunning = false;
+		bool m_bQuit = false;
+
+		// view
+		glm::mat4 m_projection = glm::mat4(1);
+		float m_viewWidth = 1280, m_viewHeight = 720;
+
+		// settings
+		size_t m_budget = 0;
+		unsigned m_tailSize = 64;
+		float m_fadeSpeed = 4;
+		uint64_t m_frame = 0;
+		uint64_t m_generation = 0;			// of the last texture loaded
+		double m_lastUpdate = 0;			// time of the last update, in seconds
+		bool m_bOverBudget = false;			// the tails alone exceed the budget (reported once)
+
+		// statistics
+		size_t m_residentBytes = 0;		// all resident levels
+		size_t m_pendingBytes = 0;		// levels requested but not uploaded yet
+		size_t m_nPending = 0;
+		size_t m_nUploaded = 0;			// levels uploaded since start
+		size_t m_nEvicted = 0;			// levels evicted since start
+		size_t m_nLoadedBytes = 0;		// bytes read from the sources since start
+
+		C3dglTextureStreamer() : C3dglObject() { }
+		C3dglTextureStreamer(const C3dglTextureStreamer&) = delete;
+		~C3dglTextureStreamer()		{ stop(); }
+
+		void run();							// the I/O thread
+		static void read(REQUEST& request);	// reads the requested levels, called on the I/O thread
+
+		size_t getLevelSize(const SOURCE& source, unsigned level) const;
+		void upload(GLuint id, TEXTURE& texture, unsigned first, unsigned last, const std::vector<std::vector<unsigned char>>& data);
+		void evict(GLuint id, TEXTURE& texture);
+		void track(GLuint id, const TEXTURE& texture) const;	// updates the size in C3dglMemoryTracker
+		bool makeRoom(size_t bytes);		// evicts the least recently used levels until bytes more fit in the budget
+
+	public:
+		static C3dglTextureStreamer& getInstance();
+
+		// Starts the I/O thread; budget is the total size of the resident levels, in bytes.
+		void start(size_t budget = 256 * 1024 * 1024);
+		// Stops the I/O thread; the textures stay as they are
+		void stop();
+		bool isRunning() const					{ return m_bRunning; }
+
+		// Size of the tail: levels of this size and smaller are loaded at once and never evicted
+		void setTailSize(unsigned size)			{ m_tailSize = size; }
+		unsigned getTailSize() const			{ return m_tailSize; }
+		void setBudget(size_t budget)			{ m_budget = budget; }
+		size_t getBudget() const				{ return m_budget; }
+		// Speed of fading in the new levels, in levels per second
+		void setFadeSpeed(float speed)			{ m_fadeSpeed = speed; }
+
+		// Creates a streamed texture (mip-mapped, options as in C3dglTexture) with only its tail resident; returns the texture id.
+		// Returns 0 if the texture cannot be streamed (e.g. TEX_NO_MIPS) - it should be then loaded with C3dglTexture.
+		GLuint load(std::string filename, unsigned options = TEX_DEFAULT);
+		// Deletes the texture and cancels its requests; returns false if the texture is not streamed
+		bool release(GLuint idTex);
+		// Forgets the cached bounding box of the model; called by C3dglModel::destroy
+		void forget(const C3dglModel* pModel)	{ m_aabbs.erase(pModel); }
+		bool isStreamed(GLuint idTex) const		{ return m_textures.find(idTex) != m_textures.end(); }
+
+		// The projection matrix and the viewport size, used to calculate the on-screen size of the models
+		void setView(glm::mat4 projection, float width, float height)	{ m_projection = projection; m_viewWidth = width; m_viewHeight = height; }
+
+		// Requests the levels of a texture appropriate for its on-screen size, in pixels
+		void request(GLuint idTex, float pixels);
+		// Requests the textures of all materials of the model, rendered with the model-view matrix; called by C3dglModel::render
+		void request(const C3dglModel& model, glm::mat4 matrix);
+
+		// Call once a frame, in the rendering thread: uploads the levels read, evicts the least recently used levels
+		// to stay within the budget and sends new requests to the I/O thread, the largest on-screen textures first.
+		void update();
+
+		// Statistics
+		size_t getResidentBytes() const			{ return m_residentBytes; }
+		size_t getPendingBytes() const			{ return m_pendingBytes; }
+		size_t getPendingCount() const			{ return m_nPending; }
+		size_t getTextureCount() const			{ return m_textures.size(); }
+		size_t getUploadCount() const			{ return m_nUploaded; }
+		size_t getEvictionCount() const			{ return m_nEvicted; }
+		void stats() const;
+
+		std::string getName() const				{ return "Texture Streamer"; }
+	};
+}; // namespace _3dgl
+
+#endif // __3dglTextureStreamer_h_
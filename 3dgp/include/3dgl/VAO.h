@@ -41,6 +41,7 @@ freely, subject to the following restrictions:
 
 // standard libraries
 #include <map>
+#include <vector>
 
 namespace _3dgl
 {
@@ -68,6 +69,16 @@ namespace _3dgl
 		C3dglProgram* m_pProgram = NULL;					// program responsible for creating the VBO's and VAO; NULL if fixed pipeline or no VAO created
 		mutable C3dglProgram* m_pLastProgramUsed = NULL;	// the last program used for rendering; NULL if never rendered since loading the model
 
+		// Position-only VAO, for the programs which use nothing but the vertex positions (depth pre-pass).
+		// Shares the vertex and index buffers of the main VAO; created on first use.
+		mutable GLuint m_idPositionVAO = 0;
+		mutable GLint m_positionAttr = -1;		// attribute location the position-only VAO is set up for
+		bool preparePositionVAO(GLint attrLocation) const;
+
+		// Index ranges (first index, count) to draw instead of the whole buffer - set while rendering with ranges
+		mutable const std::vector<std::pair<GLsizei, GLsizei>>* m_pRanges = NULL;
+		void drawElements(GLsizei instances) const;
+
 	public:
 		C3dglVertexAttrObject(size_t attrCount);
 		virtual ~C3dglVertexAttrObject();
@@ -82,6 +93,9 @@ namespace _3dgl
 		size_t getIndexCount() const					{ return m_nIndices; }
 		GLuint getIndexBufferId() const					{ return m_idIndex; }
 
+		// total size of all vertex and index buffers, in bytes (queried from OpenGL)
+		size_t getBufferSize() const;
+
 		// The create & destroy all standard buffers. The latter, typically, doesn't need to be called
 		void create(size_t attrCount, size_t nVertices, void** attrData, size_t* attrSize, size_t nIndices, void* indexData, size_t indSize, C3dglProgram* pProgram = NULL);
 		virtual void destroy();
@@ -99,7 +113,11 @@ namespace _3dgl
 
 		// Rendering
 		void render(glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL) const;
+		// renders the listed ranges of the index buffer only (first index, count) - e.g. the visible parts of a merged mesh
+		void render(glm::mat4 matrix, const std::vector<std::pair<GLsizei, GLsizei>>& ranges, C3dglProgram* pProgram = NULL) const;
 		virtual void render(GLsizei instances = 1) const;
+		// Renders through the position-only VAO (see C3dglProgram::isPositionOnly); falls back to render(instances) if not available
+		void renderPositionOnly(GLint attrLocation, GLsizei instances = 1) const;
 
 		using C3dglObject::getName;
 	};
@@ -1,4 +1,8 @@
 #include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <random>
+#include <algorithm>
 #include <GL/glew.h>
 #include <3dgl/3dgl.h>
 #include <GL/glut.h>
@@ -15,18 +19,64 @@ using namespace _3dgl;
 using namespace glm;
 
 // Global Variables
-GLuint idTexCube; // global variable for cubemap
+C3dglReflectionProbeManager probes; // environment maps
+unsigned probeVase; // dynamic probe of the vase
+bool bLayered = false; // cube map rendered in a single pass, with shaders/cubemap.geom
+size_t streamBudget = 0; // texture streaming budget, in bytes; 0 if not streaming
+C3dglLightGrid lightGrid; // clustered culling of the small point lights
+C3dglLightAssigner lightAssigner(1.2f); // per-object lists of the small point lights - the cells about the light diameter
+std::vector<POINT_LIGHT> smallLights; // small coloured lights flying around the room
+std::vector<vec3> smallLightOrigins; // ... and the centres of their orbits
+int lightMode = 1; // 1 = clustered, 2 = all lights for every fragment, 3 = per-object light lists
+bool bLightBench = false; // "-lightbench" command line option
+C3dglDeferredRenderer deferred; // deferred shading - the G-buffer is created on first use
+bool bDeferred = false;
+bool bPrePass = false; // depth pre-pass before the forward colour pass
+GLuint idFragmentQuery = 0; // fragments shaded in the colour pass: shader invocations where supported, samples passed otherwise
+GLuint64 fragmentCount = 0;
+bool bFragmentQueryPending = false;
+C3dglShadowAtlas shadows; // shadow maps of the lamps and the directional light
+int shadowLights[3] = { -1, -1, -1 }; // ... their ids in the atlas
+std::vector<unsigned> staticCasters, dynamicCasters; // scene objects casting shadows
+bool bShadows = true;
+C3dglRenderQueue renderQueue; // scene objects sorted by program, material and mesh, then front to back - and instanced
+bool bRenderQueue = true;
+bool bInstancing = true; // ... not with the per-object light lists, which differ from object to object
+C3dglStaticBatch tableBatch; // the table and chairs pre-transformed into one buffer per material
+C3dglMaterial matTable(NULL), matCloth(NULL); // ... and their materials
+std::vector<unsigned> tableNodes; // the same, as separate scene objects
+unsigned nodeTableBatch;
+bool bStaticBatch = true;
+
+// Baked assets - must outlive the models loaded from it
+C3dglAssetPack assetPack;
 
 // GLSL Program
 C3dglProgram program;
+C3dglProgram programGBuffer; // deferred shading: G-buffer pass
+C3dglProgram programDeferred; // deferred shading: lighting pass
+C3dglProgram programDepth; // depth pre-pass - positions only
+C3dglProgram* pProgram = &program; // the program the scene objects are rendered with: forward, depth pre-pass, or the G-buffer pass
 
 // 3D models
 C3dglModel camera;
 C3dglModel table;
 C3dglModel vase;
 C3dglModel bunny;
-C3dglModel lamp1;
-C3dglModel lamp2;
+std::shared_ptr<C3dglModel> lamp1;	// both lamps share the same geometry - see C3dglResourceCache
+std::shared_ptr<C3dglModel> lamp2;
+
+// Procedural primitives - built once, rendered from their VAO's
+C3dglPrimitive sphere;
+C3dglPrimitive teapot;
+
+// Scene objects - see createSceneObjects
+C3dglScene scene;
+unsigned nodeBulb1, nodeBulb2; // glowing while the lamps are on
+unsigned nodePyramid, nodeBunny; // spinning
+
+// Model textures collected in a single texture array - no texture binds between the models
+C3dglTextureArray texArray;
 
 // The View Matrix
 mat4 matrixView;
@@ -51,15 +101,16 @@ bool lamp2On = true;
 float lightIntensity1 = 1.0;
 float lightIntensity2 = 1.0;
 
-// Texture IDs
-GLuint idTexWood;
+// Textures
 GLuint idTexNone;
 
 
 // Function Declarations
 bool init();
-void renderScene(mat4& matrixView, float time, float deltaTime);
+void createSceneObjects();
+void renderScene(mat4& matrixView, float time, float deltaTime, const std::vector<unsigned>* pObjects = NULL);
 void onRender();
+void lightBenchmark();
 void onReshape(int w, int h);
 void onKeyDown(unsigned char key, int x, int y);
 void onKeyUp(unsigned char key, int x, int y);
@@ -71,6 +122,54 @@ void onMouseWheel(int button, int dir, int x, int y);
 
 int main(int argc, char** argv)
 {
+	// "-objcheck" command line option: verifies the native OBJ loader against AssImp and measures its throughput
+	if (argc > 1 && std::string(argv[1]) == "-objcheck")
+	{
+		for (auto& entry : std::filesystem::directory_iterator("models"))
+			if (entry.path().extension() == ".obj")
+			{
+				C3dglObjLoader::compare(entry.path().string().c_str());
+				C3dglObjLoader::benchmark(entry.path().string().c_str());
+			}
+		return 0;
+	}
+
+	// "-imagecheck" command line option: measures the throughput of the native image decoder against DevIL
+	if (argc > 1 && std::string(argv[1]) == "-imagecheck")
+	{
+		std::vector<std::string> filenames;
+		for (auto& entry : std::filesystem::directory_iterator("models"))
+			if (entry.path().extension() == ".bmp" || entry.path().extension() == ".tga" || entry.path().extension() == ".png" || entry.path().extension() == ".jpg")
+				filenames.push_back(entry.path().string());
+		if (!filenames.empty())
+			C3dglBitmap::benchmark(filenames);
+		return 0;
+	}
+
+	// "-stream [MB]" command line option: material textures are streamed, within the given memory budget
+	if (argc > 1 && std::string(argv[1]) == "-stream")
+		streamBudget = (size_t)(argc > 2 ? atoi(argv[2]) : 64) * 1024 * 1024;
+
+	// "-layered" command line option: the cube map is rendered in a single pass, by a geometry shader
+	if (argc > 1 && std::string(argv[1]) == "-layered")
+		bLayered = true;
+
+	// "-lightbench" command line option: frame times with 2..1024 small point lights, clustered and not
+	if (argc > 1 && std::string(argv[1]) == "-lightbench")
+		bLightBench = true;
+
+	// "-profilecheck" command line option: verifies that the fast and balanced import profiles give the same geometry as the default one
+	if (argc > 1 && std::string(argv[1]) == "-profilecheck")
+	{
+		for (auto& entry : std::filesystem::directory_iterator("models"))
+			if (entry.path().extension() == ".obj" || entry.path().extension() == ".3ds")
+			{
+				C3dglModel::validateImportFlags(entry.path().string().c_str(), C3dglModel::IMPORT_FAST);
+				C3dglModel::validateImportFlags(entry.path().string().c_str(), C3dglModel::IMPORT_BALANCED);
+			}
+		return 0;
+	}
+
 	// init GLUT and create Window
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
@@ -118,10 +217,14 @@ int main(int argc, char** argv)
 
 bool init()
 {
+	// baked assets (see assets.manifest and the 3dgl-bake tool); loose files are used if the pack is not present
+	if (std::filesystem::exists("assets.pak") && assetPack.open("assets.pak"))
+		C3dglAssetPack::mount(&assetPack);
 
 	// Local variables
 	C3dglShader vertexShader;
 	C3dglShader fragmentShader;
+	C3dglShader geometryShader;
 
 	if (!vertexShader.create(GL_VERTEX_SHADER)) return false;
 	if (!vertexShader.loadFromFile("shaders/basic.vert")) return false;
@@ -134,7 +237,46 @@ bool init()
 	if (!program.create()) return false;
 	if (!program.attach(vertexShader)) return false;
 	if (!program.attach(fragmentShader)) return false;
+	if (bLayered)
+	{
+		if (!geometryShader.create(GL_GEOMETRY_SHADER)) return false;
+		if (!geometryShader.loadFromFile("shaders/cubemap.geom")) return false;
+		if (!geometryShader.compile()) return false;
+		if (!program.attach(geometryShader)) return false;
+	}
 	if (!program.link()) return false;
+
+	// deferred shading: the G-buffer pass (basic.vert and gbuffer.frag) and the lighting pass
+	C3dglShader gbufferShader, deferredVertexShader, deferredFragmentShader;
+	if (!gbufferShader.create(GL_FRAGMENT_SHADER)) return false;
+	if (!gbufferShader.loadFromFile("shaders/gbuffer.frag")) return false;
+	if (!gbufferShader.compile()) return false;
+	if (!programGBuffer.create()) return false;
+	if (!programGBuffer.attach(vertexShader)) return false;
+	if (!programGBuffer.attach(gbufferShader)) return false;
+	if (!programGBuffer.link()) return false;
+
+	if (!deferredVertexShader.create(GL_VERTEX_SHADER)) return false;
+	if (!deferredVertexShader.loadFromFile("shaders/deferred.vert")) return false;
+	if (!deferredVertexShader.compile()) return false;
+	if (!deferredFragmentShader.create(GL_FRAGMENT_SHADER)) return false;
+	if (!deferredFragmentShader.loadFromFile("shaders/deferred.frag")) return false;
+	if (!deferredFragmentShader.compile()) return false;
+	if (!programDeferred.create()) return false;
+	if (!programDeferred.attach(deferredVertexShader)) return false;
+	if (!programDeferred.attach(deferredFragmentShader)) return false;
+	if (!programDeferred.link()) return false;
+
+	// depth pre-pass: no fragment shader - depth only
+	C3dglShader depthShader;
+	if (!depthShader.create(GL_VERTEX_SHADER)) return false;
+	if (!depthShader.loadFromFile("shaders/depth.vert")) return false;
+	if (!depthShader.compile()) return false;
+	if (!programDepth.create()) return false;
+	if (!programDepth.attach(depthShader)) return false;
+	if (!programDepth.link()) return false;
+	glGenQueries(1, &idFragmentQuery);
+
 	if (!program.use(true)) return false;
 
 	// rendering states
@@ -144,13 +286,26 @@ bool init()
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);    // this is the default one; try GL_LINE!
 
 
+	// mip chains generated on the first run are reused
+	C3dglTexture::setCacheDirectory("cache");
+
+	// texture streaming must be started before the models are loaded
+	if (streamBudget)
+		C3dglTextureStreamer::getInstance().start(streamBudget);
+
 	// load your 3D models here!
 	if (!camera.load("models\\camera.3ds")) return false;
 	if (!table.load("models\\table.obj")) return false;
 	if (!vase.load("models\\vase.obj")) return false;
 	if (!bunny.load("models\\bunny.obj")) return false;
-	if (!lamp1.load("models\\lamp.obj")) return false;
-	if (!lamp2.load("models\\lamp.obj")) return false;
+	if (!(lamp1 = C3dglResourceCache::getInstance().getModel("models\\lamp.obj"))) return false;
+	if (!(lamp2 = C3dglResourceCache::getInstance().getModel("models\\lamp.obj"))) return false;
+	C3dglResourceCache::getInstance().stats();
+	C3dglMemoryTracker::getInstance().stats();
+	texArray.create({ &camera, &table, &vase, &bunny, lamp1.get(), lamp2.get() });
+	sphere.createSphere(1, 32, 32);
+	teapot.createTeapot(2.0);
+	createSceneObjects();
 
 
 	// Initialise the View Matrix (initial position of the camera)
@@ -197,21 +352,8 @@ bool init()
 
 	// TEXTURE LOADING START
 
-	// Load Texture
-	C3dglBitmap bm;
-
-	bm.load("models/oak.bmp", GL_RGBA);
-	if (!bm.getBits()) return false;
-
-	// Prepare texture buffer
+	// Null Texture - the scene objects use the blank texture of their materials (see createSceneObjects)
 	glActiveTexture(GL_TEXTURE0);
-	glGenTextures(1, &idTexWood);
-	glBindTexture(GL_TEXTURE_2D, idTexWood);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA,
-		GL_UNSIGNED_BYTE, bm.getBits());
-
-	// Null Texture
 	glGenTextures(1, &idTexNone);
 	glBindTexture(GL_TEXTURE_2D, idTexNone);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -223,20 +365,52 @@ bool init()
 
 	// TEXTURE LOADING END
 
-				// load Cube Map
-	glActiveTexture(GL_TEXTURE1);
-	glGenTextures(1, &idTexCube);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, idTexCube);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	//DO NOT LOAD BITMAPS IN HERE, WE WILL RENDER TO THE TEXTURE
+	// Reflection probes: a dynamic one for the vase, which reflects the moving objects,
+	// and two static ones for the chrome ball - baked once, then loaded from the cache
+	if ((probeVase = probes.addDynamic(vec3(0.0f, 4.2f, 0.0f))) == (unsigned)-1) return false;
+	probes.addStatic("probe_left", vec3(-1.0f, 3.6f, 0.8f), vec3(-3.0f, 3.04f, -2.0f), vec3(0.0f, 6.0f, 3.0f));
+	probes.addStatic("probe_right", vec3(1.0f, 3.6f, 0.8f), vec3(0.0f, 3.04f, -2.0f), vec3(3.0f, 6.0f, 3.0f));
 
 // Send the cube map info to the shaders
 	program.sendUniform("textureCubeMap", 1);
+	program.sendUniform("textureCubeMap2", 3);
+
+	// Texture array on unit 2
+	texArray.bind(GL_TEXTURE2);
+	program.sendUniform("textureArray", 2);
+	programGBuffer.sendUniform("texture0", 0);
+	programGBuffer.sendUniform("textureArray", 2);
+	glActiveTexture(GL_TEXTURE0);
+
+	// Clustered point lights - texture buffers on units 4..6
+	if (!lightGrid.create()) return false;
+	program.sendUniform("lightData", 4);
+	program.sendUniform("lightClusters", 5);
+	program.sendUniform("lightIndices", 6);
+
+	// Shadow atlas on unit 10: the lamps and the directional light, which covers all the scene objects.
+	// The bulbs enclose the lamp lights, so they cast no shadows; the spinning objects are dynamic casters.
+	if (!shadows.create()) return false;
+	vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (unsigned i = 0; i < scene.getNodeCount(); i++)
+		if (scene.isRenderable(i))
+		{
+			vec3 aabb[2];
+			scene.getAABB(i, aabb);
+			lo = min(lo, aabb[0]);
+			hi = max(hi, aabb[1]);
+			if (i != nodeBulb1 && i != nodeBulb2)
+				(scene.isDynamic(i) ? dynamicCasters : staticCasters).push_back(i);
+		}
+	shadowLights[0] = shadows.addPointLight(vec3(-1.95f, 4.24f, -1.0f));
+	shadowLights[1] = shadows.addPointLight(vec3(1.95f, 4.24f, -0.5f));
+	shadowLights[2] = shadows.addDirectionalLight(vec3(1.0, 0.5, 1.0), (lo + hi) * 0.5f, length(hi - lo) * 0.5f);
+	program.sendUniform("shadowAtlas", 10);
+
+	// Instance data of the render queue on unit 11
+	renderQueue.setInstancing(bInstancing, GL_TEXTURE11);
+	for (C3dglProgram* p : { &program, &programGBuffer, &programDepth })
+		p->sendUniform("instanceData", 11);
 
 	cout << endl;
 	cout << "Use:" << endl;
@@ -244,88 +418,175 @@ bool init()
 	cout << "  QE or PgUp/Dn to move the camera up and down" << endl;
 	cout << "  Shift to speed up your movement" << endl;
 	cout << "  Drag the mouse to look around" << endl;
+	cout << "  L to change the number of small point lights, K to switch between clustered, all and per-object lights" << endl;
+	cout << "  G to switch between forward and deferred shading" << endl;
+	cout << "  P to switch the depth pre-pass on and off" << endl;
+	cout << "  H to switch the shadows on and off" << endl;
+	cout << "  O to switch between sorted and instanced, sorted only and unsorted draws" << endl;
+	cout << "  J to switch the static batching of the table and chairs on and off" << endl;
 	cout << endl;
 
 
 	return true;
 }
 
-void renderScene(mat4& matrixView, float time, float deltaTime)
+// Creates the scene: the transforms, the materials and what to render, as data. The spinning objects are children of
+// their placement nodes - only their own rotation changes every frame.
+void createSceneObjects()
+{
+	C3dglMaterial* pMaterial;
+
+	// bulbs - they glow while the lamps are on
+	nodeBulb1 = scene.addPrimitive(&sphere);
+	scene.setTransform(nodeBulb1, vec3(-1.95f, 4.24f, -1.0f), quat(1, 0, 0, 0), vec3(0.1f));
+	pMaterial = &scene.getMaterial(nodeBulb1);
+	pMaterial->setDiffuse(vec3(1.0f, 1.0f, 1.0f));
+	pMaterial->setSpecular(vec3(0.0f, 0.0f, 0.0f));
+	pMaterial->setEmissive(vec3(1.0f, 1.0f, 1.0f));
+	pMaterial->loadTexture();
+
+	nodeBulb2 = scene.addPrimitive(&sphere);
+	scene.setTransform(nodeBulb2, vec3(1.95f, 4.24f, -0.5f), quat(1, 0, 0, 0), vec3(0.1f));
+	pMaterial = &scene.getMaterial(nodeBulb2);
+	pMaterial->setDiffuse(vec3(1.0f, 0.0f, 0.0f));
+	pMaterial->setSpecular(vec3(0.0f, 0.0f, 0.0f));
+	pMaterial->setEmissive(vec3(1.0f, 0.0f, 0.0f));
+	pMaterial->loadTexture();
+
+	// lamps - gray
+	unsigned node = scene.addModel(lamp1.get(), 0);
+	scene.setTransform(node, vec3(-1.60f, 3.04f, -1.0f), quat(1, 0, 0, 0), vec3(0.015f));
+	pMaterial = &scene.getMaterial(node);
+	pMaterial->setDiffuse(vec3(0.6f, 0.6f, 0.6f));
+	pMaterial->setSpecular(vec3(0.6f, 0.6f, 1.0f));
+	pMaterial->loadTexture();
+
+	node = scene.addModel(lamp2.get(), 0);
+	scene.setTransform(node, vec3(1.6f, 3.04f, -0.5f), angleAxis(radians(180.f), vec3(0.0f, 1.0f, 0.0f)), vec3(0.015f));
+	pMaterial = &scene.getMaterial(node);
+	pMaterial->setDiffuse(vec3(0.6f, 0.6f, 0.6f));
+	pMaterial->setSpecular(vec3(0.6f, 0.6f, 1.0f));
+	pMaterial->loadTexture();
+
+	// table and chairs - gray, the table cloth orange
+	for (float angle : { 180.f, 0.f, 270.f, 90.f })
+	{
+		node = scene.addModel(&table, 0);
+		scene.setTransform(node, vec3(0), angleAxis(radians(angle), vec3(0.0f, 1.0f, 0.0f)), vec3(0.004f));
+		pMaterial = &scene.getMaterial(node);
+		pMaterial->setDiffuse(vec3(0.6f, 0.6f, 0.6f));
+		pMaterial->setSpecular(vec3(0.6f, 0.6f, 1.0f));
+		pMaterial->loadTexture("models/oak.bmp");
+		tableNodes.push_back(node);
+	}
+	node = scene.addModel(&table, 1);
+	scene.setTransform(node, vec3(0), angleAxis(radians(180.f), vec3(0.0f, 1.0f, 0.0f)), vec3(0.004f));
+	pMaterial = &scene.getMaterial(node);
+	pMaterial->setDiffuse(vec3(0.9f, 0.5f, 0.3f));
+	pMaterial->setSpecular(vec3(0.0f, 0.0f, 0.0f));
+	pMaterial->loadTexture("models/oak.bmp");
+	tableNodes.push_back(node);
+
+	// ... and the same, batched: rendered instead of the nodes above while bStaticBatch is on
+	matTable.setDiffuse(vec3(0.6f, 0.6f, 0.6f));
+	matTable.setSpecular(vec3(0.6f, 0.6f, 1.0f));
+	matTable.loadTexture("models/oak.bmp");
+	matCloth.setDiffuse(vec3(0.9f, 0.5f, 0.3f));
+	matCloth.setSpecular(vec3(0.0f, 0.0f, 0.0f));
+	matCloth.loadTexture("models/oak.bmp");
+	for (float angle : { 180.f, 0.f, 270.f, 90.f })
+		tableBatch.add(&table, scale(rotate(mat4(1), radians(angle), vec3(0.0f, 1.0f, 0.0f)), vec3(0.004f)), &matTable, 0);
+	tableBatch.add(&table, scale(rotate(mat4(1), radians(180.f), vec3(0.0f, 1.0f, 0.0f)), vec3(0.004f)), &matCloth, 1);
+	tableBatch.build(&program);
+	vec3 aabbBatch[2];
+	tableBatch.getAABB(aabbBatch);
+	nodeTableBatch = scene.addFunction([](mat4 m) { tableBatch.render(m, pProgram); }, aabbBatch);
+	for (unsigned i : tableNodes)
+		scene.setVisible(i, !bStaticBatch);
+	scene.setVisible(nodeTableBatch, bStaticBatch);
+
+	// teapot - blue
+	node = scene.addPrimitive(&teapot);
+	scene.setTransform(node, vec3(1.5f, 3.36f, 0.5f), angleAxis(radians(320.f), vec3(0.0f, 1.0f, 0.0f)), vec3(0.2f));
+	pMaterial = &scene.getMaterial(node);
+	pMaterial->setDiffuse(vec3(0.2f, 0.2f, 0.8f));
+	pMaterial->setSpecular(vec3(0.6f, 0.6f, 1.0f));
+	pMaterial->loadTexture();
+
+	// pyramid - red, spinning; rendered with plain OpenGL calls
+	node = scene.addNode();
+	scene.setTransform(node, vec3(-1.5f, 3.74f, 0.5f), angleAxis(radians(180.f), vec3(0.0f, 0.0f, 1.0f)), vec3(0.1f));
+	vec3 aabb[2] = { vec3(-4, 0, -4), vec3(4, 7, 4) };
+	nodePyramid = scene.addFunction([](mat4 m)
+		{
+			pProgram->sendUniform("matrixModelView", m);
+
+			// Get Attribute Locations - no normals in the depth pre-pass
+			GLuint attribVertex = pProgram->getAttribLocation("aVertex");
+			GLint attribNormal = pProgram->getAttribLocation("aNormal");
+
+			// Enable vertex attribute arrays
+			glEnableVertexAttribArray(attribVertex);
+			if (attribNormal != -1)
+				glEnableVertexAttribArray(attribNormal);
+
+			// Bind (activate) the vertex buffer and set the pointer to it
+			glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+			glVertexAttribPointer(attribVertex, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+			// Bind (activate) the normal buffer and set the pointer to it
+			glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+			if (attribNormal != -1)
+				glVertexAttribPointer(attribNormal, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+			// Draw triangles - using index buffer
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+			glDrawElements(GL_TRIANGLES, 18, GL_UNSIGNED_INT, 0);
+
+			// Disable arrays
+			glDisableVertexAttribArray(attribVertex);
+			if (attribNormal != -1)
+				glDisableVertexAttribArray(attribNormal);
+		}, aabb, node);
+	scene.setDynamic(nodePyramid);
+	pMaterial = &scene.getMaterial(nodePyramid);
+	pMaterial->setDiffuse(vec3(0.9f, 0.1f, 0.1f));
+	pMaterial->setSpecular(vec3(0.6f, 0.6f, 1.0f));
+	pMaterial->loadTexture();
+
+	// bunny - green, spinning
+	node = scene.addNode();
+	scene.setTransform(node, vec3(-1.5f, 3.55f, 0.5f), quat(1, 0, 0, 0), vec3(4.0f));
+	nodeBunny = scene.addModel(&bunny, 0, node);
+	scene.setDynamic(nodeBunny);
+	pMaterial = &scene.getMaterial(nodeBunny);
+	pMaterial->setDiffuse(vec3(0.2f, 0.5f, 0.1f));
+	pMaterial->setSpecular(vec3(0.6f, 0.6f, 1.0f));
+	pMaterial->loadTexture();
+
+	scene.update();
+}
+
+// World space bounding boxes of the scene nodes, indexed by the node id; empty for the nodes with nothing to render
+std::vector<std::pair<vec3, vec3>> getSceneAABBs()
 {
+	std::vector<std::pair<vec3, vec3>> aabbs(scene.getNodeCount());
+	for (unsigned i = 0; i < scene.getNodeCount(); i++)
+	{
+		vec3 aabb[2];
+		scene.getAABB(i, aabb);
+		aabbs[i] = { aabb[0], aabb[1] };
+	}
+	return aabbs;
+}
 
+// Sends the lights of the scene: ambient, directional and the two lamps
+void sendLights(C3dglProgram& program)
+{
 	// Directional light settings
 	program.sendUniform("lightDir.direction", vec3(1.0, 0.5, 1.0));
 	program.sendUniform("lightDir.diffuse", vec3(0.2, 0.2, 0.2));
 
-	// Material settings
-	program.sendUniform("materialDiffuse", vec3(0.6f, 0.6f, 0.6f));
-	program.sendUniform("materialSpecular", vec3(0.6f, 0.6f, 1.0f));
-	program.sendUniform("shininess", 10.0f);
-
-	program.sendUniform("lightAmbient.color", vec3(0.1, 0.1, 0.1));
-	program.sendUniform("materialAmbient", vec3(1.0, 1.0, 1.0));
-
-	// Point Light intensity
-	program.sendUniform("lightIntensity1", lightIntensity1);
-	program.sendUniform("lightIntensity2", lightIntensity2);
-
-	mat4 m;
-
-	//---------------------------------
-	//render bulb 1
-	m = matrixView;
-	m = translate(m, vec3(-1.95f, 4.24f, -1.0f));
-	m = scale(m, vec3(0.1f, 0.1f, 0.1f));
-	program.sendUniform("matrixModelView", m);
-
-	program.sendUniform("materialDiffuse", vec3(1.0f, 1.0f, 1.0f));
-	program.sendUniform("materialSpecular", vec3(0.0f, 0.0f, 0.0f));
-	if (lamp1On)
-		program.sendUniform("lightAmbient.color", vec3(1.0, 1.0, 1.0));
-	else
-		program.sendUniform("lightAmbient.color", vec3(0.1, 0.1, 0.1));
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	glutSolidSphere(1, 32, 32);
-	program.sendUniform("lightAmbient.color", vec3(0.1, 0.1, 0.1)); // Reset ambient light
-	//---------------------------------
-
-	//render lamp1
-	m = matrixView;
-	m = translate(m, vec3(-1.60f, 3.04f, -1.0f));
-	m = scale(m, vec3(0.015f, 0.015f, 0.015f));
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	lamp1.render(0, m);
-
-	//render bulb 2
-	m = matrixView;
-	m = translate(m, vec3(1.95f, 4.24f, -0.5f));
-	m = scale(m, vec3(0.1f, 0.1f, 0.1f));
-	program.sendUniform("matrixModelView", m);
-
-	program.sendUniform("materialDiffuse", vec3(1.0f, 0.0f, 0.0f));
-	program.sendUniform("materialSpecular", vec3(0.0f, 0.0f, 0.0f));
-	if (lamp2On)
-		program.sendUniform("lightAmbient.color", vec3(1.0, 0.0, 0.0));
-	else
-		program.sendUniform("lightAmbient.color", vec3(0.1, 0.1, 0.1));
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	glutSolidSphere(1, 32, 32);
-	program.sendUniform("lightAmbient.color", vec3(0.1, 0.1, 0.1)); // Reset ambient light
-	//---------------------------------
-
-	//gray
-	program.sendUniform("materialDiffuse", vec3(0.6f, 0.6f, 0.6f));
-	program.sendUniform("materialSpecular", vec3(0.6f, 0.6f, 1.0f));
-	program.sendUniform("shininess", 10.0f);
-
-	//render lamp2
-	m = matrixView;
-	m = translate(m, vec3(1.6f, 3.04f, -0.5f));
-	m = rotate(m, radians(180.f), vec3(0.0f, 1.0f, 0.0f));
-	m = scale(m, vec3(0.015f, 0.015f, 0.015f));
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	lamp2.render(0, m);
-
 	// Point light setup
 	program.sendUniform("lightPoint1.position", vec3(-1.95f, 4.24f, -1.0f));
 	program.sendUniform("lightPoint1.diffuse", vec3(0.5f, 0.5f, 0.5f));
@@ -335,181 +596,147 @@ void renderScene(mat4& matrixView, float time, float deltaTime)
 	program.sendUniform("lightPoint2.diffuse", vec3(0.5f, 0.0f, 0.0f));
 	program.sendUniform("lightPoint2.specular", vec3(1.0f, 1.0f, 1.0f));
 
-	m = matrixView;
-	m = translate(m, vec3(0.0f, 0, 0.0f));
-	m = rotate(m, radians(180.f), vec3(0.0f, 1.0f, 0.0f));
-	m = scale(m, vec3(0.004f, 0.004f, 0.004f));
-	glBindTexture(GL_TEXTURE_2D, idTexWood);
-	table.render(0, m);
-
-	program.sendUniform("materialDiffuse", vec3(0.9f, 0.5f, 0.3f));
-	program.sendUniform("materialSpecular", vec3(0.0f, 0.0f, 0.0f));
-	glBindTexture(GL_TEXTURE_2D, idTexWood);
-	table.render(1, m);
-
-	// setup materials - grey
-	program.sendUniform("materialDiffuse", vec3(0.6f, 0.6f, 0.6f));
-	program.sendUniform("materialSpecular", vec3(0.6f, 0.6f, 1.0f));
-
-	m = matrixView;
-	m = translate(m, vec3(0.0f, 0, 0.0f));
-	m = rotate(m, radians(0.f), vec3(0.0f, 1.0f, 0.0f));
-	m = scale(m, vec3(0.004f, 0.004f, 0.004f));
-	glBindTexture(GL_TEXTURE_2D, idTexWood);
-	table.render(0, m);
-
-	m = matrixView;
-	m = translate(m, vec3(0.0f, 0, 0.0f));
-	m = rotate(m, radians(270.f), vec3(0.0f, 1.0f, 0.0f));
-	m = scale(m, vec3(0.004f, 0.004f, 0.004f));
-	glBindTexture(GL_TEXTURE_2D, idTexWood);
-	table.render(0, m);
-
-	m = matrixView;
-	m = translate(m, vec3(0.0f, 0, 0.0f));
-	m = rotate(m, radians(90.0f), vec3(0.0f, 1.0f, 0.0f));
-	m = scale(m, vec3(0.004f, 0.004f, 0.004f));
-	glBindTexture(GL_TEXTURE_2D, idTexWood);
-	table.render(0, m);
-
-	// setup materials - light green
-	/*program.sendUniform("materialDiffuse", vec3(0.5f, 0.7f, 0.9f));
-	program.sendUniform("materialSpecular", vec3(0.6f, 0.6f, 1.0f));
-	m = matrixView;
-	m = translate(m, vec3(0.0f, 3.04f, 0.0f));
-	m = rotate(m, radians(90.0f), vec3(0.0f, 1.0f, 0.0f));
-	m = scale(m, vec3(0.1f, 0.1f, 0.1f));
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	vase.render(0, m);*/
-
-	// setup materials - blue
-	program.sendUniform("materialDiffuse", vec3(0.2f, 0.2f, 0.8f));
-	program.sendUniform("materialSpecular", vec3(0.6f, 0.6f, 1.0f));
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-
-	// teapot
-	m = matrixView;
-	m = translate(m, vec3(1.5f, 3.36f, 0.5f));
-	m = rotate(m, radians(320.f), vec3(0.0f, 1.0f, 0.0f));
-	m = scale(m, vec3(0.2f, 0.2f, 0.2f));
-	// the GLUT objects require the Model View Matrix setup
-	program.sendUniform("matrixModelView", m);
-	glutSolidTeapot(2.0);
+	// Point Light intensity
+	program.sendUniform("lightIntensity1", lightIntensity1);
+	program.sendUniform("lightIntensity2", lightIntensity2);
 
-	// pyramid
-	m = matrixView;
+	program.sendUniform("lightAmbient.color", vec3(0.1, 0.1, 0.1));
+}
 
-	program.sendUniform("materialDiffuse", vec3(0.9f, 0.1f, 0.1f));
-	program.sendUniform("materialSpecular", vec3(0.6f, 0.6f, 1.0f));
+void renderScene(mat4& matrixView, float time, float deltaTime, const std::vector<unsigned>* pObjects)
+{
+	// models in the texture array do not bind their textures, so the active unit must be set here
+	glActiveTexture(GL_TEXTURE0);
 
-	m = translate(m, vec3(-1.5f, 3.74f, 0.5f));
-	m = rotate(m, radians(180.f), vec3(0.0f, 0.0f, 1.0f));
+	// lights - in the G-buffer pass, they are sent to the deferred lighting instead
+	if (pProgram == &program)
+		sendLights(program);
 
-	if (pyramidRotation > 360.0f)
-		pyramidRotation = 0.0f;
+	// Material settings
+	pProgram->sendUniform("shininess", 10.0f);
+	pProgram->sendUniform("materialAmbient", vec3(1.0, 1.0, 1.0));
+
+	// all objects, or the ones listed; with the per-object light lists, each is sent before the object is drawn
+	bool bObjectLights = lightMode == 3 && pProgram == &program;
+	std::function<void(unsigned)> prepare = nullptr;
+	if (bObjectLights)
+		prepare = [&](unsigned node) { lightAssigner.send(&program, node); };
+	if (bRenderQueue)
+	{
+		// the same in every pass - the depth pre-pass must draw the objects as the colour pass does
+		renderQueue.setInstancing(bInstancing && lightMode != 3);
+		scene.render(renderQueue, matrixView, pProgram, pObjects, prepare);
+	}
 	else
-		pyramidRotation += 0.1f;
-
-	m = rotate(m, radians(pyramidRotation), vec3(0.0f, 1.0f, 0.0f));
-
-	m = scale(m, vec3(0.1f, 0.1f, 0.1f));
-
-	program.sendUniform("matrixModelView", m);
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	// Get Attribute Locations
-	GLuint attribVertex = program.getAttribLocation("aVertex");
-	GLuint attribNormal = program.getAttribLocation("aNormal");
-
-	// Enable vertex attribute arrays
-	glEnableVertexAttribArray(attribVertex);
-	glEnableVertexAttribArray(attribNormal);
-
-	// Bind (activate) the vertex buffer and set the pointer to it
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-	glVertexAttribPointer(attribVertex, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-	// Bind (activate) the normal buffer and set the pointer to it
-	glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-	glVertexAttribPointer(attribNormal, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-	// Draw triangles  using index buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-	glDrawElements(GL_TRIANGLES, 18, GL_UNSIGNED_INT, 0);
-
-	// Disable arrays
-	glDisableVertexAttribArray(attribVertex);
-	glDisableVertexAttribArray(attribNormal);
-
-
-	program.sendUniform("materialAmbient", vec3(1.0, 1.0, 1.0));
-	program.sendUniform("materialDiffuse", vec3(0.2f, 0.5f, 0.1f));
-	program.sendUniform("materialSpecular", vec3(0.6f, 0.6f, 1.0f));
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	// bunny
-	m = matrixView;
+		scene.render(matrixView, pProgram, pObjects, prepare);
+	if (bObjectLights)
+		program.sendUniform("objectLightCount", 0);
+}
 
-	m = translate(m, vec3(-1.5f, 3.55f, 0.5f));
+// Renders the shadow maps - the static casters only when the atlas needs them - and sends them to the shader
+void renderShadows(float time, float deltaTime)
+{
+	if (bShadows)
+	{
+		C3dglProgram* pPrevProgram = pProgram;
+		mat4 matrixProjection;
+		programDepth.retrieveUniform("matrixProjection", matrixProjection);
+		pProgram = &programDepth;
+		auto render = [&](std::vector<unsigned>& casters)
+		{
+			return [&](unsigned light, mat4 matrixView, mat4 matrixProjection)
+			{
+				programDepth.sendUniform("matrixProjection", matrixProjection);
+				renderScene(matrixView, time, deltaTime, &casters);
+			};
+		};
+		shadows.render(render(staticCasters), render(dynamicCasters));
+		programDepth.sendUniform("matrixProjection", matrixProjection);
+		pProgram = pPrevProgram;
+		shadows.bind(&program, GL_TEXTURE10);
+	}
+	program.sendUniform("shadowPoint1", bShadows ? shadows.getFirstTile(shadowLights[0]) : -1);
+	program.sendUniform("shadowPoint2", bShadows ? shadows.getFirstTile(shadowLights[1]) : -1);
+	program.sendUniform("shadowDir", bShadows ? shadows.getFirstTile(shadowLights[2]) : -1);
+}
 
-	m = rotate(m, radians(pyramidRotation), vec3(0.0f, -1.0f, 0.0f));
+// Creates n small point lights, at random places around the table
+void createSmallLights(unsigned n)
+{
+	std::mt19937 rnd(n);
+	std::uniform_real_distribution<float> x(-3.0f, 3.0f), y(2.9f, 4.2f), z(-2.0f, 2.0f), c(0.2f, 1.0f);
+	smallLights.clear();
+	smallLightOrigins.clear();
+	for (unsigned i = 0; i < n; i++)
+	{
+		smallLightOrigins.push_back(vec3(x(rnd), y(rnd), z(rnd)));
+		smallLights.push_back({ smallLightOrigins.back(), 0.6f, vec3(c(rnd), c(rnd), c(rnd)) });
+	}
+}
 
-	m = scale(m, vec3(4.0f, 4.0f, 4.0f));
+// Moves the small point lights
+void moveSmallLights(float time)
+{
+	for (unsigned i = 0; i < smallLights.size(); i++)
+		smallLights[i].position = smallLightOrigins[i] + 0.3f * vec3(sin(time + i), 0, cos(1.3f * time + i));
+}
 
-	bunny.render(0, m);
+// Moves the small point lights, then bins them into the clusters of the view (or finds the lights of each scene object)
+// and sends them to the shader
+void prepareSmallLights(mat4& matrixView, float time)
+{
+	moveSmallLights(time);
+	lightGrid.build(matrixView, smallLights, lightMode != 3);
+	if (lightMode == 3)
+	{
+		lightAssigner.build(smallLights);
+		lightAssigner.assign(getSceneAABBs());
+	}
+	lightGrid.upload();
+	lightGrid.bind(&program, GL_TEXTURE4);
+	program.sendUniform("clusteredLights", smallLights.empty() ? 0 : lightMode);
 }
 
 //----------------------------------
 // CODE for the Dynamic Environment Map Start
 //----------------------------------
 
-void prepareCubeMap(float x, float y, float z, float time, float deltaTime)
+void prepareCubeMap(C3dglCubeMapRenderer& renderer, vec3 position, float time, float deltaTime)
 {
-	// Store the current viewport in a safe place
-	GLint viewport[4];
-	glGetIntegerv(GL_VIEWPORT, viewport);
-	int w = viewport[2];
-	int h = viewport[3];
-
-	// setup the viewport to 256x256, 90 degrees FoV (Field of View)
-	glViewport(0, 0, 256, 256);
-	program.sendUniform("matrixProjection", perspective(radians(90.f), 1.0f, 0.02f, 1000.0f));
-
-	// render environment 6 times
+	// render scene objects - all but the reflective one; the small point lights are not captured
 	program.sendUniform("reflectionPower", 0.0);
-	for (int i = 0; i < 6; ++i)
+	program.sendUniform("clusteredLights", 0);
+	glActiveTexture(GL_TEXTURE0);
+	if (bLayered)
+		// all six faces in a single pass
+		renderer.renderLayered(position, &program, [&](mat4 matrixView, mat4 matrixProjection)
+			{
+				program.sendUniform("matrixProjection", matrixProjection);
+				program.sendUniform("matrixView", matrixView);
+				renderScene(matrixView, time, deltaTime);
+			});
+	else
 	{
-		// clear background
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// setup the camera
-		const GLfloat ROTATION[6][6] =
-		{        // at              up
-				{ 1.0, 0.0, 0.0,   0.0, -1.0, 0.0 },  // pos x
-				{ -1.0, 0.0, 0.0,  0.0, -1.0, 0.0 },  // neg x
-				{ 0.0, 1.0, 0.0,   0.0, 0.0, 1.0 },   // pos y
-				{ 0.0, -1.0, 0.0,  0.0, 0.0, -1.0 },  // neg y
-				{ 0.0, 0.0, 1.0,   0.0, -1.0, 0.0 },  // poz z
-				{ 0.0, 0.0, -1.0,  0.0, -1.0, 0.0 }   // neg z
-		};
-		mat4 matrixView2 = lookAt(
-			vec3(x, y, z),
-			vec3(x + ROTATION[i][0], y + ROTATION[i][1], z + ROTATION[i][2]),
-			vec3(ROTATION[i][3], ROTATION[i][4], ROTATION[i][5]));
-
-		// send the View Matrix
-		program.sendUniform("matrixView", matrixView2);
-
-		// render scene objects - all but the reflective one
-		glActiveTexture(GL_TEXTURE0);
-		renderScene(matrixView2, time, deltaTime);
-
-		// send the image to the cube texture
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, idTexCube);
-		glCopyTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, 0, 0, 256, 256, 0);
+		// objects binned into the faces - each face renders only the objects it sees. Binned with the first face
+		// updated, so that the frames when no face is due skip gathering the bounding boxes and binning
+		std::vector<unsigned> faces[6];
+		bool bBinned = false;
+		renderer.render(position, [&](unsigned face, mat4 matrixView, mat4 matrixProjection)
+			{
+				if (!bBinned)
+				{
+					renderer.bin(position, getSceneAABBs(), faces);
+					bBinned = true;
+				}
+				program.sendUniform("matrixProjection", matrixProjection);
+				program.sendUniform("matrixView", matrixView);
+				renderScene(matrixView, time, deltaTime, &faces[face]);
+			});
 	}
-	// restore the matrixView, viewport and projection
 
-	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);      // set the viewport (x, y, w, h)
+	// restore the projection (the viewport is restored by the cube map renderer)
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
 	mat4 matrixProjection = perspective(radians(_fov), (float)viewport[2] / (float)viewport[3], 0.02f, 1000.f);
 	program.sendUniform("matrixProjection", matrixProjection);
 }
@@ -518,8 +745,7 @@ void renderReflectiveObjects(mat4 matrixView, float time, float deltaTime)
 {
 	mat4 m;
 	program.sendUniform("reflectionPower", 0.9f);  // Enable reflections
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, idTexCube);
+	probes.bind(&program, probeVase, GL_TEXTURE1);
 
 	// setup materials - light green
 	program.sendUniform("materialDiffuse", vec3(0.5f, 0.7f, 0.9f));
@@ -531,6 +757,19 @@ void renderReflectiveObjects(mat4 matrixView, float time, float deltaTime)
 	program.sendUniform("matrixModelView", m);
 	vase.render(0, m);
 
+	// chrome ball - between the two static probes, which are blended
+	vec3 pos(0.0f, 3.29f, 0.8f);
+	probes.bind(&program, pos, GL_TEXTURE1, GL_TEXTURE3);
+	program.sendUniform("reflectionPower", 1.0f);
+	program.sendUniform("materialDiffuse", vec3(0.3f, 0.3f, 0.3f));
+	program.sendUniform("materialSpecular", vec3(1.0f, 1.0f, 1.0f));
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, idTexNone);
+	m = matrixView;
+	m = translate(m, pos);
+	m = scale(m, vec3(0.25f, 0.25f, 0.25f));
+	sphere.render(m);
+
 	program.sendUniform("reflectionPower", 0.0f); //Disable reflections
 }
 
@@ -540,16 +779,48 @@ void renderReflectiveObjects(mat4 matrixView, float time, float deltaTime)
 
 void onRender()
 {
+	if (bLightBench)
+	{
+		lightBenchmark();
+		glutLeaveMainLoop();
+		return;
+	}
+
 	// these variables control time & animation
 	static float prev = 0;
 	float time = glutGet(GLUT_ELAPSED_TIME) * 0.001f;	// time since start in seconds
 	float deltaTime = time - prev;						// time since last frame
 	prev = time;										// framerate is 1/deltaTime
 
-	float cubeMapX = 0.0f;  // X coordinate for cube map center
-	float cubeMapY = 4.2f;  // Y coordinate for cube map center
-	float cubeMapZ = 0.0f;  // Z coordinate for cube map center
-	prepareCubeMap(cubeMapX, cubeMapY, cubeMapZ, time, deltaTime);
+	// texture binding counters are per frame
+	C3dglMaterial::resetBindCounters();
+
+	// animation - the rotating pyramid and bunny
+	pyramidRotation = fmod(pyramidRotation + 40.f * deltaTime, 360.f);
+	scene.setRotation(nodePyramid, radians(pyramidRotation), vec3(0.0f, 1.0f, 0.0f));
+	scene.setRotation(nodeBunny, radians(pyramidRotation), vec3(0.0f, -1.0f, 0.0f));
+
+	// world matrices - of the spinning objects only
+	scene.update();
+
+	// the objects moved invalidate the faces of the dynamic probes which see them, where they were or where they are now
+	for (unsigned node : scene.getUpdatedNodes())
+	{
+		vec3 aabb[2];
+		scene.getChangedAABB(node, aabb);
+		if (aabb[0].x <= aabb[1].x)
+			probes.invalidate((aabb[0] + aabb[1]) * 0.5f, length(aabb[1] - aabb[0]) * 0.5f);
+
+		// a moved static caster - its cached shadows are rendered again
+		if (std::find(staticCasters.begin(), staticCasters.end(), node) != staticCasters.end())
+			shadows.invalidate();
+	}
+
+	// shadow maps - used by the probes as well
+	renderShadows(time, deltaTime);
+
+	// capture the reflection probes which need it
+	probes.update([&](C3dglCubeMapRenderer& renderer, vec3 position) { prepareCubeMap(renderer, position, time, deltaTime); });
 
 	// clear screen and buffers
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -563,17 +834,80 @@ void onRender()
 		-pitch, vec3(1, 0, 0))	// switch the pitch on
 		* matrixView;
 
-	// setup View Matrix
-	program.sendUniform("matrixView", matrixView);
-
-	// render the scene objects
-	renderScene(matrixView, time, deltaTime);
+	if (bDeferred)
+	{
+		// deferred shading: the scene objects to the G-buffer, then lit by the lamps and the small point lights
+		pProgram = &programGBuffer;
+		programGBuffer.sendUniform("matrixView", matrixView);
+		deferred.beginGeometry();
+		renderScene(matrixView, time, deltaTime);
+		deferred.endGeometry();
+		pProgram = &program;
+
+		moveSmallLights(time);
+		mat4 matrixProjection;
+		programGBuffer.retrieveUniform("matrixProjection", matrixProjection);
+		sendLights(programDeferred);
+		deferred.resolve(&programDeferred, matrixView, matrixProjection, smallLights);
+
+		// the reflective objects are rendered forward, over the resolved image
+		program.sendUniform("matrixView", matrixView);
+		program.sendUniform("clusteredLights", 0);
+		sendLights(program);
+	}
+	else
+	{
+		// setup View Matrix
+		program.sendUniform("matrixView", matrixView);
+
+		// small point lights
+		prepareSmallLights(matrixView, time);
+
+		// depth pre-pass: positions only, so that the colour pass shades the visible fragments only
+		if (bPrePass)
+		{
+			pProgram = &programDepth;
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			renderScene(matrixView, time, deltaTime);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+			pProgram = &program;
+		}
+
+		// render the scene objects - counting the fragments shaded (the result of the previous frame is read)
+		GLenum target = GLEW_ARB_pipeline_statistics_query ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED;
+		if (bFragmentQueryPending)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(idFragmentQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				glGetQueryObjectui64v(idFragmentQuery, GL_QUERY_RESULT, &fragmentCount);
+				bFragmentQueryPending = false;
+			}
+		}
+		if (!bFragmentQueryPending)
+			glBeginQuery(target, idFragmentQuery);
+		renderScene(matrixView, time, deltaTime);
+		if (!bFragmentQueryPending)
+		{
+			glEndQuery(target);
+			bFragmentQueryPending = true;
+		}
+
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
 
 	renderReflectiveObjects(matrixView, time, deltaTime);
 
 	// essential for double-buffering technique
 	glutSwapBuffers();
 
+	// upload the streamed texture levels read since the last frame and request new ones
+	C3dglTextureStreamer::getInstance().update();
+
 	// proceed the animation
 	glutPostRedisplay();
 }
@@ -587,6 +921,49 @@ void onReshape(int w, int h)
 
 	// Setup the Projection Matrix
 	program.sendUniform("matrixProjection", matrixProjection);
+	C3dglTextureStreamer::getInstance().setView(matrixProjection, (float)w, (float)h);
+	lightGrid.setProjection(matrixProjection, 0.02f, 1000.f, w, h);
+	programGBuffer.sendUniform("matrixProjection", matrixProjection);
+	programDepth.sendUniform("matrixProjection", matrixProjection);
+	if (deferred.getWidth())
+		deferred.create(w, h);
+}
+
+// Frame times with 2..1024 small point lights: clustered, all lights for every fragment, then per-object light lists
+void lightBenchmark()
+{
+	const unsigned nFrames = 50;
+	int mode = lightMode;
+	C3dglLightAssigner::benchmark();
+	for (unsigned n = 2; n <= 1024; n *= 2)
+	{
+		createSmallLights(n);
+		double ms[3] = { 0, 0, 0 }, build = 0, assign = 0;
+		for (lightMode = 1; lightMode <= 3; lightMode++)
+		{
+			glFinish();
+			auto t0 = std::chrono::high_resolution_clock::now();
+			for (unsigned frame = 0; frame < nFrames; frame++)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				program.sendUniform("matrixView", matrixView);
+				prepareSmallLights(matrixView, frame * 0.02f);
+				if (lightMode == 1)
+					build += lightGrid.getBuildTime();
+				if (lightMode == 3)
+					assign += lightAssigner.getBuildTime() + lightAssigner.getAssignTime();
+				renderScene(matrixView, 0, 0);
+			}
+			glFinish();
+			ms[lightMode - 1] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count() / nFrames;
+		}
+		C3dglLogger::log("** Benchmark of {} point lights: clustered {:.2f} ms/frame (binned in {:.3f} ms, {} light indices), all lights {:.2f} ms/frame, "
+			"per object {:.2f} ms/frame (assigned in {:.3f} ms, {} lights)", n, ms[0], build / nFrames, lightGrid.getIndexCount(), ms[1],
+			ms[2], assign / nFrames, lightAssigner.getAssignedCount());
+	}
+	lightGrid.stats();
+	lightAssigner.stats();
+	lightMode = mode;
 }
 
 // Handle WASDQE keys and lamps
@@ -600,20 +977,129 @@ void onKeyDown(unsigned char key, int x, int y)
 	case 'd': _acc.x = -accel; break;
 	case 'e': _acc.y = accel; break;
 	case 'q': _acc.y = -accel; break;
+	case 't': C3dglTextureStreamer::getInstance().stats(); break;
+	case 'b':
+		// counters of the last frame complete
+		C3dglLogger::log("Texture bindings: {} requested by the materials, {} calls sent to OpenGL", C3dglMaterial::getBindRequestCount(), C3dglMaterial::getBindCallCount());
+		break;
+	case 'm':
+		C3dglMemoryTracker::getInstance().stats();
+		C3dglMemoryTracker::getInstance().exportJSON("memory.json");
+		break;
+	case 'u':
+		// cube map update policy: every face in every frame -> one face per frame -> only when changed -> within 0.5 ms per frame
+		if (probes.getRenderer(probeVase).getTimeBudget() > 0)
+		{
+			probes.getRenderer(probeVase).setTimeBudget(0);
+			C3dglLogger::log("Cube map: all faces in every frame");
+		}
+		else if (probes.getRenderer(probeVase).isChangeDriven())
+		{
+			probes.getRenderer(probeVase).setChangeDriven(false);
+			probes.getRenderer(probeVase).setTimeBudget(0.5f);
+			C3dglLogger::log("Cube map: within 0.5 ms per frame");
+		}
+		else if (probes.getRenderer(probeVase).getFacesPerFrame() < 6)
+		{
+			probes.getRenderer(probeVase).setFacesPerFrame(6);
+			probes.getRenderer(probeVase).setChangeDriven(true);
+			C3dglLogger::log("Cube map: only the faces which changed");
+		}
+		else
+		{
+			probes.getRenderer(probeVase).setFacesPerFrame(1);
+			C3dglLogger::log("Cube map: one face per frame");
+		}
+		break;
+	case 'r':
+		// staleness of the cube map, compared with a fresh render
+		program.sendUniform("reflectionPower", 0.0);
+		program.sendUniform("clusteredLights", 0);
+		probes.getRenderer(probeVase).measureError([&](unsigned face, mat4 matrixView, mat4 matrixProjection)
+			{
+				program.sendUniform("matrixProjection", matrixProjection);
+				program.sendUniform("matrixView", matrixView);
+				renderScene(matrixView, 0, 0);
+			});
+		probes.getRenderer(probeVase).stats();
+		probes.stats();
+		break;
 
+	case 'l':
+		// number of small point lights: 0, 16, 128, 1024
+		createSmallLights(smallLights.empty() ? 16 : smallLights.size() < 1024 ? (unsigned)smallLights.size() * 8 : 0);
+		C3dglLogger::log("Small point lights: {}", smallLights.size());
+		break;
+	case 'p':
+		// depth pre-pass; the fragments shaded in the last frame, to compare
+		C3dglLogger::log("Fragments shaded ({}): {} {} the depth pre-pass", GLEW_ARB_pipeline_statistics_query ? "fragment shader invocations" : "samples passed",
+			fragmentCount, bPrePass ? "with" : "without");
+		bPrePass = !bPrePass;
+		break;
+	case 'h':
+		bShadows = !bShadows;
+		C3dglLogger::log("Shadows: {}", bShadows ? "on" : "off");
+		if (!bShadows)
+			shadows.stats();
+		break;
+	case 'o':
+		// counters of the last queue executed - the colour pass
+		renderQueue.stats();
+		C3dglLogger::log("Texture bindings: {} requested by the materials, {} calls sent to OpenGL", C3dglMaterial::getBindRequestCount(), C3dglMaterial::getBindCallCount());
+		if (!bRenderQueue)
+		{
+			bRenderQueue = true;
+			bInstancing = true;
+		}
+		else if (bInstancing)
+			bInstancing = false;
+		else
+			bRenderQueue = false;
+		C3dglLogger::log("Render queue: {}", !bRenderQueue ? "off" : !bInstancing ? "sorted" : lightMode == 3 ? "sorted (instanced without the per-object lights)" : "sorted and instanced");
+		break;
+	case 'j':
+		// the batch or the separate objects - both stay in the shadow casters, only the visible ones are rendered
+		tableBatch.stats();
+		bStaticBatch = !bStaticBatch;
+		for (unsigned i : tableNodes)
+			scene.setVisible(i, !bStaticBatch);
+		scene.setVisible(nodeTableBatch, bStaticBatch);
+		C3dglLogger::log("Static batching: {}", bStaticBatch ? "on" : "off");
+		break;
+	case 'g':
+		// forward or deferred shading; the G-buffer is created on first use
+		if (!bDeferred && !deferred.getWidth() && !deferred.create(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT)))
+			break;
+		bDeferred = !bDeferred;
+		C3dglLogger::log("Shading: {}", bDeferred ? "deferred" : "forward");
+		if (!bDeferred)
+			deferred.stats();
+		break;
+	case 'k':
+		lightMode = lightMode % 3 + 1;
+		C3dglLogger::log("Small point lights: {}", lightMode == 1 ? "clustered" : lightMode == 2 ? "all lights for every fragment" : "per-object light lists");
+		if (lightMode == 1)
+			lightAssigner.stats();
+		else
+			lightGrid.stats();
+		break;
 	case '1':
+		probes.getRenderer(probeVase).invalidate();
 		lamp1On = !lamp1On;
 		if (lamp1On)
 			lightIntensity1 = 1.0;
 		else
 			lightIntensity1 = 0.0;
+		scene.getMaterial(nodeBulb1).setEmissive(lamp1On ? vec3(1.0f, 1.0f, 1.0f) : vec3(0));
 		break;
 	case '2':
+		probes.getRenderer(probeVase).invalidate();
 		lamp2On = !lamp2On;
 		if (lamp2On)
 			lightIntensity2 = 1.0;
 		else
 			lightIntensity2 = 0.0;
+		scene.getMaterial(nodeBulb2).setEmissive(lamp2On ? vec3(1.0f, 0.0f, 0.0f) : vec3(0));
 		break;
 	}
 }
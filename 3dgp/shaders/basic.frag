@@ -3,8 +3,8 @@
 out vec4 outColor;
 
 // Materials
+// (the diffuse and emissive colours come from the vertex shader - see diffuseColor, emissiveColor)
 uniform vec3 materialAmbient;
-uniform vec3 materialDiffuse;
 uniform vec3 materialSpecular;
 uniform float shininess;
 
@@ -24,8 +24,17 @@ uniform float lightIntensity1;
 uniform float lightIntensity2;
 
 // Per-pixel data from vertex shader
-in vec4 position;
-in vec3 normal;
+in VERTEX
+{
+	vec4 color;
+	vec4 position;
+	vec3 normal;
+	vec2 texCoord0;			// Texture coordinates
+	vec3 texCoordCubeMap;	// Cube Map TexCoord
+	vec3 worldPosition;
+	flat vec3 diffuseColor;
+	flat vec3 emissiveColor;	// glowing objects (the bulbs)
+};
 
 // Ambient Light Data
 struct AMBIENT
@@ -43,14 +52,119 @@ struct DIRECTIONAL
 uniform DIRECTIONAL lightDir;
 
 // TEXTURE START
-in vec2 texCoord0; // Texture coordinates
 uniform sampler2D texture0; // Sampler for the texture
+
+// Texture array - materials which are in the array send their layer and atlas region instead of binding texture0
+uniform sampler2DArray textureArray;
+uniform float textureLayer = -1;
+uniform vec4 textureRegion = vec4(1, 1, 0, 0);
 // TEXTURE END
 
 // Environment Mapping 
-in vec3 texCoordCubeMap; // in variable
 uniform samplerCube textureCubeMap;
 uniform float reflectionPower;
+uniform float reflectionBlur = 0;	// mip level bias - blurred reflections of rough surfaces
+
+// Reflection probes (see C3dglReflectionProbeManager): textureCubeMap is captured at probe1,
+// blended with textureCubeMap2, captured at probe2. An empty box means no parallax correction.
+struct PROBE
+{
+	vec3 position;
+	vec3 boxMin;
+	vec3 boxMax;
+};
+uniform PROBE probe1;
+uniform PROBE probe2;
+uniform samplerCube textureCubeMap2;
+uniform float probeBlend = 0;
+
+// Clustered point lights (see C3dglLightGrid): 0 = off, 1 = only the lights listed in the cluster of the fragment,
+// 2 = all lights (brute force, for comparison), 3 = only the lights listed for the object (see C3dglLightAssigner)
+uniform int clusteredLights = 0;
+uniform samplerBuffer lightData;		// two texels per light: view space position and radius, colour
+uniform usamplerBuffer lightClusters;	// offset and count of each cluster
+uniform usamplerBuffer lightIndices;
+uniform int lightCount;
+uniform ivec3 clusterCount;				// tiles x, tiles y, depth slices
+uniform vec2 clusterTileSize;			// in pixels
+uniform vec2 clusterDepth;				// slice = log(depth) * x + y
+uniform int objectLights[8];			// MAX_OBJECT_LIGHTS
+uniform int objectLightCount = 0;
+
+// Shadows (see C3dglShadowAtlas): the first atlas tile of each light, -1 = no shadows
+uniform sampler2DShadow shadowAtlas;
+uniform mat4 shadowMatrices[16];		// MAX_SHADOW_TILES; world space to atlas coordinates
+uniform vec4 shadowRegions[16];			// min and max atlas coordinates of each tile
+uniform int shadowPoint1 = -1;
+uniform int shadowPoint2 = -1;
+uniform int shadowDir = -1;
+
+// Box projection: the reflection vector, as seen from the probe - where it hits the box of the probe
+vec3 ParallaxCorrect(vec3 R, PROBE probe)
+{
+	if (any(greaterThanEqual(probe.boxMin, probe.boxMax)))
+		return R;
+	vec3 first = (probe.boxMax - worldPosition) / R;
+	vec3 second = (probe.boxMin - worldPosition) / R;
+	vec3 furthest = max(first, second);
+	float dist = min(min(furthest.x, furthest.y), furthest.z);
+	if (dist < 0)
+		return R;	// outside the box
+	return worldPosition + R * dist - probe.position;
+}
+
+// Looks up a tile of the shadow atlas: 1 = lit, 0 = in shadow.
+// 3x3 PCF, each sample also filtered bilinearly by the depth comparison; the samples are kept within the tile.
+float ShadowPCF(int tile)
+{
+	vec4 p = shadowMatrices[tile] * vec4(worldPosition, 1);
+	p.xyz /= p.w;
+	vec4 region = shadowRegions[tile];
+	if (any(lessThan(p.xy, region.xy)) || any(greaterThan(p.xy, region.zw)) || p.z > 1)
+		return 1;	// outside the shadow map
+	vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+	float lit = 0;
+	for (int y = -1; y <= 1; y++)
+		for (int x = -1; x <= 1; x++)
+			lit += texture(shadowAtlas, vec3(clamp(p.xy + vec2(x, y) * texel, region.xy + texel, region.zw - texel), p.z));
+	return lit / 9;
+}
+
+// Shadow of a point light: the cube face is chosen by the major axis of the light-to-fragment vector
+float ShadowPoint(int tile, vec3 lightPosition)
+{
+	if (tile < 0)
+		return 1;
+	vec3 d = worldPosition - lightPosition;
+	vec3 a = abs(d);
+	int face = a.x >= a.y && a.x >= a.z ? (d.x > 0 ? 0 : 1) : a.y >= a.z ? (d.y > 0 ? 2 : 3) : (d.z > 0 ? 4 : 5);
+	return ShadowPCF(tile + face);
+}
+
+// Shadow of a directional light
+float ShadowDirectional(int tile)
+{
+	return tile < 0 ? 1 : ShadowPCF(tile);
+}
+
+// Samples the material texture: texture0, a whole layer of the array, or an atlas region within a layer
+vec4 TextureColor(vec2 uv)
+{
+	if (textureLayer < 0)
+		return texture(texture0, uv);
+	if (textureRegion == vec4(1, 1, 0, 0))
+		return texture(textureArray, vec3(uv, textureLayer));
+
+	// fract() would break the derivatives at the repeat seams, so the LOD is taken from the original coordinates.
+	// It is limited to the levels in which the region does not blend with its neighbours.
+	vec2 layerSize = vec2(textureSize(textureArray, 0).xy);
+	vec2 size = layerSize * textureRegion.xy;
+	vec2 dx = dFdx(uv * size), dy = dFdy(uv * size);
+	float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0, log2(min(size.x, size.y)));
+	vec2 halfTexel = 0.5 * exp2(ceil(lod)) / layerSize;
+	vec2 st = clamp(fract(uv) * textureRegion.xy, halfTexel, textureRegion.xy - halfTexel) + textureRegion.zw;
+	return textureLod(textureArray, vec3(st, textureLayer), lod);
+}
 
 // Calculates the ambient light of an object
 vec4 AmbientLight(AMBIENT light)
@@ -65,7 +179,7 @@ vec4 DirectionalLight(DIRECTIONAL light)
 	// Calculate Directional Light
 	vec3 L = normalize(mat3(matrixView) * light.direction);
 	float NdotL = dot(normal, L);
-	return vec4(materialDiffuse * light.diffuse, 1) * max(NdotL, 0);
+	return vec4(diffuseColor * light.diffuse, 1) * max(NdotL, 0);
 }
 
 // Calculates the point light of an object
@@ -79,7 +193,7 @@ vec4 PointLight(POINT light, float intensity)
     vec3 L = normalize((lightPositionViewSpace.xyz - position.xyz));
     
     float NdotL = dot(normal, L);
-    color += vec4(materialDiffuse * light.diffuse, 1) * max(NdotL, 0) * intensity;
+    color += vec4(diffuseColor * light.diffuse, 1) * max(NdotL, 0) * intensity;
 
     // Specular Calculation:
     vec3 V = normalize(-position.xyz);
@@ -90,16 +204,53 @@ vec4 PointLight(POINT light, float intensity)
     return color;
 }
 
+// Calculates a clustered point light - diffuse only, with a smooth fall-off to zero at its range
+vec4 ClusteredLight(int i)
+{
+	vec4 light = texelFetch(lightData, 2 * i);
+	vec3 L = light.xyz - position.xyz;
+	float att = max(1 - dot(L, L) / (light.w * light.w), 0);
+	float NdotL = max(dot(normal, normalize(L)), 0);
+	return vec4(diffuseColor * texelFetch(lightData, 2 * i + 1).rgb * NdotL * att * att, 0);
+}
+
+// Calculates all clustered point lights which reach the fragment
+vec4 ClusteredLights()
+{
+	vec4 color = vec4(0, 0, 0, 0);
+	if (clusteredLights == 2)
+	{
+		for (int i = 0; i < lightCount; i++)
+			color += ClusteredLight(i);
+		return color;
+	}
+	if (clusteredLights == 3)
+	{
+		for (int i = 0; i < objectLightCount; i++)
+			color += ClusteredLight(objectLights[i]);
+		return color;
+	}
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterCount.xy - 1);
+	int slice = clamp(int(log(-position.z) * clusterDepth.x + clusterDepth.y), 0, clusterCount.z - 1);
+	uvec2 cluster = texelFetch(lightClusters, (slice * clusterCount.y + tile.y) * clusterCount.x + tile.x).xy;
+	for (uint i = 0u; i < cluster.y; i++)
+		color += ClusteredLight(int(texelFetch(lightIndices, int(cluster.x + i)).r));
+	return color;
+}
+
 void main(void) 
 {
     outColor = vec4(0,0,0,0);
     outColor += AmbientLight(lightAmbient);
-	outColor += DirectionalLight(lightDir);
-    outColor += PointLight(lightPoint1, lightIntensity1);
-    outColor += PointLight(lightPoint2, lightIntensity2);
+	outColor += vec4(emissiveColor, 0);
+	outColor += DirectionalLight(lightDir) * ShadowDirectional(shadowDir);
+    outColor += PointLight(lightPoint1, lightIntensity1) * ShadowPoint(shadowPoint1, lightPoint1.position);
+    outColor += PointLight(lightPoint2, lightIntensity2) * ShadowPoint(shadowPoint2, lightPoint2.position);
+	if (clusteredLights > 0)
+		outColor += ClusteredLights();
     
     // Apply texture to the output
-	outColor *= texture(texture0, texCoord0);
+	outColor *= TextureColor(texCoord0);
 	
 	// Fresnel Calculation and Reflection:
 	float F0 = 0.3; // Typical value for dielectrics
@@ -108,7 +259,9 @@ void main(void)
 	float fresnel = F0 + (1.0 - F0) * pow(1.0 - NdotV, 5.0);
 
 	// Mix the base color with the reflection based on the Fresnel factor
-	vec4 reflectionColor = texture(textureCubeMap, texCoordCubeMap);
+	vec4 reflectionColor = texture(textureCubeMap, ParallaxCorrect(texCoordCubeMap, probe1), reflectionBlur);
+	if (probeBlend > 0)
+		reflectionColor = mix(reflectionColor, texture(textureCubeMap2, ParallaxCorrect(texCoordCubeMap, probe2), reflectionBlur), probeBlend);
 
 	// Apply reflection ONLY if reflectionPower > 0
 	outColor = mix(outColor, mix(outColor, reflectionColor, fresnel), reflectionPower); // Blend with Fresnel
@@ -8,25 +8,53 @@ uniform mat4 matrixView;
 uniform vec3 materialAmbient;
 uniform vec3 materialDiffuse;
 uniform vec3 materialSpecular;
+uniform vec3 materialEmissive = vec3(0);
 uniform float shininess;
 
+// Instanced draws (see C3dglRenderQueue): six texels per instance from instanceBase -
+// model-view matrix, diffuse and emissive colour (w = 0 if not set: the uniform is used)
+uniform int instanceBase = -1;
+uniform samplerBuffer instanceData;
+
 // Vertex Attributes
 in vec3 aVertex;
 in vec3 aNormal;
 in vec2 aTexCoord;
 
-// Output Variables (for fragment shader)
-out vec4 color;
-out vec4 position;
-out vec3 normal;
-out vec2 texCoord0;
-out vec3 texCoordCubeMap; // NEW - Cube Map TexCoord
+// Output Variables (for fragment shader, or for cubemap.geom when rendering a cube map in a single pass)
+out VERTEX
+{
+	vec4 color;
+	vec4 position;
+	vec3 normal;
+	vec2 texCoord0;
+	vec3 texCoordCubeMap; // NEW - Cube Map TexCoord
+	vec3 worldPosition;   // for the parallax correction of the reflections
+	flat vec3 diffuseColor;	// the material colours - per instance in the instanced draws
+	flat vec3 emissiveColor;
+};
+
+// the depth pre-pass (depth.vert) must give exactly the same depth
+invariant gl_Position;
 
 void main(void) 
 {
-    normal = normalize(mat3(matrixModelView) * aNormal);
+	mat4 modelView = matrixModelView;
+	diffuseColor = materialDiffuse;
+	emissiveColor = materialEmissive;
+	if (instanceBase >= 0)
+	{
+		int i = instanceBase + 6 * gl_InstanceID;
+		modelView = mat4(texelFetch(instanceData, i), texelFetch(instanceData, i + 1), texelFetch(instanceData, i + 2), texelFetch(instanceData, i + 3)) * matrixModelView;
+		vec4 diffuse = texelFetch(instanceData, i + 4);
+		vec4 emissive = texelFetch(instanceData, i + 5);
+		if (diffuse.w > 0) diffuseColor = diffuse.rgb;
+		if (emissive.w > 0) emissiveColor = emissive.rgb;
+	}
+
+    normal = normalize(mat3(modelView) * aNormal);
 	// calculate position
-	position = matrixModelView * vec4(aVertex, 1.0);
+	position = modelView * vec4(aVertex, 1.0);
 	gl_Position = matrixProjection * position;
     
     // calculate texture coordinate
@@ -34,4 +62,5 @@ void main(void)
 	
 	// calculate reflection vector
 	texCoordCubeMap = inverse(mat3(matrixView)) * reflect(position.xyz, normal);
+	worldPosition = (inverse(matrixView) * position).xyz;
 }
\ No newline at end of file
@@ -0,0 +1,123 @@
+#version 330
+
+// Lighting pass of the deferred renderer (see C3dglDeferredRenderer): the global lights, as in basic.frag,
+// in the full-screen pass (lightVolume = 0); a point light within its volume (lightVolume = 1)
+
+out vec4 outColor;
+
+// G-buffer
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferDepth;
+
+// Matrices
+uniform mat4 matrixView;
+uniform mat4 matrixInvProjection;
+
+uniform int lightVolume = 0;
+flat in vec4 lightPosition;		// view space position and radius of the light
+flat in vec3 lightColor;
+
+// Global lights
+struct AMBIENT
+{	
+	vec3 color;
+};
+uniform AMBIENT lightAmbient;
+
+struct DIRECTIONAL
+{	
+	vec3 direction;
+	vec3 diffuse;
+};
+uniform DIRECTIONAL lightDir;
+
+struct POINT
+{
+	vec3 position;
+	vec3 diffuse;
+	vec3 specular;
+};
+uniform POINT lightPoint1;
+uniform POINT lightPoint2;
+
+uniform float lightIntensity1;
+uniform float lightIntensity2;
+
+// Surface, as read from the G-buffer
+vec3 position;		// view space
+vec3 normal;
+vec3 albedo;
+float specular;
+float shininess;
+
+// Inverse of the octahedral encoding (see gbuffer.frag)
+vec3 OctDecode(vec2 e)
+{
+	e = e * 2 - 1;
+	vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0);
+	n.xy += vec2(n.x >= 0 ? -t : t, n.y >= 0 ? -t : t);
+	return normalize(n);
+}
+
+vec4 DirectionalLight(DIRECTIONAL light)
+{
+	vec3 L = normalize(mat3(matrixView) * light.direction);
+	return vec4(albedo * light.diffuse * max(dot(normal, L), 0), 0);
+}
+
+vec4 PointLight(POINT light, float intensity)
+{
+	vec3 L = normalize((matrixView * vec4(light.position, 1)).xyz - position);
+	vec3 V = normalize(-position);
+	vec3 R = reflect(-L, normal);
+	vec3 color = albedo * light.diffuse * max(dot(normal, L), 0);
+	color += specular * light.specular * pow(max(dot(R, V), 0), shininess);
+	return vec4(color * intensity, 0);
+}
+
+// A local point light - diffuse only, with a smooth fall-off to zero at its range, as the clustered lights of basic.frag
+vec4 VolumeLight()
+{
+	vec3 L = lightPosition.xyz - position;
+	float att = max(1 - dot(L, L) / (lightPosition.w * lightPosition.w), 0);
+	return vec4(albedo * lightColor * max(dot(normal, normalize(L)), 0) * att * att, 0);
+}
+
+void main(void) 
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gbufferDepth, pixel, 0).r;
+	if (depth == 1)
+		discard;	// background
+
+	// position reconstructed from the depth
+	vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gbufferDepth, 0)) * 2 - 1;
+	vec4 p = matrixInvProjection * vec4(ndc, depth * 2 - 1, 1);
+	position = p.xyz / p.w;
+
+	vec4 a = texelFetch(gbufferAlbedo, pixel, 0);
+	vec4 n = texelFetch(gbufferNormal, pixel, 0);
+	albedo = a.rgb;
+	specular = a.a;
+	normal = OctDecode(n.xy);
+	shininess = n.z * 128;
+	bool emissive = n.w > 0.5;
+
+	if (lightVolume == 1)
+	{
+		if (emissive)
+			discard;
+		outColor = VolumeLight();
+	}
+	else if (emissive)
+		outColor = vec4(albedo, 1);
+	else
+	{
+		outColor = vec4(albedo * lightAmbient.color, 1);
+		outColor += DirectionalLight(lightDir);
+		outColor += PointLight(lightPoint1, lightIntensity1);
+		outColor += PointLight(lightPoint2, lightIntensity2);
+	}
+}
@@ -0,0 +1,26 @@
+#version 330
+
+// Lighting pass of the deferred renderer (see C3dglDeferredRenderer): a full-screen triangle (lightVolume = 0),
+// or the light volumes - unit spheres, instanced, scaled to the range of each point light (lightVolume = 1)
+
+uniform mat4 matrixProjection;
+uniform int lightVolume = 0;
+
+// Vertex Attributes
+in vec3 aVertex;
+in vec4 aLightPosition;		// view space position and radius of the light
+in vec3 aLightColor;
+
+// Output Variables
+flat out vec4 lightPosition;
+flat out vec3 lightColor;
+
+void main(void) 
+{
+	lightPosition = aLightPosition;
+	lightColor = aLightColor;
+	if (lightVolume == 0)
+		gl_Position = vec4(gl_VertexID == 1 ? 3 : -1, gl_VertexID == 2 ? 3 : -1, 0, 1);
+	else
+		gl_Position = matrixProjection * vec4(aLightPosition.xyz + aVertex * aLightPosition.w, 1);
+}
@@ -0,0 +1,28 @@
+#version 330
+
+// Depth pre-pass: vertex positions only (see C3dglProgram::isPositionOnly).
+// The depth must match the colour pass exactly, so gl_Position is computed as in basic.vert, and invariant.
+
+uniform mat4 matrixProjection;
+uniform mat4 matrixModelView;
+
+// Instanced draws: the model-view matrix from the instance data, as in basic.vert
+uniform int instanceBase = -1;
+uniform samplerBuffer instanceData;
+
+// Vertex Attributes
+in vec3 aVertex;
+
+invariant gl_Position;
+
+void main(void) 
+{
+	mat4 modelView = matrixModelView;
+	if (instanceBase >= 0)
+	{
+		int i = instanceBase + 6 * gl_InstanceID;
+		modelView = mat4(texelFetch(instanceData, i), texelFetch(instanceData, i + 1), texelFetch(instanceData, i + 2), texelFetch(instanceData, i + 3)) * matrixModelView;
+	}
+	vec4 position = modelView * vec4(aVertex, 1.0);
+	gl_Position = matrixProjection * position;
+}
@@ -0,0 +1,69 @@
+#version 330
+
+// G-buffer pass of the deferred renderer (see C3dglDeferredRenderer), with basic.vert.
+// Takes the same material uniforms as basic.frag, so that any model may be rendered with it.
+layout(location = 0) out vec4 outAlbedo;	// albedo, specular intensity
+layout(location = 1) out vec4 outNormal;	// octahedral normal, shininess / 128, emissive flag
+
+// Materials
+// (the diffuse and emissive colours come from the vertex shader - see diffuseColor, emissiveColor)
+uniform vec3 materialAmbient;
+uniform vec3 materialSpecular;
+uniform float shininess;
+
+// Per-pixel data from vertex shader
+in VERTEX
+{
+	vec4 color;
+	vec4 position;
+	vec3 normal;
+	vec2 texCoord0;			// Texture coordinates
+	vec3 texCoordCubeMap;	// Cube Map TexCoord
+	vec3 worldPosition;
+	flat vec3 diffuseColor;
+	flat vec3 emissiveColor;	// if set, replaces the albedo - and the surface is not lit
+};
+
+// TEXTURE START
+uniform sampler2D texture0; // Sampler for the texture
+
+// Texture array - materials which are in the array send their layer and atlas region instead of binding texture0
+uniform sampler2DArray textureArray;
+uniform float textureLayer = -1;
+uniform vec4 textureRegion = vec4(1, 1, 0, 0);
+// TEXTURE END
+
+// Samples the material texture: texture0, a whole layer of the array, or an atlas region within a layer
+vec4 TextureColor(vec2 uv)
+{
+	if (textureLayer < 0)
+		return texture(texture0, uv);
+	if (textureRegion == vec4(1, 1, 0, 0))
+		return texture(textureArray, vec3(uv, textureLayer));
+
+	// as in basic.frag
+	vec2 layerSize = vec2(textureSize(textureArray, 0).xy);
+	vec2 size = layerSize * textureRegion.xy;
+	vec2 dx = dFdx(uv * size), dy = dFdy(uv * size);
+	float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0, log2(min(size.x, size.y)));
+	vec2 halfTexel = 0.5 * exp2(ceil(lod)) / layerSize;
+	vec2 st = clamp(fract(uv) * textureRegion.xy, halfTexel, textureRegion.xy - halfTexel) + textureRegion.zw;
+	return textureLod(textureArray, vec3(st, textureLayer), lod);
+}
+
+// Octahedral encoding: the unit sphere folded onto the square [0, 1] x [0, 1]
+vec2 OctEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0)
+		n.xy = (1 - abs(n.yx)) * vec2(n.x >= 0 ? 1 : -1, n.y >= 0 ? 1 : -1);
+	return n.xy * 0.5 + 0.5;
+}
+
+void main(void) 
+{
+	bool emissive = any(greaterThan(emissiveColor, vec3(0)));
+	vec3 albedo = (emissive ? emissiveColor : diffuseColor) * TextureColor(texCoord0).rgb;
+	outAlbedo = vec4(albedo, max(max(materialSpecular.r, materialSpecular.g), materialSpecular.b));
+	outNormal = vec4(OctEncode(normalize(normal)), clamp(shininess / 128, 0, 1), emissive ? 1 : 0);
+}